@@ -13,6 +13,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "fad_defs.h"
+#include "fad_mem.h"
 
 /* Defines how many values the algorithm will read from the ADC buffer. Should always be at least half of buffer size. */
 int algo_delay_read_size_g = 512;
@@ -21,13 +22,15 @@ int algo_delay_read_size_g = 512;
 /* This delay size determines how many samples (in terms of output) to shift the incoming signal by. Determines delay time. */
 int delay_size_g = 5000; //was 10000
 
-/* This is a circular buffer that holds signals for the output delay. Needs to be allocated based on the sample delay amount. */
+/* This is a circular buffer that holds signals for the output delay. Taken from the algorithm scratch region, sized by the sample delay amount. */
 uint8_t *delay_buffer_g;
 
 /* This is the current position in the delay buffer. */
 int delay_buffer_pos_g;
 
-void algo_delay(uint16_t *in_buff, uint8_t *out_buff, uint16_t in_pos, uint16_t out_pos, int multisamples) {
+void algo_delay(uint16_t *in_buff, const uint16_t *ref_buff, uint8_t *out_buff, uint16_t in_pos, uint16_t out_pos, int multisamples) {
+
+    if (delay_buffer_g == NULL) return; // scratch region too small, already logged by init
 
     for(int i = 0; i < (algo_delay_read_size_g) / multisamples; i++)
     {
@@ -61,11 +64,11 @@ void algo_delay(uint16_t *in_buff, uint8_t *out_buff, uint16_t in_pos, uint16_t
 void algo_delay_init() { //fad_algo_init_params_t *params
     //algo_delay_read_size_g = params->algo_delay_params.read_size;
     //delay_size_g = params->algo_delay_params.delay;
-    delay_buffer_g = malloc(sizeof(uint8_t) * delay_size_g);
-    memset(delay_buffer_g, 128, delay_size_g);
+    delay_buffer_g = fad_mem_algo_alloc(sizeof(uint8_t) * delay_size_g);
+    if (delay_buffer_g != NULL) memset(delay_buffer_g, 128, delay_size_g);
     delay_buffer_pos_g = 0;
 }
 
 void algo_delay_deinit() {
-    free(delay_buffer_g);
+    delay_buffer_g = NULL; // the scratch region goes back with fad_mem_algo_reset; masking and freq_shift share this deinit
 }
\ No newline at end of file
@@ -28,7 +28,7 @@ int in_signal;
 int prev_signal=0;
 
 
-void algo_freq_shift(uint16_t *in_buff, uint8_t *out_buff, uint16_t in_pos, uint16_t out_pos, int multisamples)
+void algo_freq_shift(uint16_t *in_buff, const uint16_t *ref_buff, uint8_t *out_buff, uint16_t in_pos, uint16_t out_pos, int multisamples)
 {
     
     /* Need to multiply incoming data by sine wave to shift frequency. However, incoming data is centered around 2048 (ideally). 
@@ -85,7 +85,7 @@ void algo_freq_init()
     int period = ALARM_FREQ / pitch_freq;
     shift_array_period_s = period;
 
-    shift_array = (uint32_t *) malloc(period * sizeof(uint32_t));
+    shift_array = (uint32_t *) fad_mem_algo_alloc(period * sizeof(uint32_t));
 
     for (double i = 0; i < period, i++)
     {
@@ -96,5 +96,5 @@ void algo_freq_init()
 
 void algo_freq_deinit()
 {
-    //free(shift_array);
+    //shift_array = NULL; // the scratch region is reset by the app
 }
\ No newline at end of file
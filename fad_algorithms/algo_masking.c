@@ -10,9 +10,9 @@
 
 #include "algo_masking.h"
 #include "esp_log.h"
+#include "fad_log.h"
 #include "fft.h"
 #include "fad_defs.h"
-#include "driver/adc.h"
 #include "math.h"
 
 static const char* TAG = "algo_masking";
@@ -31,7 +31,7 @@ float DAC_out_val; // Output value to the DAC
 float MAX_DAC_OUT = 2048; // Maximum value that the DAC can output
 
 /*The Main program for the process of masking algorithm*/
-void algo_masking(uint16_t *in_buff, uint8_t *out_buff, uint16_t in_pos, uint16_t out_pos, int multisamples)
+void algo_masking(uint16_t *in_buff, const uint16_t *ref_buff, uint8_t *out_buff, uint16_t in_pos, uint16_t out_pos, int multisamples)
 {
 
     /**
@@ -73,11 +73,11 @@ void algo_masking(uint16_t *in_buff, uint8_t *out_buff, uint16_t in_pos, uint16_
 
            
         /*Print out the outputs for Programmers to error check. Deletable once masker works*/
-    ESP_LOGI(TAG, "in signal count... %0.3f", in_signal_count);
-     ESP_LOGI(TAG, "out signal count... %0.3f", out_signal_count);
-     ESP_LOGI(TAG, "max out count... %0.3f", max_out_count);
-     ESP_LOGI(TAG, "currentADC... %0.3f", current_ADC_val);
-     ESP_LOGI(TAG, "Roll Average... %0.3f", roll_AVG);
+    FAD_LOGI_DEFER(TAG, "in signal count... %0.3f", in_signal_count);
+     FAD_LOGI_DEFER(TAG, "out signal count... %0.3f", out_signal_count);
+     FAD_LOGI_DEFER(TAG, "max out count... %0.3f", max_out_count);
+     FAD_LOGI_DEFER(TAG, "currentADC... %0.3f", current_ADC_val);
+     FAD_LOGI_DEFER(TAG, "Roll Average... %0.3f", roll_AVG);
 
 
     //ESP_LOGI(ALGO_TAG, "running algo... %d", out_buff[out_pos]);
@@ -86,6 +86,14 @@ void algo_masking(uint16_t *in_buff, uint8_t *out_buff, uint16_t in_pos, uint16_
 
 void algo_masking_init()//fad_algo_init_params_t *params
 {
+    /* Start from the same state every time, so a capture replays to the same output */
+    in_signal_count = 0;
+    out_signal_count = 0;
+    in_sig_flag = true;
+    current_ADC_val = 0;
+    max_out_count = 250;
+    DAC_out_val = 0;
+
     //s_algo_template_read_size = params->algo_template_params.read_size;
     //s_period = params->algo_template_params.period;
     //float fft_input[s_algo_template_read_size];
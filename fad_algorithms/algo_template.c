@@ -10,6 +10,7 @@
 
 #include "algo_template.h"
 #include "esp_log.h"
+#include "fad_log.h"
 
 #define ALGO_TAG "ALGO_TEMPLATE"
 
@@ -19,7 +20,7 @@ static int s_algo_template_read_size = 512;
 /* Determines the period of the square wave */
 static int s_period = 30;
 
-void algo_template(uint16_t *in_buff, uint8_t *out_buff, uint16_t in_pos, uint16_t out_pos, int multisamples)
+void algo_template(uint16_t *in_buff, const uint16_t *ref_buff, uint8_t *out_buff, uint16_t in_pos, uint16_t out_pos, int multisamples)
 {
 
     /**
@@ -53,16 +54,17 @@ void algo_template(uint16_t *in_buff, uint8_t *out_buff, uint16_t in_pos, uint16
         out_buff[out_pos + i] = val;
 
     }
-     ESP_LOGI(ALGO_TAG, "running algo... %d", out_buff[out_pos]);
+     FAD_LOGI_DEFER(ALGO_TAG, "running algo... %d", out_buff[out_pos]);
 }
 
 void algo_template_init(fad_algo_init_params_t *params)
 {
     s_algo_template_read_size = params->algo_template_params.read_size;
     s_period = params->algo_template_params.period;
+    // Take any buffers from fad_mem_algo_alloc here, never malloc
 }
 
 void algo_template_deinit()
 {
-    // Undo any memory allocations here
+    // Forget pointers into the scratch region here; the app resets it before the next algorithm
 }
\ No newline at end of file
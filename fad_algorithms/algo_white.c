@@ -13,7 +13,7 @@
 #include "esp_system.h"
 #include "esp_log.h"
 
-void algo_white(uint16_t *in_buff, uint8_t *out_buff, uint16_t in_pos, uint16_t out_pos, int multisamples)
+void algo_white(uint16_t *in_buff, const uint16_t *ref_buff, uint8_t *out_buff, uint16_t in_pos, uint16_t out_pos, int multisamples)
 {
 	/* quick scan for max/min */
 	uint16_t max = 0;
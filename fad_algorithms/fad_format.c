@@ -0,0 +1,87 @@
+/**
+ * fad_format.c
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Output format negotiation and the block converters. Stereo frames are built as one 32-bit word
+ * (left in the low half, as the little-endian PCM stream wants) and stored a word at a time.
+ */
+
+#include <string.h>
+
+#include "fad_format.h"
+
+/* dac_buffer value to 16-bit signed: flip the sign bit and move it to the top byte. The low byte is always 0, so the
+ * 16-bit sinks still get 8-bit resolution until the algorithms write wider samples */
+static inline uint16_t widen(uint8_t value)
+{
+	return (uint16_t)((value ^ 0x80) << 8);
+}
+
+esp_err_t fad_format_negotiate(fad_output_mode_t mode, uint32_t sink_hz, fad_format_desc_t *desc)
+{
+	switch (mode)
+	{
+	case FAD_OUTPUT_DAC:
+	case FAD_OUTPUT_PWM:
+		*desc = (fad_format_desc_t){FAD_FORMAT_U8, OUTPUT_FREQ, 1, 1};
+		return ESP_OK;
+	case FAD_OUTPUT_I2S:
+		*desc = (fad_format_desc_t){FAD_FORMAT_S16_MONO, OUTPUT_FREQ, 1, 2};
+		return ESP_OK;
+	case FAD_OUTPUT_BT:
+		if (sink_hz < OUTPUT_FREQ || sink_hz % OUTPUT_FREQ != 0 || sink_hz / OUTPUT_FREQ > UINT8_MAX)
+			return ESP_ERR_NOT_SUPPORTED;
+		*desc = (fad_format_desc_t){FAD_FORMAT_S16_STEREO, sink_hz, sink_hz / OUTPUT_FREQ, 4};
+		return ESP_OK;
+	}
+	return ESP_ERR_NOT_SUPPORTED;
+}
+
+int fad_format_convert(const fad_format_desc_t *desc, const uint8_t *in, int count, void *out)
+{
+	switch (desc->format)
+	{
+	case FAD_FORMAT_U8:
+		memcpy(out, in, count);
+		return count;
+
+	case FAD_FORMAT_S16_MONO:
+	{
+		uint16_t *dst = out;
+		for (int i = 0; i < count; i++)
+			dst[i] = widen(in[i]);
+		return count * 2;
+	}
+
+	case FAD_FORMAT_S16_STEREO:
+	{
+		uint32_t *dst = out;
+		int upsample = desc->upsample;
+		if (upsample == 4) // 11025 Hz to 44.1 kHz, the usual case
+		{
+			for (int i = 0; i < count; i++, dst += 4)
+			{
+				uint32_t frame = widen(in[i]) * 0x00010001u;
+				dst[0] = frame;
+				dst[1] = frame;
+				dst[2] = frame;
+				dst[3] = frame;
+			}
+		}
+		else
+		{
+			for (int i = 0; i < count; i++)
+			{
+				uint32_t frame = widen(in[i]) * 0x00010001u;
+				for (int j = 0; j < upsample; j++)
+					*dst++ = frame;
+			}
+		}
+		return count * upsample * 4;
+	}
+	}
+	return 0;
+}
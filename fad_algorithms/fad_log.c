@@ -0,0 +1,261 @@
+/**
+ * fad_log.c
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Deferred logging ring. Each slot carries a sequence number: a writer claims a slot by advancing the
+ * head with a compare-and-swap, fills it in, then publishes it by bumping the sequence. The log task is
+ * the only reader, so it just follows the tail. A writer interrupted between claiming and publishing only
+ * holds up the reader, never another writer, so the ISR can log while a task is in the middle of it.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "fad_log.h"
+#include "fad_mem.h"
+
+#define LOG_TAG "FAD_LOG"
+#define LOG_TASK_STACK 3072 // float formatting needs the room
+#define LOG_LINE_SIZE 160
+
+_Static_assert((FAD_LOG_RECORDS & (FAD_LOG_RECORDS - 1)) == 0, "FAD_LOG_RECORDS must be a power of two");
+
+typedef struct {
+	uint32_t seq;		// position + 1 once published, position + FAD_LOG_RECORDS once read
+	fad_log_site_t *site;
+	uint8_t nargs;
+	fad_log_arg_t args[FAD_LOG_MAX_ARGS];
+} log_slot_t;
+
+static log_slot_t s_ring[FAD_LOG_RECORDS];
+static uint32_t s_head = 0;		// next position to claim
+static uint32_t s_tail = 0;		// next position to print; log task only
+static bool s_ring_ready = false;
+static fad_log_stats_t s_stats;
+static TaskHandle_t s_task_handle = NULL;
+
+static inline void count(uint32_t *counter)
+{
+	__atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+}
+
+static void ring_init(void)
+{
+	for (uint32_t i = 0; i < FAD_LOG_RECORDS; i++)
+		s_ring[i].seq = i;
+	s_ring_ready = true;
+}
+
+/* Rate limit by call site. Unlocked: two contexts racing on one site can let a line or two extra through. */
+static bool IRAM_ATTR site_allows(fad_log_site_t *site)
+{
+	uint32_t now = esp_log_timestamp();
+	if (now - site->window_ms >= 1000)
+	{
+		site->window_ms = now;
+		site->window_count = 0;
+	}
+	return site->window_count++ < FAD_LOG_RATE_LIMIT;
+}
+
+void IRAM_ATTR fad_log_write(fad_log_site_t *site, const fad_log_arg_t *args, int nargs)
+{
+	if (!s_ring_ready)
+	{
+		count(&site->suppressed);
+		count(&s_stats.ring_full);
+		return;
+	}
+	if (!site_allows(site))
+	{
+		count(&site->suppressed);
+		count(&s_stats.rate_limited);
+		return;
+	}
+
+	uint32_t pos = __atomic_load_n(&s_head, __ATOMIC_RELAXED);
+	log_slot_t *slot;
+	for (;;)
+	{
+		slot = &s_ring[pos & (FAD_LOG_RECORDS - 1)];
+		int32_t diff = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+		if (diff == 0)
+		{
+			if (__atomic_compare_exchange_n(&s_head, &pos, pos + 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+			// pos now holds the current head; try again
+		}
+		else if (diff < 0)
+		{
+			count(&site->suppressed);
+			count(&s_stats.ring_full);
+			return;
+		}
+		else
+		{
+			pos = __atomic_load_n(&s_head, __ATOMIC_RELAXED);
+		}
+	}
+
+	if (nargs > FAD_LOG_MAX_ARGS)
+		nargs = FAD_LOG_MAX_ARGS;
+	slot->site = site;
+	slot->nargs = nargs;
+	memcpy(slot->args, args, nargs * sizeof(fad_log_arg_t));
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+	count(&s_stats.written);
+	uint32_t waiting = pos + 1 - __atomic_load_n(&s_tail, __ATOMIC_RELAXED);
+	uint32_t high = __atomic_load_n(&s_stats.high_water, __ATOMIC_RELAXED);
+	while (waiting > high &&
+		   !__atomic_compare_exchange_n(&s_stats.high_water, &high, waiting, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/**
+ * @brief Expand a format string with raw arguments, one conversion at a time
+ * @return Characters written to out, not counting the terminator
+ */
+static int format_line(const char *format, const fad_log_arg_t *args, int nargs, char *out, int size)
+{
+	int len = 0;
+	int next = 0;
+	const char *p = format;
+
+	while (*p && len < size - 1)
+	{
+		if (*p != '%')
+		{
+			out[len++] = *p++;
+			continue;
+		}
+		if (p[1] == '%')
+		{
+			out[len++] = '%';
+			p += 2;
+			continue;
+		}
+
+		/* Copy one conversion spec, dropping length modifiers: the argument is always 32 bits or a float */
+		char spec[16];
+		int n = 0;
+		spec[n++] = *p++;
+		while (*p && strchr("-+ #0123456789.", *p) && n < (int)sizeof(spec) - 3)
+			spec[n++] = *p++;
+		while (*p && strchr("hlLqjzt", *p))
+			p++;
+		char conv = *p ? *p++ : 'd';
+		spec[n++] = conv;
+		spec[n] = '\0';
+
+		fad_log_arg_t arg = (next < nargs) ? args[next] : fad_log_arg_int(0);
+		next++;
+
+		int w;
+		if (strchr("fFeEgGaA", conv))
+			w = snprintf(out + len, size - len, spec, (double)arg.f);
+		else if (strchr("uxXo", conv))
+			w = snprintf(out + len, size - len, spec, (unsigned)arg.i);
+		else if (strchr("dic", conv))
+			w = snprintf(out + len, size - len, spec, (int)arg.i);
+		else
+			w = snprintf(out + len, size - len, "%s", "?");
+		if (w > 0)
+			len += (w < size - len) ? w : size - len - 1;
+	}
+
+	out[len] = '\0';
+	return len;
+}
+
+static void print_slot(const log_slot_t *slot)
+{
+	char line[LOG_LINE_SIZE];
+	fad_log_site_t *site = slot->site;
+	int len = format_line(site->format, slot->args, slot->nargs, line, sizeof(line));
+
+	uint32_t suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+	if (suppressed > 0)
+		snprintf(line + len, sizeof(line) - len, " (%u more suppressed)", suppressed);
+
+	switch (site->level)
+	{
+	case ESP_LOG_ERROR:
+		ESP_LOGE(site->tag, "%s", line);
+		break;
+	case ESP_LOG_WARN:
+		ESP_LOGW(site->tag, "%s", line);
+		break;
+	case ESP_LOG_INFO:
+		ESP_LOGI(site->tag, "%s", line);
+		break;
+	default:
+		ESP_LOGD(site->tag, "%s", line);
+		break;
+	}
+}
+
+void fad_log_flush(void)
+{
+	for (;;)
+	{
+		log_slot_t *slot = &s_ring[s_tail & (FAD_LOG_RECORDS - 1)];
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != s_tail + 1)
+			return; // empty, or the next line is not published yet
+
+		print_slot(slot);
+		count(&s_stats.printed);
+		__atomic_store_n(&slot->seq, s_tail + FAD_LOG_RECORDS, __ATOMIC_RELEASE);
+		__atomic_store_n(&s_tail, s_tail + 1, __ATOMIC_RELAXED);
+	}
+}
+
+/**
+ * @brief FreeRTOS task that prints the queued lines every FAD_LOG_FLUSH_MS
+ * @param params [in] required as part of the task function definition
+ */
+static void log_task(void *params)
+{
+	for (;;)
+	{
+		fad_log_flush();
+		vTaskDelay(pdMS_TO_TICKS(FAD_LOG_FLUSH_MS) > 0 ? pdMS_TO_TICKS(FAD_LOG_FLUSH_MS) : 1);
+	}
+
+	vTaskDelete(s_task_handle);
+}
+
+esp_err_t fad_log_init(void)
+{
+	if (s_task_handle != NULL)
+		return ESP_OK;
+
+	ring_init();
+	if (xTaskCreate(log_task, "FAD_Log_Task", LOG_TASK_STACK, 0, tskIDLE_PRIORITY + 1, &s_task_handle) != pdPASS)
+	{
+		s_ring_ready = false;
+		ESP_LOGW(LOG_TAG, "Could not create task");
+		return ESP_FAIL;
+	}
+	fad_mem_track_task(s_task_handle, "FAD_Log_Task", LOG_TASK_STACK);
+	return ESP_OK;
+}
+
+void fad_log_get_stats(fad_log_stats_t *stats)
+{
+	memcpy(stats, &s_stats, sizeof(fad_log_stats_t));
+}
+
+void fad_log_report(void)
+{
+	fad_log_stats_t stats;
+	fad_log_get_stats(&stats);
+	ESP_LOGI(LOG_TAG, "Deferred log: %u queued, %u printed, %u rate limited, %u dropped ring full, %u of %d slots at most",
+			 stats.written, stats.printed, stats.rate_limited, stats.ring_full, stats.high_water, FAD_LOG_RECORDS);
+}
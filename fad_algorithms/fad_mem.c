@@ -0,0 +1,324 @@
+/**
+ * fad_mem.c
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * The memory plan and the boot-time arena. All regions with the same placement share one block,
+ * allocated with the matching heap capabilities and cut up in plan order. Also the footprint report.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+#include "fad_mem.h"
+
+#define MEM_TAG "FAD_MEM"
+#define MEM_TASKS 12		// Tasks fad_mem_track_task can hold
+#define MEM_HEAP_CHARGES 4	// Subsystems fad_mem_heap_charge can hold
+#define MEM_ALGO_TYPES (FAD_ALGO_WHITE + 1)
+#define ALIGN_UP(n) (((n) + FAD_MEM_ALIGN - 1) & ~(size_t)(FAD_MEM_ALIGN - 1))
+
+_Static_assert((FAD_MEM_ALIGN & (FAD_MEM_ALIGN - 1)) == 0, "FAD_MEM_ALIGN must be a power of two");
+
+typedef struct {
+	const char *name;
+	size_t size;
+	fad_mem_place_t place;
+	bool optional;		// Only reserved when fad_mem_init is asked for it
+} mem_plan_t;
+
+/* The plan. Sizes come from fad_defs.h; keep in step with fad_mem_region_t */
+static const mem_plan_t s_plan[FAD_MEM_REGION_MAX] = {
+	{"ADC ring",		ADC_BUFFER_SIZE * sizeof(uint16_t),								FAD_MEM_FAST, false},
+	{"ADC ref ring",	(FAD_ADC_CHANNELS > 1) ? ADC_BUFFER_SIZE * sizeof(uint16_t) : 0,	FAD_MEM_FAST, false},
+	{"DAC ring",		DAC_BUFFER_SIZE * sizeof(uint8_t),								FAD_MEM_FAST, false},
+	{"Algo scratch",	FAD_MEM_ALGO_SCRATCH_SIZE,										FAD_MEM_FAST, false},
+	{"Trace ring",		FAD_TRACE_ENABLE ? FAD_TRACE_RECORDS * 12 : 0,					FAD_MEM_FAST, false}, // 12-byte records
+	{"BT rings",		FAD_BT_BUFFER_SIZE + FAD_BT_PCM_FRAMES * sizeof(uint32_t),		FAD_MEM_FAST, false},
+	{"Capture store",	FAD_CAPTURE_BUFFER_SIZE,										FAD_MEM_BULK, true},
+};
+
+static const uint32_t s_place_caps[FAD_MEM_PLACE_MAX] = {
+	MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT,
+	MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT,
+};
+
+/* Names of fad_algo_type_t, for the scratch entries */
+static const char *s_algo_names[MEM_ALGO_TYPES] = {
+	"delay",
+	"freq_shift",
+	"masking",
+	"template",
+	"white",
+};
+
+static const char *s_use_names[FAD_MEM_USE_MAX] = {
+	"region",
+	"scratch",
+	"stack",
+	"heap",
+	"free",
+};
+
+typedef struct {
+	TaskHandle_t task;		// NULL once untracked
+	const char *name;
+	uint32_t stack_size;
+	uint32_t peak;			// Most stack used at the last reading
+} mem_task_t;
+
+typedef struct {
+	const char *name;
+	uint32_t bytes;
+} mem_charge_t;
+
+static uint8_t *s_blocks[FAD_MEM_PLACE_MAX];
+static bool s_in_psram[FAD_MEM_PLACE_MAX];
+static uint8_t *s_regions[FAD_MEM_REGION_MAX];
+static size_t s_sizes[FAD_MEM_REGION_MAX];
+static bool s_ready = false;
+static size_t s_algo_used = 0;
+static int s_algo_owner = -1;
+static uint32_t s_algo_peak[MEM_ALGO_TYPES];
+static mem_task_t s_tasks[MEM_TASKS];
+static int s_task_count = 0;
+static mem_charge_t s_charges[MEM_HEAP_CHARGES];
+static int s_charge_count = 0;
+
+esp_err_t fad_mem_init(uint32_t optional)
+{
+	if (s_ready)
+		return ESP_OK;
+
+	size_t totals[FAD_MEM_PLACE_MAX] = {0};
+	for (int r = 0; r < FAD_MEM_REGION_MAX; r++)
+	{
+		bool wanted = !s_plan[r].optional || (optional & FAD_MEM_BIT(r));
+		s_sizes[r] = wanted ? s_plan[r].size : 0;
+		totals[s_plan[r].place] += ALIGN_UP(s_sizes[r]);
+	}
+
+	for (int p = 0; p < FAD_MEM_PLACE_MAX; p++)
+	{
+		if (totals[p] == 0)
+			continue;
+		s_blocks[p] = heap_caps_calloc(1, totals[p], s_place_caps[p]);
+		s_in_psram[p] = (s_blocks[p] != NULL) && (s_place_caps[p] & MALLOC_CAP_SPIRAM);
+		if (s_blocks[p] == NULL && p != FAD_MEM_FAST)
+			s_blocks[p] = heap_caps_calloc(1, totals[p], s_place_caps[FAD_MEM_FAST]); // No PSRAM on this board
+		if (s_blocks[p] == NULL)
+		{
+			ESP_LOGE(MEM_TAG, "No memory for the plan: %u bytes fast, %u bytes bulk",
+					 (unsigned)totals[FAD_MEM_FAST], (unsigned)totals[FAD_MEM_BULK]);
+			for (int q = 0; q < p; q++)
+			{
+				heap_caps_free(s_blocks[q]);
+				s_blocks[q] = NULL;
+			}
+			return ESP_ERR_NO_MEM;
+		}
+	}
+
+	uint8_t *next[FAD_MEM_PLACE_MAX];
+	memcpy(next, s_blocks, sizeof(next));
+	for (int r = 0; r < FAD_MEM_REGION_MAX; r++)
+	{
+		fad_mem_place_t p = s_plan[r].place;
+		s_regions[r] = (s_sizes[r] > 0) ? next[p] : NULL;
+		next[p] += ALIGN_UP(s_sizes[r]);
+	}
+
+	s_algo_used = 0;
+	s_ready = true;
+	return ESP_OK;
+}
+
+void *fad_mem_region(fad_mem_region_t region, size_t *size)
+{
+	bool valid = s_ready && region < FAD_MEM_REGION_MAX;
+	if (size != NULL)
+		*size = valid ? s_sizes[region] : 0;
+	return valid ? s_regions[region] : NULL;
+}
+
+void *fad_mem_algo_alloc(size_t size)
+{
+	size_t need = ALIGN_UP(size);
+	if (!s_ready || s_algo_used + need > s_sizes[FAD_MEM_ALGO])
+	{
+		ESP_LOGE(MEM_TAG, "Algorithm scratch is %u bytes, %u used, %u more asked for. Raise FAD_MEM_ALGO_SCRATCH_SIZE",
+				 (unsigned)s_sizes[FAD_MEM_ALGO], (unsigned)s_algo_used, (unsigned)size);
+		return NULL;
+	}
+
+	void *mem = s_regions[FAD_MEM_ALGO] + s_algo_used;
+	s_algo_used += need;
+	if (s_algo_owner >= 0 && s_algo_used > s_algo_peak[s_algo_owner])
+		s_algo_peak[s_algo_owner] = s_algo_used;
+	return mem;
+}
+
+void fad_mem_algo_reset(fad_algo_type_t next)
+{
+	s_algo_used = 0;
+	s_algo_owner = (next < MEM_ALGO_TYPES) ? (int)next : -1;
+}
+
+/* Stack used so far, from FreeRTOS's high-water mark (the least stack ever left free) */
+static uint32_t stack_peak(const mem_task_t *t)
+{
+	if (t->task == NULL)
+		return t->peak;
+	uint32_t left = uxTaskGetStackHighWaterMark(t->task);
+	return (left < t->stack_size) ? t->stack_size - left : 0;
+}
+
+void fad_mem_track_task(TaskHandle_t task, const char *name, uint32_t stack_size)
+{
+	if (task == NULL)
+		return;
+
+	int i;
+	for (i = 0; i < s_task_count; i++)
+		if (strcmp(s_tasks[i].name, name) == 0)
+			break;
+	if (i == s_task_count)
+	{
+		if (s_task_count == MEM_TASKS)
+		{
+			ESP_LOGW(MEM_TAG, "Not tracking task %s, %d already", name, MEM_TASKS);
+			return;
+		}
+		s_task_count++;
+	}
+
+	s_tasks[i].task = task;
+	s_tasks[i].name = name;
+	s_tasks[i].stack_size = stack_size;
+	s_tasks[i].peak = 0;
+}
+
+void fad_mem_untrack_task(TaskHandle_t task)
+{
+	for (int i = 0; i < s_task_count; i++)
+	{
+		if (s_tasks[i].task == task)
+		{
+			s_tasks[i].peak = stack_peak(&s_tasks[i]);
+			s_tasks[i].task = NULL;
+		}
+	}
+}
+
+size_t fad_mem_heap_free(void)
+{
+	return heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+}
+
+void fad_mem_heap_charge(const char *name, size_t free_before)
+{
+	if (s_charge_count == MEM_HEAP_CHARGES)
+	{
+		ESP_LOGW(MEM_TAG, "Not charging %s, %d subsystems already", name, MEM_HEAP_CHARGES);
+		return;
+	}
+
+	size_t free_now = fad_mem_heap_free();
+	s_charges[s_charge_count].name = name;
+	s_charges[s_charge_count].bytes = (free_before > free_now) ? free_before - free_now : 0;
+	s_charge_count++;
+}
+
+static int add_usage(fad_mem_usage_t *out, int n, int max, fad_mem_use_t kind, const char *name, uint32_t size, uint32_t peak)
+{
+	if (n < max)
+	{
+		out[n].kind = kind;
+		out[n].name = name;
+		out[n].size = size;
+		out[n].peak = peak;
+	}
+	return n + 1;
+}
+
+int fad_mem_get_usage(fad_mem_usage_t *out, int max)
+{
+	int n = 0;
+
+	for (int r = 0; r < FAD_MEM_REGION_MAX; r++)
+		if (s_sizes[r] > 0)
+			n = add_usage(out, n, max, FAD_MEM_USE_REGION, s_plan[r].name, s_sizes[r], s_sizes[r]);
+
+	for (int a = 0; a < MEM_ALGO_TYPES; a++)
+		n = add_usage(out, n, max, FAD_MEM_USE_SCRATCH, s_algo_names[a], s_sizes[FAD_MEM_ALGO], s_algo_peak[a]);
+
+	for (int i = 0; i < s_task_count; i++)
+		n = add_usage(out, n, max, FAD_MEM_USE_STACK, s_tasks[i].name, s_tasks[i].stack_size, stack_peak(&s_tasks[i]));
+
+	for (int i = 0; i < s_charge_count; i++)
+		n = add_usage(out, n, max, FAD_MEM_USE_HEAP, s_charges[i].name, s_charges[i].bytes, s_charges[i].bytes);
+
+	n = add_usage(out, n, max, FAD_MEM_USE_FREE, "internal", heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+				  heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL));
+	n = add_usage(out, n, max, FAD_MEM_USE_FREE, "internal block", heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL),
+				  heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+	n = add_usage(out, n, max, FAD_MEM_USE_FREE, "psram", heap_caps_get_free_size(MALLOC_CAP_SPIRAM),
+				  heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM));
+
+	return (n < max) ? n : max;
+}
+
+#define MEM_USAGE_MAX (FAD_MEM_REGION_MAX + MEM_ALGO_TYPES + MEM_TASKS + MEM_HEAP_CHARGES + 3)
+
+void fad_mem_report(void)
+{
+	if (!s_ready)
+	{
+		ESP_LOGW(MEM_TAG, "Memory plan not reserved");
+		return;
+	}
+
+	for (int r = 0; r < FAD_MEM_REGION_MAX; r++)
+	{
+		fad_mem_place_t p = s_plan[r].place;
+		if (s_sizes[r] == 0)
+			ESP_LOGI(MEM_TAG, "  %-14s      -", s_plan[r].name);
+		else
+			ESP_LOGI(MEM_TAG, "  %-14s %6u  %s", s_plan[r].name, (unsigned)s_sizes[r], s_in_psram[p] ? "PSRAM" : "internal");
+	}
+
+	ESP_LOGI(MEM_TAG, "Algo scratch: %u of %u bytes in use", (unsigned)s_algo_used, (unsigned)s_sizes[FAD_MEM_ALGO]);
+	for (int a = 0; a < MEM_ALGO_TYPES; a++)
+		if (s_algo_peak[a] > 0)
+			ESP_LOGI(MEM_TAG, "  %-14s %6u at most", s_algo_names[a], (unsigned)s_algo_peak[a]);
+
+	if (s_task_count > 0)
+		ESP_LOGI(MEM_TAG, "Task stacks:");
+	for (int i = 0; i < s_task_count; i++)
+		ESP_LOGI(MEM_TAG, "  %-30s %5u of %5u bytes at most%s", s_tasks[i].name, (unsigned)stack_peak(&s_tasks[i]),
+				 (unsigned)s_tasks[i].stack_size, s_tasks[i].task == NULL ? " (ended)" : "");
+
+	for (int i = 0; i < s_charge_count; i++)
+		ESP_LOGI(MEM_TAG, "Heap taken by %s: %u bytes", s_charges[i].name, (unsigned)s_charges[i].bytes);
+	ESP_LOGI(MEM_TAG, "Internal heap: %u free, %u at least, largest block %u",
+			 (unsigned)heap_caps_get_free_size(MALLOC_CAP_INTERNAL), (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
+			 (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+}
+
+void fad_mem_dump(FILE *out)
+{
+	fad_mem_usage_t usage[MEM_USAGE_MAX];
+	int n = fad_mem_get_usage(usage, MEM_USAGE_MAX);
+
+	fprintf(out, "FMEM-BEGIN %d\n", n);
+	fprintf(out, "kind,name,size,peak\n");
+	for (int i = 0; i < n; i++)
+		fprintf(out, "%s,%s,%u,%u\n", s_use_names[usage[i].kind], usage[i].name, (unsigned)usage[i].size, (unsigned)usage[i].peak);
+	fprintf(out, "FMEM-END\n");
+	fflush(out);
+}
@@ -40,6 +40,12 @@
 #include <complex.h>
 
 #include "fft.h"
+#include "fad_mem.h"
+
+/* Plans live in the FAD algorithm scratch region, so setting one up in an algorithm's init never
+   touches the heap. They are released with the region by fad_mem_algo_reset, not by fft_destroy. */
+#define FFT_ALLOC(size) fad_mem_algo_alloc(size)
+#define FFT_FREE(ptr) ((void)(ptr))
 
 #define TWO_PI 6.28318530
 #define USE_SPLIT_RADIX 1
@@ -54,12 +60,14 @@ fft_config_t *fft_init(int size, fft_type_t type, fft_direction_t direction, flo
    */
   int k,m;
 
-  fft_config_t *config = (fft_config_t *)malloc(sizeof(fft_config_t));
-
   // Check if the size is a power of two
   if ((size & (size-1)) != 0)  // tests if size is a power of two
     return NULL;
 
+  fft_config_t *config = (fft_config_t *)FFT_ALLOC(sizeof(fft_config_t));
+  if (config == NULL)
+    return NULL;
+
   // start configuration
   config->flags = 0;
   config->type = type;
@@ -67,7 +75,9 @@ fft_config_t *fft_init(int size, fft_type_t type, fft_direction_t direction, flo
   config->size = size;
 
   // Allocate and precompute twiddle factors
-  config->twiddle_factors = (float *)malloc(2 * config->size * sizeof(float));
+  config->twiddle_factors = (float *)FFT_ALLOC(2 * config->size * sizeof(float));
+  if (config->twiddle_factors == NULL)
+    return NULL;
 
   float two_pi_by_n = TWO_PI / config->size;
 
@@ -83,9 +93,9 @@ fft_config_t *fft_init(int size, fft_type_t type, fft_direction_t direction, flo
   else 
   {
     if (config->type == FFT_REAL)
-      config->input = (float *)malloc(config->size * sizeof(float));
+      config->input = (float *)FFT_ALLOC(config->size * sizeof(float));
     else if (config->type == FFT_COMPLEX)
-      config->input = (float *)malloc(2 * config->size * sizeof(float));
+      config->input = (float *)FFT_ALLOC(2 * config->size * sizeof(float));
 
     config->flags |= FFT_OWN_INPUT_MEM;
   }
@@ -99,9 +109,9 @@ fft_config_t *fft_init(int size, fft_type_t type, fft_direction_t direction, flo
   else
   {
     if (config->type == FFT_REAL)
-      config->output = (float *)malloc(config->size * sizeof(float));
+      config->output = (float *)FFT_ALLOC(config->size * sizeof(float));
     else if (config->type == FFT_COMPLEX)
-      config->output = (float *)malloc(2 * config->size * sizeof(float));
+      config->output = (float *)FFT_ALLOC(2 * config->size * sizeof(float));
 
     config->flags |= FFT_OWN_OUTPUT_MEM;
   }
@@ -115,13 +125,13 @@ fft_config_t *fft_init(int size, fft_type_t type, fft_direction_t direction, flo
 void fft_destroy(fft_config_t *config)
 {
   if (config->flags & FFT_OWN_INPUT_MEM)
-    free(config->input);
+    FFT_FREE(config->input);
 
   if (config->flags & FFT_OWN_OUTPUT_MEM)
-    free(config->output);
+    FFT_FREE(config->output);
 
-  free(config->twiddle_factors);
-  free(config);
+  FFT_FREE(config->twiddle_factors);
+  FFT_FREE(config);
 }
 
 void fft_execute(fft_config_t *config)
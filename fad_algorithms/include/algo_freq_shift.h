@@ -19,10 +19,11 @@
 /**
  * @brief Frequency shifter...
  * @param in_buff
+ * @param ref_buff
  * @param 
  * @param   
  */
-void algo_freq_shift(uint16_t *in_buff, uint8_t *out_buff, uint16_t in_pos, uint16_t out_pos, int multisamples);
+void algo_freq_shift(uint16_t *in_buff, const uint16_t *ref_buff, uint8_t *out_buff, uint16_t in_pos, uint16_t out_pos, int multisamples);
 
 
 
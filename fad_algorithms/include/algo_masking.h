@@ -19,12 +19,13 @@
 /**
  * @brief White noise algorithm for ESP masker
  * @param in_buff Buffer that points to the beginning of the ADC data
+ * @param ref_buff Reference channel, indexed like in_buff, or NULL without one
  * @param out_buff [OUT] Buffer that points to the beggining of DAC data staged to be output to the DAC
  * @param in_pos Points to starting point of this algorithm chunk
  * @param out_pos Points to starting point of this algorithm chunk
  * @param multisamples Number of input samples per output sample
  */
-void algo_masking(uint16_t *in_buff, uint8_t *out_buff, uint16_t in_pos, uint16_t out_pos, int multisamples); 
+void algo_masking(uint16_t *in_buff, const uint16_t *ref_buff, uint8_t *out_buff, uint16_t in_pos, uint16_t out_pos, int multisamples); 
 
 /**
  * @brief Initializes algorithm constants
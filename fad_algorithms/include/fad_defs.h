@@ -17,12 +17,133 @@
 #define MULTISAMPLES 1          //Number of ADC samples per DAC output
 #define DAC_BUFFER_SIZE (ADC_BUFFER_SIZE / MULTISAMPLES)  //Buffer size for holding staged DAC data. Hold one DAC sample for each ADC sample divided by multisamples
 #define ADC_CHANNEL ADC_CHANNEL_6
+#define FAD_ADC_CHANNELS 1      //2 to also sample a reference mic (ADC_CHANNEL_REF, or the right channel of a stereo digital mic) into adc_buffer_ref
+#define ADC_CHANNEL_REF ADC_CHANNEL_0 //GPIO 36. Converted right after ADC_CHANNEL in the same ISR
+#define FAD_ADC_FAST_PATH 1     //1 to read ADC1 through the RTC registers in the ISR, 0 to use adc1_get_raw
+#define FAD_ADC_POLL_LIMIT 200  //Max polls for a conversion before the ISR gives up and repeats the last value
+
+/* DAC Definitions */
+#define FAD_DAC_FAST_PATH 1     //1 to write the DAC through the RTC IO registers in the ISR, 0 to use dac_output_voltage
+
+/* PWM Output Definitions. The pin needs an RC low-pass (e.g. 1k / 10nF) in front of the headphone amp */
+#define FAD_PWM_SIGMA_DELTA 0   //1 to use the sigma-delta modulator (always 8 bit, no software shaping), 0 for LEDC PWM
+#define FAD_PWM_BITS 7          //LEDC duty resolution, below the 8-bit samples so the shaper has work. The carrier runs at 80 MHz >> bits: 625 kHz
+#define FAD_PWM_SD_PRESCALE 8   //Sigma-delta modulator clock divider, 80 MHz / prescale
+#define FAD_PWM_NOISE_SHAPING 2 //Order of the error feedback used to requantize to a duty resolution below 8 bits, 0 to just round
+
+/* I2S Codec Output Definitions. 16-bit stereo frames at OUTPUT_FREQ, both channels carry the same sample */
+#define FAD_I2S_OUT_PORT 1          //I2S peripheral for the codec. Port 0 is left for a PDM mic, which only port 0 supports
+#define FAD_I2S_DMA_BUF_COUNT 4     //DMA buffers. Count * length is the output queue: 512 samples = 46 ms at 11025 Hz
+#define FAD_I2S_DMA_BUF_LEN 128     //Frames per DMA buffer
+#define FAD_I2S_CHUNK 128           //Samples the output task moves from the DAC buffer per write. At most a quarter of DAC_BUFFER_SIZE
+
+/* Digital Microphone Input Definitions. Samples are scaled to 12-bit ADC codes so the algorithms see the same range */
+#define FAD_MIC_PORT 0              //I2S peripheral for the mic. PDM receive only exists on port 0
+#define FAD_MIC_PDM 1               //1 for a PDM mic (clock + data), 0 for an I2S MEMS mic with 24-bit data in 32-bit slots
+#define FAD_MIC_DMA_BUF_COUNT 4     //DMA buffers. The mic task collects an algorithm block from them
+#define FAD_MIC_DMA_BUF_LEN 128     //Samples per DMA buffer
+#define FAD_MIC_GAIN_SHIFT 2        //Left shift before scaling to 12 bits. MEMS mics sit around -26 dBFS at 94 dB SPL
 
 /* Timer Definitions */
 #define TIMER_FREQ 88200    //Frequency of the Timer
 #define ALARM_FREQ 11025    //Determines the frequency of ADC sampling and DAC output
 #define OUTPUT_FREQ (ALARM_FREQ / MULTISAMPLES)
 #define FAD_GPIO_POLLING_PERIOD 32  // GPIO Check polling period in ms. Check GPIO every period.
+#define FAD_TIMER_FRACTIONAL_N 0    // 1 to alternate alarm steps so the average sample rate is exactly ALARM_FREQ
+#define FAD_TIMER_FRAC_DIVIDER 2    // Timer divider used by fractional-N scheduling (80 MHz / 2 = 40 MHz ticks)
+
+/* Instrumentation Definitions */
+#define FAD_PERF_ENABLE 0               // Count ISR cycles and benchmark the sample paths when output starts
+#define FAD_PERF_BENCH_ITERATIONS 1000  // Reads/writes per path in the start-up benchmark
+#define FAD_PERF_REPORT_BLOCKS 256      // Log the instrumentation report every this many algorithm blocks, with REPORT_MODE in main.c
+#define FAD_JITTER_ENABLE 0             // Timestamp ISR entries for the jitter histogram and sample rate report
+#define FAD_JITTER_BINS 33              // Histogram bins centered on the nominal period; the end bins collect outliers
+#define FAD_JITTER_BIN_NS 500           // Width of one histogram bin
+#define FAD_TRACE_ENABLE 1              // Record timestamped pipeline events into the trace ring
+#define FAD_TRACE_RECORDS 512           // Trace ring size, a power of two; 12 bytes each, ~1 s of events while streaming
+#define FAD_LOG_RECORDS 64              // Deferred log ring size, a power of two; 28 bytes each
+#define FAD_LOG_RATE_LIMIT 10           // Lines per second each deferred log call site may print
+#define FAD_LOG_FLUSH_MS 50             // How often the log task prints the queued lines
+#define FAD_LOAD_ENABLE 1               // Sample the task run-time counters for the CPU load meter; the power governor needs it
+#define FAD_LOAD_PERIOD_MS 1000         // Length of one load window
+#define FAD_LOAD_HISTORY 60             // Load windows kept for the rolling average and peak
+#define FAD_LOAD_MAX_TASKS 24           // Tasks measured per window; the rest go uncounted
+
+/* Latency Measurement Definitions */
+#define FAD_LATENCY_TRIALS 8                // Number of marker round trips averaged into one latency report
+#define FAD_LATENCY_TIMEOUT_MS 2000         // A trial is abandoned if its marker has not come out by then
+#define FAD_LATENCY_SETTLE_MS 250           // Quiet time between trials so the previous marker dies out
+#define FAD_LATENCY_IMPULSE 4095            // ADC value injected as the marker (12 bit full scale)
+#define FAD_LATENCY_DETECT_LEVEL 48         // Deviation of an output value from its block mean that counts as the marker
+#define FAD_LATENCY_CHIRP_LEN 64            // Length in output samples of the loopback chirp
+#define FAD_LATENCY_CHIRP_START_HZ 500      // Chirp sweep start frequency
+#define FAD_LATENCY_CHIRP_END_HZ 4000       // Chirp sweep end frequency
+#define FAD_LATENCY_CORR_THRESHOLD 0.6f     // Normalized correlation needed to accept the chirp in the mic signal
+
+/* Capture and Replay Definitions */
+#define FAD_CAPTURE_BUFFER_SIZE 65536       // RAM for an on-device capture; ~2.4 s at 11025 Hz with outputs stored
+#define FAD_CAPTURE_OUTPUT 1                // Store the algorithm output with each block, so a replay can check it is bit-identical
+#define FAD_CAPTURE_DUMP_LINE 57            // Capture bytes per base64 line in the console dump (76 characters)
+
+/* Event Dispatch Definitions. Event parameters are copied into the queue message, or into a pool slot if too large */
+#define FAD_APP_INLINE_PARAM_SIZE (4 * sizeof(void *)) // Parameter bytes carried in the message itself: 16 on the ESP32
+#define FAD_APP_POOL_SLOTS 8                // Preallocated slots for larger parameters. At most 32
+#define FAD_APP_POOL_SLOT_SIZE 64           // Bytes per pool slot; larger parameters are refused
+#define FAD_APP_RT_QUEUE_LEN 4              // Audio blocks waiting for the app task. A full ring's worth is already stale
+#define FAD_APP_CONTROL_QUEUE_LEN 8         // Buttons, BT connection and AVRCP events
+#define FAD_APP_BACKGROUND_QUEUE_LEN 4      // Latency tests and capture bookkeeping; served only when nothing else waits
+
+/* Memory Plan Definitions. Audio buffers are reserved once at boot from the plan in fad_mem.c */
+#define FAD_MEM_ALGO_SCRATCH_SIZE 10240     // Scratch for the active algorithm: the delay line (5000), or a 512-point real FFT plan with its buffers (~8.2 KB)
+#define FAD_MEM_ALIGN 8                     // Alignment of every region and scratch allocation
+
+/* Bluetooth Output Definitions. The sample ISR feeds a ring that the A2DP data callback drains; see fad_bt_buffer.c */
+#define FAD_BT_BUFFER_SIZE 1024             // Ring between the sample ISR and the A2DP callback, a power of two; ~93 ms
+#define FAD_BT_BUFFER_TARGET 256            // Fill the stream starts at, and restarts at after an underrun; ~23 ms of latency
+#define FAD_BT_BUFFER_LOW 64                // A read that leaves less than this counts as a near underrun
+#define FAD_BT_BUFFER_HIGH 640              // More than this and the oldest samples are dropped back to the target
+#define FAD_BT_BUFFER_FADE 32               // Samples over which concealment fades to silence, and playback fades back in
+#define FAD_BT_ASRC_ENABLE 1                // Resample the ring to the headset clock, steered by the fill, so it stays at the target
+#define FAD_BT_ASRC_KP_PPM 10.0f            // Rate correction per sample of fill error; ~10 s to pull the fill back
+#define FAD_BT_ASRC_KI_PPM 0.5f             // Added per second for each sample of remaining error; learns the clock offset
+#define FAD_BT_ASRC_MAX_PPM 2000            // Largest correction around the nominal ratio; crystals are within ~100 ppm
+#define FAD_BT_ASRC_SMOOTHING 64            // Callback reads the fill is averaged over before it steers the rate
+#define FAD_BT_PCM_FRAMES 512               // Ring of converted 16-bit stereo frames the callback copies from, a power of two
+#define FAD_BT_PCM_READY 256                // Frames kept converted ahead of the callback; ~6 ms at 44.1 kHz. Must cover one callback, usually 128
+#define FAD_BT_SBC_PRESET FAD_BT_PRESET_MUSIC // SBC and queue settings fad_bt_init applies, see fad_bt_main.h
+#define FAD_BT_RECONNECT_FIRST_MS 250       // Wait after the first failed connection attempt; doubles with each failure
+#define FAD_BT_RECONNECT_MAX_MS 4000        // Longest wait between attempts
+#define FAD_BT_RECONNECT_ATTEMPTS 8         // Attempts on the stored headset before falling back to discovery
+
+/* Discovery Definitions. Inquiry responses are filtered and ranked in fad_bt_gap.c */
+#define FAD_GAP_INQUIRY_LEN 0x06            // Inquiry length in 1.28 s units; ~7.7 s per round
+#define FAD_GAP_INQUIRY_ROUNDS 3            // Rounds without a candidate before giving up
+#define FAD_GAP_MAX_CANDIDATES 8            // Audio sinks kept per discovery; a full table drops its weakest
+#define FAD_GAP_MIN_RSSI -80                // Weaker audio sinks are ignored; in a busy room they belong to someone else
+#define FAD_GAP_STRONG_RSSI -50             // A sink this strong (within ~1 m) ends the inquiry early...
+#define FAD_GAP_SETTLE_MS 2000              // ...once the inquiry has run this long
+#define FAD_GAP_NAME_LEN 32                 // Longest device name kept; longer ones are cut
+#define FAD_GAP_NAME_CACHE 8                // Names remembered across discoveries, for responses without one
+
+/* Bluetooth Telemetry and Diagnostics Definitions. See fad_bt_telemetry.h and fad_diag.h */
+#define FAD_BT_TELEM_INTERVAL_BINS 32       // Histogram of the time between A2DP data callbacks; the last bin collects outliers
+#define FAD_BT_TELEM_INTERVAL_BIN_US 1000   // Width of one interval bin
+#define FAD_BT_TELEM_LEN_BINS 16            // Histogram of the bytes a callback asks for; the last bin collects outliers
+#define FAD_BT_TELEM_LEN_BIN 128            // Width of one length bin; 32 stereo frames
+#define FAD_BT_TELEM_RSSI_MS 1000           // Period of the RSSI delta reads while a link is up
+#define FAD_DIAG_ENABLE 1                   // Read diagnostics commands from the console UART
+#define FAD_DIAG_LINE_LEN 32                // Longest command line; longer ones are dropped
+
+/* Power Management Definitions. The CPU clock follows the measured load; see fad_power.c */
+#define FAD_POWER_ENABLE 1                  // Scale the CPU clock with the load and light-sleep while no audio runs. Needs CONFIG_PM_ENABLE
+#define FAD_POWER_LIGHT_SLEEP 0             // Allow automatic light sleep while the sample clock is stopped. The console UART wakes the chip, but loses the waking characters
+#define FAD_POWER_MIN_MHZ 40                // CPU clock when nothing holds a lock (XTAL)
+#define FAD_POWER_PERIOD_MS 5000            // How often the governor picks the algorithm clock from the load windows
+#define FAD_POWER_LOAD_LIMIT 700            // Busiest core's load the governor allows, in tenths of a percent
+#define FAD_POWER_HYSTERESIS 100            // Extra margin below the limit before the clock is lowered
+#define FAD_POWER_BATTERY_MAH 1000          // Battery capacity the runtime projections are for
+#define FAD_POWER_BOARD_MA 10               // Current of everything but the ESP32 (amp, mic, regulator losses)
+#define FAD_POWER_RADIO_MA 35               // Average current the BT radio adds while streaming A2DP
 
 
 /* The GPIO assignments. */
@@ -36,6 +157,19 @@
 #define FAD_HS_DETECT_1 GPIO_NUM_32
 #define FAD_HS_DETECT_2 GPIO_NUM_33
 
+// PWM / sigma-delta audio output. Any output-capable pin; keeps DAC1 (GPIO 25) free
+#define FAD_PWM_GPIO GPIO_NUM_27
+
+// I2S codec output. Codecs that need a master clock (MCLK) are not supported; PCM5102-style ones generate it themselves
+#define FAD_I2S_BCK_GPIO GPIO_NUM_26
+#define FAD_I2S_WS_GPIO GPIO_NUM_19
+#define FAD_I2S_DOUT_GPIO GPIO_NUM_18
+
+// Digital mic. CLK is the PDM clock, or BCK for an I2S mic. WS is only used by I2S mics
+#define FAD_MIC_CLK_GPIO GPIO_NUM_23
+#define FAD_MIC_WS_GPIO GPIO_NUM_22
+#define FAD_MIC_DATA_GPIO GPIO_NUM_35
+
 /* Volume button characteristics. Values correspond to gpio_history values */
 #define FAD_VOL_CHANGE_DELAY 10 // Determines how long the button needs to be held before volume begins ramping continuously
 #define FAD_VOL_CHANGE_SLOPE 5 // Determines how quickly (period) the button volume ramps 
@@ -45,9 +179,31 @@
 /* The outupt mode determines whether the device is outputting to physical headset or BT */
 typedef enum {
     FAD_OUTPUT_DAC,
-    FAD_OUTPUT_BT
+    FAD_OUTPUT_BT,
+    FAD_OUTPUT_PWM,     // Physical headset through a PWM or sigma-delta pin, see FAD_PWM_GPIO
+    FAD_OUTPUT_I2S,     // Physical headset through an external 16-bit I2S codec, see FAD_I2S_OUT_PORT
 } fad_output_mode_t;
 
+/* Where the audio input comes from. ADC samples the analog mic in the timer ISR, MIC reads a digital mic over I2S DMA */
+typedef enum {
+    FAD_INPUT_ADC,
+    FAD_INPUT_MIC,
+} fad_input_mode_t;
+
+/* The latency measurement mode. INJECT places an impulse in the ADC stream, LOOPBACK plays a chirp and listens for it */
+typedef enum {
+    FAD_LATENCY_OFF,
+    FAD_LATENCY_INJECT,
+    FAD_LATENCY_LOOPBACK,
+} fad_latency_mode_t;
+
+/* Capture mode. RECORD stores the ADC blocks the algorithm sees, REPLAY feeds a stored capture back through the algorithm */
+typedef enum {
+    FAD_CAPTURE_OFF,
+    FAD_CAPTURE_RECORD,
+    FAD_CAPTURE_REPLAY,
+} fad_capture_mode_t;
+
 
 /* The type of algorithm to be used */
 typedef enum {
@@ -99,6 +255,7 @@ typedef union {
 char *ALGO_TAG;
 
 uint16_t *adc_buffer;
+uint16_t *adc_buffer_ref;   // Reference channel, same positions as adc_buffer. NULL unless FAD_ADC_CHANNELS is 2
 uint8_t *dac_buffer;
 uint16_t adc_buffer_pos;
 uint16_t dac_buffer_pos;
@@ -113,12 +270,13 @@ uint16_t dac_buffer_pos_copy;
  * @brief     algorithm function
  * 
  * @param in_buff Pointer to beginning of ADC buffer (also a global)
+ * @param ref_buff Pointer to beginning of the reference channel, indexed like in_buff, or NULL with one channel
  * @param out_buff [OUT] Pointer to beginning of DAC buffer (also a global)
  * @param in_pos Integer index of algorithm beginning location in ADC buffer
  * @param out_pos Integer index of algorithm beginning location in ADC buffer
  * @param multisamples The number of input samples per output
  */
-typedef void (* algo_func_t) (uint16_t *in_buff, uint8_t *out_buff, uint16_t in_pos, uint16_t out_pos, int multisamples);
+typedef void (* algo_func_t) (uint16_t *in_buff, const uint16_t *ref_buff, uint8_t *out_buff, uint16_t in_pos, uint16_t out_pos, int multisamples);
 
 typedef void (* algo_init_func_t) (fad_algo_init_params_t *params);
 
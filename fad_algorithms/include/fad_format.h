@@ -0,0 +1,56 @@
+/**
+ * fad_format.h
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Output sample formats. The algorithms always write 8-bit unsigned mono at OUTPUT_FREQ into dac_buffer;
+ * each output stage negotiates the format its sink takes and converts whole blocks to it on its own task,
+ * so nothing per-sample is left for the driver or Bluetooth callbacks.
+ */
+
+#ifndef _FAD_FORMAT_H_
+#define _FAD_FORMAT_H_
+
+#include <stdint.h>
+#include "esp_system.h"
+#include "fad_defs.h"
+
+/* Formats an output stage can take */
+typedef enum {
+	FAD_FORMAT_U8,				// 8-bit unsigned mono at OUTPUT_FREQ, as in dac_buffer: the DAC and PWM
+	FAD_FORMAT_S16_MONO,		// 16-bit signed mono at OUTPUT_FREQ: the I2S codec
+	FAD_FORMAT_S16_STEREO,		// 16-bit signed stereo at a multiple of OUTPUT_FREQ: A2DP at 44.1 kHz
+} fad_format_t;
+
+/* What an output stage agreed on */
+typedef struct {
+	fad_format_t format;
+	uint32_t rate_hz;			// Frames per second at the sink
+	uint8_t upsample;			// Frames per dac_buffer sample, each a copy of the last
+	uint8_t frame_bytes;		// Bytes per frame
+} fad_format_desc_t;
+
+/**
+ * @brief Agree on the format for an output
+ * @param mode The output
+ * @param sink_hz The rate the sink runs at; for A2DP the negotiated SBC rate. Ignored by the wired outputs
+ * @param desc [OUT] The format
+ * @return
+ * 		-ESP_OK if successful
+ * 		-ESP_ERR_NOT_SUPPORTED if sink_hz is not a whole multiple of OUTPUT_FREQ
+ */
+esp_err_t fad_format_negotiate(fad_output_mode_t mode, uint32_t sink_hz, fad_format_desc_t *desc);
+
+/**
+ * @brief Convert a block of dac_buffer samples
+ * @param desc The format
+ * @param in dac_buffer samples
+ * @param count Number of samples
+ * @param out [OUT] count * upsample frames; 4-byte aligned for FAD_FORMAT_S16_STEREO, 2-byte for FAD_FORMAT_S16_MONO
+ * @return Bytes written
+ */
+int fad_format_convert(const fad_format_desc_t *desc, const uint8_t *in, int count, void *out);
+
+#endif
@@ -0,0 +1,125 @@
+/**
+ * fad_log.h
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Deferred logging for the audio path. FAD_LOGI_DEFER and friends store a pointer to their call site
+ * (tag, level and constant format string) and up to four raw integer or float arguments in a
+ * lock-free ring, from any task or the ISR, without formatting anything. A low-priority task formats
+ * and prints the lines later through ESP_LOG. Each call site is rate limited to FAD_LOG_RATE_LIMIT
+ * lines per second, and the next line printed from it says how many were suppressed.
+ *
+ * Arguments must be integers (up to 32 bits) or floats; conversions %d %i %u %x %X %c %f %e %g work.
+ * Nothing is printed until fad_log_init has started the task. Log times are when a line is printed,
+ * up to FAD_LOG_FLUSH_MS after the call.
+ */
+
+#ifndef _FAD_LOG_H_
+#define _FAD_LOG_H_
+
+#include <stdint.h>
+#include "esp_system.h"
+#include "esp_log.h"
+#include "fad_defs.h"
+
+#define FAD_LOG_MAX_ARGS 4
+
+/* One raw argument */
+typedef union {
+	int32_t i;
+	float f;
+} fad_log_arg_t;
+
+/* A deferred log call site. The macros make one static instance per call; its address is the format ID. */
+typedef struct {
+	const char *tag;
+	const char *format;
+	esp_log_level_t level;
+	uint32_t window_ms;		// Start of the current rate limit window
+	uint32_t window_count;	// Lines taken in the current window
+	uint32_t suppressed;	// Lines rate limited or dropped since the last one printed
+} fad_log_site_t;
+
+/* Deferred logging counters since boot */
+typedef struct {
+	uint32_t written;		// Lines queued
+	uint32_t printed;		// Lines formatted and printed
+	uint32_t rate_limited;	// Lines refused by a call site's rate limit
+	uint32_t ring_full;		// Lines dropped because the ring was full
+	uint32_t high_water;	// Most lines waiting in the ring at once
+} fad_log_stats_t;
+
+/**
+ * @brief Start the task that prints deferred lines
+ * @return
+ * 		-ESP_OK if successful
+ * 		-ESP_FAIL if the task could not be created
+ */
+esp_err_t fad_log_init(void);
+
+/**
+ * @brief Queue a line. Safe from the ISR and from any task. Use the macros below.
+ * @param site The call site
+ * @param args The raw arguments
+ * @param nargs Number of arguments, at most FAD_LOG_MAX_ARGS
+ */
+void IRAM_ATTR fad_log_write(fad_log_site_t *site, const fad_log_arg_t *args, int nargs);
+
+/**
+ * @brief Print every queued line now, from the calling task
+ */
+void fad_log_flush(void);
+
+/**
+ * @brief Copy out the counters
+ * @param stats [OUT] Destination for the counters
+ */
+void fad_log_get_stats(fad_log_stats_t *stats);
+
+/**
+ * @brief Log the counters
+ */
+void fad_log_report(void);
+
+static inline fad_log_arg_t fad_log_arg_int(int32_t v)
+{
+	fad_log_arg_t a;
+	a.i = v;
+	return a;
+}
+
+static inline fad_log_arg_t fad_log_arg_float(float v)
+{
+	fad_log_arg_t a;
+	a.f = v;
+	return a;
+}
+
+#define FAD_LOG_ARG(x) _Generic((x), float: fad_log_arg_float, double: fad_log_arg_float, default: fad_log_arg_int)(x)
+
+#define FAD_LOG_COUNT(...) FAD_LOG_COUNT_(__VA_ARGS__, 4, 3, 2, 1, 0)
+#define FAD_LOG_COUNT_(a, b, c, d, n, ...) n
+#define FAD_LOG_CAT(a, b) FAD_LOG_CAT_(a, b)
+#define FAD_LOG_CAT_(a, b) a##b
+#define FAD_LOG_ARGS_1(a) FAD_LOG_ARG(a)
+#define FAD_LOG_ARGS_2(a, b) FAD_LOG_ARG(a), FAD_LOG_ARG(b)
+#define FAD_LOG_ARGS_3(a, b, c) FAD_LOG_ARG(a), FAD_LOG_ARG(b), FAD_LOG_ARG(c)
+#define FAD_LOG_ARGS_4(a, b, c, d) FAD_LOG_ARG(a), FAD_LOG_ARG(b), FAD_LOG_ARG(c), FAD_LOG_ARG(d)
+
+/* Queue a line with one to four arguments */
+#define FAD_LOG_DEFER(lvl_, tag_, fmt_, ...) do {											\
+		static fad_log_site_t fad_log_site_ = { NULL, (fmt_), (lvl_), 0, 0, 0 };			\
+		fad_log_site_.tag = (tag_); /* tags are often static variables, not constants */	\
+		const fad_log_arg_t fad_log_args_[] = {												\
+			FAD_LOG_CAT(FAD_LOG_ARGS_, FAD_LOG_COUNT(__VA_ARGS__))(__VA_ARGS__) };			\
+		fad_log_write(&fad_log_site_, fad_log_args_, FAD_LOG_COUNT(__VA_ARGS__));			\
+	} while (0)
+
+#define FAD_LOGE_DEFER(tag, fmt, ...) FAD_LOG_DEFER(ESP_LOG_ERROR, tag, fmt, __VA_ARGS__)
+#define FAD_LOGW_DEFER(tag, fmt, ...) FAD_LOG_DEFER(ESP_LOG_WARN, tag, fmt, __VA_ARGS__)
+#define FAD_LOGI_DEFER(tag, fmt, ...) FAD_LOG_DEFER(ESP_LOG_INFO, tag, fmt, __VA_ARGS__)
+#define FAD_LOGD_DEFER(tag, fmt, ...) FAD_LOG_DEFER(ESP_LOG_DEBUG, tag, fmt, __VA_ARGS__)
+
+#endif
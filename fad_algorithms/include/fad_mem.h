@@ -0,0 +1,153 @@
+/**
+ * fad_mem.h
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Static memory plan for the audio path. Every audio buffer is a region in the plan in fad_mem.c, sized
+ * from fad_defs.h, and fad_mem_init reserves all of them in one go at boot. After that nothing in the
+ * audio path calls malloc or free, so it cannot fail for lack of memory or fragment the heap mid-stream.
+ *
+ * Each region has a placement. FAST regions live in internal DRAM, next to the IRAM code that touches
+ * them from the ISR. BULK regions go to PSRAM when the board has it and fall back to internal DRAM.
+ *
+ * The active algorithm gets one scratch region. It carves its delay lines, FFT plans and so on out of it
+ * with fad_mem_algo_alloc in its init function; the app calls fad_mem_algo_reset before each algorithm
+ * change, which hands the whole region to the next algorithm. Algorithms never free anything.
+ *
+ * The module also keeps the memory footprint by subsystem: the regions, each algorithm's share of the
+ * scratch region, the stack of every task registered with fad_mem_track_task, heap taken by subsystems
+ * that allocate for themselves (the BT stack) and the heap low-water marks. fad_mem_report logs it;
+ * fad_mem_dump prints it as CSV for uart_tester/tools/mem_tools.py, which diffs two runs and attributes
+ * a build's static IRAM and DRAM to the same subsystems from its linker map.
+ */
+
+#ifndef _FAD_MEM_H_
+#define _FAD_MEM_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "fad_defs.h"
+
+/* Where a region is placed */
+typedef enum {
+	FAD_MEM_FAST,		// Internal DRAM
+	FAD_MEM_BULK,		// PSRAM when fitted, else internal DRAM
+	FAD_MEM_PLACE_MAX,
+} fad_mem_place_t;
+
+/* Regions in the memory plan */
+typedef enum {
+	FAD_MEM_ADC,		// adc_buffer, written by the sample ISR
+	FAD_MEM_ADC_REF,	// adc_buffer_ref. Empty unless FAD_ADC_CHANNELS is 2
+	FAD_MEM_DAC,		// dac_buffer, read by the sample ISR
+	FAD_MEM_ALGO,		// Scratch for the active algorithm, see fad_mem_algo_alloc
+	FAD_MEM_TRACE,		// Event trace ring. Empty unless FAD_TRACE_ENABLE
+	FAD_MEM_BT,			// Jitter buffer between the sample ISR and the A2DP callback, then its PCM ring
+	FAD_MEM_CAPTURE,	// On-device capture store. Optional
+	FAD_MEM_REGION_MAX,
+} fad_mem_region_t;
+
+#define FAD_MEM_BIT(region) (1u << (region))
+
+/* Kinds of footprint entry. The meaning of size and peak depends on the kind */
+typedef enum {
+	FAD_MEM_USE_REGION,		// A plan region. size: bytes reserved, peak: the same
+	FAD_MEM_USE_SCRATCH,	// One algorithm. size: the scratch region, peak: most the algorithm took from it
+	FAD_MEM_USE_STACK,		// A tracked task. size: its stack, peak: most of it ever used
+	FAD_MEM_USE_HEAP,		// A subsystem's own allocations. size and peak: heap it took while starting
+	FAD_MEM_USE_FREE,		// A heap. size: free now, peak: least free since boot
+	FAD_MEM_USE_MAX,
+} fad_mem_use_t;
+
+/* One footprint entry */
+typedef struct {
+	fad_mem_use_t kind;
+	const char *name;
+	uint32_t size;
+	uint32_t peak;
+} fad_mem_usage_t;
+
+/**
+ * @brief Reserve every region in the plan. Call once at boot, before anything uses a region.
+ * @param optional FAD_MEM_BIT of each optional region to reserve as well; the others stay empty
+ * @return
+ * 		-ESP_OK if successful
+ * 		-ESP_ERR_NO_MEM if the plan does not fit. Nothing is reserved
+ */
+esp_err_t fad_mem_init(uint32_t optional);
+
+/**
+ * @brief Get a region reserved by fad_mem_init. Its memory is zeroed at boot and never moves.
+ * @param region The region
+ * @param size [OUT] Size of the region in bytes, 0 if it is empty. May be NULL
+ * @return Start of the region, or NULL if it is empty or fad_mem_init has not run
+ */
+void *fad_mem_region(fad_mem_region_t region, size_t *size);
+
+/**
+ * @brief Take memory from the algorithm scratch region, FAD_MEM_ALIGN aligned. Not thread safe:
+ * call from an algorithm's init function, which runs on the app task.
+ * @param size Bytes needed
+ * @return The memory, or NULL (with an error logged) if the scratch region is too small for it
+ */
+void *fad_mem_algo_alloc(size_t size);
+
+/**
+ * @brief Hand the whole scratch region back, for the next algorithm. Call after the old algorithm's deinit.
+ * @param next The algorithm about to be initialized; what it takes is charged to it in the footprint
+ */
+void fad_mem_algo_reset(fad_algo_type_t next);
+
+/**
+ * @brief Add a task to the footprint. Registering a name again replaces the old entry.
+ * @param task The task
+ * @param name Name to report it under; must stay valid
+ * @param stack_size Stack size the task was created with, in bytes
+ */
+void fad_mem_track_task(TaskHandle_t task, const char *name, uint32_t stack_size);
+
+/**
+ * @brief Take a task's final stack reading and stop querying it. Call before the task deletes itself.
+ * @param task The task
+ */
+void fad_mem_untrack_task(TaskHandle_t task);
+
+/**
+ * @brief Get the free internal heap, to pass to fad_mem_heap_charge once a subsystem has started
+ * @return Free internal heap in bytes
+ */
+size_t fad_mem_heap_free(void);
+
+/**
+ * @brief Charge a subsystem with the heap it allocated while starting
+ * @param name Name to report it under; must stay valid
+ * @param free_before fad_mem_heap_free from just before the subsystem started
+ */
+void fad_mem_heap_charge(const char *name, size_t free_before);
+
+/**
+ * @brief Copy out the footprint
+ * @param out [OUT] Entries, in the order listed in fad_mem_use_t
+ * @param max Room in out
+ * @return Number of entries written
+ */
+int fad_mem_get_usage(fad_mem_usage_t *out, int max);
+
+/**
+ * @brief Log the footprint
+ */
+void fad_mem_report(void);
+
+/**
+ * @brief Print the footprint as CSV (kind,name,size,peak) between "FMEM-BEGIN" and "FMEM-END" lines
+ * @param out Where to print it: stdout on the device, a file on the host
+ */
+void fad_mem_dump(FILE *out);
+
+#endif
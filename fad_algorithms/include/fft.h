@@ -63,6 +63,7 @@ typedef struct
   unsigned int flags; // FFT flags
 } fft_config_t;
 
+/* Memory comes from the algorithm scratch region (fad_mem.h): call from an algorithm's init function */
 fft_config_t *fft_init(int size, fft_type_t type, fft_direction_t direction, float *input, float *output);
 void fft_destroy(fft_config_t *config);
 void fft_execute(fft_config_t *config);
@@ -0,0 +1,73 @@
+/**
+ * fad_bt_host.c
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Stand-ins for fad_bt_main.c and fad_bt_gap.c. The host has no radio, so the simulated firmware
+ * always takes the wired (DAC) output path; these only log if the BT path is reached anyway.
+ */
+
+#include <string.h>
+#include "esp_log.h"
+
+#include "main.h"
+#include "fad_bt_main.h"
+#include "fad_bt_gap.h"
+
+#define BT_HOST_TAG "BT_HOST"
+
+void fad_bt_init()
+{
+	ESP_LOGW(BT_HOST_TAG, "Bluetooth is not simulated");
+}
+
+esp_err_t fad_bt_start(const uint8_t *peer_addr)
+{
+	ESP_LOGW(BT_HOST_TAG, "Bluetooth is not simulated, not starting");
+	return ESP_ERR_NOT_SUPPORTED;
+}
+
+void fad_bt_connect(esp_bd_addr_t peer_addr)
+{
+	ESP_LOGW(BT_HOST_TAG, "Bluetooth is not simulated, not connecting");
+}
+
+void fad_bt_report(void)
+{
+}
+
+void fad_bt_stack_evt_handler(uint16_t event, void *param)
+{
+	ESP_LOGW(BT_HOST_TAG, "Bluetooth is not simulated, dropping event %d", event);
+}
+
+esp_err_t fad_gap_start_discovery()
+{
+	ESP_LOGW(BT_HOST_TAG, "Bluetooth is not simulated, no discovery");
+	return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t fad_gap_read_rssi(esp_bd_addr_t bda)
+{
+	return ESP_ERR_NOT_SUPPORTED;
+}
+
+int fad_gap_get_candidates(fad_gap_candidate_t *candidates, int max)
+{
+	return 0;
+}
+
+void fad_gap_get_stats(fad_gap_stats_t *stats)
+{
+	memset(stats, 0, sizeof(fad_gap_stats_t));
+}
+
+void fad_gap_connect_failed(const esp_bd_addr_t bda)
+{
+}
+
+void fad_gap_connected(void)
+{
+}
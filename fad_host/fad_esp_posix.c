@@ -0,0 +1,219 @@
+/**
+ * fad_esp_posix.c
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Host versions of the small ESP-IDF services the firmware uses: logging, error names,
+ * random numbers, GPIO, the UART and NVS.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "driver/gpio.h"
+#include "driver/uart.h"
+#include "fad_host.h"
+
+#define NVS_MAX_ENTRIES 32
+#define NVS_KEY_LEN 16
+#define NVS_MAX_NAMESPACES 8
+
+typedef struct {
+	nvs_handle_t ns;
+	char key[NVS_KEY_LEN];
+	uint64_t value;
+} nvs_entry_t;
+
+static esp_log_level_t s_log_level = ESP_LOG_INFO;
+static uint32_t s_random_state = 0x2545f491;
+static uint64_t s_gpio_pull_up = 0;
+static nvs_entry_t s_nvs[NVS_MAX_ENTRIES];
+static int s_nvs_count = 0;
+static char s_namespaces[NVS_MAX_NAMESPACES][NVS_KEY_LEN];
+static int s_namespace_count = 0;
+
+void fad_host_log_set_level(esp_log_level_t level)
+{
+	s_log_level = level;
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+	if (strcmp(tag, "*") == 0)
+		s_log_level = level;
+}
+
+uint32_t esp_log_timestamp(void)
+{
+	return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+	static const char letters[] = "NEWIDV";
+	if (level > s_log_level)
+		return;
+
+	fprintf(stderr, "%c (%u) %s: ", letters[level], esp_log_timestamp(), tag);
+	va_list args;
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	fputc('\n', stderr);
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+	switch (code)
+	{
+	case ESP_OK: return "ESP_OK";
+	case ESP_FAIL: return "ESP_FAIL";
+	case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+	case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+	case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+	case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+	case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+	case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+	case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+	case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+	default: return "UNKNOWN ERROR";
+	}
+}
+
+/* xorshift32 with a fixed seed */
+uint32_t esp_random(void)
+{
+	s_random_state ^= s_random_state << 13;
+	s_random_state ^= s_random_state >> 17;
+	s_random_state ^= s_random_state << 5;
+	return s_random_state;
+}
+
+void esp_restart(void)
+{
+	fprintf(stderr, "esp_restart called, exiting\n");
+	exit(1);
+}
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+	if (config->pull_up_en)
+		s_gpio_pull_up |= config->pin_bit_mask;
+	else
+		s_gpio_pull_up &= ~config->pin_bit_mask;
+	return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+	return (s_gpio_pull_up >> gpio_num) & 1;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+	return ESP_OK;
+}
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size, int queue_size,
+							  QueueHandle_t *uart_queue, int intr_alloc_flags)
+{
+	return ESP_ERR_NOT_SUPPORTED; // no console input on the host
+}
+
+int uart_read_bytes(uart_port_t uart_num, uint8_t *buf, uint32_t length, TickType_t ticks_to_wait)
+{
+	return 0;
+}
+
+esp_err_t uart_set_wakeup_threshold(uart_port_t uart_num, int wakeup_threshold)
+{
+	return ESP_OK;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+	return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+	s_nvs_count = 0;
+	return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+	for (int i = 0; i < s_namespace_count; i++)
+	{
+		if (strncmp(s_namespaces[i], name, NVS_KEY_LEN - 1) == 0)
+		{
+			*out_handle = i + 1;
+			return ESP_OK;
+		}
+	}
+
+	if (open_mode == NVS_READONLY)
+		return ESP_ERR_NVS_NOT_FOUND;
+	if (s_namespace_count == NVS_MAX_NAMESPACES)
+		return ESP_ERR_NO_MEM;
+
+	strncpy(s_namespaces[s_namespace_count], name, NVS_KEY_LEN - 1);
+	*out_handle = ++s_namespace_count;
+	return ESP_OK;
+}
+
+static nvs_entry_t *nvs_find(nvs_handle_t handle, const char *key)
+{
+	for (int i = 0; i < s_nvs_count; i++)
+	{
+		if (s_nvs[i].ns == handle && strncmp(s_nvs[i].key, key, NVS_KEY_LEN - 1) == 0)
+			return &s_nvs[i];
+	}
+	return NULL;
+}
+
+esp_err_t nvs_set_u64(nvs_handle_t handle, const char *key, uint64_t value)
+{
+	if (handle == 0)
+		return ESP_ERR_INVALID_ARG;
+
+	nvs_entry_t *entry = nvs_find(handle, key);
+	if (entry == NULL)
+	{
+		if (s_nvs_count == NVS_MAX_ENTRIES)
+			return ESP_ERR_NO_MEM;
+		entry = &s_nvs[s_nvs_count++];
+		entry->ns = handle;
+		strncpy(entry->key, key, NVS_KEY_LEN - 1);
+	}
+	entry->value = value;
+	return ESP_OK;
+}
+
+esp_err_t nvs_get_u64(nvs_handle_t handle, const char *key, uint64_t *out_value)
+{
+	nvs_entry_t *entry = nvs_find(handle, key);
+	if (entry == NULL)
+		return ESP_ERR_NVS_NOT_FOUND;
+
+	*out_value = entry->value;
+	return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+	return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
@@ -0,0 +1,643 @@
+/**
+ * fad_hal_posix.c
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Host implementation of fad_hal.h. The sample clock is a loop in the host main thread: for every
+ * sample period it lets the RTOS run to idle, then plays the timer interrupt with the next input
+ * sample on the ADC (a stereo WAV's second channel on ADC_CHANNEL_REF), and records whatever the DAC
+ * (or the PWM pin, once set up) holds afterwards.
+ * The I2S codec is a queue of FAD_I2S_DMA_BUF_COUNT * FAD_I2S_DMA_BUF_LEN samples drained at OUTPUT_FREQ
+ * by the same clock; what it plays replaces the DAC in the output file and can go to its own 16-bit file.
+ * The digital mic is a queue of the same shape filled with the input samples, widened to 16 bit, while
+ * the timer runs; a full queue drops new samples like the DMA does. Simulated time is counted in
+ * samples, so a run is as fast as the host can compute it and gives the same output every time.
+ *
+ * fad_hal_cycles counts simulated nanoseconds plus the wall-clock time spent in the current
+ * sample period. Interval measurements (jitter) therefore see the ideal clock, and cost
+ * measurements (perf) see the real host cost.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "hal/adc_types.h"
+
+#include "fad_defs.h"
+#include "fad_hal.h"
+#include "fad_host.h"
+
+#define HAL_TAG "HOST_HAL"
+#define SIM_CPU_HZ 1000000000 // fad_hal_cycles runs in nanoseconds
+#define ADC_MAX 4095
+#define ADC_MID 2048
+#define DAC_MID 128
+#define LOOPBACK_MAX_DELAY 65536
+#define WAV_HEADER_SIZE 44
+#define I2S_QUEUE_SIZE (FAD_I2S_DMA_BUF_COUNT * FAD_I2S_DMA_BUF_LEN)
+#define MIC_QUEUE_SIZE (FAD_MIC_DMA_BUF_COUNT * FAD_MIC_DMA_BUF_LEN * FAD_ADC_CHANNELS)
+
+typedef enum {
+	INPUT_SILENCE,
+	INPUT_RAW_U12,	// little-endian uint16 ADC codes
+	INPUT_WAV_S16,
+	INPUT_WAV_U8,
+} input_format_t;
+
+static fad_host_config_t s_config;
+static FILE *s_input = NULL;
+static input_format_t s_input_format = INPUT_SILENCE;
+static int s_input_channels = 1;
+static FILE *s_output = NULL;
+static bool s_output_wav = false;
+
+static fad_hal_isr_t s_isr = NULL;
+static volatile bool s_timer_running = false;
+static volatile uint64_t s_sim_samples = 0;	// simulated time, in sample periods
+static uint64_t s_io_samples = 0;
+static TickType_t s_sim_ticks = 0;
+static int64_t s_period_start_ns = 0;		// wall clock at the start of the current sample period
+
+static int s_adc_value = ADC_MID;
+static int s_ref_value = ADC_MID; // ADC_CHANNEL_REF, with FAD_ADC_CHANNELS 2
+static uint8_t s_dac_value[DAC_CHANNEL_MAX] = {DAC_MID, DAC_MID};
+static bool s_pwm_enabled = false;
+static int s_pwm_bits = 8;
+static uint8_t s_pwm_level = DAC_MID; // PWM duty as the 8-bit level the RC filter settles to
+static bool s_i2s_enabled = false;
+static int16_t s_i2s_queue[I2S_QUEUE_SIZE]; // the DMA buffers
+static int s_i2s_head = 0;
+static int s_i2s_count = 0;
+static int s_i2s_phase = 0;				 // ADC samples into the current codec frame
+static uint8_t s_i2s_level = DAC_MID;	 // codec output as an 8-bit level, for the output file and loopback
+static FILE *s_i2s_file = NULL;
+static bool s_i2s_wav = false;
+static uint64_t s_i2s_frames = 0;
+static uint64_t s_i2s_underruns = 0;
+static bool s_mic_enabled = false;
+static int16_t s_mic_queue[MIC_QUEUE_SIZE]; // the DMA buffers
+static int s_mic_head = 0;
+static int s_mic_count = 0;
+static uint64_t s_mic_overflows = 0;
+static uint8_t *s_loopback = NULL;
+static uint32_t s_loopback_pos = 0;
+
+static int64_t wall_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static uint32_t read_le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t read_le16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static void write_le32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static void write_le16(uint8_t *p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+/* Walk the RIFF chunks up to the start of the sample data */
+static esp_err_t open_wav(FILE *f)
+{
+	uint8_t header[12];
+	if (fread(header, 1, 12, f) != 12 || memcmp(header, "RIFF", 4) || memcmp(header + 8, "WAVE", 4))
+		return ESP_ERR_NOT_SUPPORTED;
+
+	bool have_fmt = false;
+	for (;;)
+	{
+		uint8_t chunk[8];
+		if (fread(chunk, 1, 8, f) != 8)
+			return ESP_ERR_NOT_SUPPORTED;
+		uint32_t size = read_le32(chunk + 4);
+
+		if (memcmp(chunk, "fmt ", 4) == 0)
+		{
+			uint8_t fmt[16];
+			if (size < 16 || fread(fmt, 1, 16, f) != 16)
+				return ESP_ERR_NOT_SUPPORTED;
+			fseek(f, size - 16 + (size & 1), SEEK_CUR);
+
+			uint16_t format = read_le16(fmt);
+			uint16_t bits = read_le16(fmt + 14);
+			uint32_t rate = read_le32(fmt + 4);
+			s_input_channels = read_le16(fmt + 2);
+			if (format != 1 || (bits != 16 && bits != 8) || s_input_channels < 1)
+				return ESP_ERR_NOT_SUPPORTED;
+			if (rate != ALARM_FREQ)
+				ESP_LOGW(HAL_TAG, "Input is %u Hz, played at %d Hz without resampling", rate, ALARM_FREQ);
+
+			s_input_format = (bits == 16) ? INPUT_WAV_S16 : INPUT_WAV_U8;
+			have_fmt = true;
+		}
+		else if (memcmp(chunk, "data", 4) == 0)
+		{
+			return have_fmt ? ESP_OK : ESP_ERR_NOT_SUPPORTED;
+		}
+		else
+		{
+			fseek(f, size + (size & 1), SEEK_CUR);
+		}
+	}
+}
+
+static bool has_suffix(const char *name, const char *suffix)
+{
+	size_t n = strlen(name), s = strlen(suffix);
+	return n >= s && strcmp(name + n - s, suffix) == 0;
+}
+
+esp_err_t fad_host_hal_open(const fad_host_config_t *config)
+{
+	s_config = *config;
+
+	if (config->input_path == NULL)
+	{
+		s_input_format = INPUT_SILENCE;
+	}
+	else if (strcmp(config->input_path, "-") == 0)
+	{
+		s_input = stdin;
+		s_input_format = INPUT_RAW_U12;
+	}
+	else
+	{
+		s_input = fopen(config->input_path, "rb");
+		if (s_input == NULL)
+		{
+			ESP_LOGE(HAL_TAG, "Cannot open input %s", config->input_path);
+			return ESP_ERR_NOT_FOUND;
+		}
+
+		s_input_format = INPUT_RAW_U12;
+		if (has_suffix(config->input_path, ".wav"))
+		{
+			esp_err_t err = open_wav(s_input);
+			if (err)
+			{
+				ESP_LOGE(HAL_TAG, "%s is not a mono or stereo 8/16-bit PCM WAV", config->input_path);
+				return err;
+			}
+		}
+	}
+
+	if (config->output_path != NULL)
+	{
+		s_output = (strcmp(config->output_path, "-") == 0) ? stdout : fopen(config->output_path, "wb");
+		if (s_output == NULL)
+		{
+			ESP_LOGE(HAL_TAG, "Cannot open output %s", config->output_path);
+			return ESP_ERR_NOT_FOUND;
+		}
+
+		s_output_wav = has_suffix(config->output_path, ".wav");
+		if (s_output_wav)
+		{
+			uint8_t header[WAV_HEADER_SIZE] = {0}; // sizes are filled in on close
+			fwrite(header, 1, sizeof(header), s_output);
+		}
+	}
+
+	if (config->i2s_path != NULL)
+	{
+		s_i2s_file = fopen(config->i2s_path, "wb");
+		if (s_i2s_file == NULL)
+		{
+			ESP_LOGE(HAL_TAG, "Cannot open I2S output %s", config->i2s_path);
+			return ESP_ERR_NOT_FOUND;
+		}
+
+		s_i2s_wav = has_suffix(config->i2s_path, ".wav");
+		if (s_i2s_wav)
+		{
+			uint8_t header[WAV_HEADER_SIZE] = {0}; // sizes are filled in on close
+			fwrite(header, 1, sizeof(header), s_i2s_file);
+		}
+	}
+
+	if (config->loopback_delay > 0)
+	{
+		if (config->loopback_delay > LOOPBACK_MAX_DELAY)
+			return ESP_ERR_INVALID_ARG;
+		s_loopback = malloc(config->loopback_delay);
+		if (s_loopback == NULL)
+			return ESP_ERR_NO_MEM;
+		memset(s_loopback, DAC_MID, config->loopback_delay);
+	}
+
+	return ESP_OK;
+}
+
+/* Fetch the next input value as a 12-bit ADC code, and the reference channel's: the second channel
+ * of a WAV input, else the same value. Returns false at the end of the input. */
+static bool next_input(int *value, int *ref)
+{
+	switch (s_input_format)
+	{
+	case INPUT_SILENCE:
+		*value = *ref = ADC_MID;
+		return true;
+
+	case INPUT_RAW_U12:
+	{
+		uint8_t b[2];
+		if (fread(b, 1, 2, s_input) != 2)
+			return false;
+		*value = *ref = read_le16(b) & ADC_MAX;
+		return true;
+	}
+
+	case INPUT_WAV_S16:
+	{
+		uint8_t b[2 * 8];
+		int bytes = 2 * (s_input_channels < 8 ? s_input_channels : 8);
+		if (fread(b, 1, bytes, s_input) != (size_t)bytes)
+			return false;
+		if (s_input_channels > 8)
+			fseek(s_input, 2 * (s_input_channels - 8), SEEK_CUR);
+		*value = ((int16_t)read_le16(b) >> 4) + ADC_MID;
+		*ref = (s_input_channels > 1) ? ((int16_t)read_le16(b + 2) >> 4) + ADC_MID : *value;
+		return true;
+	}
+
+	case INPUT_WAV_U8:
+	{
+		uint8_t b[8];
+		int bytes = s_input_channels < 8 ? s_input_channels : 8;
+		if (fread(b, 1, bytes, s_input) != (size_t)bytes)
+			return false;
+		if (s_input_channels > 8)
+			fseek(s_input, s_input_channels - 8, SEEK_CUR);
+		*value = b[0] << 4;
+		*ref = (s_input_channels > 1) ? b[1] << 4 : *value;
+		return true;
+	}
+	}
+	return false;
+}
+
+/* What the headset hears: the codec or the PWM pin once set up, else DAC1 */
+static uint8_t output_level(void)
+{
+	if (s_i2s_enabled)
+		return s_i2s_level;
+	return s_pwm_enabled ? s_pwm_level : s_dac_value[DAC_CHANNEL_1];
+}
+
+/* One sample period of the codec clock: play the next queued frame, or silence if the queue ran dry */
+static void i2s_clock(void)
+{
+	if (!s_i2s_enabled || ++s_i2s_phase < MULTISAMPLES)
+		return;
+	s_i2s_phase = 0;
+
+	int16_t sample = 0;
+	if (s_i2s_count > 0)
+	{
+		sample = s_i2s_queue[s_i2s_head];
+		s_i2s_head = (s_i2s_head + 1) % I2S_QUEUE_SIZE;
+		s_i2s_count--;
+	}
+	else
+	{
+		s_i2s_underruns++;
+	}
+
+	s_i2s_level = (uint8_t)((sample >> 8) + DAC_MID);
+	s_i2s_frames++;
+	if (s_i2s_file)
+	{
+		uint8_t b[2] = {(uint8_t)sample, (uint8_t)(sample >> 8)};
+		fwrite(b, 1, 2, s_i2s_file);
+	}
+}
+
+/* The acoustic path from the DAC back into the mic, a pure delay */
+static int apply_loopback(int value)
+{
+	if (s_loopback == NULL)
+		return value;
+
+	int fed_back = s_loopback[s_loopback_pos];
+	s_loopback[s_loopback_pos] = output_level();
+	s_loopback_pos = (s_loopback_pos + 1) % s_config.loopback_delay;
+
+	value += (int)lroundf((fed_back - DAC_MID) * s_config.loopback_gain);
+	return value < 0 ? 0 : value > ADC_MAX ? ADC_MAX : value;
+}
+
+/* Receive one mic frame into DMA */
+static void mic_clock(int value, int ref)
+{
+	if (!s_mic_enabled)
+		return;
+	if (s_mic_count == MIC_QUEUE_SIZE)
+	{
+		s_mic_overflows++;
+		return;
+	}
+	s_mic_queue[(s_mic_head + s_mic_count++) % MIC_QUEUE_SIZE] = (int16_t)((value - ADC_MID) << 4);
+	if (FAD_ADC_CHANNELS > 1)
+		s_mic_queue[(s_mic_head + s_mic_count++) % MIC_QUEUE_SIZE] = (int16_t)((ref - ADC_MID) << 4);
+}
+
+void fad_host_hal_run(void)
+{
+	uint64_t limit = (uint64_t)(s_config.max_seconds * ALARM_FREQ);
+	int64_t start_ns = wall_ns();
+
+	for (;;)
+	{
+		fad_rtos_run_until_idle();
+
+		if (limit && s_sim_samples >= limit)
+			break;
+		if (s_config.finished != NULL && s_config.finished())
+			break;
+
+		if (s_timer_running && s_isr != NULL)
+		{
+			int value, ref;
+			if (!next_input(&value, &ref))
+				break;
+			s_adc_value = apply_loopback(value);
+			s_ref_value = ref;
+			mic_clock(s_adc_value, s_ref_value);
+
+			s_sim_samples++;
+			s_period_start_ns = wall_ns();
+			s_isr(NULL);
+			i2s_clock();
+
+			if (s_output)
+				fputc(output_level(), s_output);
+			s_io_samples++;
+		}
+		else
+		{
+			s_period_start_ns = wall_ns();
+			s_sim_samples++;
+			i2s_clock();
+		}
+
+		TickType_t ticks = s_sim_samples * configTICK_RATE_HZ / ALARM_FREQ;
+		while (s_sim_ticks != ticks)
+		{
+			s_sim_ticks++;
+			fad_rtos_tick();
+		}
+
+		if (s_config.realtime)
+		{
+			int64_t due_ns = start_ns + (int64_t)(s_sim_samples * 1000000000ULL / ALARM_FREQ);
+			int64_t ahead_ns = due_ns - wall_ns();
+			if (ahead_ns > 1000000) // sleep in ms steps, the loop catches up in between
+			{
+				struct timespec ts = {ahead_ns / 1000000000LL, ahead_ns % 1000000000LL};
+				nanosleep(&ts, NULL);
+			}
+		}
+	}
+
+	fad_rtos_run_until_idle();
+}
+
+/* Fill in the header reserved at the start of a mono WAV file */
+static void finish_wav(FILE *f, uint32_t rate, int bits, uint32_t frames)
+{
+	uint32_t data_size = frames * (bits / 8);
+	uint8_t header[WAV_HEADER_SIZE];
+	memcpy(header, "RIFF", 4);
+	write_le32(header + 4, 36 + data_size);
+	memcpy(header + 8, "WAVEfmt ", 8);
+	write_le32(header + 16, 16);
+	write_le16(header + 20, 1);					// PCM
+	write_le16(header + 22, 1);					// mono
+	write_le32(header + 24, rate);
+	write_le32(header + 28, rate * (bits / 8)); // byte rate
+	write_le16(header + 32, bits / 8);			// block align
+	write_le16(header + 34, bits);
+	memcpy(header + 36, "data", 4);
+	write_le32(header + 40, data_size);
+	fseek(f, 0, SEEK_SET);
+	fwrite(header, 1, sizeof(header), f);
+}
+
+void fad_host_hal_close(void)
+{
+	if (s_output && s_output_wav && s_output != stdout)
+		finish_wav(s_output, ALARM_FREQ, 8, s_io_samples); // unsigned 8 bit, same as the DAC
+
+	if (s_i2s_file)
+	{
+		if (s_i2s_wav)
+			finish_wav(s_i2s_file, OUTPUT_FREQ, 16, s_i2s_frames);
+		fclose(s_i2s_file);
+		s_i2s_file = NULL;
+	}
+
+	if (s_output && s_output != stdout)
+		fclose(s_output);
+	else if (s_output)
+		fflush(s_output);
+	if (s_input && s_input != stdin)
+		fclose(s_input);
+
+	s_output = NULL;
+	s_input = NULL;
+}
+
+uint64_t fad_host_sim_samples(void)
+{
+	return s_sim_samples;
+}
+
+uint64_t fad_host_io_samples(void)
+{
+	return s_io_samples;
+}
+
+uint64_t fad_host_mic_overflows(void)
+{
+	return s_mic_overflows;
+}
+
+void fad_host_i2s_counts(uint64_t *frames, uint64_t *underruns)
+{
+	*frames = s_i2s_frames;
+	*underruns = s_i2s_underruns;
+}
+
+esp_err_t fad_hal_timer_init(fad_hal_isr_t isr)
+{
+	s_isr = isr;
+	s_timer_running = false;
+	return ESP_OK;
+}
+
+esp_err_t fad_hal_timer_start(void)
+{
+	s_timer_running = true;
+	return ESP_OK;
+}
+
+void fad_hal_timer_pause(void)
+{
+	s_timer_running = false;
+}
+
+void fad_hal_timer_isr_enter(void)
+{
+}
+
+void fad_hal_timer_isr_exit(void)
+{
+}
+
+double fad_hal_timer_configured_rate(void)
+{
+	return ALARM_FREQ;
+}
+
+esp_err_t fad_hal_adc_init(int channel)
+{
+	return ESP_OK;
+}
+
+int fad_hal_adc_read_fast(int channel)
+{
+	return (FAD_ADC_CHANNELS > 1 && channel == ADC_CHANNEL_REF) ? s_ref_value : s_adc_value;
+}
+
+int fad_hal_adc_read_driver(int channel)
+{
+	return (FAD_ADC_CHANNELS > 1 && channel == ADC_CHANNEL_REF) ? s_ref_value : s_adc_value;
+}
+
+uint32_t fad_hal_adc_poll_timeouts(void)
+{
+	return 0;
+}
+
+esp_err_t fad_hal_dac_setup(dac_channel_t channel)
+{
+	if (channel >= DAC_CHANNEL_MAX)
+		return ESP_ERR_INVALID_ARG;
+
+	s_dac_value[channel] = DAC_MID;
+	return ESP_OK;
+}
+
+void fad_hal_dac_write_fast(dac_channel_t channel, uint8_t value)
+{
+	s_dac_value[channel] = value;
+}
+
+void fad_hal_dac_write_driver(dac_channel_t channel, uint8_t value)
+{
+	s_dac_value[channel] = value;
+}
+
+esp_err_t fad_hal_pwm_setup(int gpio, int bits, bool sigma_delta)
+{
+	if (bits < 1 || bits > 16 || (sigma_delta && bits != 8))
+		return ESP_ERR_INVALID_ARG;
+
+	s_pwm_bits = bits;
+	s_pwm_level = DAC_MID;
+	s_pwm_enabled = true;
+	return ESP_OK;
+}
+
+void fad_hal_pwm_write_fast(uint32_t duty)
+{
+	s_pwm_level = (s_pwm_bits <= 8) ? duty << (8 - s_pwm_bits) : duty >> (s_pwm_bits - 8);
+}
+
+esp_err_t fad_hal_i2s_setup(uint32_t rate)
+{
+	if (rate != OUTPUT_FREQ)
+		return ESP_ERR_NOT_SUPPORTED; // the simulated codec runs off the sample clock
+
+	s_i2s_head = 0;
+	s_i2s_count = 0;
+	s_i2s_enabled = true;
+	return ESP_OK;
+}
+
+/* Never waits: the caller's retry lets the clock loop run and drain the queue */
+int fad_hal_i2s_write(const int16_t *samples, int count, uint32_t timeout_ms)
+{
+	int n = 0;
+	for (; n < count && s_i2s_count < I2S_QUEUE_SIZE; n++, s_i2s_count++)
+		s_i2s_queue[(s_i2s_head + s_i2s_count) % I2S_QUEUE_SIZE] = samples[n];
+	return n;
+}
+
+esp_err_t fad_hal_mic_setup(uint32_t rate)
+{
+	if (rate != ALARM_FREQ)
+		return ESP_ERR_NOT_SUPPORTED; // the simulated mic runs off the sample clock
+
+	s_mic_head = 0;
+	s_mic_count = 0;
+	s_mic_enabled = true;
+	return ESP_OK;
+}
+
+/* Never waits: returns what has arrived, and the caller's retry lets the clock loop fill the queue */
+int fad_hal_mic_read(int16_t *samples, int count, uint32_t timeout_ms)
+{
+	int n = 0;
+	for (; n < count * FAD_ADC_CHANNELS && s_mic_count > 0; n++, s_mic_count--)
+	{
+		samples[n] = s_mic_queue[s_mic_head];
+		s_mic_head = (s_mic_head + 1) % MIC_QUEUE_SIZE;
+	}
+	return n / FAD_ADC_CHANNELS;
+}
+
+uint32_t fad_hal_cycles(void)
+{
+	uint64_t sim_ns = s_sim_samples * 1000000000ULL / ALARM_FREQ;
+	return (uint32_t)(sim_ns + (wall_ns() - s_period_start_ns));
+}
+
+uint32_t fad_hal_cpu_hz(void)
+{
+	return SIM_CPU_HZ;
+}
+
+int64_t fad_hal_time_us(void)
+{
+	return (int64_t)(s_sim_samples * 1000000ULL / ALARM_FREQ);
+}
+
+int64_t esp_timer_get_time(void)
+{
+	return fad_hal_time_us();
+}
@@ -0,0 +1,744 @@
+/**
+ * fad_rtos_posix.c
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * The FreeRTOS subset used by the firmware, on pthreads. Every task is a thread, but only the task
+ * holding the simulated CPU (s_current) runs; the others wait on their own condition variable.
+ * The CPU changes hands only inside RTOS calls, always to the highest priority ready task, so a
+ * run is deterministic. When no task is ready the CPU goes back to the sample clock, which then
+ * delivers the next interrupt or tick. Interrupts therefore never preempt a task mid-block; the
+ * firmware sees an infinitely fast CPU.
+ *
+ * Run-time counters measure the host's own clock: each hand-off charges the time since the last one
+ * to the task that held the CPU, or to a stand-in idle task while the sample clock thread had it.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "fad_host.h"
+
+#define TIMER_TASK_PRIORITY 1
+#define TIMER_TASK_STACK 2048
+
+typedef enum {
+	TASK_READY,
+	TASK_BLOCKED,
+	TASK_DELETED,
+} task_state_t;
+
+struct fad_rtos_task {
+	pthread_t thread;
+	pthread_cond_t cond;
+	TaskFunction_t code;
+	void *params;
+	char name[16];
+	UBaseType_t priority;
+	uint32_t stack_depth;
+	task_state_t state;
+	uint64_t ready_seq;	  // FIFO order among tasks of equal priority
+	const void *wait_obj; // object the task is blocked on
+	bool timed;			  // the wait has a deadline
+	TickType_t deadline;
+	bool timed_out;
+	uint32_t run_time_us; // host time spent holding the CPU
+	struct fad_rtos_task *next;
+};
+
+struct fad_rtos_queue {
+	uint8_t *storage;
+	UBaseType_t length;
+	UBaseType_t item_size;
+	UBaseType_t count;
+	UBaseType_t head;
+	bool is_mutex;
+};
+
+struct fad_rtos_timer {
+	char name[16];
+	TickType_t period;
+	bool auto_reload;
+	bool active;
+	bool pending;
+	TickType_t expiry;
+	void *id;
+	TimerCallbackFunction_t callback;
+	struct fad_rtos_timer *next;
+};
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_idle_cond = PTHREAD_COND_INITIALIZER;
+static struct fad_rtos_task *s_tasks = NULL;
+static struct fad_rtos_task *s_current = NULL;
+static __thread struct fad_rtos_task *s_self = NULL;
+static uint64_t s_seq = 0;
+static TickType_t s_tick = 0;
+static struct fad_rtos_timer *s_timers = NULL;
+static const char s_delay_obj = 0;	   // wait object nobody signals, for vTaskDelay
+static const char s_timer_wake_obj = 0; // wait object of the timer service task
+static struct fad_rtos_task s_idle_task = {.name = "IDLE", .state = TASK_READY};
+static uint64_t s_run_start_us = 0;
+static uint64_t s_last_switch_us = 0;
+
+static uint64_t run_time_now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void make_ready(struct fad_rtos_task *task)
+{
+	task->state = TASK_READY;
+	task->ready_seq = s_seq++;
+	task->wait_obj = NULL;
+}
+
+static struct fad_rtos_task *pick_ready(void)
+{
+	struct fad_rtos_task *best = NULL;
+	for (struct fad_rtos_task *t = s_tasks; t != NULL; t = t->next)
+	{
+		if (t->state != TASK_READY)
+			continue;
+		if (best == NULL || t->priority > best->priority ||
+			(t->priority == best->priority && t->ready_seq < best->ready_seq))
+			best = t;
+	}
+	return best;
+}
+
+/* Give the CPU to the next task and hand it out, or report idle to the sample clock */
+static void hand_off(struct fad_rtos_task *next)
+{
+	uint64_t now = run_time_now_us();
+	struct fad_rtos_task *prev = s_current ? s_current : &s_idle_task;
+	prev->run_time_us += (uint32_t)(now - s_last_switch_us);
+	s_last_switch_us = now;
+
+	s_current = next;
+	if (next != NULL)
+		pthread_cond_signal(&next->cond);
+	else
+		pthread_cond_broadcast(&s_idle_cond);
+}
+
+/* Block the calling thread until it holds the CPU. Deleted tasks exit here. Lock held. */
+static void wait_for_cpu(struct fad_rtos_task *self)
+{
+	while (s_current != self || self->state == TASK_DELETED)
+	{
+		if (self->state == TASK_DELETED)
+		{
+			pthread_mutex_unlock(&s_lock);
+			pthread_exit(NULL);
+		}
+		pthread_cond_wait(&self->cond, &s_lock);
+	}
+}
+
+/* Called by the running task after it may have blocked itself or readied another task. Lock held. */
+static void reschedule(void)
+{
+	struct fad_rtos_task *self = s_self;
+	if (self == NULL || s_current != self)
+		return; // interrupt or host thread, the sample clock dispatches when it regains control
+
+	struct fad_rtos_task *next = pick_ready();
+	if (next == self)
+		return;
+
+	hand_off(next);
+	wait_for_cpu(self);
+}
+
+static void wake_waiters(const void *obj)
+{
+	for (struct fad_rtos_task *t = s_tasks; t != NULL; t = t->next)
+	{
+		if (t->state == TASK_BLOCKED && t->wait_obj == obj)
+			make_ready(t);
+	}
+}
+
+/**
+ * Block the running task on obj until it is woken or the deadline passes. Lock held.
+ * Returns false on timeout; a zero timeout or a caller that is not a task times out at once.
+ */
+static bool block_on(const void *obj, TickType_t ticks)
+{
+	struct fad_rtos_task *self = s_self;
+	if (self == NULL || ticks == 0)
+		return false;
+
+	self->state = TASK_BLOCKED;
+	self->wait_obj = obj;
+	self->timed = (ticks != portMAX_DELAY);
+	self->deadline = s_tick + ticks;
+	self->timed_out = false;
+	reschedule();
+	return !self->timed_out;
+}
+
+/* Ticks left until an absolute deadline, at least 1 so that a wait still happens this tick */
+static TickType_t ticks_left(TickType_t ticks, TickType_t deadline)
+{
+	if (ticks == portMAX_DELAY)
+		return portMAX_DELAY;
+	int32_t left = (int32_t)(deadline - s_tick);
+	return left > 0 ? (TickType_t)left : 0;
+}
+
+static void *task_entry(void *arg)
+{
+	struct fad_rtos_task *self = arg;
+	s_self = self;
+
+	pthread_mutex_lock(&s_lock);
+	wait_for_cpu(self);
+	pthread_mutex_unlock(&s_lock);
+
+	self->code(self->params);
+
+	/* A FreeRTOS task must not return; treat it as deleting itself */
+	vTaskDelete(NULL);
+	return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task_code, const char *name, uint32_t stack_depth,
+					   void *params, UBaseType_t priority, TaskHandle_t *created_task)
+{
+	struct fad_rtos_task *task = calloc(1, sizeof(struct fad_rtos_task));
+	if (task == NULL)
+		return pdFAIL;
+
+	task->code = task_code;
+	task->params = params;
+	strncpy(task->name, name ? name : "", sizeof(task->name) - 1);
+	task->priority = priority < configMAX_PRIORITIES ? priority : configMAX_PRIORITIES - 1;
+	task->stack_depth = stack_depth;
+	pthread_cond_init(&task->cond, NULL);
+
+	pthread_mutex_lock(&s_lock);
+	make_ready(task);
+
+	/* Append, so that the task list (and with it the wake order) follows creation order */
+	struct fad_rtos_task **tail = &s_tasks;
+	while (*tail != NULL)
+		tail = &(*tail)->next;
+	*tail = task;
+
+	if (pthread_create(&task->thread, NULL, task_entry, task) != 0)
+	{
+		task->state = TASK_DELETED;
+		pthread_mutex_unlock(&s_lock);
+		return pdFAIL;
+	}
+	pthread_detach(task->thread);
+
+	if (created_task)
+		*created_task = task;
+
+	reschedule();
+	pthread_mutex_unlock(&s_lock);
+	return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code, const char *name, uint32_t stack_depth,
+								   void *params, UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id)
+{
+	(void)core_id;
+	return xTaskCreate(task_code, name, stack_depth, params, priority, created_task);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+	pthread_mutex_lock(&s_lock);
+	struct fad_rtos_task *target = task ? task : s_self;
+	if (target == NULL)
+	{
+		pthread_mutex_unlock(&s_lock);
+		return;
+	}
+
+	target->state = TASK_DELETED;
+	if (target == s_current)
+	{
+		hand_off(pick_ready());
+		if (target == s_self)
+		{
+			pthread_mutex_unlock(&s_lock);
+			pthread_exit(NULL);
+		}
+	}
+	else
+	{
+		pthread_cond_signal(&target->cond); // let the thread notice and exit
+	}
+	pthread_mutex_unlock(&s_lock);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+	pthread_mutex_lock(&s_lock);
+	if (!block_on(&s_delay_obj, ticks))
+		reschedule(); // a zero delay is a yield
+	pthread_mutex_unlock(&s_lock);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+	pthread_mutex_lock(&s_lock);
+	TickType_t tick = s_tick;
+	pthread_mutex_unlock(&s_lock);
+	return tick;
+}
+
+TickType_t xTaskGetTickCountFromISR(void)
+{
+	return xTaskGetTickCount();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+	return s_self;
+}
+
+char *pcTaskGetTaskName(TaskHandle_t task)
+{
+	struct fad_rtos_task *target = task ? task : s_self;
+	return target ? target->name : "host";
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+	struct fad_rtos_task *target = task ? task : s_self;
+	return target ? target->priority : 0;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+	/* Threads run on large host stacks, so there is nothing meaningful to measure */
+	struct fad_rtos_task *target = task ? task : s_self;
+	return target ? target->stack_depth : 0;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+	struct fad_rtos_queue *queue = calloc(1, sizeof(struct fad_rtos_queue));
+	if (queue == NULL)
+		return NULL;
+
+	if (item_size > 0)
+	{
+		queue->storage = calloc(length, item_size);
+		if (queue->storage == NULL)
+		{
+			free(queue);
+			return NULL;
+		}
+	}
+	queue->length = length;
+	queue->item_size = item_size;
+	return queue;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count)
+{
+	QueueHandle_t queue = xQueueCreate(max_count, 0);
+	if (queue)
+		queue->count = initial_count;
+	return queue;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+	QueueHandle_t queue = xSemaphoreCreateCounting(1, 1);
+	if (queue)
+		queue->is_mutex = true;
+	return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+	if (queue == NULL)
+		return;
+	free(queue->storage);
+	free(queue);
+}
+
+/* Copy an item in. Lock held, queue not full. */
+static void queue_put(struct fad_rtos_queue *queue, const void *item, bool front)
+{
+	if (queue->item_size > 0)
+	{
+		UBaseType_t slot;
+		if (front)
+		{
+			queue->head = (queue->head + queue->length - 1) % queue->length;
+			slot = queue->head;
+		}
+		else
+		{
+			slot = (queue->head + queue->count) % queue->length;
+		}
+		memcpy(queue->storage + slot * queue->item_size, item, queue->item_size);
+	}
+	queue->count++;
+	wake_waiters(queue);
+}
+
+/* Copy the front item out. Lock held, queue not empty. */
+static void queue_get(struct fad_rtos_queue *queue, void *buffer, bool remove)
+{
+	if (queue->item_size > 0 && buffer != NULL)
+		memcpy(buffer, queue->storage + queue->head * queue->item_size, queue->item_size);
+
+	if (!remove)
+		return;
+
+	if (queue->item_size > 0)
+		queue->head = (queue->head + 1) % queue->length;
+	queue->count--;
+	wake_waiters(queue);
+}
+
+static BaseType_t queue_send(QueueHandle_t queue, const void *item, TickType_t ticks, bool front)
+{
+	pthread_mutex_lock(&s_lock);
+	TickType_t deadline = s_tick + ticks;
+	for (;;)
+	{
+		if (queue->count < queue->length)
+		{
+			queue_put(queue, item, front);
+			reschedule();
+			pthread_mutex_unlock(&s_lock);
+			return pdPASS;
+		}
+		if (!block_on(queue, ticks_left(ticks, deadline)))
+		{
+			pthread_mutex_unlock(&s_lock);
+			return pdFAIL;
+		}
+	}
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait)
+{
+	return queue_send(queue, item, ticks_to_wait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait)
+{
+	return queue_send(queue, item, ticks_to_wait, true);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *higher_priority_task_woken)
+{
+	BaseType_t ret = pdFAIL;
+	pthread_mutex_lock(&s_lock);
+	if (queue->count < queue->length)
+	{
+		queue_put(queue, item, false);
+		ret = pdPASS;
+	}
+	pthread_mutex_unlock(&s_lock);
+
+	if (higher_priority_task_woken)
+		*higher_priority_task_woken = (ret == pdPASS);
+	return ret;
+}
+
+static BaseType_t queue_receive(QueueHandle_t queue, void *buffer, TickType_t ticks, bool remove)
+{
+	pthread_mutex_lock(&s_lock);
+	TickType_t deadline = s_tick + ticks;
+	for (;;)
+	{
+		if (queue->count > 0)
+		{
+			queue_get(queue, buffer, remove);
+			reschedule();
+			pthread_mutex_unlock(&s_lock);
+			return pdPASS;
+		}
+		if (!block_on(queue, ticks_left(ticks, deadline)))
+		{
+			pthread_mutex_unlock(&s_lock);
+			return pdFAIL;
+		}
+	}
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticks_to_wait)
+{
+	return queue_receive(queue, buffer, ticks_to_wait, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *buffer, TickType_t ticks_to_wait)
+{
+	return queue_receive(queue, buffer, ticks_to_wait, false);
+}
+
+BaseType_t xQueueReceiveFromISR(QueueHandle_t queue, void *buffer, BaseType_t *higher_priority_task_woken)
+{
+	BaseType_t ret = pdFAIL;
+	pthread_mutex_lock(&s_lock);
+	if (queue->count > 0)
+	{
+		queue_get(queue, buffer, true);
+		ret = pdPASS;
+	}
+	pthread_mutex_unlock(&s_lock);
+
+	if (higher_priority_task_woken)
+		*higher_priority_task_woken = pdFALSE;
+	return ret;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+	pthread_mutex_lock(&s_lock);
+	UBaseType_t count = queue->count;
+	pthread_mutex_unlock(&s_lock);
+	return count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+{
+	pthread_mutex_lock(&s_lock);
+	UBaseType_t spaces = queue->length - queue->count;
+	pthread_mutex_unlock(&s_lock);
+	return spaces;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+	pthread_mutex_lock(&s_lock);
+	queue->count = 0;
+	queue->head = 0;
+	wake_waiters(queue);
+	reschedule();
+	pthread_mutex_unlock(&s_lock);
+	return pdPASS;
+}
+
+/* Runs due timer callbacks in task context, like the FreeRTOS timer service task */
+static void timer_task(void *params)
+{
+	for (;;)
+	{
+		pthread_mutex_lock(&s_lock);
+		struct fad_rtos_timer *due = NULL;
+		for (struct fad_rtos_timer *t = s_timers; t != NULL; t = t->next)
+		{
+			if (t->pending)
+			{
+				t->pending = false;
+				due = t;
+				break;
+			}
+		}
+		if (due == NULL)
+			block_on(&s_timer_wake_obj, portMAX_DELAY);
+		pthread_mutex_unlock(&s_lock);
+
+		if (due != NULL)
+			due->callback(due);
+	}
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload,
+						   void *timer_id, TimerCallbackFunction_t callback)
+{
+	struct fad_rtos_timer *timer = calloc(1, sizeof(struct fad_rtos_timer));
+	if (timer == NULL)
+		return NULL;
+
+	strncpy(timer->name, name ? name : "", sizeof(timer->name) - 1);
+	timer->period = period ? period : 1;
+	timer->auto_reload = auto_reload;
+	timer->id = timer_id;
+	timer->callback = callback;
+
+	pthread_mutex_lock(&s_lock);
+	timer->next = s_timers;
+	s_timers = timer;
+	pthread_mutex_unlock(&s_lock);
+	return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+	pthread_mutex_lock(&s_lock);
+	timer->active = true;
+	timer->expiry = s_tick + timer->period;
+	pthread_mutex_unlock(&s_lock);
+	return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+	return xTimerStart(timer, ticks_to_wait);
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+	pthread_mutex_lock(&s_lock);
+	timer->active = false;
+	timer->pending = false;
+	pthread_mutex_unlock(&s_lock);
+	return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t ticks_to_wait)
+{
+	timer->period = period ? period : 1;
+	return xTimerStart(timer, ticks_to_wait);
+}
+
+BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+	/* Kept on the list, as a callback may still be running; it just never fires again */
+	return xTimerStop(timer, ticks_to_wait);
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer)
+{
+	return timer->active;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer)
+{
+	return timer->id;
+}
+
+void *pvPortMalloc(size_t size)
+{
+	return malloc(size);
+}
+
+void vPortFree(void *ptr)
+{
+	free(ptr);
+}
+
+BaseType_t xPortGetCoreID(void)
+{
+	return 0;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void)
+{
+	pthread_mutex_lock(&s_lock);
+	UBaseType_t count = 1; // the idle stand-in
+	for (struct fad_rtos_task *t = s_tasks; t != NULL; t = t->next)
+		if (t->state != TASK_DELETED)
+			count++;
+	pthread_mutex_unlock(&s_lock);
+	return count;
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *status, UBaseType_t size, uint32_t *total_run_time)
+{
+	pthread_mutex_lock(&s_lock);
+
+	/* Bring the holder of the CPU up to date, so the counters add up to the total */
+	uint64_t now = run_time_now_us();
+	struct fad_rtos_task *holder = s_current ? s_current : &s_idle_task;
+	holder->run_time_us += (uint32_t)(now - s_last_switch_us);
+	s_last_switch_us = now;
+
+	UBaseType_t n = 0;
+	for (struct fad_rtos_task *t = &s_idle_task; t != NULL && n < size; t = (t == &s_idle_task) ? s_tasks : t->next)
+	{
+		if (t->state == TASK_DELETED)
+			continue;
+		status[n].xHandle = t;
+		status[n].pcTaskName = t->name;
+		status[n].eCurrentState = (t == s_current) ? eRunning : (t->state == TASK_READY) ? eReady : eBlocked;
+		status[n].uxCurrentPriority = t->priority;
+		status[n].ulRunTimeCounter = t->run_time_us;
+		status[n].xCoreID = 0;
+		n++;
+	}
+	if (total_run_time)
+		*total_run_time = (uint32_t)(now - s_run_start_us);
+
+	pthread_mutex_unlock(&s_lock);
+	return n;
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t cpu)
+{
+	return (cpu == 0) ? &s_idle_task : NULL;
+}
+
+void fad_rtos_init(void)
+{
+	s_run_start_us = run_time_now_us();
+	s_last_switch_us = s_run_start_us;
+	xTaskCreate(timer_task, "Tmr Svc", TIMER_TASK_STACK, NULL, TIMER_TASK_PRIORITY, NULL);
+}
+
+void fad_rtos_run_until_idle(void)
+{
+	pthread_mutex_lock(&s_lock);
+	for (;;)
+	{
+		if (s_current == NULL)
+		{
+			struct fad_rtos_task *next = pick_ready();
+			if (next == NULL)
+				break;
+			hand_off(next);
+		}
+		pthread_cond_wait(&s_idle_cond, &s_lock);
+	}
+	pthread_mutex_unlock(&s_lock);
+}
+
+void fad_rtos_tick(void)
+{
+	pthread_mutex_lock(&s_lock);
+	s_tick++;
+
+	for (struct fad_rtos_task *t = s_tasks; t != NULL; t = t->next)
+	{
+		if (t->state == TASK_BLOCKED && t->timed && (int32_t)(s_tick - t->deadline) >= 0)
+		{
+			t->timed_out = true;
+			make_ready(t);
+		}
+	}
+
+	bool fired = false;
+	for (struct fad_rtos_timer *t = s_timers; t != NULL; t = t->next)
+	{
+		if (!t->active || (int32_t)(s_tick - t->expiry) < 0)
+			continue;
+
+		t->pending = true;
+		fired = true;
+		if (t->auto_reload)
+			t->expiry += t->period;
+		else
+			t->active = false;
+	}
+	if (fired)
+		wake_waiters(&s_timer_wake_obj);
+
+	pthread_mutex_unlock(&s_lock);
+}
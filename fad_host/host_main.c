@@ -0,0 +1,376 @@
+/**
+ * host_main.c
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Runs the firmware on Linux. app_main and fad_main_stack_evt_handler run unmodified on the
+ * pthread RTOS; audio comes from a file instead of the mic and the DAC output goes to a file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "main.h"
+#include "fad_defs.h"
+#include "fad_app_core.h"
+#include "fad_hal.h"
+#include "fad_host.h"
+#include "fad_latency.h"
+#include "fad_perf.h"
+#include "fad_jitter.h"
+#include "fad_capture.h"
+#include "fad_trace.h"
+#include "fad_log.h"
+#include "fad_mem.h"
+#include "fad_load.h"
+#include "fad_power.h"
+
+#define HOST_TAG "HOST"
+#define BOOT_TASK_STACK 3584
+#define DEFAULT_LOOPBACK_GAIN 16.0f	 // a full-scale DAC swing comes back at full ADC scale
+#define DEFAULT_SILENCE_SECONDS 10.0 // run length when there is no input file
+#define HOST_CAPTURE_SIZE (64 * 1024 * 1024) // room for about 4.5 hours of recording
+#define HOST_TRACE_SIZE (1024 * 1024)
+
+void app_main(void);
+
+/* Events the command line asks for on top of the normal boot */
+typedef struct {
+	bool change_algo;
+	fad_algo_type_t algo_type;
+	fad_algo_mode_t algo_mode;
+	fad_latency_mode_t latency_mode;
+	const char *record_path;
+	const char *replay_path;
+	const char *trace_path;
+	const char *memory_path;
+} boot_options_t;
+
+static boot_options_t s_boot;
+static fad_capture_store_t s_record_store;
+static fad_capture_store_t s_replay_store;
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+			"Usage: %s [options]\n"
+			"  -i FILE    ADC input: raw uint16 LE 12-bit codes, 8/16-bit PCM .wav, or - for stdin (default: silence)\n"
+			"  -o FILE    DAC output: raw uint8, or 8-bit .wav if the name ends in .wav, or - for stdout\n"
+			"  -a ALGO    template, delay, freq_shift or masking (default: the boot algorithm in main.c)\n"
+			"  -m MODE    algorithm mode 1..3 (default 1)\n"
+			"  -l MODE    latency measurement: inject or loopback\n"
+			"  -s FILE    I2S codec stream: raw int16 LE, or 16-bit .wav (needs WIRED_OUTPUT_MODE FAD_OUTPUT_I2S in main.c)\n"
+			"  -L N       acoustic loopback from DAC to ADC with N samples delay\n"
+			"  -g GAIN    loopback gain in ADC codes per DAC step (default %.0f)\n"
+			"  -c FILE    record the algorithm input and output to a capture file (with -p: the replayed output)\n"
+			"  -p FILE    replay a capture file through the algorithm and compare the output\n"
+			"  -T FILE    write the event trace ring to FILE at the end (uart_tester/tools/trace_tools.py converts it)\n"
+			"  -M FILE    write the memory footprint to FILE as CSV at the end (uart_tester/tools/mem_tools.py diffs two)\n"
+			"  -t SEC     stop after SEC simulated seconds\n"
+			"  -r         pace the sample clock to real time\n"
+			"  -q         only log warnings and errors\n"
+			"  -v         log debug messages\n",
+			prog, DEFAULT_LOOPBACK_GAIN);
+}
+
+static bool parse_algo(const char *name, fad_algo_type_t *type)
+{
+	static const struct {
+		const char *name;
+		fad_algo_type_t type;
+	} algos[] = {
+		{"template", FAD_ALGO_TEMPLATE},
+		{"delay", FAD_ALGO_DELAY},
+		{"freq_shift", FAD_ALGO_FREQ_SHIFT},
+		{"masking", FAD_ALGO_MASKING},
+	};
+
+	for (size_t i = 0; i < sizeof(algos) / sizeof(algos[0]); i++)
+	{
+		if (strcmp(name, algos[i].name) == 0)
+		{
+			*type = algos[i].type;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool load_capture(const char *path, fad_capture_store_t *store)
+{
+	FILE *f = fopen(path, "rb");
+	if (f == NULL)
+	{
+		ESP_LOGE(HOST_TAG, "Cannot open capture %s", path);
+		return false;
+	}
+
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	store->data = malloc(size > 0 ? size : 1);
+	store->size = size > 0 ? size : 0;
+	store->len = fread(store->data, 1, store->size, f);
+	fclose(f);
+	return store->len == store->size;
+}
+
+static bool save_capture(const char *path, const fad_capture_store_t *store)
+{
+	FILE *f = fopen(path, "wb");
+	if (f == NULL)
+	{
+		ESP_LOGE(HOST_TAG, "Cannot create capture %s", path);
+		return false;
+	}
+
+	bool ok = fwrite(store->data, 1, store->len, f) == store->len;
+	return (fclose(f) == 0) && ok;
+}
+
+/* A replay ends the run once every block went through the algorithm */
+static bool replay_finished(void)
+{
+	fad_capture_report_t report;
+	fad_capture_get_report(&report);
+	return report.mode == FAD_CAPTURE_REPLAY && report.done;
+}
+
+/**
+ * Stands in for the ESP-IDF main task. It runs above the app task, so the command line events are
+ * queued right behind FAD_APP_EVT_STACK_UP and are handled before the output starts.
+ */
+static void boot_task(void *params)
+{
+	app_main();
+
+	if (s_boot.change_algo)
+	{
+		fad_main_cb_param_t p = {
+			.change_algo.algo_type = s_boot.algo_type,
+			.change_algo.algo_mode = s_boot.algo_mode,
+		};
+		fad_app_work_dispatch(fad_main_stack_evt_handler, FAD_ALGO_CHANGED, (void *)&p, sizeof(fad_main_cb_param_t), NULL);
+	}
+
+	if (s_boot.latency_mode != FAD_LATENCY_OFF)
+	{
+		fad_main_cb_param_t p = {
+			.latency_start.mode = s_boot.latency_mode,
+		};
+		fad_app_work_dispatch_class(FAD_APP_CLASS_BACKGROUND, fad_main_stack_evt_handler, FAD_LATENCY_START, (void *)&p, sizeof(fad_main_cb_param_t), NULL);
+	}
+
+	if (s_boot.record_path != NULL || s_boot.replay_path != NULL)
+	{
+		fad_main_cb_param_t p = {
+			.capture.mode = (s_boot.replay_path != NULL) ? FAD_CAPTURE_REPLAY : FAD_CAPTURE_RECORD,
+			.capture.source = (s_boot.replay_path != NULL) ? &s_replay_store : NULL,
+			.capture.dest = (s_boot.record_path != NULL) ? &s_record_store : NULL,
+		};
+		fad_app_work_dispatch_class(FAD_APP_CLASS_BACKGROUND, fad_main_stack_evt_handler, FAD_CAPTURE_START, (void *)&p, sizeof(fad_main_cb_param_t), NULL);
+	}
+
+	vTaskDelete(NULL);
+}
+
+int main(int argc, char **argv)
+{
+	fad_host_config_t config = {
+		.loopback_gain = DEFAULT_LOOPBACK_GAIN,
+	};
+	int mode = 1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "i:o:s:a:m:l:L:g:c:p:T:M:t:rqvh")) != -1)
+	{
+		switch (opt)
+		{
+		case 'i':
+			config.input_path = optarg;
+			break;
+		case 'o':
+			config.output_path = optarg;
+			break;
+		case 's':
+			config.i2s_path = optarg;
+			break;
+		case 'a':
+			if (!parse_algo(optarg, &s_boot.algo_type))
+			{
+				fprintf(stderr, "Unknown algorithm %s\n", optarg);
+				return 2;
+			}
+			s_boot.change_algo = true;
+			break;
+		case 'm':
+			mode = atoi(optarg);
+			break;
+		case 'l':
+			if (strcmp(optarg, "inject") == 0)
+				s_boot.latency_mode = FAD_LATENCY_INJECT;
+			else if (strcmp(optarg, "loopback") == 0)
+				s_boot.latency_mode = FAD_LATENCY_LOOPBACK;
+			else
+			{
+				fprintf(stderr, "Unknown latency mode %s\n", optarg);
+				return 2;
+			}
+			break;
+		case 'L':
+			config.loopback_delay = atoi(optarg);
+			break;
+		case 'g':
+			config.loopback_gain = atof(optarg);
+			break;
+		case 'c':
+			s_boot.record_path = optarg;
+			break;
+		case 'p':
+			s_boot.replay_path = optarg;
+			break;
+		case 'T':
+			s_boot.trace_path = optarg;
+			break;
+		case 'M':
+			s_boot.memory_path = optarg;
+			break;
+		case 't':
+			config.max_seconds = atof(optarg);
+			break;
+		case 'r':
+			config.realtime = true;
+			break;
+		case 'q':
+			fad_host_log_set_level(ESP_LOG_WARN);
+			break;
+		case 'v':
+			fad_host_log_set_level(ESP_LOG_DEBUG);
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (mode < 1 || mode > 3)
+	{
+		fprintf(stderr, "Mode must be 1..3\n");
+		return 2;
+	}
+	s_boot.algo_mode = FAD_ALGO_MODE_1 + (mode - 1);
+
+	if (config.input_path == NULL && config.max_seconds == 0)
+		config.max_seconds = DEFAULT_SILENCE_SECONDS;
+
+	if (s_boot.replay_path != NULL)
+	{
+		if (!load_capture(s_boot.replay_path, &s_replay_store))
+			return 1;
+		config.finished = replay_finished;
+	}
+	if (s_boot.record_path != NULL)
+	{
+		s_record_store.data = malloc(HOST_CAPTURE_SIZE);
+		s_record_store.size = HOST_CAPTURE_SIZE;
+	}
+
+	if (fad_host_hal_open(&config) != ESP_OK)
+		return 1;
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	fad_rtos_init();
+	xTaskCreate(boot_task, "main", BOOT_TASK_STACK, NULL, configMAX_PRIORITIES - 1, NULL);
+	fad_host_hal_run();
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	fad_host_hal_close();
+
+	/* Every task is blocked now, so the reports can be read from this thread */
+	fad_log_flush();
+	if (FAD_PERF_ENABLE)
+		fad_perf_report();
+	if (FAD_JITTER_ENABLE)
+		fad_jitter_report();
+	fad_app_report();
+	fad_log_report();
+	if (FAD_LOAD_ENABLE)
+		fad_load_report();
+	if (FAD_POWER_ENABLE)
+		fad_power_report();
+	fad_mem_report();
+
+	if (s_boot.record_path != NULL || s_boot.replay_path != NULL)
+	{
+		fad_capture_report_t report;
+		fad_capture_get_report(&report);
+		if (!report.done) // FAD_CAPTURE_DONE has logged the report otherwise
+		{
+			fad_capture_stop();
+			fad_capture_report();
+		}
+		if (s_boot.record_path != NULL && !save_capture(s_boot.record_path, &s_record_store))
+			return 1;
+	}
+
+	if (s_boot.trace_path != NULL)
+	{
+		fad_capture_store_t trace = {malloc(HOST_TRACE_SIZE), HOST_TRACE_SIZE, 0};
+		esp_err_t err = fad_trace_snapshot(&trace);
+		if (err != ESP_OK)
+		{
+			ESP_LOGE(HOST_TAG, "No trace to write: %s", esp_err_to_name(err));
+			return 1;
+		}
+		if (!save_capture(s_boot.trace_path, &trace))
+			return 1;
+	}
+
+	if (s_boot.memory_path != NULL)
+	{
+		FILE *f = fopen(s_boot.memory_path, "w");
+		if (f == NULL)
+		{
+			ESP_LOGE(HOST_TAG, "Cannot write %s", s_boot.memory_path);
+			return 1;
+		}
+		fad_mem_dump(f);
+		fclose(f);
+	}
+
+	if (s_boot.latency_mode != FAD_LATENCY_OFF)
+	{
+		fad_latency_report_t report;
+		if (!fad_latency_get_report(&report))
+			ESP_LOGW(HOST_TAG, "Latency measurement did not finish, %d of %d trials done",
+					 report.trials, FAD_LATENCY_TRIALS);
+	}
+
+	uint64_t i2s_frames, i2s_underruns;
+	fad_host_i2s_counts(&i2s_frames, &i2s_underruns);
+	if (i2s_frames > 0)
+		ESP_LOGW(HOST_TAG, "I2S codec played %llu frames, %llu from an empty queue",
+				 (unsigned long long)i2s_frames, (unsigned long long)i2s_underruns);
+	if (fad_host_mic_overflows() > 0)
+		ESP_LOGW(HOST_TAG, "Mic DMA queue overflowed, %llu samples dropped",
+				 (unsigned long long)fad_host_mic_overflows());
+
+	double wall = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	double simulated = (double)fad_host_sim_samples() / ALARM_FREQ;
+	ESP_LOGW(HOST_TAG, "Simulated %.2f s (%llu samples through the DAC) in %.2f s, %.1fx real time",
+			 simulated, (unsigned long long)fad_host_io_samples(), wall, wall > 0 ? simulated / wall : 0);
+
+	return 0;
+}
@@ -0,0 +1,19 @@
+/* Host stand-in for driver/uart.h. The host has no console UART to read commands from, so
+ * uart_driver_install fails and the diagnostics console (fad_diag.c) stays off. */
+#ifndef _HOST_DRIVER_UART_H_
+#define _HOST_DRIVER_UART_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+typedef int uart_port_t;
+#define UART_NUM_0 0
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size, int queue_size,
+							  QueueHandle_t *uart_queue, int intr_alloc_flags);
+int uart_read_bytes(uart_port_t uart_num, uint8_t *buf, uint32_t length, TickType_t ticks_to_wait);
+esp_err_t uart_set_wakeup_threshold(uart_port_t uart_num, int wakeup_threshold);
+
+#endif
@@ -0,0 +1,12 @@
+/* Host stand-in for esp_attr.h. Placement attributes have no meaning off the chip. */
+#ifndef _HOST_ESP_ATTR_H_
+#define _HOST_ESP_ATTR_H_
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+#define EXT_RAM_ATTR
+#define WORD_ALIGNED_ATTR __attribute__((aligned(4)))
+
+#endif
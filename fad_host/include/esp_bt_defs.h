@@ -0,0 +1,10 @@
+/* Host stand-in for esp_bt_defs.h. Only the address type is used outside the BT modules. */
+#ifndef _HOST_ESP_BT_DEFS_H_
+#define _HOST_ESP_BT_DEFS_H_
+
+#include <stdint.h>
+
+#define ESP_BD_ADDR_LEN 6
+typedef uint8_t esp_bd_addr_t[ESP_BD_ADDR_LEN];
+
+#endif
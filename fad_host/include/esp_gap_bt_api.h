@@ -0,0 +1,19 @@
+/* Host stand-in for esp_gap_bt_api.h. There is no radio on the host; the types only let
+ * fad_bt_gap.h be included. */
+#ifndef _HOST_ESP_GAP_BT_API_H_
+#define _HOST_ESP_GAP_BT_API_H_
+
+#include "esp_bt_defs.h"
+
+typedef enum {
+	ESP_BT_GAP_DISC_RES_EVT = 0,
+	ESP_BT_GAP_DISC_STATE_CHANGED_EVT,
+} esp_bt_gap_cb_event_t;
+
+typedef union {
+	struct {
+		esp_bd_addr_t bda;
+	} disc_res;
+} esp_bt_gap_cb_param_t;
+
+#endif
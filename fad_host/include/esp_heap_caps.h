@@ -0,0 +1,38 @@
+/* Host stand-in for esp_heap_caps.h. The host has no PSRAM, so SPIRAM requests fail like on a bare ESP32.
+   The host heap is not accounted, so the size queries report 0. */
+#ifndef _HOST_ESP_HEAP_CAPS_H_
+#define _HOST_ESP_HEAP_CAPS_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+static inline void *heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+	return (caps & MALLOC_CAP_SPIRAM) ? NULL : calloc(n, size);
+}
+
+static inline void heap_caps_free(void *ptr)
+{
+	free(ptr);
+}
+
+static inline size_t heap_caps_get_free_size(uint32_t caps)
+{
+	return 0;
+}
+
+static inline size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+	return 0;
+}
+
+static inline size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,43 @@
+/* Host stand-in for esp_pm.h. The host has no clocks to scale: configuration and locks succeed and do nothing. */
+#ifndef _HOST_ESP_PM_H_
+#define _HOST_ESP_PM_H_
+
+#include <stdbool.h>
+#include "esp_err.h"
+
+typedef enum {
+	ESP_PM_CPU_FREQ_MAX,
+	ESP_PM_APB_FREQ_MAX,
+	ESP_PM_NO_LIGHT_SLEEP,
+} esp_pm_lock_type_t;
+
+typedef struct esp_pm_lock *esp_pm_lock_handle_t;
+
+typedef struct {
+	int max_freq_mhz;
+	int min_freq_mhz;
+	bool light_sleep_enable;
+} esp_pm_config_esp32_t;
+
+static inline esp_err_t esp_pm_configure(const void *config)
+{
+	return ESP_OK;
+}
+
+static inline esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg, const char *name, esp_pm_lock_handle_t *out_handle)
+{
+	*out_handle = NULL;
+	return ESP_OK;
+}
+
+static inline esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle)
+{
+	return ESP_OK;
+}
+
+static inline esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle)
+{
+	return ESP_OK;
+}
+
+#endif
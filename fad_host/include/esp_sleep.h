@@ -0,0 +1,12 @@
+/* Host stand-in for esp_sleep.h. The host never sleeps, so wakeup sources are accepted and ignored. */
+#ifndef _HOST_ESP_SLEEP_H_
+#define _HOST_ESP_SLEEP_H_
+
+#include "esp_err.h"
+
+static inline esp_err_t esp_sleep_enable_uart_wakeup(int uart_num)
+{
+	return ESP_OK;
+}
+
+#endif
@@ -0,0 +1,15 @@
+/* Host stand-in for esp_system.h */
+#ifndef _HOST_ESP_SYSTEM_H_
+#define _HOST_ESP_SYSTEM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_attr.h"
+
+/* Deterministic pseudo-random numbers, so host runs are repeatable */
+uint32_t esp_random(void);
+
+void esp_restart(void);
+
+#endif
@@ -0,0 +1,9 @@
+/* Host stand-in for esp_timer.h. Time is simulated: it advances with the sample clock. */
+#ifndef _HOST_ESP_TIMER_H_
+#define _HOST_ESP_TIMER_H_
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
+
+#endif
@@ -0,0 +1,92 @@
+/**
+ * fad_host.h
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Glue between the pieces of the host simulation: the pthread RTOS (fad_rtos_posix.c), the
+ * simulated sample clock and audio I/O (fad_hal_posix.c), and the command line (host_main.c).
+ */
+
+#ifndef _FAD_HOST_H_
+#define _FAD_HOST_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_log.h"
+
+/* Command line settings for the simulated hardware */
+typedef struct {
+	const char *input_path;	 // Raw little-endian 12-bit ADC codes, a 16-bit or 8-bit mono WAV, or "-" for stdin. NULL for silence.
+	const char *output_path; // Raw unsigned 8-bit DAC values, or an 8-bit WAV if the name ends in .wav. NULL to discard.
+	const char *i2s_path;	 // 16-bit codec stream: raw signed LE, or a 16-bit WAV if the name ends in .wav. NULL to discard.
+	int loopback_delay;		 // Samples from DAC to ADC for the acoustic loopback, 0 for none
+	float loopback_gain;	 // ADC codes per DAC step fed back
+	double max_seconds;		 // Simulated run time limit, 0 for until the input ends
+	bool realtime;			 // Pace the sample clock to the wall clock
+	bool (*finished)(void);	 // Checked between samples, the run stops when it returns true. NULL for none.
+} fad_host_config_t;
+
+/**
+ * @brief Start the scheduler bookkeeping and the timer service task. Must be called before any task is created.
+ */
+void fad_rtos_init(void);
+
+/**
+ * @brief Let ready tasks run until every task is blocked. Called by the sample clock between samples.
+ */
+void fad_rtos_run_until_idle(void);
+
+/**
+ * @brief Advance the tick count by one, expiring timed waits and software timers
+ */
+void fad_rtos_tick(void);
+
+/**
+ * @brief Open the audio files for the simulated ADC and DAC
+ * @param config Settings from the command line
+ * @return
+ * 		-ESP_OK if successful
+ * 		-ESP_ERR_NOT_FOUND if a file cannot be opened
+ * 		-ESP_ERR_NOT_SUPPORTED if the input WAV format is not handled
+ */
+esp_err_t fad_host_hal_open(const fad_host_config_t *config);
+
+/**
+ * @brief Run the sample clock in the calling thread until the input ends, the time limit is hit or finished returns true
+ */
+void fad_host_hal_run(void);
+
+/**
+ * @brief Finish the output file
+ */
+void fad_host_hal_close(void);
+
+/**
+ * @brief Simulated samples since boot, counted whether or not the sample timer is running
+ */
+uint64_t fad_host_sim_samples(void);
+
+/**
+ * @brief Samples passed through the ADC and DAC while the sample timer was running
+ */
+uint64_t fad_host_io_samples(void);
+
+/**
+ * @brief Codec frames played while the I2S output was set up, and how many of them found the DMA queue empty
+ */
+void fad_host_i2s_counts(uint64_t *frames, uint64_t *underruns);
+
+/**
+ * @brief Mic samples dropped because the mic task left the DMA queue full
+ */
+uint64_t fad_host_mic_overflows(void);
+
+/**
+ * @brief Set the level below which log lines are dropped
+ */
+void fad_host_log_set_level(esp_log_level_t level);
+
+#endif
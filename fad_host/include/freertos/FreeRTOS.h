@@ -0,0 +1,51 @@
+/**
+ * Host stand-in for the FreeRTOS API subset used by the firmware, implemented on pthreads in
+ * fad_rtos_posix.c. Tasks run one at a time by priority, as on a single core, and switch only
+ * inside RTOS calls. Ticks are derived from the simulated sample clock.
+ */
+#ifndef _HOST_FREERTOS_H_
+#define _HOST_FREERTOS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_attr.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t StackType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+
+#define configTICK_RATE_HZ 100
+#define configMAX_PRIORITIES 25
+#define configMINIMAL_STACK_SIZE 768
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define portTICK_RATE_MS portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define portNUM_PROCESSORS 1
+
+/* Tasks and interrupts never overlap in the simulation, so critical sections need no lock */
+typedef struct {
+	int owner;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux) ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux) ((void)(mux))
+#define taskENTER_CRITICAL(mux) ((void)(mux))
+#define taskEXIT_CRITICAL(mux) ((void)(mux))
+#define portYIELD_FROM_ISR() do {} while (0)
+
+void *pvPortMalloc(size_t size);
+void vPortFree(void *ptr);
+BaseType_t xPortGetCoreID(void);
+
+#endif
@@ -0,0 +1,21 @@
+/* Host stand-in for freertos/semphr.h. Semaphores are queues of zero-size items, as in FreeRTOS. */
+#ifndef _HOST_FREERTOS_SEMPHR_H_
+#define _HOST_FREERTOS_SEMPHR_H_
+
+#include "freertos/queue.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+typedef SemaphoreHandle_t xSemaphoreHandle;
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+
+#define xSemaphoreCreateBinary() xSemaphoreCreateCounting(1, 0)
+#define xSemaphoreTake(sem, ticks) xQueueReceive((sem), NULL, (ticks))
+#define xSemaphoreTakeFromISR(sem, woken) xQueueReceiveFromISR((sem), NULL, (woken))
+#define xSemaphoreGive(sem) xQueueSend((sem), NULL, 0)
+#define xSemaphoreGiveFromISR(sem, woken) xQueueSendFromISR((sem), NULL, (woken))
+#define uxSemaphoreGetCount(sem) uxQueueMessagesWaiting(sem)
+#define vSemaphoreDelete(sem) vQueueDelete(sem)
+
+#endif
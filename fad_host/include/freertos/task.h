@@ -0,0 +1,48 @@
+/* Host stand-in for freertos/task.h */
+#ifndef _HOST_FREERTOS_TASK_H_
+#define _HOST_FREERTOS_TASK_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct fad_rtos_task *TaskHandle_t;
+typedef TaskHandle_t xTaskHandle;
+typedef void (*TaskFunction_t)(void *);
+
+#define tskNO_AFFINITY 0x7fffffff
+#define tskIDLE_PRIORITY 0
+
+typedef enum {
+	eRunning,
+	eReady,
+	eBlocked,
+	eSuspended,
+	eDeleted,
+} eTaskState;
+
+/* The fields of FreeRTOS's TaskStatus_t that the host fills in. Run time is in host microseconds */
+typedef struct {
+	TaskHandle_t xHandle;
+	const char *pcTaskName;
+	eTaskState eCurrentState;
+	UBaseType_t uxCurrentPriority;
+	uint32_t ulRunTimeCounter;
+	BaseType_t xCoreID;
+} TaskStatus_t;
+
+BaseType_t xTaskCreate(TaskFunction_t task_code, const char *name, uint32_t stack_depth,
+					   void *params, UBaseType_t priority, TaskHandle_t *created_task);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code, const char *name, uint32_t stack_depth,
+								   void *params, UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+TickType_t xTaskGetTickCountFromISR(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+char *pcTaskGetTaskName(TaskHandle_t task);
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+UBaseType_t uxTaskGetNumberOfTasks(void);
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *status, UBaseType_t size, uint32_t *total_run_time);
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t cpu);
+
+#endif
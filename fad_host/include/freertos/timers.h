@@ -0,0 +1,21 @@
+/* Host stand-in for freertos/timers.h. Callbacks run in a timer service task, as in FreeRTOS. */
+#ifndef _HOST_FREERTOS_TIMERS_H_
+#define _HOST_FREERTOS_TIMERS_H_
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+typedef struct fad_rtos_timer *TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload,
+						   void *timer_id, TimerCallbackFunction_t callback);
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks_to_wait);
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks_to_wait);
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t ticks_to_wait);
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t ticks_to_wait);
+BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t ticks_to_wait);
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer);
+void *pvTimerGetTimerID(TimerHandle_t timer);
+
+#endif
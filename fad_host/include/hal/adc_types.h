@@ -0,0 +1,25 @@
+/* Host stand-in for hal/adc_types.h */
+#ifndef _HOST_HAL_ADC_TYPES_H_
+#define _HOST_HAL_ADC_TYPES_H_
+
+typedef enum {
+	ADC_CHANNEL_0 = 0, ADC_CHANNEL_1, ADC_CHANNEL_2, ADC_CHANNEL_3, ADC_CHANNEL_4,
+	ADC_CHANNEL_5, ADC_CHANNEL_6, ADC_CHANNEL_7, ADC_CHANNEL_8, ADC_CHANNEL_9,
+	ADC_CHANNEL_MAX,
+} adc_channel_t;
+
+typedef enum {
+	ADC_WIDTH_BIT_9 = 0,
+	ADC_WIDTH_BIT_10,
+	ADC_WIDTH_BIT_11,
+	ADC_WIDTH_BIT_12,
+} adc_bits_width_t;
+
+typedef enum {
+	ADC_ATTEN_DB_0 = 0,
+	ADC_ATTEN_DB_2_5,
+	ADC_ATTEN_DB_6,
+	ADC_ATTEN_DB_11,
+} adc_atten_t;
+
+#endif
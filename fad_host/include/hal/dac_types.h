@@ -0,0 +1,11 @@
+/* Host stand-in for hal/dac_types.h */
+#ifndef _HOST_HAL_DAC_TYPES_H_
+#define _HOST_HAL_DAC_TYPES_H_
+
+typedef enum {
+	DAC_CHANNEL_1 = 0,
+	DAC_CHANNEL_2,
+	DAC_CHANNEL_MAX,
+} dac_channel_t;
+
+#endif
@@ -0,0 +1,23 @@
+/* Host stand-in for nvs.h. Values live in memory for the length of the run. */
+#ifndef _HOST_NVS_H_
+#define _HOST_NVS_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef uint32_t nvs_handle_t;
+typedef nvs_handle_t nvs_handle;
+
+typedef enum {
+	NVS_READONLY,
+	NVS_READWRITE,
+} nvs_open_mode_t;
+typedef nvs_open_mode_t nvs_open_mode;
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle);
+esp_err_t nvs_set_u64(nvs_handle_t handle, const char *key, uint64_t value);
+esp_err_t nvs_get_u64(nvs_handle_t handle, const char *key, uint64_t *out_value);
+esp_err_t nvs_commit(nvs_handle_t handle);
+void nvs_close(nvs_handle_t handle);
+
+#endif
@@ -0,0 +1,10 @@
+/* Host stand-in for nvs_flash.h */
+#ifndef _HOST_NVS_FLASH_H_
+#define _HOST_NVS_FLASH_H_
+
+#include "esp_err.h"
+
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_erase(void);
+
+#endif
@@ -0,0 +1,39 @@
+# Runs the loopback latency measurement over a simulated acoustic path of DELAY samples and checks that
+# every trial completes and Transport matches the path to within TOLERANCE samples.
+#   cmake -DFAD_HOST=path/to/fad_host -DALGO=template -DDELAY=100 -DRATE=11025 -P loopback_latency.cmake
+if(NOT DEFINED TOLERANCE)
+    set(TOLERANCE 2)
+endif()
+
+execute_process(COMMAND ${FAD_HOST} -a ${ALGO} -l loopback -L ${DELAY} -t 10
+    OUTPUT_VARIABLE out ERROR_VARIABLE out RESULT_VARIABLE rc)
+if(NOT rc EQUAL 0)
+    message(FATAL_ERROR "fad_host exited with ${rc}:\n${out}")
+endif()
+
+if(NOT out MATCHES "Latency report \\(loopback\\): ([0-9]+) trials, ([0-9]+) timeouts")
+    message(FATAL_ERROR "No loopback latency report:\n${out}")
+endif()
+set(trials ${CMAKE_MATCH_1})
+set(timeouts ${CMAKE_MATCH_2})
+if(NOT timeouts EQUAL 0 OR trials EQUAL 0)
+    message(FATAL_ERROR "${trials} trials, ${timeouts} timeouts:\n${out}")
+endif()
+
+if(NOT out MATCHES "Transport +avg +([0-9.]+) ms +min +([0-9.]+) ms +max +([0-9.]+) ms")
+    message(FATAL_ERROR "No Transport line:\n${out}")
+endif()
+set(min_ms ${CMAKE_MATCH_2})
+set(max_ms ${CMAKE_MATCH_3})
+
+# CMake has integer math only; compare in microseconds
+math(EXPR low_us "(${DELAY} - ${TOLERANCE}) * 1000000 / ${RATE}")
+math(EXPR high_us "(${DELAY} + ${TOLERANCE}) * 1000000 / ${RATE}")
+string(REPLACE "." "" min_us "${min_ms}0")
+string(REPLACE "." "" max_us "${max_ms}0")
+string(REGEX REPLACE "^0+([0-9])" "\\1" min_us "${min_us}")
+string(REGEX REPLACE "^0+([0-9])" "\\1" max_us "${max_us}")
+if(min_us LESS low_us OR max_us GREATER high_us)
+    message(FATAL_ERROR "Transport ${min_ms}-${max_ms} ms, expected ${low_us}-${high_us} us for ${DELAY} samples")
+endif()
+message(STATUS "${trials} trials, Transport ${min_ms}-${max_ms} ms for ${DELAY} samples")
@@ -10,9 +10,8 @@
 
 #include <stdbool.h>
 #include <stdlib.h>
-#include "driver/adc.h"
+#include <string.h>
 #include "hal/adc_types.h"
-#include "hal/adc_ll.h"
 #include "esp_log.h"
 
 #include "main.h"
@@ -21,6 +20,9 @@
 #include "fad_dac.h"
 #include "fad_defs.h"
 #include "fad_timer.h"
+#include "fad_perf.h"
+#include "fad_hal.h"
+#include "fad_mem.h"
 
 static const char *ADC_TAG = "ADC";
 
@@ -28,23 +30,37 @@ static const char *ADC_TAG = "ADC";
  * @brief	Initialize input buffer for ADC data, as well as DAC buffer for output
  * @return
  * 		-ESP_OK if successful
- * 		-ESP_ERR_NO_MEM if buffers cannot be allocated memory
+ * 		-ESP_ERR_NO_MEM if the memory plan has not been reserved (fad_mem_init)
  */
 
 /*Initializes the ADC and DAC buffers*/
 static esp_err_t adc_buffer_init(void)
 {
-	adc_buffer = (uint16_t *)calloc(ADC_BUFFER_SIZE, sizeof(uint16_t));
+	size_t size;
+
+	adc_buffer = (uint16_t *)fad_mem_region(FAD_MEM_ADC, &size);
 	if (adc_buffer == NULL)
 	{
 		return ESP_ERR_NO_MEM;
 	}
+	memset(adc_buffer, 0, size);
 
-	dac_buffer = (uint8_t *)calloc(DAC_BUFFER_SIZE, sizeof(uint8_t));
+	dac_buffer = (uint8_t *)fad_mem_region(FAD_MEM_DAC, &size);
 	if (dac_buffer == NULL)
 	{
 		return ESP_ERR_NO_MEM;
 	}
+	memset(dac_buffer, 0, size);
+
+	if (FAD_ADC_CHANNELS > 1)
+	{
+		adc_buffer_ref = (uint16_t *)fad_mem_region(FAD_MEM_ADC_REF, &size);
+		if (adc_buffer_ref == NULL)
+		{
+			return ESP_ERR_NO_MEM;
+		}
+		memset(adc_buffer_ref, 0, size);
+	}
 
 	adc_buffer_pos = 0;
 	dac_buffer_pos = 0;
@@ -53,20 +69,43 @@ static esp_err_t adc_buffer_init(void)
 }
 
 /**
- * @brief Mimic of ESP-IDF's ADC converter code. Needed to be replicated to utulize IRAM_ATTR and for max speed.
- * See toptal.com/embedded/esp32-audio-sampling for more information
+ * @brief Read one ADC1 sample. Called by the sample ISR.
  * @param channel The channel to be read from
  * @return The value read from the ADC
  */
 int IRAM_ATTR local_adc1_read(int channel)
 {
-	//adc_ll_rtc_enable_channel(ADC_NUM_1, channel);
-	//adc_ll_rtc_start_convert(ADC_NUM_1, channel);
-	//while (adc_ll_rtc_convert_is_done(ADC_NUM_1) != true)
-	//	;
-	//return adc_ll_rtc_get_convert_value(ADC_NUM_1);
+	if (FAD_ADC_FAST_PATH)
+		return fad_hal_adc_read_fast(channel);
+
+	return fad_hal_adc_read_driver(channel);
+}
+
+uint32_t adc_get_poll_timeouts(void)
+{
+	return fad_hal_adc_poll_timeouts();
+}
+
+void adc_benchmark(int iterations)
+{
+	for (int i = 0; i < iterations; i++)
+	{
+		uint32_t start = fad_perf_cycles();
+		fad_hal_adc_read_driver(ADC_CHANNEL);
+		fad_perf_record(FAD_PERF_ADC_DRIVER, fad_perf_cycles() - start);
+	}
 
-	return adc1_get_raw(channel);
+	// The driver may have changed the pad selection, so redo the fast path setup
+	if (FAD_ADC_CHANNELS > 1)
+		fad_hal_adc_init(ADC_CHANNEL_REF);
+	fad_hal_adc_init(ADC_CHANNEL);
+
+	for (int i = 0; i < iterations; i++)
+	{
+		uint32_t start = fad_perf_cycles();
+		fad_hal_adc_read_fast(ADC_CHANNEL);
+		fad_perf_record(FAD_PERF_ADC_FAST, fad_perf_cycles() - start);
+	}
 }
 
 /**
@@ -77,17 +116,19 @@ int IRAM_ATTR local_adc1_read(int channel)
 esp_err_t adc_init()
 {
 
-	//bit width of ADC input
-	adc1_config_width(ADC_WIDTH_BIT_12);
-
-	//attenuation
-	adc1_config_channel_atten(ADC_CHANNEL, ADC_ATTEN_DB_11);
+	//12 bit width, 11 dB attenuation
+	esp_err_t ret = fad_hal_adc_init(ADC_CHANNEL);
+	if (ret)
+		return ret;
 
-	esp_err_t ret;
+	if (FAD_ADC_CHANNELS > 1)
+	{
+		ret = fad_hal_adc_init(ADC_CHANNEL_REF);
+		if (ret)
+			return ret;
+	}
 
 	ret = adc_buffer_init();
 
-	adc1_get_raw(ADC_CHANNEL);
-
 	return ret;
 }
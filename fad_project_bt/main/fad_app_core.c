@@ -6,6 +6,9 @@
  *
  * Description:
  * This file starts the task handlers and queues for the FAD program.
+ * Event parameters travel inside the queue message when they are small, and in a preallocated pool
+ * slot otherwise. Slots are claimed with a compare-and-swap on a bitmap, so any task may dispatch
+ * without a lock, and are released by the app task once the callback returns.
  */
 
 #include <stdint.h>
@@ -17,21 +20,94 @@
 #include "fad_defs.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "fad_hal.h"
+#include "fad_trace.h"
+#include "fad_mem.h"
 
 
 xTaskHandle fadTaskHandle;
-xQueueHandle fadQueueHandle;
+xQueueHandle fadQueueHandles[FAD_APP_CLASS_MAX];
+static SemaphoreHandle_t s_pending;	// one count per event waiting in any class queue
 
-#define QUEUE_LENGTH 5
 #define QUEUE_SIZE sizeof(task_msg)
 #define STACK_DEPTH 2048
 
 #define APP_TAG "FAD_APP_CORE"
 
+_Static_assert(FAD_APP_POOL_SLOTS <= 32, "the pool bitmap holds 32 slots");
+
+typedef union {
+	uint8_t bytes[FAD_APP_POOL_SLOT_SIZE];
+	void *align_ptr;
+	uint32_t align_u32;
+} pool_slot_t;
+
+typedef struct {
+	const char *name;
+	UBaseType_t length;
+	TickType_t send_wait;	// ticks to wait for space before dropping the event
+} class_config_t;
+
+static const class_config_t s_classes[FAD_APP_CLASS_MAX] = {
+	[FAD_APP_CLASS_RT] = { "rt", FAD_APP_RT_QUEUE_LEN, 0 },
+	[FAD_APP_CLASS_CONTROL] = { "control", FAD_APP_CONTROL_QUEUE_LEN, 10 },
+	[FAD_APP_CLASS_BACKGROUND] = { "background", FAD_APP_BACKGROUND_QUEUE_LEN, 0 },
+};
+
+#define PENDING_MAX (FAD_APP_RT_QUEUE_LEN + FAD_APP_CONTROL_QUEUE_LEN + FAD_APP_BACKGROUND_QUEUE_LEN)
+
+static pool_slot_t s_pool[FAD_APP_POOL_SLOTS];
+static uint32_t s_pool_used = 0;	// bit n set while slot n holds parameters
+static fad_app_stats_t s_stats;
+
+static inline void count(uint32_t *counter)
+{
+	__atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+}
+
+static inline void raise_to(uint32_t *high, uint32_t value)
+{
+	uint32_t cur = __atomic_load_n(high, __ATOMIC_RELAXED);
+	while (value > cur &&
+		   !__atomic_compare_exchange_n(high, &cur, value, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/**
+ * @brief Claim a free pool slot
+ * @return The slot number, or -1 if all are taken
+ */
+static int pool_claim(void)
+{
+	uint32_t used = __atomic_load_n(&s_pool_used, __ATOMIC_RELAXED);
+	for (;;)
+	{
+		uint32_t free_bits = ~used & (uint32_t)((1ULL << FAD_APP_POOL_SLOTS) - 1);
+		if (free_bits == 0)
+			return -1;
+
+		int slot = __builtin_ctz(free_bits);
+		uint32_t claimed = used | (1U << slot);
+		if (__atomic_compare_exchange_n(&s_pool_used, &used, claimed, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		{
+			raise_to(&s_stats.pool_high_water, __builtin_popcount(claimed));
+			return slot;
+		}
+		// used now holds the current bitmap; try again
+	}
+}
+
+static void pool_release(int slot)
+{
+	__atomic_fetch_and(&s_pool_used, ~(1U << slot), __ATOMIC_RELEASE);
+}
+
 /**
  * @brief Given an event and any parameters and a destination function, places these items into the event queue
- * to be handled by their corresponding functions
+ * of the given class to be handled by their corresponding functions
+ * @param cls Priority class of the event
  * @param p_cb Callback function that will receive the event
  * @param event Event enum to be passed to p_cb
  * @param p_params Pointer to the parameters for the event handling
@@ -41,9 +117,10 @@ xQueueHandle fadQueueHandle;
  * 		-True if success
  * 		-False if failure
  */
-bool fad_app_work_dispatch(fad_app_cb_t p_cb, uint16_t event, void *p_params, int param_len, fad_app_copy_cb_t p_copy_cb) {
+bool fad_app_work_dispatch_class(fad_app_class_t cls, fad_app_cb_t p_cb, uint16_t event, void *p_params, int param_len, fad_app_copy_cb_t p_copy_cb) {
 
 	//add event to task for it to be handled
+	fad_app_class_stats_t *cstats = &s_stats.classes[cls];
 	task_msg msg;
 	memset(&msg, 0, sizeof(task_msg));
 
@@ -51,20 +128,62 @@ bool fad_app_work_dispatch(fad_app_cb_t p_cb, uint16_t event, void *p_params, in
 	msg.evt = event;
 
 	if(param_len > 0 && p_params) {
-		if((msg.params = malloc(param_len)) != NULL) { //Checks if the parameters are empty
-			memcpy(msg.params, p_params, param_len);
-		} else {
-			ESP_LOGW(APP_TAG, "No mem for param");
+		if(param_len <= (int)FAD_APP_INLINE_PARAM_SIZE) {
+			msg.storage = FAD_APP_PARAMS_INLINE;
+			memcpy(msg.params.bytes, p_params, param_len);
+			count(&s_stats.inline_msgs);
+		} else if(param_len > FAD_APP_POOL_SLOT_SIZE) {
+			count(&s_stats.oversize);
+			ESP_LOGW(APP_TAG, "Param too large: %d bytes", param_len);
 			return false;
+		} else {
+			int slot = pool_claim();
+			if(slot < 0) {
+				count(&s_stats.pool_exhausted);
+				ESP_LOGW(APP_TAG, "Param pool exhausted");
+				return false;
+			}
+			msg.storage = FAD_APP_PARAMS_POOL;
+			msg.slot = slot;
+			memcpy(s_pool[slot].bytes, p_params, param_len);
+			count(&s_stats.pooled_msgs);
 		}
 	}
 
-	if(xQueueSend(fadQueueHandle, &msg, 10) != pdPASS) {
-		ESP_LOGW(APP_TAG, "Queue full...");
+	msg.sent_us = (uint32_t)fad_hal_time_us();
+	if(xQueueSend(fadQueueHandles[cls], &msg, s_classes[cls].send_wait) != pdPASS) {
+		if(msg.storage == FAD_APP_PARAMS_POOL)
+			pool_release(msg.slot);
+		count(&cstats->dropped);
+		fad_trace_instant(FAD_TRACK_APP, FAD_TRACE_DROP, cls);
+		ESP_LOGW(APP_TAG, "%s queue full...", s_classes[cls].name);
 		return false;
-	} else {
-		return true;
 	}
+
+	UBaseType_t depth = uxQueueMessagesWaiting(fadQueueHandles[cls]);
+	count(&cstats->queued);
+	raise_to(&cstats->depth_high_water, depth);
+	if(cls == FAD_APP_CLASS_RT)
+		fad_trace_counter(FAD_TRACK_APP, FAD_TRACE_RT_DEPTH, depth);
+	xSemaphoreGive(s_pending);
+	return true;
+}
+
+bool fad_app_work_dispatch(fad_app_cb_t p_cb, uint16_t event, void *p_params, int param_len, fad_app_copy_cb_t p_copy_cb) {
+	return fad_app_work_dispatch_class(FAD_APP_CLASS_CONTROL, p_cb, event, p_params, param_len, p_copy_cb);
+}
+
+/**
+ * @brief Take the next event from the highest priority class that has one
+ * @param msg [OUT] The event
+ * @return The class it came from, or FAD_APP_CLASS_MAX if every queue is empty
+ */
+static fad_app_class_t next_msg(task_msg *msg) {
+	for(int cls = 0; cls < FAD_APP_CLASS_MAX; cls++) {
+		if(xQueueReceive(fadQueueHandles[cls], msg, 0) == pdPASS)
+			return cls;
+	}
+	return FAD_APP_CLASS_MAX;
 }
 
 /**
@@ -76,25 +195,75 @@ static void fad_app_task_handler(void *params) {
 	ESP_LOGD(APP_TAG, "Beginning task...");
 
 	for(;;) {
-		BaseType_t isData = xQueueReceive(fadQueueHandle, &msg, 5);
+		// Every count given follows a queued event, so a successful take always finds one
+		if(xSemaphoreTake(s_pending, portMAX_DELAY) != pdPASS)
+			continue;
 
-		if(isData == pdPASS) {
+		fad_app_class_t cls = next_msg(&msg);
+		if(cls != FAD_APP_CLASS_MAX) {
 			ESP_LOGD(APP_TAG, "%s event: 0x%x", __func__, msg.evt);
-			msg.cb(msg.evt, msg.params);
-			free(msg.params);
+			fad_app_class_stats_t *cstats = &s_stats.classes[cls];
+			uint32_t latency = (uint32_t)fad_hal_time_us() - msg.sent_us;
+			cstats->latency_sum_us += latency;
+			raise_to(&cstats->latency_max_us, latency);
+			count(&cstats->handled);
+			if(cls == FAD_APP_CLASS_RT)
+				fad_trace_counter(FAD_TRACK_APP, FAD_TRACE_RT_DEPTH, uxQueueMessagesWaiting(fadQueueHandles[cls]));
+
+			void *params = NULL;
+			if(msg.storage == FAD_APP_PARAMS_INLINE)
+				params = msg.params.bytes;
+			else if(msg.storage == FAD_APP_PARAMS_POOL)
+				params = s_pool[msg.slot].bytes;
+
+			fad_trace_begin(FAD_TRACK_APP, FAD_TRACE_EVENT, msg.evt);
+			msg.cb(msg.evt, params);
+			fad_trace_end(FAD_TRACK_APP, FAD_TRACE_EVENT);
+
+			if(msg.storage == FAD_APP_PARAMS_POOL)
+				pool_release(msg.slot);
 		}
 	}
 	vTaskDelete(fadTaskHandle);
 }
 
+void fad_app_get_stats(fad_app_stats_t *stats) {
+	memcpy(stats, &s_stats, sizeof(fad_app_stats_t));
+}
+
+void fad_app_report(void) {
+	fad_app_stats_t stats;
+	fad_app_get_stats(&stats);
+	ESP_LOGI(APP_TAG, "Dispatch: %u inline, %u pooled (%u of %d slots at most), dropped %u pool exhausted, %u oversize",
+			 stats.inline_msgs, stats.pooled_msgs, stats.pool_high_water, FAD_APP_POOL_SLOTS,
+			 stats.pool_exhausted, stats.oversize);
+
+	for(int cls = 0; cls < FAD_APP_CLASS_MAX; cls++) {
+		fad_app_class_stats_t *c = &stats.classes[cls];
+		if(c->queued == 0 && c->dropped == 0)
+			continue;
+		uint32_t avg = c->handled ? (uint32_t)(c->latency_sum_us / c->handled) : 0;
+		ESP_LOGI(APP_TAG, "  %-10s %u queued, %u dropped, depth %u of %u at most, latency avg %u us max %u us",
+				 s_classes[cls].name, c->queued, c->dropped, c->depth_high_water, (unsigned)s_classes[cls].length,
+				 avg, c->latency_max_us);
+	}
+}
+
 /**
  * @brief Creates queue and app task for app functionality through the FreeRTOS API
  */
 void fad_app_task_startup() {
 
-	fadQueueHandle = xQueueCreate(QUEUE_LENGTH, QUEUE_SIZE);
+	for(int cls = 0; cls < FAD_APP_CLASS_MAX; cls++) {
+		fadQueueHandles[cls] = xQueueCreate(s_classes[cls].length, QUEUE_SIZE);
+		if( fadQueueHandles[cls] == NULL ) {
+			ESP_LOGW(APP_TAG, "Queue could not be created");
+			return;
+		}
+	}
 
-	if( fadQueueHandle == NULL ) {
+	s_pending = xSemaphoreCreateCounting(PENDING_MAX, 0);
+	if( s_pending == NULL ) {
 		ESP_LOGW(APP_TAG, "Queue could not be created");
 		return;
 	} else {
@@ -105,6 +274,8 @@ void fad_app_task_startup() {
 	if ( xTaskCreate(fad_app_task_handler, "FAD_Task_Handler", STACK_DEPTH,
 					 0, configMAX_PRIORITIES - 4, &fadTaskHandle) != pdPASS) {
 		ESP_LOGW(APP_TAG, "Could not create task");
+	} else {
+		fad_mem_track_task(fadTaskHandle, "FAD_Task_Handler", STACK_DEPTH);
 	}
 
 }
@@ -114,7 +285,10 @@ void fad_app_task_startup() {
  */
 
 void fad_app_task_shutdown() {
+	fad_mem_untrack_task(fadTaskHandle);
 	vTaskDelete(fadTaskHandle);
-	vQueueDelete(fadQueueHandle);
+	for(int cls = 0; cls < FAD_APP_CLASS_MAX; cls++)
+		vQueueDelete(fadQueueHandles[cls]);
+	vSemaphoreDelete(s_pending);
 }
 
@@ -0,0 +1,419 @@
+/**
+ * fad_bt_buffer.c
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * The A2DP jitter buffer. A single-producer single-consumer ring: the sample ISR only moves the head,
+ * BT_Output_Task only moves the tail (fad_bt_buffer_read, from top_up), so neither needs a lock. Both
+ * indexes run free and are masked on access. The counters and the resampler belong to the output task.
+ *
+ * The output task reads the ring at a ratio of ring samples per output sample, interpolating linearly
+ * between neighbours. The ratio is the sample clock over the sink's rate, corrected by a PI loop that
+ * holds the smoothed fill at the target. The loop is an integrator with the fill as its state:
+ * the fill falls by OUTPUT_FREQ * correction samples a second, so Kp sets a time constant of
+ * 1 / (OUTPUT_FREQ * Kp) and Ki learns the steady clock offset.
+ *
+ * The output task takes resampled blocks from the ring and converts them to the negotiated PCM format
+ * in a second SPSC ring of 32-bit stereo frames: it moves the head, the A2DP callback (BTC task) the
+ * tail, and that tail and two plain counters are all the callback writes. The task
+ * tops that ring up to FAD_BT_PCM_READY after each pull, so the callback only copies. The PCM ring is
+ * not flushed when the sample clock restarts; by then the jitter ring has run dry and what is left in
+ * it is the fade to silence.
+ */
+
+#include <string.h>
+#include <math.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "fad_bt_buffer.h"
+#include "fad_timer.h"
+#include "fad_latency.h"
+#include "fad_mem.h"
+#include "fad_format.h"
+#include "fad_hal.h"
+
+#define BT_BUFFER_TAG "BT_BUFFER"
+#define BT_BUFFER_MASK (FAD_BT_BUFFER_SIZE - 1)
+#define SILENCE 128		// dac_buffer midpoint
+#define PHASE_ONE 65536	// Q16 read phase
+#define PCM_MASK (FAD_BT_PCM_FRAMES - 1)
+#define OUTPUT_TASK_STACK 2048
+#define OUTPUT_TASK_PRIORITY (configMAX_PRIORITIES - 3) // above BTC_TASK, so a pull is topped up before the next
+#define OUTPUT_CHUNK 32			// Ring samples converted per pass; one callback's worth at 44.1 kHz
+#define OUTPUT_WAIT_MS 20		// Top up at least this often, also before the first pull
+
+_Static_assert((FAD_BT_BUFFER_SIZE & BT_BUFFER_MASK) == 0, "FAD_BT_BUFFER_SIZE must be a power of two");
+_Static_assert((DAC_BUFFER_SIZE & (DAC_BUFFER_SIZE - 1)) == 0, "DAC_BUFFER_SIZE must be a power of two for the latency positions");
+_Static_assert(FAD_BT_BUFFER_LOW < FAD_BT_BUFFER_TARGET && FAD_BT_BUFFER_TARGET < FAD_BT_BUFFER_HIGH
+			   && FAD_BT_BUFFER_HIGH < FAD_BT_BUFFER_SIZE, "BT buffer watermarks out of order");
+_Static_assert((FAD_BT_PCM_FRAMES & PCM_MASK) == 0 && FAD_BT_PCM_READY < FAD_BT_PCM_FRAMES,
+			   "FAD_BT_PCM_FRAMES must be a power of two above FAD_BT_PCM_READY");
+
+static uint8_t *s_ring = NULL;
+
+/* Producer side, written by the ISR */
+static volatile uint32_t s_head = 0;
+static volatile uint32_t s_dac_base = 0;		// dac_buffer position of ring index 0, modulo DAC_BUFFER_SIZE
+static volatile bool s_base_valid = false;
+static volatile uint32_t s_overflows = 0;
+
+/* Consumer side, written by the output task */
+static volatile uint32_t s_tail = 0;
+static volatile uint32_t s_generation = 0;		// Bumped by fad_bt_buffer_reset
+static uint32_t s_seen_generation = 0;
+static bool s_playing = false;
+static int s_fade_in = 0;						// Samples left in the fade-in after a refill
+static int s_fade_out = 0;						// Concealed samples since the underrun
+static uint8_t s_last = SILENCE;				// Last sample played
+static fad_bt_buffer_stats_t s_stats;
+static uint64_t s_fill_sum = 0;
+static uint32_t s_fill_count = 0;
+static volatile uint32_t s_first_play_ms = 0;	// When the first ring sample since the reset was converted
+
+/* Resampler, also consumer side */
+static double s_sink_hz = OUTPUT_FREQ;			// Rate the sink takes samples at
+static double s_nominal = 1.0;					// Ring samples per output sample if both clocks were exact
+static uint32_t s_phase = 0;					// Position between the sample at the tail and the next, Q16
+static float s_fill_avg = FAD_BT_BUFFER_TARGET;	// Smoothed fill the loop steers
+static float s_integral_ppm = 0;
+static float s_ppm = 0;							// Correction in use
+static uint32_t s_pcm_delay = 0;				// Sample clock ticks queued in the PCM ring ahead of this read
+
+/* PCM ring: head written by the output task, tail by the callback */
+static uint32_t *s_pcm = NULL;
+static volatile uint32_t s_pcm_head = 0;
+static volatile uint32_t s_pcm_tail = 0;
+static fad_format_desc_t s_format = {FAD_FORMAT_S16_STEREO, 4 * OUTPUT_FREQ, 4, 4};
+static uint8_t s_chunk[OUTPUT_CHUNK];
+static volatile uint32_t s_callbacks = 0;
+static volatile uint32_t s_short_frames = 0;
+static xTaskHandle s_output_task_handle = NULL;
+static SemaphoreHandle_t s_pulled = NULL;
+
+/* Watermarks, scaled from the FAD_BT_BUFFER_* defaults by fad_bt_buffer_set_target */
+static uint16_t s_target = FAD_BT_BUFFER_TARGET;
+static uint16_t s_low = FAD_BT_BUFFER_LOW;
+static uint16_t s_high = FAD_BT_BUFFER_HIGH;
+
+void fad_bt_buffer_reset(void)
+{
+	s_ring = fad_mem_region(FAD_MEM_BT, NULL);
+	s_base_valid = false;	// dac_buffer_pos restarts with the sample clock
+	s_first_play_ms = 0;
+	s_generation++;
+}
+
+esp_err_t fad_bt_buffer_set_sink_rate(uint32_t hz)
+{
+	fad_format_desc_t format;
+	esp_err_t err = fad_format_negotiate(FAD_OUTPUT_BT, hz, &format);
+	if (err == ESP_OK && FAD_BT_PCM_FRAMES % format.upsample != 0)
+		err = ESP_ERR_NOT_SUPPORTED; // a converted block must not wrap
+	if (err)
+	{
+		ESP_LOGE(BT_BUFFER_TAG, "No PCM format for a %u Hz sink", hz);
+		return err;
+	}
+	s_format = format;
+	s_sink_hz = (double)format.rate_hz / format.upsample;
+	s_generation++; // takes effect with a fresh start
+	ESP_LOGI(BT_BUFFER_TAG, "A2DP output: 16-bit stereo at %u Hz, %u frames per sample", format.rate_hz, format.upsample);
+	return ESP_OK;
+}
+
+esp_err_t fad_bt_buffer_set_target(uint16_t target)
+{
+	uint32_t high = (uint32_t)target * FAD_BT_BUFFER_HIGH / FAD_BT_BUFFER_TARGET;
+	if (target < 2 * OUTPUT_CHUNK || high >= FAD_BT_BUFFER_SIZE)
+		return ESP_ERR_INVALID_ARG;
+	s_target = target;
+	s_low = (uint32_t)target * FAD_BT_BUFFER_LOW / FAD_BT_BUFFER_TARGET;
+	s_high = high;
+	s_generation++; // takes effect with a fresh start
+	return ESP_OK;
+}
+
+uint16_t fad_bt_buffer_get_target(void)
+{
+	return s_target;
+}
+
+void IRAM_ATTR fad_bt_buffer_put(uint8_t value, uint16_t dac_pos)
+{
+	uint32_t head = s_head;
+	if (s_ring == NULL)
+		return;
+	if (head - __atomic_load_n(&s_tail, __ATOMIC_ACQUIRE) >= FAD_BT_BUFFER_SIZE)
+	{
+		s_overflows++; // The callback has stopped reading
+		return;
+	}
+	if (!s_base_valid)
+	{
+		s_dac_base = dac_pos - head;
+		s_base_valid = true;
+	}
+	s_ring[head & BT_BUFFER_MASK] = value;
+	__atomic_store_n(&s_head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* Scale a sample's distance from silence by num / FAD_BT_BUFFER_FADE */
+static inline uint8_t fade(uint8_t value, int num)
+{
+	return (uint8_t)(SILENCE + ((int)value - SILENCE) * num / FAD_BT_BUFFER_FADE);
+}
+
+static void conceal(uint8_t *out, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		out[i] = (s_fade_out < FAD_BT_BUFFER_FADE) ? fade(s_last, FAD_BT_BUFFER_FADE - s_fade_out) : SILENCE;
+		s_fade_out++;
+	}
+	s_stats.concealed += count;
+}
+
+int fad_bt_buffer_read(uint8_t *out, int count)
+{
+	if (s_generation != s_seen_generation)
+	{
+		/* The sample clock was stopped; whatever is left in the ring is stale */
+		s_seen_generation = s_generation;
+		s_tail = s_head;
+		s_playing = false;
+		s_fade_out = FAD_BT_BUFFER_FADE;
+		s_last = SILENCE;
+		memset(&s_stats, 0, sizeof(s_stats));
+		s_fill_sum = 0;
+		s_fill_count = 0;
+		s_first_play_ms = 0;
+		s_nominal = adc_timer_get_configured_rate() / MULTISAMPLES / s_sink_hz;
+		s_phase = 0;
+		s_fill_avg = s_target;
+		s_integral_ppm = 0;
+		s_ppm = 0;
+	}
+	s_stats.reads++;
+
+	uint32_t tail = s_tail;
+	uint32_t fill = __atomic_load_n(&s_head, __ATOMIC_ACQUIRE) - tail;
+	if (!s_playing)
+	{
+		if (fill < s_target)
+		{
+			conceal(out, count);
+			s_stats.fill = fill;
+			return 0;
+		}
+		s_playing = true;
+		s_fade_in = FAD_BT_BUFFER_FADE;
+		if (s_first_play_ms == 0)
+			s_first_play_ms = (uint32_t)(fad_hal_time_us() / 1000) | 1; // 0 means "not yet"; 1 ms either way
+		s_fill_avg = fill;
+	}
+
+	if (fill > s_high)
+	{
+		uint32_t drop = fill - s_target;
+		tail += drop;
+		fill = s_target;
+		s_stats.drops++;
+		s_stats.dropped += drop;
+		s_fill_avg = fill;
+	}
+	if (fill > s_stats.fill_max)
+		s_stats.fill_max = fill;
+
+	if (FAD_BT_ASRC_ENABLE)
+	{
+		/* Steer before reading, from the fill the ISR has built up since the last read */
+		float dt = (float)count / s_sink_hz;
+		s_fill_avg += ((float)fill - s_fill_avg) / FAD_BT_ASRC_SMOOTHING;
+		float error = s_fill_avg - s_target;
+		s_integral_ppm += FAD_BT_ASRC_KI_PPM * error * dt;
+		s_integral_ppm = fmaxf(-FAD_BT_ASRC_MAX_PPM, fminf(FAD_BT_ASRC_MAX_PPM, s_integral_ppm));
+		s_ppm = fmaxf(-FAD_BT_ASRC_MAX_PPM, fminf(FAD_BT_ASRC_MAX_PPM, FAD_BT_ASRC_KP_PPM * error + s_integral_ppm));
+	}
+	uint32_t step = (uint32_t)lround(PHASE_ONE * s_nominal * (1.0 + s_ppm * 1e-6));
+
+	/* Each output sample needs the ring sample at the read position and the one after it */
+	uint32_t pos = 0;
+	uint32_t phase = s_phase;
+	int n = 0;
+	for (; n < count && pos + (phase ? 1 : 0) < fill; n++)
+	{
+		int a = s_ring[(tail + pos) & BT_BUFFER_MASK];
+		int b = phase ? s_ring[(tail + pos + 1) & BT_BUFFER_MASK] : a;
+		uint8_t value = (uint8_t)(a + (((b - a) * (int32_t)phase) >> 16));
+		if (s_fade_in > 0)
+			value = fade(value, FAD_BT_BUFFER_FADE - s_fade_in--);
+		out[n] = value;
+		if (fad_latency_armed)
+			fad_latency_isr_output((s_dac_base + tail + pos) % DAC_BUFFER_SIZE, adc_timer_get_sample_count() + s_pcm_delay);
+		phase += step;
+		pos += phase >> 16;
+		phase &= PHASE_ONE - 1;
+	}
+	s_phase = phase;
+	tail += pos;
+	if (n > 0)
+		s_last = out[n - 1];
+	__atomic_store_n(&s_tail, tail, __ATOMIC_RELEASE);
+	s_stats.played += pos;
+	fill -= pos;
+
+	if (n < count)
+	{
+		/* Underrun: fade out and refill to the target, so the next one is as far away as at the start */
+		s_stats.underruns++;
+		s_playing = false;
+		s_fade_out = 0;
+		conceal(out + n, count - n);
+	}
+	else
+	{
+		if (fill < s_low)
+			s_stats.lows++;
+		if (s_fill_count == 0 || fill < s_stats.fill_min)
+			s_stats.fill_min = fill;
+		s_fill_sum += fill;
+		s_fill_count++;
+	}
+	s_stats.fill = fill;
+	return n;
+}
+
+/**
+ * @brief Convert from the jitter ring until the PCM ring holds FAD_BT_PCM_READY frames
+ */
+static void top_up(void)
+{
+	uint32_t head = s_pcm_head;
+	for (;;)
+	{
+		uint32_t fill = head - __atomic_load_n(&s_pcm_tail, __ATOMIC_ACQUIRE);
+		if (fill >= FAD_BT_PCM_READY)
+			break;
+
+		/* Stop at the end of the ring; the next pass starts at its beginning */
+		uint32_t room = FAD_BT_PCM_FRAMES - fill;
+		uint32_t contiguous = FAD_BT_PCM_FRAMES - (head & PCM_MASK);
+		int count = (contiguous < room ? contiguous : room) / s_format.upsample;
+		if (count > OUTPUT_CHUNK)
+			count = OUTPUT_CHUNK;
+		if (count == 0)
+			break;
+
+		s_pcm_delay = fill / s_format.upsample * MULTISAMPLES;
+		fad_bt_buffer_read(s_chunk, count);
+		fad_format_convert(&s_format, s_chunk, count, &s_pcm[head & PCM_MASK]);
+		head += count * s_format.upsample;
+		__atomic_store_n(&s_pcm_head, head, __ATOMIC_RELEASE);
+	}
+}
+
+/**
+ * @brief FreeRTOS task that keeps the PCM ring ready for the A2DP callback
+ * @param params [in] required as part of the task function definition
+ */
+static void bt_output_task(void *params)
+{
+	for (;;)
+	{
+		xSemaphoreTake(s_pulled, pdMS_TO_TICKS(OUTPUT_WAIT_MS));
+		top_up();
+	}
+
+	fad_mem_untrack_task(s_output_task_handle);
+	vTaskDelete(s_output_task_handle);
+}
+
+esp_err_t fad_bt_buffer_init(void)
+{
+	if (s_output_task_handle != NULL)
+		return ESP_OK;
+
+	uint8_t *region = fad_mem_region(FAD_MEM_BT, NULL);
+	if (region == NULL)
+		return ESP_ERR_NO_MEM;
+	s_ring = region;
+	s_pcm = (uint32_t *)(region + FAD_BT_BUFFER_SIZE);
+
+	s_pulled = xSemaphoreCreateBinary();
+	if (s_pulled == NULL)
+		return ESP_ERR_NO_MEM;
+	xTaskCreate(bt_output_task, "BT_Output_Task", OUTPUT_TASK_STACK, 0, OUTPUT_TASK_PRIORITY, &s_output_task_handle);
+	if (s_output_task_handle == NULL)
+		return ESP_ERR_NO_MEM;
+	fad_mem_track_task(s_output_task_handle, "BT_Output_Task", OUTPUT_TASK_STACK);
+	return ESP_OK;
+}
+
+int fad_bt_buffer_pull(uint8_t *data, int len)
+{
+	uint32_t frames = len / s_format.frame_bytes;
+	uint32_t tail = s_pcm_tail;
+	uint32_t fill = (s_pcm == NULL) ? 0 : __atomic_load_n(&s_pcm_head, __ATOMIC_ACQUIRE) - tail;
+	uint32_t n = (frames < fill) ? frames : fill;
+
+	/* At most two copies, split where the ring wraps */
+	uint32_t first = FAD_BT_PCM_FRAMES - (tail & PCM_MASK);
+	if (first > n)
+		first = n;
+	memcpy(data, &s_pcm[tail & PCM_MASK], first * sizeof(uint32_t));
+	memcpy(data + first * sizeof(uint32_t), s_pcm, (n - first) * sizeof(uint32_t));
+	__atomic_store_n(&s_pcm_tail, tail + n, __ATOMIC_RELEASE);
+
+	if (n < frames)
+	{
+		/* The output task fell behind; pad with silence rather than stall Bluedroid */
+		memset(data + n * sizeof(uint32_t), 0, len - n * sizeof(uint32_t));
+		s_short_frames += frames - n;
+	}
+	s_callbacks++;
+	if (s_pulled != NULL)
+		xSemaphoreGive(s_pulled);
+	return n * s_format.frame_bytes;
+}
+
+uint32_t fad_bt_buffer_first_play_ms(void)
+{
+	return s_first_play_ms;
+}
+
+void fad_bt_buffer_get_stats(fad_bt_buffer_stats_t *stats)
+{
+	memcpy(stats, &s_stats, sizeof(fad_bt_buffer_stats_t));
+	stats->fill_avg = s_fill_count ? (float)s_fill_sum / s_fill_count : 0;
+	stats->playing = s_playing;
+	stats->overflows = s_overflows;
+	stats->ratio = s_nominal;
+	stats->correction_ppm = s_ppm;
+	stats->callbacks = s_callbacks;
+	stats->short_frames = s_short_frames;
+	stats->pcm_fill = s_pcm_head - s_pcm_tail;
+}
+
+void fad_bt_buffer_report(void)
+{
+	fad_bt_buffer_stats_t stats;
+	fad_bt_buffer_get_stats(&stats);
+	if (stats.reads == 0)
+		return; // Output is wired
+	ESP_LOGI(BT_BUFFER_TAG, "A2DP buffer %s: fill %u (%.1f ms), avg %.1f ms, min %u, max %u of target %d",
+			 stats.playing ? "playing" : "filling", stats.fill, stats.fill * 1000.0 / OUTPUT_FREQ,
+			 stats.fill_avg * 1000.0 / OUTPUT_FREQ, stats.fill_min, stats.fill_max, s_target);
+	ESP_LOGI(BT_BUFFER_TAG, "  PCM ring %u frames (%.1f ms) at %u Hz, %u callbacks, %u frames short",
+			 stats.pcm_fill, stats.pcm_fill * 1000.0 / s_format.rate_hz, s_format.rate_hz, stats.callbacks, stats.short_frames);
+	ESP_LOGI(BT_BUFFER_TAG, "  %u reads, %u played, %u concealed, %u underruns, %u low, %u drops (%u samples), %u overflows",
+			 stats.reads, stats.played, stats.concealed, stats.underruns, stats.lows, stats.drops, stats.dropped, stats.overflows);
+	if (FAD_BT_ASRC_ENABLE)
+		ESP_LOGI(BT_BUFFER_TAG, "  resampling %.6f ring samples per output sample, %+.1f ppm of it steering the fill",
+				 stats.ratio * (1.0 + stats.correction_ppm * 1e-6), stats.correction_ppm);
+}
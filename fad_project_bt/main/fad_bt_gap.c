@@ -21,40 +21,128 @@
 
 #include "main.h"
 #include "fad_app_core.h"
+#include "fad_bt_gap.h"
+#include "fad_bt_telemetry.h"
+#include "fad_hal.h"
 
 static const char *GAP_TAG = "FAD_GAP";
 
+#define NO_RSSI -128                // Response without an RSSI; ranks last
+#define AUDIO_SINK_UUID 0x110B      // A2DP sink service class
+#define COD_SRVC_SINK (ESP_BT_COD_SRVC_RENDERING | ESP_BT_COD_SRVC_AUDIO) // Service class bits 18 and 21
+#define COD_MINOR_HEADSET 1         // Minor classes of the audio/video major class, for sinks that set no service bits
+#define COD_MINOR_HEADPHONES 6
+
+/* A name learnt from an inquiry response, kept across discoveries */
+typedef struct {
+    esp_bd_addr_t bda;
+    char name[FAD_GAP_NAME_LEN + 1];
+} name_entry_t;
+
+static fad_gap_candidate_t s_candidates[FAD_GAP_MAX_CANDIDATES];
+static int s_num_candidates = 0;
+static name_entry_t s_names[FAD_GAP_NAME_CACHE];
+static int s_next_name = 0;         // Entry replaced next once the cache is full
+static fad_gap_stats_t s_stats;
+static int64_t s_start_us = 0;
+static esp_bd_addr_t s_failed_bda;         // Last device the A2DP source gave up on
+static bool s_have_failed = false;
+static bool s_registered = false;
+
 static void fad_gap_cb(esp_bt_gap_cb_event_t evt, esp_bt_gap_cb_param_t *params);
 
+static uint32_t elapsed_ms(void)
+{
+    return (uint32_t)((fad_hal_time_us() - s_start_us) / 1000);
+}
+
+static esp_err_t gap_register(void)
+{
+    if (s_registered)
+        return ESP_OK;
+    esp_err_t err = esp_bt_gap_register_callback(fad_gap_cb);
+    if (err == ESP_OK)
+        s_registered = true;
+    return err;
+}
+
 esp_err_t fad_gap_start_discovery()
 {
-    esp_err_t err = 0;
+    esp_err_t err = gap_register();
+    if (err)
+        return err;
+
+    /* A new discovery forgets the last one's candidates; one already running just carries on with none */
+    bool running = s_stats.running;
+    memset(s_candidates, 0, sizeof(s_candidates));
+    s_num_candidates = 0;
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_stats.running = true;
+    s_stats.rounds = 1;
+    s_start_us = fad_hal_time_us();
+    if (running)
+        return ESP_OK;
 
     err = esp_bt_gap_set_scan_mode(ESP_BT_CONNECTABLE, ESP_BT_GENERAL_DISCOVERABLE);
+    err = esp_bt_gap_start_discovery(ESP_BT_INQ_MODE_GENERAL_INQUIRY, FAD_GAP_INQUIRY_LEN, 0);
+    if (err)
+        s_stats.running = false;
+    return err;
+}
 
-    err = esp_bt_gap_register_callback(fad_gap_cb);
+esp_err_t fad_gap_read_rssi(esp_bd_addr_t bda)
+{
+    esp_err_t err = gap_register();
+    if (err)
+        return err;
+    return esp_bt_gap_read_rssi_delta(bda);
+}
 
-    err = esp_bt_gap_start_discovery(ESP_BT_INQ_MODE_GENERAL_INQUIRY, 0x10, 0);
+int fad_gap_get_candidates(fad_gap_candidate_t *candidates, int max)
+{
+    int n = (s_num_candidates < max) ? s_num_candidates : max;
+    memcpy(candidates, s_candidates, n * sizeof(fad_gap_candidate_t));
+    return n;
+}
 
-    return err;
+void fad_gap_get_stats(fad_gap_stats_t *stats)
+{
+    memcpy(stats, &s_stats, sizeof(fad_gap_stats_t));
+    if (s_stats.running)
+        stats->elapsed_ms = elapsed_ms();
+}
+
+void fad_gap_connect_failed(const esp_bd_addr_t bda)
+{
+    memcpy(s_failed_bda, bda, sizeof(esp_bd_addr_t));
+    s_have_failed = true;
+}
+
+void fad_gap_connected(void)
+{
+    s_have_failed = false;
 }
 
-static void found_address(esp_bd_addr_t peer_addr)
+static void found_address(const fad_gap_candidate_t *candidate)
 {
     /* Disable discoverability and connectability, end search */
-    esp_bt_gap_cancel_discovery();
     esp_bt_gap_set_scan_mode(ESP_BT_NON_CONNECTABLE, ESP_BT_NON_DISCOVERABLE);
+    s_stats.running = false;
+    s_stats.elapsed_ms = elapsed_ms();
 
     /* Send found address back to main function for storage/connection */
     fad_main_cb_param_t p;
     p.addr_found.from_nvs = false;
-    memcpy(p.addr_found.peer_addr, peer_addr, sizeof(esp_bd_addr_t));
+    memcpy(p.addr_found.peer_addr, candidate->bda, sizeof(esp_bd_addr_t));
 
     fad_app_work_dispatch(fad_main_stack_evt_handler, FAD_BT_ADDR_FOUND, (void*)&p, sizeof(fad_main_cb_param_t), NULL);
-    ESP_LOGI(GAP_TAG, "Set Addr: %x:%x:%x:%x:%x:%x", peer_addr[0], peer_addr[1], peer_addr[2], peer_addr[3], peer_addr[4], peer_addr[5]);
+    const uint8_t *a = candidate->bda;
+    ESP_LOGI(GAP_TAG, "Chose %s (%x:%x:%x:%x:%x:%x) at %d dBm of %d candidates after %u ms; %u responses, %u not audio sinks, %u too weak",
+             candidate->name[0] ? candidate->name : "unnamed device", a[0], a[1], a[2], a[3], a[4], a[5], candidate->rssi,
+             s_num_candidates, s_stats.elapsed_ms, s_stats.responses, s_stats.rejected_class, s_stats.rejected_rssi);
 }
 
-static bool get_name_from_eir(uint8_t *eir, uint8_t *bdname, uint8_t *bdname_len)
+static bool get_name_from_eir(uint8_t *eir, char *bdname)
 {
     uint8_t *rmt_bdname = NULL;
     uint8_t rmt_bdname_len = 0;
@@ -72,56 +160,100 @@ static bool get_name_from_eir(uint8_t *eir, uint8_t *bdname, uint8_t *bdname_len
 
     if (rmt_bdname)
     {
-        if (rmt_bdname_len > ESP_BT_GAP_MAX_BDNAME_LEN)
+        if (rmt_bdname_len > FAD_GAP_NAME_LEN)
         {
-            rmt_bdname_len = ESP_BT_GAP_MAX_BDNAME_LEN;
+            rmt_bdname_len = FAD_GAP_NAME_LEN;
         }
+        memcpy(bdname, rmt_bdname, rmt_bdname_len);
+        bdname[rmt_bdname_len] = '\0';
+        return true;
+    }
 
-        if (bdname)
-        {
-            memcpy(bdname, rmt_bdname, rmt_bdname_len);
-            bdname[rmt_bdname_len] = '\0';
-        }
-        if (bdname_len)
+    return false;
+}
+
+/* Remember a name, or look one up if name is empty */
+static void cache_name(const esp_bd_addr_t bda, char *name)
+{
+    for (int i = 0; i < FAD_GAP_NAME_CACHE; i++)
+    {
+        if (memcmp(s_names[i].bda, bda, sizeof(esp_bd_addr_t)) == 0 && s_names[i].name[0])
         {
-            *bdname_len = rmt_bdname_len;
+            if (name[0])
+                strcpy(s_names[i].name, name);
+            else
+                strcpy(name, s_names[i].name);
+            return;
         }
-        return true;
     }
+    if (name[0])
+    {
+        memcpy(s_names[s_next_name].bda, bda, sizeof(esp_bd_addr_t));
+        strcpy(s_names[s_next_name].name, name);
+        s_next_name = (s_next_name + 1) % FAD_GAP_NAME_CACHE;
+    }
+}
 
+/* Whether an EIR service list of the given type names the A2DP sink. *listed, if given, is false without such a list */
+static bool eir_lists_sink(uint8_t *eir, esp_bt_eir_type_t type, bool *listed)
+{
+    uint8_t len = 0;
+    uint8_t *uuids = esp_bt_gap_resolve_eir_data(eir, type, &len);
+    if (listed)
+        *listed = (uuids != NULL);
+    for (int i = 0; uuids && i + 1 < len; i += 2)
+        if ((uuids[i] | (uuids[i + 1] << 8)) == AUDIO_SINK_UUID)
+            return true;
     return false;
 }
 
-static void parse_props(int num_props, esp_bt_gap_dev_prop_t *props, esp_bd_addr_t bda)
+/* Whether a responder takes A2DP. A 16-bit service list naming the sink settles it, and so does a complete list
+   without it. Otherwise go by the class of device: the rendering and audio service bits, or a headset or headphones */
+static bool is_audio_sink(uint32_t cod, uint8_t *eir)
 {
-    if (!num_props)
-        return;
+    if (eir)
+    {
+        bool complete;
+        if (eir_lists_sink(eir, ESP_BT_EIR_TYPE_CMPL_16BITS_UUID, &complete)
+            || eir_lists_sink(eir, ESP_BT_EIR_TYPE_INCMPL_16BITS_UUID, NULL))
+            return true;
+        if (complete)
+            return false;
+    }
 
+    if (!esp_bt_gap_is_valid_cod(cod))
+        return false;
+    if ((esp_bt_gap_get_cod_srvc(cod) & COD_SRVC_SINK) == COD_SRVC_SINK)
+        return true;
+    uint32_t major = esp_bt_gap_get_cod_major_dev(cod);
+    uint32_t minor = esp_bt_gap_get_cod_minor_dev(cod);
+    return major == ESP_BT_COD_MAJOR_DEV_AV && (minor == COD_MINOR_HEADSET || minor == COD_MINOR_HEADPHONES);
+}
+
+static void parse_props(int num_props, esp_bt_gap_dev_prop_t *props, esp_bd_addr_t bda)
+{
     uint32_t cod = 0;
-    // int32_t rssi = -129; /* invalid value */
+    int rssi = NO_RSSI;
     uint8_t *eir = NULL;
+    char name[FAD_GAP_NAME_LEN + 1] = "";
 
+    s_stats.responses++;
     for (int i = 0; i < num_props; i++)
     {
         switch (props[i].type)
         {
-        case ESP_BT_GAP_DEV_PROP_BDNAME:
+        case ESP_BT_GAP_DEV_PROP_BDNAME:;
+            int len = (props[i].len < FAD_GAP_NAME_LEN) ? props[i].len : FAD_GAP_NAME_LEN;
+            memcpy(name, props[i].val, len);
+            name[len] = '\0';
             break;
 
-        case ESP_BT_GAP_DEV_PROP_COD:;
+        case ESP_BT_GAP_DEV_PROP_COD:
             cod = *(uint32_t *)props[i].val;
-            if (esp_bt_gap_is_valid_cod(cod))
-            {
-                uint32_t major = esp_bt_gap_get_cod_major_dev(cod);
-                uint32_t srvc = esp_bt_gap_get_cod_srvc(cod);
-                uint32_t minor = esp_bt_gap_get_cod_minor_dev(cod);
-                ESP_LOGI(GAP_TAG, "Class of device: Major->%x Minor->%x Srvc->%x",
-                     major, minor, srvc);
-            }
             break;
 
         case ESP_BT_GAP_DEV_PROP_RSSI:
-            // rssi = *(int8_t *)props[i].val;
+            rssi = *(int8_t *)props[i].val;
             break;
 
         case ESP_BT_GAP_DEV_PROP_EIR:
@@ -130,30 +262,98 @@ static void parse_props(int num_props, esp_bt_gap_dev_prop_t *props, esp_bd_addr
         }
     }
 
-    if (esp_bt_gap_is_valid_cod(cod))
+    if (!is_audio_sink(cod, eir))
+    {
+        ESP_LOGD(GAP_TAG, "Not an audio sink. COD: %x", cod);
+        s_stats.rejected_class++;
+        return;
+    }
+    if (rssi != NO_RSSI && rssi < FAD_GAP_MIN_RSSI)
+    {
+        ESP_LOGD(GAP_TAG, "Audio sink too far away: %d dBm", rssi);
+        s_stats.rejected_rssi++;
+        return;
+    }
+    if (!name[0])
+        get_name_from_eir(eir, name);
+    cache_name(bda, name);
+
+    /* Keep the strongest response of each device. A full table gives up its weakest entry to a stronger one */
+    fad_gap_candidate_t *candidate = NULL;
+    for (int i = 0; i < s_num_candidates; i++)
+        if (memcmp(s_candidates[i].bda, bda, sizeof(esp_bd_addr_t)) == 0)
+            candidate = &s_candidates[i];
+    if (candidate == NULL)
     {
-        uint32_t major = esp_bt_gap_get_cod_major_dev(cod);
-        // uint32_t srvc = esp_bt_gap_get_cod_srvc(cod);
-        uint32_t minor = esp_bt_gap_get_cod_minor_dev(cod);
-        if (major != 4 || (minor != 6 && minor != 1))
+        if (s_num_candidates < FAD_GAP_MAX_CANDIDATES)
         {
-            ESP_LOGI(GAP_TAG, "Not correct COD. Major: %x, Minor: %x", major, minor);
-            return;
+            candidate = &s_candidates[s_num_candidates++];
+        }
+        else
+        {
+            candidate = &s_candidates[0];
+            for (int i = 1; i < s_num_candidates; i++)
+                if (s_candidates[i].rssi < candidate->rssi)
+                    candidate = &s_candidates[i];
+            if (candidate->rssi >= rssi)
+                return;
         }
+        memset(candidate, 0, sizeof(fad_gap_candidate_t));
+        memcpy(candidate->bda, bda, sizeof(esp_bd_addr_t));
+        candidate->rssi = NO_RSSI;
     }
+    if (candidate->responses == 0 || rssi > candidate->rssi)
+        candidate->rssi = rssi;
+    candidate->cod = cod;
+    candidate->responses++;
+    if (name[0])
+        strcpy(candidate->name, name);
+    ESP_LOGI(GAP_TAG, "Audio sink %s at %d dBm", candidate->name[0] ? candidate->name : "(no name)", rssi);
 
-    if (eir)
-    {
-        unsigned char *peer_bdname = (unsigned char *)malloc(ESP_BT_GAP_MAX_BDNAME_LEN);
-        get_name_from_eir(eir, peer_bdname, NULL);
+    /* One right next to us will not be beaten; stop asking once the others have had time to answer */
+    if (rssi >= FAD_GAP_STRONG_RSSI && elapsed_ms() >= FAD_GAP_SETTLE_MS)
+        esp_bt_gap_cancel_discovery();
+}
+
+/* Rank by RSSI. The device the last connection attempts failed on ranks below every other */
+static int rank(const fad_gap_candidate_t *candidate)
+{
+    bool failed = s_have_failed && memcmp(candidate->bda, s_failed_bda, sizeof(esp_bd_addr_t)) == 0;
+    return candidate->rssi - (failed ? 256 : 0);
+}
+
+static int best_candidate(void)
+{
+    int best = -1;
+    for (int i = 0; i < s_num_candidates; i++)
+        if (best < 0 || rank(&s_candidates[i]) > rank(&s_candidates[best]))
+            best = i;
+    return best;
+}
 
-        ESP_LOGI(GAP_TAG, "Found a target device, name %s", peer_bdname);
-    } else
+static void discovery_stopped(void)
+{
+    if (!s_stats.running)
+        return;
+
+    int best = best_candidate();
+    if (best >= 0)
     {
-        ESP_LOGI(GAP_TAG, "Found a nameless target device.");
+        found_address(&s_candidates[best]);
+    }
+    else if (s_stats.rounds < FAD_GAP_INQUIRY_ROUNDS)
+    {
+        s_stats.rounds++;
+        esp_bt_gap_start_discovery(ESP_BT_INQ_MODE_GENERAL_INQUIRY, FAD_GAP_INQUIRY_LEN, 0);
+    }
+    else
+    {
+        esp_bt_gap_set_scan_mode(ESP_BT_NON_CONNECTABLE, ESP_BT_NON_DISCOVERABLE);
+        s_stats.running = false;
+        s_stats.elapsed_ms = elapsed_ms();
+        ESP_LOGW(GAP_TAG, "No audio sink after %u ms: %u responses, %u not audio sinks, %u too weak",
+                 s_stats.elapsed_ms, s_stats.responses, s_stats.rejected_class, s_stats.rejected_rssi);
     }
-
-    found_address(bda);
 }
 
 static void fad_gap_cb(esp_bt_gap_cb_event_t evt, esp_bt_gap_cb_param_t *params)
@@ -168,14 +368,21 @@ static void fad_gap_cb(esp_bt_gap_cb_event_t evt, esp_bt_gap_cb_param_t *params)
         else if (params->disc_st_chg.state == ESP_BT_GAP_DISCOVERY_STOPPED)
         {
             ESP_LOGI(GAP_TAG, "Discovery Stopped.");
+            discovery_stopped();
         };
         break;
 
     case ESP_BT_GAP_DISC_RES_EVT:;
         unsigned char *addr = params->disc_res.bda;
-        ESP_LOGI(GAP_TAG, "Device Found. ADDR: %x:%x:%x:%x:%x:%x",
+        ESP_LOGD(GAP_TAG, "Device Found. ADDR: %x:%x:%x:%x:%x:%x",
                  addr[0], addr[1], addr[2], addr[3], addr[4], addr[5]);
-        parse_props(params->disc_res.num_prop, params->disc_res.prop, params->disc_res.bda);
+        if (s_stats.running)
+            parse_props(params->disc_res.num_prop, params->disc_res.prop, params->disc_res.bda);
+        break;
+
+    case ESP_BT_GAP_READ_RSSI_DELTA_EVT:
+        if (params->read_rssi_delta.stat == ESP_BT_STATUS_SUCCESS)
+            fad_bt_telemetry_rssi(params->read_rssi_delta.rssi_delta);
         break;
     default:
         ESP_LOGI(GAP_TAG, "CB Event: 0x%x", evt);
@@ -20,10 +20,21 @@
 #include "esp_log.h"
 #include "esp_avrc_api.h"
 #include "esp_a2dp_api.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
 
 #include "fad_bt_main.h"
+#include "fad_bt_gap.h"
 #include "fad_app_core.h"
 #include "fad_defs.h"
+#include "fad_latency.h"
+#include "fad_timer.h"
+#include "fad_trace.h"
+#include "fad_mem.h"
+#include "fad_bt_buffer.h"
+#include "fad_bt_telemetry.h"
+#include "fad_hal.h"
 #include "main.h"
 
 // AVRCP used transaction label
@@ -31,8 +42,12 @@
 #define APP_RC_CT_TL_RN_VOLUME_CHANGE (1)
 #define APP_RC_CT_TL_RN_BATTERY_CHANGE (2)
 
-// output aliasing (converts 1 output value to N output values)
-#define FAD_OUTPUT_BT_ALIASING 4
+// SBC sample rate of the A2DP source
+#define FAD_OUTPUT_BT_SINK_HZ 44100
+
+// Task that brings the controller up while the app task initialises audio
+#define BT_INIT_TASK_STACK 3072
+#define BT_INIT_TASK_PRIORITY (configMAX_PRIORITIES - 4) // level with the app task; they run on both cores
 
 enum
 {
@@ -60,6 +75,8 @@ static void bt_app_rc_ct_cb(esp_avrc_ct_cb_event_t event, esp_avrc_ct_cb_param_t
 
 static void bt_av_hdl_avrc_ct_evt(uint16_t event, void *p_param);
 
+static void bt_av_hdl_a2d_evt(uint16_t event, void *p_param);
+
 static void bt_secondary_stack_init();
 
 static esp_avrc_rn_evt_cap_mask_t s_avrc_peer_rn_cap;
@@ -67,10 +84,87 @@ static const char *BT_TAG = "FAD_BT";
 static int s_media_state = APP_AV_MEDIA_STATE_IDLE;
 static int s_a2dp_conn_state = A2DP_CONN_STATE_UNCONNECTED;
 static esp_bd_addr_t s_peer_bda = {0, 0, 0, 0, 0, 0};
-static int s_out_pos = 0;
 
-/// Delay for when BT output is just beginning
-static int s_buffer_fill_delay = 0;
+/// Speech queue: the shortest whose low mark (scaled to 32 samples) still leaves one conversion block above empty
+#define SPEECH_QUEUE_SAMPLES 128
+
+/// SBC presets, indexed by fad_bt_preset_t. ESP-IDF 4.x fixes the codec settings, so they only differ in queue depth
+static const fad_bt_sbc_config_t s_presets[FAD_BT_PRESET_CUSTOM] = {
+    {16, 8, 53, FAD_BT_SBC_JOINT_STEREO, FAD_BT_BUFFER_TARGET},
+    {16, 8, 53, FAD_BT_SBC_JOINT_STEREO, SPEECH_QUEUE_SAMPLES},
+};
+static const char *s_preset_names[FAD_BT_PRESET_MAX] = {"music", "speech", "custom"};
+
+/// What a preset measured while it was in use
+typedef struct {
+    bool valid;
+    fad_latency_mode_t mode;    // INJECT stops at the encoder, LOOPBACK is mouth to ear
+    int trials;
+    float latency_ms;
+    uint32_t bitrate;           // Of the stream the latency was measured on; 0 if none was configured
+} preset_record_t;
+
+static fad_bt_preset_t s_preset = FAD_BT_PRESET_MUSIC; // Bluedroid's defaults until fad_bt_init applies FAD_BT_SBC_PRESET
+static fad_bt_sbc_config_t s_requested = {16, 8, 53, FAD_BT_SBC_JOINT_STEREO, FAD_BT_BUFFER_TARGET};
+static fad_bt_sbc_config_t s_negotiated;
+static uint32_t s_negotiated_hz = 0; // 0 until the headset configures a stream
+static preset_record_t s_records[FAD_BT_PRESET_MAX];
+static uint64_t s_latency_seen = 0;  // Latency report already credited to a preset
+
+/// Connection cycle: from boot, or from a lost link, to the first audio
+static fad_bt_connect_times_t s_times = {.power_on = true};
+static int64_t s_cycle_start_us = 0;
+static uint8_t s_attempts = 0;       // Connection attempts this cycle
+static bool s_disconnecting = false; // We asked for the disconnect, so do not reconnect
+static TimerHandle_t s_retry_timer = NULL;
+static xTaskHandle s_init_task_handle = NULL;
+static esp_bd_addr_t s_start_peer;
+static bool s_start_has_peer = false;
+
+static uint32_t cycle_ms(void)
+{
+    uint32_t ms = (uint32_t)((fad_hal_time_us() - s_cycle_start_us) / 1000);
+    return ms ? ms : 1; // 0 means "not yet"
+}
+
+static void bt_connect_failed(void);
+
+/// Start a connection attempt to s_peer_bda. The connection state belongs to the app task: the attempts
+/// start from FAD_BT_CONNECT and FAD_BT_RETRY, and the A2DP events are dispatched to it
+static void bt_connect_attempt(void)
+{
+    s_attempts++;
+    s_a2dp_conn_state = A2DP_CONN_STATE_CONNECTING;
+    if (esp_a2d_source_connect(s_peer_bda) != ESP_OK)
+    {
+        ESP_LOGW(BT_TAG, "Could not start connection attempt %d", s_attempts);
+        s_a2dp_conn_state = A2DP_CONN_STATE_UNCONNECTED;
+        bt_connect_failed();
+    }
+}
+
+/// An attempt failed: try again after a wait that doubles each time, or give up and let the user discover
+static void bt_connect_failed(void)
+{
+    fad_gap_connect_failed(s_peer_bda);
+    if (s_attempts >= FAD_BT_RECONNECT_ATTEMPTS)
+    {
+        ESP_LOGW(BT_TAG, "No answer after %d attempts. Initializing GAP to find new device...", s_attempts);
+        s_attempts = 0;
+        fad_app_work_dispatch(fad_main_stack_evt_handler, FAD_DISC_START, NULL, 0, NULL);
+        return;
+    }
+    uint32_t delay_ms = FAD_BT_RECONNECT_MAX_MS;
+    if (s_attempts <= 16 && ((uint32_t)FAD_BT_RECONNECT_FIRST_MS << (s_attempts - 1)) < FAD_BT_RECONNECT_MAX_MS)
+        delay_ms = (uint32_t)FAD_BT_RECONNECT_FIRST_MS << (s_attempts - 1);
+    ESP_LOGI(BT_TAG, "Connection attempt %d failed, retrying in %u ms", s_attempts, delay_ms);
+    xTimerChangePeriod(s_retry_timer, pdMS_TO_TICKS(delay_ms), 0); // starts the timer too
+}
+
+static void bt_retry_timer_cb(TimerHandle_t timer)
+{
+    fad_app_work_dispatch(fad_bt_stack_evt_handler, FAD_BT_RETRY, NULL, 0, NULL);
+}
 
 void fad_bt_stack_evt_handler(uint16_t event, void *param)
 {
@@ -80,9 +174,13 @@ void fad_bt_stack_evt_handler(uint16_t event, void *param)
     {
     case FAD_BT_CONNECT:
         memcpy(s_peer_bda, p->connect_params.peer_addr, sizeof(esp_bd_addr_t));
-        bt_secondary_stack_init();
-        esp_a2d_source_connect(s_peer_bda);
-        s_a2dp_conn_state = A2DP_CONN_STATE_CONNECTING;
+        s_attempts = 0;
+        bt_connect_attempt();
+        break;
+
+    case FAD_BT_RETRY:
+        if (s_a2dp_conn_state == A2DP_CONN_STATE_UNCONNECTED)
+            bt_connect_attempt();
         break;
 
     case FAD_BT_ADVANCE_BUFF:
@@ -104,12 +202,15 @@ static void bt_secondary_stack_init()
 
     /* initialize A2DP source */
     esp_a2d_register_callback(bt_app_a2d_cb);
+    fad_bt_buffer_set_sink_rate(FAD_OUTPUT_BT_SINK_HZ);
     esp_a2d_source_register_data_callback(bt_app_a2d_data_cb);
     esp_a2d_source_init();
 }
 
 void fad_bt_init()
 {
+    size_t heap_before = fad_mem_heap_free();
+
     ESP_ERROR_CHECK(esp_bt_controller_mem_release(ESP_BT_MODE_BLE));
 
     esp_bt_controller_config_t bt_cfg = BT_CONTROLLER_INIT_CONFIG_DEFAULT();
@@ -138,62 +239,293 @@ void fad_bt_init()
         return;
     }
 
+    /* Charge the controller and Bluedroid with what they allocated, and watch the Bluedroid task stacks */
+    fad_mem_heap_charge("Bluetooth", heap_before);
+    fad_mem_track_task(xTaskGetHandle("BTC_TASK"), "BTC_TASK", CONFIG_BT_BTC_TASK_STACK_SIZE);
+    fad_mem_track_task(xTaskGetHandle("BTU_TASK"), "BTU_TASK", CONFIG_BT_BTU_TASK_STACK_SIZE);
+
+    if (fad_bt_buffer_init() != ESP_OK)
+        ESP_LOGE(BT_TAG, "%s output task failed\n", __func__);
+    fad_bt_set_preset(FAD_BT_SBC_PRESET);
+    fad_bt_telemetry_init();
+
+    /* Register the profiles once, so a connection attempt only has to page the headset */
+    bt_secondary_stack_init();
+    s_retry_timer = xTimerCreate("BT Reconnect", pdMS_TO_TICKS(FAD_BT_RECONNECT_FIRST_MS), pdFALSE, NULL, bt_retry_timer_cb);
 }
 
-static int32_t bt_app_a2d_data_cb(uint8_t *data, int32_t len)
+/**
+ * @brief FreeRTOS task that brings up Bluetooth and starts the first connection, then ends
+ * @param params [in] required as part of the task function definition
+ */
+static void bt_init_task(void *params)
 {
-    // DO NOT ESP_LOG IN HERE. Breaks bluetooth output. Only do it for debugging.
+    fad_bt_init();
+    s_times.controller_ms = cycle_ms();
+    ESP_LOGI(BT_TAG, "Controller up after %u ms", s_times.controller_ms);
 
-    if (len < 0 || data == NULL)
+    if (s_retry_timer == NULL)
+        ESP_LOGE(BT_TAG, "%s Bluetooth did not come up\n", __func__);
+    else if (s_start_has_peer)
     {
-        ESP_LOGI(BT_TAG, "Given length of 0");
-        return 0;
+        fad_bt_params param;
+        memcpy(param.connect_params.peer_addr, s_start_peer, sizeof(esp_bd_addr_t));
+        fad_app_work_dispatch(fad_bt_stack_evt_handler, FAD_BT_CONNECT, &param, sizeof(fad_bt_params), NULL);
+    }
+    else
+    {
+        fad_app_work_dispatch(fad_main_stack_evt_handler, FAD_DISC_START, NULL, 0, NULL);
     }
 
-    /* Delay to let buffer fill to an appropriate level before data is read. Adds 256 sample delay (25ms). */
-    if (s_buffer_fill_delay < 1)
+    fad_mem_untrack_task(s_init_task_handle);
+    vTaskDelete(s_init_task_handle);
+}
+
+esp_err_t fad_bt_start(const uint8_t *peer_addr)
+{
+    if (s_init_task_handle != NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    s_start_has_peer = (peer_addr != NULL);
+    if (peer_addr)
+        memcpy(s_start_peer, peer_addr, sizeof(esp_bd_addr_t));
+    if (xTaskCreate(bt_init_task, "BT_Init_Task", BT_INIT_TASK_STACK, 0, BT_INIT_TASK_PRIORITY, &s_init_task_handle) != pdPASS)
+        return ESP_ERR_NO_MEM;
+    fad_mem_track_task(s_init_task_handle, "BT_Init_Task", BT_INIT_TASK_STACK);
+    return ESP_OK;
+}
+
+/// Take the first audio from the output task's stamp, so the data callback does not have to watch for it
+static void update_first_audio(void)
+{
+    if (s_times.first_audio_ms != 0 || s_times.streaming_ms == 0)
+        return;
+    uint32_t play_ms = fad_bt_buffer_first_play_ms();
+    uint32_t start_ms = (uint32_t)(s_cycle_start_us / 1000);
+    if (play_ms != 0 && (int32_t)(play_ms - start_ms) >= 0)
+        s_times.first_audio_ms = (play_ms - start_ms) ? play_ms - start_ms : 1;
+}
+
+bool fad_bt_get_connect_times(fad_bt_connect_times_t *times)
+{
+    update_first_audio();
+    *times = s_times;
+    return s_times.first_audio_ms != 0;
+}
+
+static const char *sbc_mode_name(fad_bt_sbc_mode_t mode)
+{
+    switch (mode)
     {
-        for (int i = 0; i < len; i++)
-        {
-            data[i] = 0;
-        }
-        s_buffer_fill_delay++;
-        return len;
+    case FAD_BT_SBC_JOINT_STEREO:
+        return "joint stereo";
+    case FAD_BT_SBC_STEREO:
+        return "stereo";
+    case FAD_BT_SBC_DUAL:
+        return "dual channel";
+    case FAD_BT_SBC_MONO:
+        return "mono";
+    }
+    return "?";
+}
+
+static bool sbc_config_valid(const fad_bt_sbc_config_t *config)
+{
+    int max_bitpool;
+    switch (config->mode)
+    {
+    case FAD_BT_SBC_MONO:
+    case FAD_BT_SBC_DUAL:
+        max_bitpool = 16 * config->subbands;
+        break;
+    case FAD_BT_SBC_STEREO:
+    case FAD_BT_SBC_JOINT_STEREO:
+        max_bitpool = 32 * config->subbands;
+        break;
+    default:
+        return false;
+    }
+    if (config->blocks < 4 || config->blocks > 16 || config->blocks % 4 != 0)
+        return false;
+    if (config->subbands != 4 && config->subbands != 8)
+        return false;
+    return config->bitpool >= 2 && config->bitpool <= max_bitpool && config->bitpool <= 250;
+}
+
+uint32_t fad_bt_sbc_bitrate(const fad_bt_sbc_config_t *config, uint32_t sample_hz)
+{
+    /* Frame length from the A2DP spec: header and scale factors, then the samples */
+    int channels = (config->mode == FAD_BT_SBC_MONO) ? 1 : 2;
+    int sample_bits;
+    switch (config->mode)
+    {
+    case FAD_BT_SBC_MONO:
+    case FAD_BT_SBC_DUAL:
+        sample_bits = config->blocks * channels * config->bitpool;
+        break;
+    case FAD_BT_SBC_STEREO:
+        sample_bits = config->blocks * config->bitpool;
+        break;
+    default:
+        sample_bits = config->subbands + config->blocks * config->bitpool; // joint flags, one per subband
+        break;
+    }
+    uint32_t frame_bytes = 4 + (4 * config->subbands * channels) / 8 + (sample_bits + 7) / 8;
+    return (uint32_t)((uint64_t)frame_bytes * 8 * sample_hz / (config->subbands * config->blocks));
+}
+
+/// Credit a finished latency run to the preset in use, once
+static void record_latency(void)
+{
+    fad_latency_report_t report;
+    if (!fad_latency_get_report(&report))
+        return;
+    fad_latency_stat_t *total = &report.stage[FAD_LATENCY_STAGE_TOTAL];
+    uint64_t seen = total->sum + total->count;
+    if (total->count == 0 || seen == s_latency_seen)
+        return;
+    s_latency_seen = seen;
+
+    preset_record_t *record = &s_records[s_preset];
+    record->valid = true;
+    record->mode = report.mode;
+    record->trials = total->count;
+    record->latency_ms = (float)total->sum / total->count * 1000.0f / ALARM_FREQ;
+    record->bitrate = s_negotiated_hz ? fad_bt_sbc_bitrate(&s_negotiated, s_negotiated_hz) : 0;
+}
+
+/// Whether config asks for other SBC settings than Bluedroid's own, the only ones ESP-IDF 4.x will use
+static bool sbc_codec_differs(const fad_bt_sbc_config_t *config)
+{
+    const fad_bt_sbc_config_t *own = &s_presets[FAD_BT_PRESET_MUSIC];
+    return config->blocks != own->blocks || config->subbands != own->subbands || config->bitpool != own->bitpool ||
+           config->mode != own->mode;
+}
+
+static esp_err_t apply_sbc_config(const fad_bt_sbc_config_t *config, fad_bt_preset_t preset)
+{
+    if (!sbc_config_valid(config))
+        return ESP_ERR_INVALID_ARG;
+    if (sbc_codec_differs(config))
+    {
+        ESP_LOGW(BT_TAG, "ESP-IDF 4.x fixes the SBC settings; only the queue depth can change");
+        return ESP_ERR_NOT_SUPPORTED;
     }
+    esp_err_t err = fad_bt_buffer_set_target(config->queue_samples);
+    if (err)
+        return err;
+
+    record_latency(); // a run made with the old settings
+    s_requested = *config;
+    s_preset = preset;
+    ESP_LOGI(BT_TAG, "SBC %s: %u blocks, %u subbands, bitpool %u, %s, queue %.1f ms", s_preset_names[preset],
+             config->blocks, config->subbands, config->bitpool, sbc_mode_name(config->mode),
+             config->queue_samples * 1000.0 / OUTPUT_FREQ);
+    return ESP_OK;
+}
 
-    /* 
-    *  Output is formatted as follows: Left lower byte, left upper, right lower byte, right upper
-    *  Our input is mono 8 bit, so right and left are equal with lower bytes set to 0
-    *  Also, we utilize aliasing to transform our ~11 kHz output to 44.1 kHz
-    */
+esp_err_t fad_bt_set_sbc_config(const fad_bt_sbc_config_t *config)
+{
+    return apply_sbc_config(config, FAD_BT_PRESET_CUSTOM);
+}
 
-    /* Sets how many outputs a single FAD output will expand to.
-    4 for 8-bit mono to 16-bit stereo conversion, rest for aliasing */
-    int scaler = FAD_OUTPUT_BT_ALIASING * 4;
+esp_err_t fad_bt_set_preset(fad_bt_preset_t preset)
+{
+    if (preset >= FAD_BT_PRESET_CUSTOM)
+        return ESP_ERR_INVALID_ARG;
+    return apply_sbc_config(&s_presets[preset], preset);
+}
 
+bool fad_bt_get_sbc_config(fad_bt_sbc_config_t *requested, fad_bt_sbc_config_t *negotiated, uint32_t *sample_hz)
+{
+    if (requested)
+        *requested = s_requested;
+    if (s_negotiated_hz == 0)
+        return false;
+    if (negotiated)
+        *negotiated = s_negotiated;
+    if (sample_hz)
+        *sample_hz = s_negotiated_hz;
+    return true;
+}
 
-    for (int i = 0; i < (len / scaler); i++) // for loop to go through each fad output value
+/// Decode the SBC codec information element of ESP_A2D_AUDIO_CFG_EVT, where one bit of each field is set
+static void bt_sbc_configured(const uint8_t *cie)
+{
+    static const uint32_t rates[4] = {48000, 44100, 32000, 16000}; // bits 4 to 7 of octet 0
+    fad_bt_sbc_config_t config = {0};
+    uint32_t hz = 0;
+    for (int i = 0; i < 4; i++)
     {
-        for (int j = 0; j < FAD_OUTPUT_BT_ALIASING; j++)
-        {
-            // set lower bytes to 0
-            data[(scaler * i) + (4 * j) + 0] = 0;
-            data[(scaler * i) + (4 * j) + 2] = 0;
+        if (cie[0] & (0x10 << i))
+            hz = rates[i];
+        if (cie[1] & (0x10 << i))
+            config.blocks = 16 - 4 * i; // bits 4 to 7 of octet 1 are 16, 12, 8 and 4 blocks
+    }
+    config.mode = (fad_bt_sbc_mode_t)(cie[0] & 0x0f);
+    config.subbands = (cie[1] & 0x04) ? 8 : 4;
+    config.bitpool = cie[3]; // the encoder may go up to the maximum
+    config.queue_samples = fad_bt_buffer_get_target();
+
+    s_negotiated = config;
+    s_negotiated_hz = hz;
+    fad_bt_buffer_set_sink_rate(hz);
+    fad_bt_telemetry_stream(fad_bt_sbc_bitrate(&config, hz), hz);
+
+    if (config.blocks != s_requested.blocks || config.subbands != s_requested.subbands ||
+        config.mode != s_requested.mode || config.bitpool != s_requested.bitpool)
+        ESP_LOGW(BT_TAG, "Headset configured %u Hz, %u blocks, %u subbands, bitpool %u-%u, %s, not the %s preset",
+                 hz, config.blocks, config.subbands, cie[2], cie[3], sbc_mode_name(config.mode), s_preset_names[s_preset]);
+}
 
-            // set left and right upper bytes to value
-            data[(scaler * i) + (4 * j) + 1] = dac_buffer[s_out_pos];
-            data[(scaler * i) + (4 * j) + 3] = dac_buffer[s_out_pos];
-        }
+void fad_bt_report(void)
+{
+    record_latency();
+    update_first_audio();
+    if (s_negotiated_hz == 0)
+        return;
 
-        /* Advance and wrap buffer */
-        s_out_pos++;
-        if (s_out_pos >= DAC_BUFFER_SIZE)
-            s_out_pos = 0;
+    if (s_times.first_audio_ms)
+        ESP_LOGI(BT_TAG, "First audio %u ms after %s: controller %u ms, connected %u ms (%u attempts), streaming %u ms",
+                 s_times.first_audio_ms, s_times.power_on ? "boot" : "the link was lost", s_times.controller_ms,
+                 s_times.connected_ms, s_times.attempts, s_times.streaming_ms);
+
+    uint32_t frame_samples = s_negotiated.subbands * s_negotiated.blocks;
+    ESP_LOGI(BT_TAG, "SBC stream (%s preset): %u Hz, %u blocks, %u subbands, bitpool %u, %s: %.0f kbps, %.2f ms frames",
+             s_preset_names[s_preset], s_negotiated_hz, s_negotiated.blocks, s_negotiated.subbands, s_negotiated.bitpool,
+             sbc_mode_name(s_negotiated.mode), fad_bt_sbc_bitrate(&s_negotiated, s_negotiated_hz) / 1000.0,
+             frame_samples * 1000.0 / s_negotiated_hz);
+    for (int p = 0; p < FAD_BT_PRESET_MAX; p++)
+    {
+        const preset_record_t *record = &s_records[p];
+        if (record->valid)
+            ESP_LOGI(BT_TAG, "  %-6s %4.0f kbps, %.1f ms %s over %d trials", s_preset_names[p], record->bitrate / 1000.0,
+                     record->latency_ms, (record->mode == FAD_LATENCY_LOOPBACK) ? "mouth to ear" : "mic to encoder", record->trials);
     }
+}
 
+static int32_t bt_app_a2d_data_cb(uint8_t *data, int32_t len)
+{
+    // DO NOT ESP_LOG IN HERE. Breaks bluetooth output. Only do it for debugging.
+
+    if (len < 0 || data == NULL)
+    {
+        ESP_LOGI(BT_TAG, "Given length of 0");
+        return 0;
+    }
+
+    fad_trace_begin(FAD_TRACK_A2DP, FAD_TRACE_A2DP_DATA, len);
+    fad_bt_telemetry_callback(len);
+
+    /* BT_Output_Task has already converted the output to 16-bit stereo at the sink rate; just copy it */
+    fad_bt_buffer_pull(data, len);
+
+    fad_trace_end(FAD_TRACK_A2DP, FAD_TRACE_A2DP_DATA);
     return len;
 }
 
+_Static_assert(sizeof(esp_avrc_ct_cb_param_t) <= FAD_APP_POOL_SLOT_SIZE, "AVRC parameters must fit a dispatch pool slot");
+
 static void bt_app_rc_ct_cb(esp_avrc_ct_cb_event_t event, esp_avrc_ct_cb_param_t *param)
 {
     switch (event)
@@ -257,6 +589,7 @@ static void bt_app_av_media_proc(uint16_t event, void *param)
             {
                 ESP_LOGI(BT_TAG, "a2dp media start successfully.");
                 s_media_state = APP_AV_MEDIA_STATE_STARTED;
+                s_times.streaming_ms = cycle_ms();
             }
         }
         break;
@@ -274,6 +607,7 @@ static void bt_app_av_media_proc(uint16_t event, void *param)
             {
                 ESP_LOGI(BT_TAG, "a2dp media stopped successfully, disconnecting...");
                 s_media_state = APP_AV_MEDIA_STATE_IDLE;
+                s_disconnecting = true;
                 esp_a2d_source_disconnect(s_peer_bda);
             }
             else
@@ -287,8 +621,17 @@ static void bt_app_av_media_proc(uint16_t event, void *param)
     }
 }
 
+_Static_assert(sizeof(esp_a2d_cb_param_t) <= FAD_APP_POOL_SLOT_SIZE, "A2DP parameters must fit a dispatch pool slot");
+
+/// A2DP events run on the app task, which owns the connection state
 static void bt_app_a2d_cb(esp_a2d_cb_event_t event, esp_a2d_cb_param_t *param)
 {
+    fad_app_work_dispatch(bt_av_hdl_a2d_evt, event, param, sizeof(esp_a2d_cb_param_t), NULL);
+}
+
+static void bt_av_hdl_a2d_evt(uint16_t event, void *p_param)
+{
+    esp_a2d_cb_param_t *param = p_param;
     esp_a2d_cb_param_t *a2d = NULL;
     switch (event)
     {
@@ -298,25 +641,40 @@ static void bt_app_a2d_cb(esp_a2d_cb_event_t event, esp_a2d_cb_param_t *param)
         if (a2d->conn_stat.state == ESP_A2D_CONNECTION_STATE_CONNECTED)
         {
             ESP_LOGI(BT_TAG, "a2dp connected");
+            s_times.connected_ms = cycle_ms();
+            s_times.attempts = s_attempts;
+            s_attempts = 0;
+            fad_gap_connected();
             fad_app_work_dispatch(fad_main_stack_evt_handler, FAD_OUTPUT_READY, NULL, 0, NULL);
             ESP_LOGI(BT_TAG, "a2dp media ready checking ...");
             esp_a2d_media_ctrl(ESP_A2D_MEDIA_CTRL_CHECK_SRC_RDY);
             s_a2dp_conn_state = A2DP_CONN_STATE_CONNECTED;
+            fad_bt_telemetry_link_up(a2d->conn_stat.remote_bda);
         }
         else if (a2d->conn_stat.state == ESP_A2D_CONNECTION_STATE_DISCONNECTED)
         {
             ESP_LOGI(BT_TAG, "a2dp disconnected");
-            if (s_a2dp_conn_state == A2DP_CONN_STATE_CONNECTING)
+            int was = s_a2dp_conn_state;
+            s_a2dp_conn_state = A2DP_CONN_STATE_UNCONNECTED;
+            s_media_state = APP_AV_MEDIA_STATE_IDLE;
+            if (was == A2DP_CONN_STATE_CONNECTING)
             {
-                // ESP_LOGI(BT_TAG, "Initializing GAP to find new device...");
-                // fad_app_work_dispatch(fad_main_stack_evt_handler, FAD_DISC_START, NULL, 0, NULL);
+                bt_connect_failed();
             }
-            else if (s_a2dp_conn_state == A2DP_CONN_STATE_CONNECTED)
+            else if (was == A2DP_CONN_STATE_CONNECTED)
             {
+                fad_bt_telemetry_link_down(!s_disconnecting);
                 fad_app_work_dispatch(fad_main_stack_evt_handler, FAD_OUTPUT_DISCONNECT, NULL, 0, NULL);
+                if (!s_disconnecting)
+                {
+                    /* Lost the link: start a new cycle and page the headset again */
+                    s_cycle_start_us = fad_hal_time_us();
+                    memset(&s_times, 0, sizeof(s_times));
+                    s_attempts = 0;
+                    xTimerChangePeriod(s_retry_timer, pdMS_TO_TICKS(FAD_BT_RECONNECT_FIRST_MS), 0);
+                }
             }
-
-            s_a2dp_conn_state = A2DP_CONN_STATE_UNCONNECTED;
+            s_disconnecting = false;
         }
         break;
     }
@@ -328,6 +686,10 @@ static void bt_app_a2d_cb(esp_a2d_cb_event_t event, esp_a2d_cb_param_t *param)
         }
         break;
     case ESP_A2D_AUDIO_CFG_EVT:
+        a2d = (esp_a2d_cb_param_t *)(param);
+        if (a2d->audio_cfg.mcc.type == ESP_A2D_MCT_SBC)
+            bt_sbc_configured(a2d->audio_cfg.mcc.cie.sbc);
+        break;
     case ESP_A2D_MEDIA_CTRL_ACK_EVT:
         break;
     default:
@@ -0,0 +1,296 @@
+/**
+ * fad_bt_telemetry.c
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * A2DP streaming telemetry: callback cadence and length histograms, throughput and link quality.
+ *
+ * The data callback is the only writer of its counters and never waits for a reader: it makes a
+ * sequence number odd while it updates them, and a reader copies them again if the number was odd or
+ * moved under it. A reset only bumps a generation, which the callback applies on its next call. The
+ * link and RSSI fields come from other callbacks and share a critical section instead.
+ */
+
+#include <string.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+
+#include "fad_bt_telemetry.h"
+#include "fad_bt_buffer.h"
+#include "fad_bt_gap.h"
+#include "fad_hal.h"
+
+#define TELEM_TAG "BT_TELEM"
+#define DUMP_FIXED_ROWS 31		// Rows of fad_bt_telemetry_dump besides the histogram bins
+
+/* Written by the data callback only */
+typedef struct {
+	uint32_t callbacks;
+	uint64_t bytes;
+	uint32_t interval_hist[FAD_BT_TELEM_INTERVAL_BINS];
+	uint32_t interval_min_us;
+	uint32_t interval_max_us;
+	uint32_t len_hist[FAD_BT_TELEM_LEN_BINS];
+	uint32_t len_min;
+	uint32_t len_max;
+} callback_counts_t;
+
+static callback_counts_t s_counts;
+static volatile uint32_t s_counts_seq = 0;		// Odd while the callback updates s_counts
+static volatile uint32_t s_counts_gen = 0;		// Reset generation s_counts belongs to
+static volatile uint32_t s_reset_gen = 0;		// Bumped by fad_bt_telemetry_reset
+static volatile bool s_new_link = false;		// The next callback starts a new interval series
+static int64_t s_last_cb_us = 0;				// 0 until the first callback after a reset or a new link
+
+/* Link and stream fields of s_telem; its callback fields stay unused */
+static fad_bt_telemetry_t s_telem;
+static int64_t s_start_us = 0;
+static esp_bd_addr_t s_peer;
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static TimerHandle_t s_rssi_timer = NULL;
+
+static void rssi_timer_cb(TimerHandle_t timer)
+{
+	if (s_telem.linked)
+		fad_gap_read_rssi(s_peer);
+}
+
+esp_err_t fad_bt_telemetry_init(void)
+{
+	fad_bt_telemetry_reset();
+	if (s_rssi_timer != NULL)
+		return ESP_OK;
+	s_rssi_timer = xTimerCreate("BT RSSI", pdMS_TO_TICKS(FAD_BT_TELEM_RSSI_MS), pdTRUE, NULL, rssi_timer_cb);
+	if (s_rssi_timer == NULL)
+	{
+		ESP_LOGW(TELEM_TAG, "Could not create the RSSI timer");
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+static void clear_counts(callback_counts_t *counts)
+{
+	memset(counts, 0, sizeof(*counts));
+	counts->interval_min_us = UINT32_MAX;
+	counts->len_min = UINT32_MAX;
+}
+
+void fad_bt_telemetry_reset(void)
+{
+	portENTER_CRITICAL(&s_mux);
+	s_telem.links = s_telem.linked ? 1 : 0;
+	s_telem.link_losses = 0;
+	s_telem.rssi_reads = 0;
+	s_telem.rssi_min = INT8_MAX;
+	s_telem.rssi_max = INT8_MIN;
+	s_start_us = fad_hal_time_us();
+	portEXIT_CRITICAL(&s_mux);
+	__atomic_fetch_add(&s_reset_gen, 1, __ATOMIC_RELEASE); // the callback zeroes its counters
+}
+
+void fad_bt_telemetry_callback(int32_t len)
+{
+	int64_t now = fad_hal_time_us();
+	uint32_t ulen = (len > 0) ? (uint32_t)len : 0;
+	int len_bin = ulen / FAD_BT_TELEM_LEN_BIN;
+	if (len_bin >= FAD_BT_TELEM_LEN_BINS)
+		len_bin = FAD_BT_TELEM_LEN_BINS - 1;
+
+	uint32_t seq = s_counts_seq;
+	__atomic_store_n(&s_counts_seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	uint32_t gen = __atomic_load_n(&s_reset_gen, __ATOMIC_ACQUIRE);
+	if (gen != s_counts_gen)
+	{
+		clear_counts(&s_counts);
+		s_counts_gen = gen;
+		s_last_cb_us = 0;
+	}
+	if (s_new_link)
+	{
+		s_new_link = false;
+		s_last_cb_us = 0; // the gap since the last link is not a callback interval
+	}
+	if (s_last_cb_us != 0)
+	{
+		uint32_t interval = (uint32_t)(now - s_last_cb_us);
+		int bin = interval / FAD_BT_TELEM_INTERVAL_BIN_US;
+		if (bin >= FAD_BT_TELEM_INTERVAL_BINS)
+			bin = FAD_BT_TELEM_INTERVAL_BINS - 1;
+		s_counts.interval_hist[bin]++;
+		if (interval < s_counts.interval_min_us)
+			s_counts.interval_min_us = interval;
+		if (interval > s_counts.interval_max_us)
+			s_counts.interval_max_us = interval;
+	}
+	s_last_cb_us = now;
+	s_counts.len_hist[len_bin]++;
+	if (ulen < s_counts.len_min)
+		s_counts.len_min = ulen;
+	if (ulen > s_counts.len_max)
+		s_counts.len_max = ulen;
+	s_counts.callbacks++;
+	s_counts.bytes += ulen;
+
+	__atomic_store_n(&s_counts_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void fad_bt_telemetry_stream(uint32_t bitrate, uint32_t hz)
+{
+	portENTER_CRITICAL(&s_mux);
+	s_telem.stream_bps = bitrate;
+	s_telem.stream_hz = hz;
+	portEXIT_CRITICAL(&s_mux);
+}
+
+void fad_bt_telemetry_link_up(const esp_bd_addr_t bda)
+{
+	memcpy(s_peer, bda, sizeof(esp_bd_addr_t));
+	portENTER_CRITICAL(&s_mux);
+	s_telem.linked = true;
+	s_telem.links++;
+	portEXIT_CRITICAL(&s_mux);
+	s_new_link = true;
+	if (s_rssi_timer != NULL)
+		xTimerStart(s_rssi_timer, 0);
+}
+
+void fad_bt_telemetry_link_down(bool lost)
+{
+	if (s_rssi_timer != NULL)
+		xTimerStop(s_rssi_timer, 0);
+	portENTER_CRITICAL(&s_mux);
+	s_telem.linked = false;
+	if (lost)
+		s_telem.link_losses++;
+	portEXIT_CRITICAL(&s_mux);
+}
+
+void fad_bt_telemetry_rssi(int8_t delta)
+{
+	portENTER_CRITICAL(&s_mux);
+	s_telem.rssi = delta;
+	if (delta < s_telem.rssi_min)
+		s_telem.rssi_min = delta;
+	if (delta > s_telem.rssi_max)
+		s_telem.rssi_max = delta;
+	s_telem.rssi_reads++;
+	portEXIT_CRITICAL(&s_mux);
+}
+
+void fad_bt_telemetry_get(fad_bt_telemetry_t *telemetry)
+{
+	callback_counts_t counts;
+	uint32_t gen, before, after;
+	do
+	{
+		before = __atomic_load_n(&s_counts_seq, __ATOMIC_ACQUIRE);
+		counts = s_counts;
+		gen = s_counts_gen;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		after = __atomic_load_n(&s_counts_seq, __ATOMIC_RELAXED);
+	} while ((before & 1) || before != after);
+	if (gen != __atomic_load_n(&s_reset_gen, __ATOMIC_ACQUIRE))
+		clear_counts(&counts); // reset since the last callback
+
+	portENTER_CRITICAL(&s_mux);
+	*telemetry = s_telem;
+	telemetry->elapsed_ms = (uint32_t)((fad_hal_time_us() - s_start_us) / 1000);
+	portEXIT_CRITICAL(&s_mux);
+
+	telemetry->callbacks = counts.callbacks;
+	telemetry->bytes = counts.bytes;
+	memcpy(telemetry->interval_hist, counts.interval_hist, sizeof(counts.interval_hist));
+	telemetry->interval_min_us = counts.interval_min_us;
+	telemetry->interval_max_us = counts.interval_max_us;
+	memcpy(telemetry->len_hist, counts.len_hist, sizeof(counts.len_hist));
+	telemetry->len_min = counts.len_min;
+	telemetry->len_max = counts.len_max;
+	if (telemetry->callbacks < 2)
+		telemetry->interval_min_us = 0;
+	if (telemetry->callbacks == 0)
+		telemetry->len_min = 0;
+	if (telemetry->rssi_reads == 0)
+		telemetry->rssi_min = telemetry->rssi_max = 0;
+}
+
+/* Bytes per second the callbacks took over the counted time */
+static uint32_t byte_rate(const fad_bt_telemetry_t *t)
+{
+	return t->elapsed_ms ? (uint32_t)(t->bytes * 1000 / t->elapsed_ms) : 0;
+}
+
+void fad_bt_telemetry_dump(FILE *out)
+{
+	fad_bt_telemetry_t t;
+	fad_bt_buffer_stats_t b;
+	fad_bt_telemetry_get(&t);
+	fad_bt_buffer_get_stats(&b);
+
+	int interval_bins = 0, len_bins = 0;
+	for (int i = 0; i < FAD_BT_TELEM_INTERVAL_BINS; i++)
+		interval_bins += (t.interval_hist[i] != 0);
+	for (int i = 0; i < FAD_BT_TELEM_LEN_BINS; i++)
+		len_bins += (t.len_hist[i] != 0);
+
+	fprintf(out, "FBT-BEGIN %d\n", DUMP_FIXED_ROWS + interval_bins + len_bins);
+	fprintf(out, "section,name,value\n");
+	fprintf(out, "callback,elapsed_ms,%u\n", (unsigned)t.elapsed_ms);
+	fprintf(out, "callback,count,%u\n", (unsigned)t.callbacks);
+	fprintf(out, "callback,bytes,%llu\n", (unsigned long long)t.bytes);
+	fprintf(out, "callback,bytes_per_s,%u\n", (unsigned)byte_rate(&t));
+	fprintf(out, "callback,interval_min_us,%u\n", (unsigned)t.interval_min_us);
+	fprintf(out, "callback,interval_max_us,%u\n", (unsigned)t.interval_max_us);
+	fprintf(out, "callback,len_min,%u\n", (unsigned)t.len_min);
+	fprintf(out, "callback,len_max,%u\n", (unsigned)t.len_max);
+	for (int i = 0; i < FAD_BT_TELEM_INTERVAL_BINS; i++)
+		if (t.interval_hist[i])
+			fprintf(out, "interval_us,%d,%u\n", i * FAD_BT_TELEM_INTERVAL_BIN_US, (unsigned)t.interval_hist[i]);
+	for (int i = 0; i < FAD_BT_TELEM_LEN_BINS; i++)
+		if (t.len_hist[i])
+			fprintf(out, "len,%d,%u\n", i * FAD_BT_TELEM_LEN_BIN, (unsigned)t.len_hist[i]);
+	fprintf(out, "stream,bitrate,%u\n", (unsigned)t.stream_bps);
+	fprintf(out, "stream,hz,%u\n", (unsigned)t.stream_hz);
+	fprintf(out, "buffer,fill,%u\n", b.fill);
+	fprintf(out, "buffer,fill_min,%u\n", b.fill_min);
+	fprintf(out, "buffer,fill_max,%u\n", b.fill_max);
+	fprintf(out, "buffer,fill_avg,%.1f\n", b.fill_avg);
+	fprintf(out, "buffer,target,%u\n", fad_bt_buffer_get_target());
+	fprintf(out, "buffer,pcm_fill,%u\n", b.pcm_fill);
+	fprintf(out, "buffer,played,%u\n", (unsigned)b.played);
+	fprintf(out, "buffer,concealed,%u\n", (unsigned)b.concealed);
+	fprintf(out, "buffer,underruns,%u\n", (unsigned)b.underruns);
+	fprintf(out, "buffer,lows,%u\n", (unsigned)b.lows);
+	fprintf(out, "buffer,dropped,%u\n", (unsigned)b.dropped);
+	fprintf(out, "buffer,overflows,%u\n", (unsigned)b.overflows);
+	fprintf(out, "buffer,short_frames,%u\n", (unsigned)b.short_frames);
+	fprintf(out, "buffer,correction_ppm,%.1f\n", b.correction_ppm);
+	fprintf(out, "link,up,%d\n", t.linked);
+	fprintf(out, "link,links,%u\n", (unsigned)t.links);
+	fprintf(out, "link,losses,%u\n", (unsigned)t.link_losses);
+	fprintf(out, "link,rssi_reads,%u\n", (unsigned)t.rssi_reads);
+	fprintf(out, "link,rssi,%d\n", t.rssi);
+	fprintf(out, "link,rssi_min,%d\n", t.rssi_min);
+	fprintf(out, "link,rssi_max,%d\n", t.rssi_max);
+	fprintf(out, "FBT-END\n");
+	fflush(out);
+}
+
+void fad_bt_telemetry_report(void)
+{
+	fad_bt_telemetry_t t;
+	fad_bt_telemetry_get(&t);
+	if (t.callbacks == 0)
+		return; // Output is wired, or nothing streamed yet
+
+	ESP_LOGI(TELEM_TAG, "%u callbacks in %u ms, every %.1f ms (%.1f-%.1f), %u-%u bytes, %.1f kB/s",
+			 t.callbacks, t.elapsed_ms, t.callbacks > 1 ? t.elapsed_ms / (double)t.callbacks : 0.0,
+			 t.interval_min_us / 1000.0, t.interval_max_us / 1000.0, t.len_min, t.len_max, byte_rate(&t) / 1000.0);
+	ESP_LOGI(TELEM_TAG, "  link %s, %u made, %u lost, RSSI delta %d dB (%d..%d over %u reads)",
+			 t.linked ? "up" : "down", t.links, t.link_losses, t.rssi, t.rssi_min, t.rssi_max, t.rssi_reads);
+}
@@ -0,0 +1,498 @@
+/**
+ * fad_capture.c
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Capture and replay of algorithm input blocks. While a capture runs the algorithm reads a copy of
+ * its block taken before it starts, not the live ADC buffer the ISR keeps writing, so a recording holds
+ * exactly what the algorithm saw. A replay runs one block at a time: the replay task dispatches a block,
+ * and fad_capture_block_end releases the task for the next one.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "main.h"
+#include "fad_defs.h"
+#include "fad_app_core.h"
+#include "fad_capture.h"
+#include "fad_mem.h"
+
+#define CAPTURE_TAG "CAPTURE"
+#define CAPTURE_VERSION 2
+#define CAPTURE_VERSION_MONO 1 // before reference spans; still replayed
+#define CAPTURE_HEADER_SIZE 16
+#define CAPTURE_FLAG_OUTPUT 0x01
+#define CAPTURE_FLAG_REF 0x02
+#define CAPTURE_ADC_BITS 12
+#define RECORD_SYNC 0xFAD0
+#define RECORD_HEADER_SIZE 12
+#define REPLAY_TASK_STACK 2048
+#define REPLAY_TASK_PRIORITY (configMAX_PRIORITIES - 5) // below the app task, so a block is handled before the next is loaded
+
+volatile bool fad_capture_active = false;
+
+static volatile fad_capture_mode_t s_mode = FAD_CAPTURE_OFF;
+static fad_capture_header_t s_header;
+static fad_capture_report_t s_report;
+static fad_capture_store_t *s_dest = NULL;
+static const fad_capture_store_t *s_source = NULL;
+static size_t s_read_pos = 0;
+
+/* The block the algorithm is working on */
+static uint16_t s_block[ADC_BUFFER_SIZE];
+static uint16_t s_ref_block[ADC_BUFFER_SIZE];
+static uint8_t s_expected[DAC_BUFFER_SIZE];
+static uint16_t s_block_len = 0;
+static uint16_t s_block_adc_pos = 0;
+static uint16_t s_block_dac_pos = 0;
+static uint32_t s_block_sample_count = 0;
+static uint32_t s_last_sample_count = 0;
+
+static SemaphoreHandle_t s_replay_go = NULL;
+static xTaskHandle s_replay_task_handle = NULL;
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static size_t packed_size(int len)
+{
+	return (len / 2) * 3 + (len % 2) * 2;
+}
+
+static size_t record_size(const fad_capture_header_t *header, int len)
+{
+	return RECORD_HEADER_SIZE + packed_size(len) * (header->has_ref ? 2 : 1) +
+		   (header->has_output ? len / header->multisamples : 0);
+}
+
+/* Two 12-bit samples in three bytes; an odd last sample takes two */
+static void pack12(const uint16_t *in, int len, uint8_t *out)
+{
+	int i = 0;
+	for (; i + 1 < len; i += 2)
+	{
+		*out++ = in[i];
+		*out++ = ((in[i] >> 8) & 0x0f) | (in[i + 1] << 4);
+		*out++ = in[i + 1] >> 4;
+	}
+	if (i < len)
+		put_u16(out, in[i] & 0x0fff);
+}
+
+static void unpack12(const uint8_t *in, int len, uint16_t *out)
+{
+	int i = 0;
+	for (; i + 1 < len; i += 2, in += 3)
+	{
+		out[i] = in[0] | ((in[1] & 0x0f) << 8);
+		out[i + 1] = (in[1] >> 4) | (in[2] << 4);
+	}
+	if (i < len)
+		out[i] = get_u16(in) & 0x0fff;
+}
+
+static void write_header(uint8_t *p, const fad_capture_header_t *header)
+{
+	memcpy(p, "FADC", 4);
+	p[4] = CAPTURE_VERSION;
+	p[5] = (header->has_output ? CAPTURE_FLAG_OUTPUT : 0) | (header->has_ref ? CAPTURE_FLAG_REF : 0);
+	put_u16(p + 6, header->block_len);
+	put_u32(p + 8, header->sample_rate);
+	p[12] = CAPTURE_ADC_BITS;
+	p[13] = header->multisamples;
+	p[14] = header->algo_type;
+	p[15] = header->algo_mode;
+}
+
+esp_err_t fad_capture_parse_header(const fad_capture_store_t *store, fad_capture_header_t *header)
+{
+	const uint8_t *p = store->data;
+	if (store->len < CAPTURE_HEADER_SIZE || memcmp(p, "FADC", 4) != 0)
+		return ESP_ERR_INVALID_ARG;
+	if ((p[4] != CAPTURE_VERSION && p[4] != CAPTURE_VERSION_MONO) || p[12] != CAPTURE_ADC_BITS || p[13] == 0)
+		return ESP_ERR_INVALID_ARG;
+
+	header->has_output = p[5] & CAPTURE_FLAG_OUTPUT;
+	header->has_ref = (p[4] != CAPTURE_VERSION_MONO) && (p[5] & CAPTURE_FLAG_REF);
+	header->block_len = get_u16(p + 6);
+	header->sample_rate = get_u32(p + 8);
+	header->multisamples = p[13];
+	header->algo_type = p[14];
+	header->algo_mode = p[15];
+
+	if (header->block_len == 0 || header->block_len > ADC_BUFFER_SIZE)
+		return ESP_ERR_INVALID_ARG;
+	return ESP_OK;
+}
+
+/* Append the current block and its output. Returns false if the store is full. */
+static bool append_record(fad_capture_store_t *store, const uint8_t *out, int out_len)
+{
+	size_t size = record_size(&s_header, s_block_len);
+	if (store->len + size > store->size)
+		return false;
+
+	uint8_t *p = store->data + store->len;
+	put_u16(p, RECORD_SYNC);
+	put_u16(p + 2, s_block_len);
+	put_u32(p + 4, s_block_sample_count);
+	put_u16(p + 8, s_block_adc_pos);
+	put_u16(p + 10, s_block_dac_pos);
+	pack12(s_block, s_block_len, p + RECORD_HEADER_SIZE);
+	if (s_header.has_ref)
+		pack12(s_ref_block, s_block_len, p + RECORD_HEADER_SIZE + packed_size(s_block_len));
+
+	if (s_header.has_output)
+	{
+		int stored = s_block_len / s_header.multisamples;
+		uint8_t *dst = p + size - stored;
+		memset(dst, 0, stored);
+		memcpy(dst, out, out_len < stored ? out_len : stored);
+	}
+
+	store->len += size;
+	return true;
+}
+
+/* Load the next block of the source into s_block. Returns false at the end or on a malformed block. */
+static bool load_next_record(void)
+{
+	if (s_read_pos + RECORD_HEADER_SIZE > s_source->len)
+		return false;
+
+	const uint8_t *p = s_source->data + s_read_pos;
+	uint16_t len = get_u16(p + 2);
+	if (get_u16(p) != RECORD_SYNC || len == 0 || len > ADC_BUFFER_SIZE ||
+		s_read_pos + record_size(&s_header, len) > s_source->len)
+	{
+		ESP_LOGE(CAPTURE_TAG, "Malformed block at byte %u", (unsigned)s_read_pos);
+		s_report.corrupt = true;
+		return false;
+	}
+
+	s_block_len = len;
+	s_block_sample_count = get_u32(p + 4);
+	s_block_adc_pos = get_u16(p + 8);
+	s_block_dac_pos = get_u16(p + 10);
+	unpack12(p + RECORD_HEADER_SIZE, len, s_block);
+	if (s_header.has_ref)
+		unpack12(p + RECORD_HEADER_SIZE + packed_size(len), len, s_ref_block);
+	size_t size = record_size(&s_header, len);
+	if (s_header.has_output)
+		memcpy(s_expected, p + size - len / s_header.multisamples, len / s_header.multisamples);
+
+	s_read_pos += size;
+	s_report.bytes = s_read_pos;
+	return true;
+}
+
+/* End the run on its own (store full, end of replay) and tell the main handler */
+static void capture_finish(void)
+{
+	fad_main_cb_param_t p = {
+		.capture.mode = s_mode,
+		.capture.source = (fad_capture_store_t *)s_source,
+		.capture.dest = s_dest,
+	};
+
+	fad_capture_stop();
+	fad_app_work_dispatch_class(FAD_APP_CLASS_BACKGROUND, fad_main_stack_evt_handler, FAD_CAPTURE_DONE, (void *)&p, sizeof(fad_main_cb_param_t), NULL);
+}
+
+/**
+ * @brief FreeRTOS task that dispatches the replay blocks, one each time it is released
+ * @param params [in] required as part of the task function definition
+ */
+static void replay_task(void *params)
+{
+	for (;;)
+	{
+		xSemaphoreTake(s_replay_go, portMAX_DELAY);
+		if (s_mode != FAD_CAPTURE_REPLAY)
+			continue;
+
+		if (!load_next_record())
+		{
+			capture_finish();
+			continue;
+		}
+
+		fad_main_cb_param_t p = {
+			.adc_buff_pos_info.adc_pos = s_block_adc_pos,
+			.adc_buff_pos_info.dac_pos = s_block_dac_pos,
+			.adc_buff_pos_info.sample_count = s_block_sample_count,
+			.adc_buff_pos_info.replay = true,
+		};
+		if (!fad_app_work_dispatch_class(FAD_APP_CLASS_RT, fad_main_stack_evt_handler, FAD_ADC_BUFFER_READY, (void *)&p, sizeof(fad_main_cb_param_t), NULL))
+		{
+			ESP_LOGE(CAPTURE_TAG, "Could not dispatch replay block %u", s_report.blocks);
+			capture_finish();
+		}
+	}
+
+	fad_mem_untrack_task(s_replay_task_handle);
+	vTaskDelete(s_replay_task_handle);
+}
+
+static void reset_report(fad_capture_mode_t mode)
+{
+	memset(&s_report, 0, sizeof(s_report));
+	s_report.mode = mode;
+}
+
+esp_err_t fad_capture_record_start(fad_capture_store_t *dest, fad_algo_type_t algo_type, fad_algo_mode_t algo_mode, int block_len)
+{
+	if (fad_capture_active)
+		return ESP_ERR_INVALID_STATE;
+	if (block_len <= 0 || block_len > ADC_BUFFER_SIZE)
+		return ESP_ERR_INVALID_ARG;
+	if (dest == NULL || dest->data == NULL || dest->size < CAPTURE_HEADER_SIZE)
+		return ESP_ERR_NO_MEM;
+
+	s_header.sample_rate = ALARM_FREQ;
+	s_header.block_len = block_len;
+	s_header.multisamples = MULTISAMPLES;
+	s_header.has_output = FAD_CAPTURE_OUTPUT;
+	s_header.has_ref = FAD_ADC_CHANNELS > 1;
+	s_header.algo_type = algo_type;
+	s_header.algo_mode = algo_mode;
+
+	write_header(dest->data, &s_header);
+	dest->len = CAPTURE_HEADER_SIZE;
+
+	s_dest = dest;
+	s_source = NULL;
+	reset_report(FAD_CAPTURE_RECORD);
+	s_report.bytes = dest->len;
+	s_mode = FAD_CAPTURE_RECORD;
+	fad_capture_active = true;
+
+	ESP_LOGI(CAPTURE_TAG, "Recording %d-sample blocks, up to %u bytes", block_len, (unsigned)dest->size);
+	return ESP_OK;
+}
+
+esp_err_t fad_capture_replay_start(const fad_capture_store_t *source, fad_capture_store_t *dest, fad_capture_header_t *header)
+{
+	if (fad_capture_active)
+		return ESP_ERR_INVALID_STATE;
+	if (source == NULL || fad_capture_parse_header(source, &s_header) != ESP_OK)
+		return ESP_ERR_INVALID_ARG;
+	if (s_header.multisamples != MULTISAMPLES)
+		return ESP_ERR_INVALID_ARG;
+	if (s_header.sample_rate != ALARM_FREQ)
+		ESP_LOGW(CAPTURE_TAG, "Capture was taken at %u Hz, firmware runs at %d Hz", s_header.sample_rate, ALARM_FREQ);
+	if (FAD_ADC_CHANNELS > 1 && !s_header.has_ref)
+		ESP_LOGW(CAPTURE_TAG, "Capture has no reference channel; the algorithm gets no ref_buff");
+
+	if (dest != NULL)
+	{
+		if (dest->data == NULL || dest->size < CAPTURE_HEADER_SIZE)
+			return ESP_ERR_NO_MEM;
+		s_header.has_output = true;
+		write_header(dest->data, &s_header);
+		s_header.has_output = source->data[5] & CAPTURE_FLAG_OUTPUT;
+		dest->len = CAPTURE_HEADER_SIZE;
+	}
+
+	if (s_replay_go == NULL)
+	{
+		s_replay_go = xSemaphoreCreateBinary();
+		xTaskCreate(replay_task, "Capture_Replay_Task", REPLAY_TASK_STACK, 0, REPLAY_TASK_PRIORITY, &s_replay_task_handle);
+		fad_mem_track_task(s_replay_task_handle, "Capture_Replay_Task", REPLAY_TASK_STACK);
+	}
+
+	memcpy(header, &s_header, sizeof(fad_capture_header_t));
+	s_source = source;
+	s_dest = dest;
+	s_read_pos = CAPTURE_HEADER_SIZE;
+	reset_report(FAD_CAPTURE_REPLAY);
+	s_report.verified = s_header.has_output;
+	s_mode = FAD_CAPTURE_REPLAY;
+	fad_capture_active = true;
+
+	ESP_LOGI(CAPTURE_TAG, "Replaying %u bytes of %d-sample blocks, algo %d mode %d",
+			 (unsigned)source->len, s_header.block_len, s_header.algo_type, s_header.algo_mode);
+	xSemaphoreGive(s_replay_go);
+	return ESP_OK;
+}
+
+void fad_capture_stop(void)
+{
+	fad_capture_active = false;
+	s_mode = FAD_CAPTURE_OFF;
+	s_report.done = true;
+}
+
+uint16_t *fad_capture_block_begin(const uint16_t *in_buff, const uint16_t *ref_buff, uint16_t in_pos, int len,
+								  uint32_t sample_count, uint16_t dac_pos, bool replay, const uint16_t **ref_block)
+{
+	*ref_block = s_header.has_ref ? s_ref_block : NULL;
+	if (s_mode == FAD_CAPTURE_REPLAY)
+		return replay ? s_block : NULL; // live blocks would disturb the algorithm state, so they are skipped
+
+	if (s_mode != FAD_CAPTURE_RECORD || replay)
+		return NULL;
+
+	if (len > ADC_BUFFER_SIZE)
+		len = ADC_BUFFER_SIZE;
+
+	/* Take the block before the ISR can overwrite it */
+	int first = (in_pos + len <= ADC_BUFFER_SIZE) ? len : ADC_BUFFER_SIZE - in_pos;
+	memcpy(s_block, in_buff + in_pos, first * sizeof(uint16_t));
+	memcpy(s_block + first, in_buff, (len - first) * sizeof(uint16_t));
+	if (s_header.has_ref)
+	{
+		memcpy(s_ref_block, ref_buff + in_pos, first * sizeof(uint16_t));
+		memcpy(s_ref_block + first, ref_buff, (len - first) * sizeof(uint16_t));
+	}
+
+	if (s_report.blocks > 0 && sample_count - s_last_sample_count != (uint32_t)len)
+		s_report.gaps++;
+	s_last_sample_count = sample_count;
+
+	s_block_len = len;
+	s_block_adc_pos = in_pos;
+	s_block_dac_pos = dac_pos;
+	s_block_sample_count = sample_count;
+	return s_block;
+}
+
+void fad_capture_block_end(const uint8_t *out, int out_len)
+{
+	if (s_mode == FAD_CAPTURE_RECORD)
+	{
+		if (!append_record(s_dest, out, out_len))
+		{
+			s_report.overflow = true;
+			capture_finish();
+			return;
+		}
+		s_report.blocks++;
+		s_report.bytes = s_dest->len;
+	}
+	else if (s_mode == FAD_CAPTURE_REPLAY)
+	{
+		if (s_header.has_output)
+		{
+			int compared = s_block_len / s_header.multisamples;
+			if (out_len < compared)
+				compared = out_len;
+
+			uint32_t diffs = 0;
+			for (int i = 0; i < compared; i++)
+				diffs += (out[i] != s_expected[i]);
+			if (diffs)
+			{
+				if (s_report.mismatched_blocks == 0)
+					ESP_LOGW(CAPTURE_TAG, "First output mismatch in block %u (sample clock %u)",
+							 s_report.blocks, s_block_sample_count);
+				s_report.mismatched_blocks++;
+				s_report.mismatched_samples += diffs;
+			}
+		}
+
+		if (s_dest != NULL && !s_report.overflow)
+		{
+			fad_capture_header_t source_header = s_header;
+			s_header.has_output = true;
+			s_report.overflow = !append_record(s_dest, out, out_len);
+			s_header = source_header;
+		}
+
+		s_report.blocks++;
+		xSemaphoreGive(s_replay_go);
+	}
+}
+
+void fad_capture_get_report(fad_capture_report_t *report)
+{
+	memcpy(report, &s_report, sizeof(fad_capture_report_t));
+}
+
+void fad_capture_report(void)
+{
+	fad_capture_report_t report;
+	fad_capture_get_report(&report);
+
+	if (report.mode == FAD_CAPTURE_RECORD)
+	{
+		ESP_LOGI(CAPTURE_TAG, "Recorded %u blocks, %u bytes, %u timestamp gaps%s",
+				 report.blocks, (unsigned)report.bytes, report.gaps, report.overflow ? ", stopped when full" : "");
+	}
+	else if (report.mode == FAD_CAPTURE_REPLAY)
+	{
+		ESP_LOGI(CAPTURE_TAG, "Replayed %u blocks%s", report.blocks, report.corrupt ? ", stopped at a malformed block" : "");
+		if (!report.verified)
+			ESP_LOGI(CAPTURE_TAG, "  Capture has no outputs, nothing to compare");
+		else if (report.mismatched_blocks == 0)
+			ESP_LOGI(CAPTURE_TAG, "  Output bit-identical to the recording");
+		else
+			ESP_LOGW(CAPTURE_TAG, "  Output differs in %u blocks, %u samples",
+					 report.mismatched_blocks, report.mismatched_samples);
+	}
+}
+
+void fad_capture_dump(const fad_capture_store_t *store)
+{
+	fad_capture_dump_bytes("FADC", store->data, store->len);
+}
+
+void fad_capture_dump_bytes(const char *marker, const uint8_t *data, size_t len)
+{
+	static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	char line[(FAD_CAPTURE_DUMP_LINE + 2) / 3 * 4 + 1];
+
+	printf("%s-BEGIN %u\n", marker, (unsigned)len);
+	for (size_t pos = 0; pos < len; pos += FAD_CAPTURE_DUMP_LINE)
+	{
+		size_t n = len - pos < FAD_CAPTURE_DUMP_LINE ? len - pos : FAD_CAPTURE_DUMP_LINE;
+		const uint8_t *in = data + pos;
+		char *out = line;
+
+		for (size_t i = 0; i < n; i += 3)
+		{
+			uint32_t v = in[i] << 16;
+			if (i + 1 < n)
+				v |= in[i + 1] << 8;
+			if (i + 2 < n)
+				v |= in[i + 2];
+
+			*out++ = alphabet[(v >> 18) & 0x3f];
+			*out++ = alphabet[(v >> 12) & 0x3f];
+			*out++ = (i + 1 < n) ? alphabet[(v >> 6) & 0x3f] : '=';
+			*out++ = (i + 2 < n) ? alphabet[v & 0x3f] : '=';
+		}
+		*out = '\0';
+		printf("%s\n", line);
+	}
+	printf("%s-END\n", marker);
+	fflush(stdout);
+}
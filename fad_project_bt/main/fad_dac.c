@@ -11,43 +11,60 @@
 #include <stdlib.h>
 #include "fad_dac.h"
 
-#include "driver/dac.h"
-#include "soc/dac_periph.h"
 #include "hal/dac_types.h"
 #include "esp_system.h"
 
+#include "fad_defs.h"
+#include "fad_perf.h"
+#include "fad_hal.h"
+
 #define DAC_CHANNEL DAC_CHANNEL_1
+#define DAC_MIDSCALE 128
 
 /**
  * @brief Initialize DAC through Espressif DAC API
  */
 esp_err_t dac_init(void) {
-	esp_err_t err = dac_output_enable(DAC_CHANNEL);
-	return err;
+	return dac_channel_setup(DAC_CHANNEL);
 }
 
+/**
+ * @brief Enable a DAC pad and turn off the cosine generator for it, so that after this only the
+ * pad's output value register needs to be written per sample.
+ */
+esp_err_t dac_channel_setup(dac_channel_t channel) {
+	return fad_hal_dac_setup(channel);
+}
 
 /**
- * @brief Output voltage with value (8 bit).
+ * @brief Output voltage with value (8 bit) on a channel prepared by dac_channel_setup.
+ * A single register store, no argument checks, safe from IRAM.
  * @param channel DAC channel num.
  * @param value Output value. Value range: 0 ~ 255.
  *        The corresponding range of voltage is 0v ~ VDD3P3_RTC.
  */
-
- //Check DAC function to wrap in IRAM_ATTR 
-
-
+void IRAM_ATTR dac_write_channel(dac_channel_t channel, uint8_t value) {
+	fad_hal_dac_write_fast(channel, value);
+}
 
 void IRAM_ATTR dac_output_value(uint8_t value) {
-    dac_output_voltage(DAC_CHANNEL_1, value);
-    /*
-    if (DAC_CHANNEL == DAC_CHANNEL_1) {
-        SENS.sar_dac_ctrl2.dac_cw_en1 = 0;
-        RTCIO.pad_dac[DAC_CHANNEL].dac = value;
-    } else if (DAC_CHANNEL == DAC_CHANNEL_2) {
-        SENS.sar_dac_ctrl2.dac_cw_en2 = 0;
-        RTCIO.pad_dac[DAC_CHANNEL].dac = value;
-    }
-    */
+	if (FAD_DAC_FAST_PATH) {
+		dac_write_channel(DAC_CHANNEL, value);
+	} else {
+		fad_hal_dac_write_driver(DAC_CHANNEL, value);
+	}
 }
 
+void dac_benchmark(int iterations) {
+	for (int i = 0; i < iterations; i++) {
+		uint32_t start = fad_perf_cycles();
+		fad_hal_dac_write_driver(DAC_CHANNEL, DAC_MIDSCALE);
+		fad_perf_record(FAD_PERF_DAC_DRIVER, fad_perf_cycles() - start);
+	}
+
+	for (int i = 0; i < iterations; i++) {
+		uint32_t start = fad_perf_cycles();
+		dac_write_channel(DAC_CHANNEL, DAC_MIDSCALE);
+		fad_perf_record(FAD_PERF_DAC_FAST, fad_perf_cycles() - start);
+	}
+}
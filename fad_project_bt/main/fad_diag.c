@@ -0,0 +1,151 @@
+/**
+ * fad_diag.c
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Diagnostics console: reads command lines from the console UART and prints the dumps they ask for.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "driver/uart.h"
+#include "esp_sleep.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "fad_diag.h"
+#include "fad_bt_telemetry.h"
+#include "fad_mem.h"
+
+#define DIAG_TAG "DIAG"
+#define DIAG_UART UART_NUM_0		// The console UART
+#define DIAG_RX_BUFFER 256			// UART driver receive buffer; must be larger than the 128-byte FIFO
+#define DIAG_TASK_STACK 3072		// The dumps format floats
+#define DIAG_TASK_PRIORITY 1		// Above idle only; a dump waits for everything else
+#define DIAG_WAKEUP_EDGES 3			// RX edges that wake the chip from light sleep, the hardware minimum
+
+static TaskHandle_t s_diag_task_handle = NULL;
+
+static void cmd_bt(const char *arg);
+static void cmd_mem(const char *arg);
+static void cmd_help(const char *arg);
+
+static const struct {
+	const char *name;
+	void (*run)(const char *arg);
+	const char *help;
+} s_commands[] = {
+	{"bt", cmd_bt, "bt [reset]  A2DP telemetry dump, or zero its counters"},
+	{"mem", cmd_mem, "mem         Memory footprint dump"},
+	{"help", cmd_help, "help        This list"},
+};
+
+static void cmd_bt(const char *arg)
+{
+	if (strcmp(arg, "reset") == 0)
+	{
+		fad_bt_telemetry_reset();
+		ESP_LOGI(DIAG_TAG, "A2DP telemetry reset");
+	}
+	else
+	{
+		fad_bt_telemetry_dump(stdout);
+	}
+}
+
+static void cmd_mem(const char *arg)
+{
+	fad_mem_dump(stdout);
+}
+
+static void cmd_help(const char *arg)
+{
+	for (size_t i = 0; i < sizeof(s_commands) / sizeof(s_commands[0]); i++)
+		ESP_LOGI(DIAG_TAG, "  %s", s_commands[i].help);
+}
+
+esp_err_t fad_diag_command(const char *line)
+{
+	while (*line == ' ')
+		line++;
+	size_t name_len = strcspn(line, " ");
+	const char *arg = line + name_len;
+	while (*arg == ' ')
+		arg++;
+
+	for (size_t i = 0; i < sizeof(s_commands) / sizeof(s_commands[0]); i++)
+	{
+		if (strlen(s_commands[i].name) == name_len && strncmp(line, s_commands[i].name, name_len) == 0)
+		{
+			s_commands[i].run(arg);
+			return ESP_OK;
+		}
+	}
+	return ESP_ERR_NOT_FOUND;
+}
+
+/**
+ * @brief FreeRTOS task that collects command lines from the UART and runs them
+ * @param params [in] required as part of the task function definition
+ */
+static void diag_task(void *params)
+{
+	char line[FAD_DIAG_LINE_LEN + 1];
+	int len = 0;
+	bool overlong = false;
+
+	for (;;)
+	{
+		uint8_t c;
+		if (uart_read_bytes(DIAG_UART, &c, 1, portMAX_DELAY) != 1)
+			continue;
+
+		if (c == '\r' || c == '\n')
+		{
+			line[len] = '\0';
+			if (overlong)
+				ESP_LOGW(DIAG_TAG, "Command longer than %d characters", FAD_DIAG_LINE_LEN);
+			else if (len > 0 && fad_diag_command(line) == ESP_ERR_NOT_FOUND)
+				ESP_LOGW(DIAG_TAG, "Unknown command \"%s\", try help", line);
+			len = 0;
+			overlong = false;
+		}
+		else if (len < FAD_DIAG_LINE_LEN)
+		{
+			line[len++] = c;
+		}
+		else
+		{
+			overlong = true;
+		}
+	}
+}
+
+esp_err_t fad_diag_init(void)
+{
+	if (!FAD_DIAG_ENABLE || s_diag_task_handle != NULL)
+		return ESP_OK;
+
+	esp_err_t err = uart_driver_install(DIAG_UART, DIAG_RX_BUFFER, 0, 0, NULL, 0);
+	if (err)
+	{
+		ESP_LOGW(DIAG_TAG, "No console input, diagnostics commands are off (%s)", esp_err_to_name(err));
+		return err;
+	}
+
+	/* In light sleep the UART is off; the edges that wake it are lost, so send a newline before a command */
+	if (FAD_POWER_ENABLE && FAD_POWER_LIGHT_SLEEP)
+	{
+		uart_set_wakeup_threshold(DIAG_UART, DIAG_WAKEUP_EDGES);
+		esp_sleep_enable_uart_wakeup(DIAG_UART);
+	}
+
+	if (xTaskCreate(diag_task, "Diag_Console", DIAG_TASK_STACK, 0, DIAG_TASK_PRIORITY, &s_diag_task_handle) != pdPASS)
+		return ESP_ERR_NO_MEM;
+	fad_mem_track_task(s_diag_task_handle, "Diag_Console", DIAG_TASK_STACK);
+	ESP_LOGI(DIAG_TAG, "Diagnostics console ready, type help");
+	return ESP_OK;
+}
@@ -6,6 +6,7 @@
 
 #include "fad_app_core.h"
 #include "fad_defs.h"
+#include "fad_trace.h"
 #include "main.h"
 
 #define BUTTON_BIT_MASK ((1ULL << FAD_VOL_DN_BN) | (1ULL << FAD_VOL_UP_BN) | (1ULL << FAD_DISC_BN))
@@ -64,6 +65,8 @@ static int16_t parse_volume_history(int16_t vu, int16_t vd)
 
 void gpio_polling_task(TimerHandle_t timer)
 {
+    fad_trace_begin(FAD_TRACK_GPIO, FAD_TRACE_GPIO_POLL, 0);
+
     /* Get pin levels */
 
     // Buttons
@@ -94,6 +97,7 @@ void gpio_polling_task(TimerHandle_t timer)
 
     // ESP_LOGI(GPIO_TAG, "HS_1: %d, HS_2: %d", s_gp_hist.hs_1, s_gp_hist.hs_2);
 
+    fad_trace_end(FAD_TRACK_GPIO, FAD_TRACE_GPIO_POLL);
 }
 
 void fad_gpio_init()
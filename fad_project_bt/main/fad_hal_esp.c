@@ -0,0 +1,382 @@
+/**
+ * fad_hal_esp.c
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * ESP32 implementation of fad_hal.h: timer group 0 for the sample clock, RTC registers for the ADC1
+ * and DAC fast paths, LEDC or sigma-delta registers for the PWM output, the I2S driver for the codec
+ * output and the digital mic, and the CPU cycle counter for timing.
+ */
+
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_intr_alloc.h"
+#include "freertos/FreeRTOS.h"
+#include "esp32/clk.h"
+#include "driver/timer.h"
+#include "driver/adc.h"
+#include "driver/dac.h"
+#include "driver/ledc.h"
+#include "driver/sigmadelta.h"
+#include "driver/i2s.h"
+#include "driver/gpio.h"
+#include "hal/adc_types.h"
+#include "hal/adc_ll.h"
+#include "hal/cpu_hal.h"
+#include "hal/ledc_ll.h"
+#include "hal/gpio_sd_ll.h"
+#include "soc/sens_struct.h"
+#include "soc/rtc_io_struct.h"
+
+#include "fad_defs.h"
+#include "fad_hal.h"
+
+#define TIMER_GROUP TIMER_GROUP_0
+#define TIMER_NUMBER TIMER_0
+#define APB_CLK_HZ 80000000
+#define CLOCK_DIVIDER (APB_CLK_HZ / TIMER_FREQ) //divider required to make timer frequency correct
+#define ALARM_STEP_SIZE (TIMER_FREQ / ALARM_FREQ)
+#define FRAC_TICK_HZ (APB_CLK_HZ / FAD_TIMER_FRAC_DIVIDER) // timer tick rate with fractional-N scheduling
+#define FRAC_STEP (FRAC_TICK_HZ / ALARM_FREQ)				 // whole ticks per sample
+#define FRAC_STEP_REM (FRAC_TICK_HZ % ALARM_FREQ)			 // leftover ticks per sample, in 1/ALARM_FREQ units
+#define DAC_MIDSCALE 128
+#define PWM_LEDC_CHANNEL LEDC_CHANNEL_0
+#define PWM_SD_CHANNEL SIGMADELTA_CHANNEL_0
+
+static uint32_t s_frac_acc = 0;				 // fractional-N remainder accumulator
+static int s_last_value[ADC1_CHANNEL_MAX];	 // last good conversion per channel, repeated if a conversion times out
+static volatile uint32_t s_poll_timeouts = 0; // conversions that did not finish within FAD_ADC_POLL_LIMIT polls
+static int s_adc_pad = -1; // ADC1 channel whose pad is selected for the fast path
+static bool s_pwm_sigma_delta = false;
+static int16_t s_i2s_frames[2 * FAD_I2S_CHUNK]; // stereo staging for fad_hal_i2s_write
+static int32_t s_mic_words[FAD_MIC_DMA_BUF_LEN * FAD_ADC_CHANNELS]; // 32-bit slot staging for I2S mics
+
+esp_err_t fad_hal_timer_init(fad_hal_isr_t isr)
+{
+	//API struct from driver/timer.h
+	timer_config_t adc_timer =
+		{
+			.alarm_en = TIMER_ALARM_EN,
+			.counter_en = TIMER_PAUSE,
+			.counter_dir = TIMER_COUNT_UP,
+			.auto_reload = TIMER_AUTORELOAD_EN,
+			.divider = FAD_TIMER_FRACTIONAL_N ? FAD_TIMER_FRAC_DIVIDER : CLOCK_DIVIDER, //80 MHz / 907 = ~88.2 kHz
+		};
+
+	esp_err_t err;
+
+	//API functions from driver/timer.h
+	err = timer_init(TIMER_GROUP, TIMER_NUMBER, &adc_timer);
+	err = timer_set_counter_value(TIMER_GROUP, TIMER_NUMBER, 0x00000000ULL);
+	err = timer_enable_intr(TIMER_GROUP, TIMER_NUMBER);
+	err = timer_set_alarm_value(TIMER_GROUP, TIMER_NUMBER, FAD_TIMER_FRACTIONAL_N ? FRAC_STEP : ALARM_STEP_SIZE);
+	err = timer_isr_register(TIMER_GROUP, TIMER_NUMBER, isr, 0, ESP_INTR_FLAG_IRAM, NULL);
+
+	return err;
+}
+
+esp_err_t fad_hal_timer_start(void)
+{
+	return timer_start(TIMER_GROUP, TIMER_NUMBER);
+}
+
+void fad_hal_timer_pause(void)
+{
+	timer_pause(TIMER_GROUP, TIMER_NUMBER);
+}
+
+void IRAM_ATTR fad_hal_timer_isr_enter(void)
+{
+	timer_spinlock_take(TIMER_GROUP); //At beginning and end, Timer API asks us to enclose ISR with spinlock _take and _give functions to function properly
+}
+
+void IRAM_ATTR fad_hal_timer_isr_exit(void)
+{
+	/* Fractional-N: the step alternates between FRAC_STEP and FRAC_STEP + 1 ticks so that the average
+	 * period is exactly FRAC_TICK_HZ / ALARM_FREQ. Counter was auto-reloaded, so this sets the next period. */
+	if (FAD_TIMER_FRACTIONAL_N)
+	{
+		uint64_t step = FRAC_STEP;
+		s_frac_acc += FRAC_STEP_REM;
+		if (s_frac_acc >= ALARM_FREQ)
+		{
+			s_frac_acc -= ALARM_FREQ;
+			step++;
+		}
+		timer_group_set_alarm_value_in_isr(TIMER_GROUP, TIMER_NUMBER, step);
+	}
+
+	timer_group_clr_intr_status_in_isr(TIMER_GROUP, TIMER_NUMBER); // clear the interrupt
+	timer_group_enable_alarm_in_isr(TIMER_GROUP, TIMER_NUMBER); // enable alarm
+	timer_spinlock_give(TIMER_GROUP);
+}
+
+double fad_hal_timer_configured_rate(void)
+{
+	if (FAD_TIMER_FRACTIONAL_N)
+		return ALARM_FREQ;
+
+	return (double)APB_CLK_HZ / CLOCK_DIVIDER / ALARM_STEP_SIZE;
+}
+
+/**
+ * @brief One-time setup for fad_hal_adc_read_fast. The driver read leaves SAR ADC1 under RTC control
+ * with the configured width and attenuation; after that only the channel's pad needs to be selected.
+ * Nothing else in the firmware uses ADC1, so the driver lock can be skipped from then on.
+ */
+esp_err_t fad_hal_adc_init(int channel)
+{
+	//bit width of ADC input
+	esp_err_t err = adc1_config_width(ADC_WIDTH_BIT_12);
+	if (err)
+		return err;
+
+	//attenuation
+	err = adc1_config_channel_atten(channel, ADC_ATTEN_DB_11);
+	if (err)
+		return err;
+
+	adc_power_acquire();
+	s_last_value[channel] = adc1_get_raw(channel);
+	adc_ll_rtc_enable_channel(ADC_NUM_1, channel);
+	s_adc_pad = channel;
+
+	return ESP_OK;
+}
+
+/**
+ * Register-level ADC1 conversion. Mimics what adc1_get_raw does once the channel is set up,
+ * without its locks and argument checks, so it can run from the IRAM ISR. Alternating between two
+ * channels costs a pad select register write per read.
+ * See toptal.com/embedded/esp32-audio-sampling for more information
+ */
+int IRAM_ATTR fad_hal_adc_read_fast(int channel)
+{
+	if (channel != s_adc_pad)
+	{
+		adc_ll_rtc_enable_channel(ADC_NUM_1, channel);
+		s_adc_pad = channel;
+	}
+	adc_ll_rtc_start_convert(ADC_NUM_1, channel);
+
+	for (int polls = 0; adc_ll_rtc_convert_is_done(ADC_NUM_1) != true; polls++)
+	{
+		if (polls == FAD_ADC_POLL_LIMIT)
+		{
+			s_poll_timeouts++;
+			return s_last_value[channel];
+		}
+	}
+
+	s_last_value[channel] = adc_ll_rtc_get_convert_value(ADC_NUM_1);
+	return s_last_value[channel];
+}
+
+int fad_hal_adc_read_driver(int channel)
+{
+	return adc1_get_raw(channel);
+}
+
+uint32_t fad_hal_adc_poll_timeouts(void)
+{
+	return s_poll_timeouts;
+}
+
+/* Enable the pad through the driver and turn off the cosine generator for it, so that after this
+ * only the pad's output value register needs to be written per sample. */
+esp_err_t fad_hal_dac_setup(dac_channel_t channel)
+{
+	esp_err_t err = dac_output_enable(channel);
+	if (err)
+		return err;
+
+	if (channel == DAC_CHANNEL_1) {
+		SENS.sar_dac_ctrl2.dac_cw_en1 = 0;
+	} else if (channel == DAC_CHANNEL_2) {
+		SENS.sar_dac_ctrl2.dac_cw_en2 = 0;
+	}
+	RTCIO.pad_dac[channel].dac = DAC_MIDSCALE;
+
+	return ESP_OK;
+}
+
+/* A single register store, no argument checks, safe from IRAM */
+void IRAM_ATTR fad_hal_dac_write_fast(dac_channel_t channel, uint8_t value)
+{
+	RTCIO.pad_dac[channel].dac = value;
+}
+
+void fad_hal_dac_write_driver(dac_channel_t channel, uint8_t value)
+{
+	dac_output_voltage(channel, value);
+}
+
+esp_err_t fad_hal_pwm_setup(int gpio, int bits, bool sigma_delta)
+{
+	s_pwm_sigma_delta = sigma_delta;
+	if (sigma_delta)
+	{
+		sigmadelta_config_t sd = {
+			.channel = PWM_SD_CHANNEL,
+			.sigmadelta_duty = 0, // midscale
+			.sigmadelta_prescale = FAD_PWM_SD_PRESCALE,
+			.sigmadelta_gpio = gpio,
+		};
+		return (bits == 8) ? sigmadelta_config(&sd) : ESP_ERR_INVALID_ARG;
+	}
+
+	ledc_timer_config_t timer = {
+		.speed_mode = LEDC_HIGH_SPEED_MODE,
+		.duty_resolution = bits,
+		.timer_num = LEDC_TIMER_0,
+		.freq_hz = APB_CLK_HZ >> bits,
+		.clk_cfg = LEDC_USE_APB_CLK,
+	};
+	esp_err_t err = ledc_timer_config(&timer);
+	if (err)
+		return err;
+
+	/* The driver leaves the duty stepping set to a single step, so after this a new duty only
+	 * needs the duty register and the start bit */
+	ledc_channel_config_t channel = {
+		.gpio_num = gpio,
+		.speed_mode = LEDC_HIGH_SPEED_MODE,
+		.channel = PWM_LEDC_CHANNEL,
+		.intr_type = LEDC_INTR_DISABLE,
+		.timer_sel = LEDC_TIMER_0,
+		.duty = 1 << (bits - 1),
+		.hpoint = 0,
+	};
+	return ledc_channel_config(&channel);
+}
+
+/* Two register stores for LEDC, one for sigma-delta. No argument checks, safe from IRAM. */
+void IRAM_ATTR fad_hal_pwm_write_fast(uint32_t duty)
+{
+	if (s_pwm_sigma_delta) {
+		gpio_sd_ll_set_duty(&SIGMADELTA, PWM_SD_CHANNEL, (int8_t)(duty - 128));
+		return;
+	}
+	ledc_ll_set_duty_int_part(LEDC_LL_GET_HW(), LEDC_HIGH_SPEED_MODE, PWM_LEDC_CHANNEL, duty);
+	ledc_ll_set_duty_start(LEDC_LL_GET_HW(), LEDC_HIGH_SPEED_MODE, PWM_LEDC_CHANNEL, true);
+}
+
+esp_err_t fad_hal_i2s_setup(uint32_t rate)
+{
+	i2s_config_t config = {
+		.mode = I2S_MODE_MASTER | I2S_MODE_TX,
+		.sample_rate = rate,
+		.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
+		.channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,
+		.communication_format = I2S_COMM_FORMAT_STAND_I2S,
+		.intr_alloc_flags = 0,
+		.dma_buf_count = FAD_I2S_DMA_BUF_COUNT,
+		.dma_buf_len = FAD_I2S_DMA_BUF_LEN,
+		.use_apll = true, // 11025 Hz is not reachable from the 160 MHz PLL with a small error
+		.tx_desc_auto_clear = true, // an underrun plays silence, not the last buffer again
+	};
+	i2s_pin_config_t pins = {
+		.bck_io_num = FAD_I2S_BCK_GPIO,
+		.ws_io_num = FAD_I2S_WS_GPIO,
+		.data_out_num = FAD_I2S_DOUT_GPIO,
+		.data_in_num = I2S_PIN_NO_CHANGE,
+	};
+
+	esp_err_t err = i2s_driver_install(FAD_I2S_OUT_PORT, &config, 0, NULL);
+	if (err)
+		return err;
+	return i2s_set_pin(FAD_I2S_OUT_PORT, &pins);
+}
+
+int fad_hal_i2s_write(const int16_t *samples, int count, uint32_t timeout_ms)
+{
+	int done = 0;
+	while (done < count)
+	{
+		int n = (count - done < FAD_I2S_CHUNK) ? count - done : FAD_I2S_CHUNK;
+		for (int i = 0; i < n; i++)
+		{
+			s_i2s_frames[2 * i] = samples[done + i];
+			s_i2s_frames[2 * i + 1] = samples[done + i];
+		}
+
+		size_t written = 0;
+		i2s_write(FAD_I2S_OUT_PORT, s_i2s_frames, n * 2 * sizeof(int16_t), &written, pdMS_TO_TICKS(timeout_ms));
+		done += written / (2 * sizeof(int16_t));
+		if (written < n * 2 * sizeof(int16_t))
+			break;
+	}
+	return done;
+}
+
+esp_err_t fad_hal_mic_setup(uint32_t rate)
+{
+	i2s_config_t config = {
+		.mode = I2S_MODE_MASTER | I2S_MODE_RX | (FAD_MIC_PDM ? I2S_MODE_PDM : 0),
+		.sample_rate = rate,
+		.bits_per_sample = FAD_MIC_PDM ? I2S_BITS_PER_SAMPLE_16BIT : I2S_BITS_PER_SAMPLE_32BIT,
+		.channel_format = (FAD_ADC_CHANNELS > 1) ? I2S_CHANNEL_FMT_RIGHT_LEFT : I2S_CHANNEL_FMT_ONLY_LEFT,
+		.communication_format = I2S_COMM_FORMAT_STAND_I2S,
+		.intr_alloc_flags = 0,
+		.dma_buf_count = FAD_MIC_DMA_BUF_COUNT,
+		.dma_buf_len = FAD_MIC_DMA_BUF_LEN,
+		.use_apll = false, // the APLL is left for the codec output
+	};
+	i2s_pin_config_t pins = {
+		.bck_io_num = FAD_MIC_PDM ? I2S_PIN_NO_CHANGE : FAD_MIC_CLK_GPIO,
+		.ws_io_num = FAD_MIC_PDM ? FAD_MIC_CLK_GPIO : FAD_MIC_WS_GPIO, // PDM clock comes out on the WS pin
+		.data_out_num = I2S_PIN_NO_CHANGE,
+		.data_in_num = FAD_MIC_DATA_GPIO,
+	};
+
+	esp_err_t err = i2s_driver_install(FAD_MIC_PORT, &config, 0, NULL);
+	if (err)
+		return err;
+	err = i2s_set_pin(FAD_MIC_PORT, &pins);
+	if (err || !FAD_MIC_PDM)
+		return err;
+
+	/* 128x oversampling puts the PDM clock at 1.4 MHz for 11025 Hz; most PDM mics need at least 1 MHz */
+	return i2s_set_pdm_rx_down_sample(FAD_MIC_PORT, I2S_PDM_DSR_16S);
+}
+
+int fad_hal_mic_read(int16_t *samples, int count, uint32_t timeout_ms)
+{
+	size_t bytes = 0;
+	if (FAD_MIC_PDM)
+	{
+		i2s_read(FAD_MIC_PORT, samples, count * FAD_ADC_CHANNELS * sizeof(int16_t), &bytes, pdMS_TO_TICKS(timeout_ms));
+		return bytes / (FAD_ADC_CHANNELS * sizeof(int16_t));
+	}
+
+	int done = 0;
+	while (done < count)
+	{
+		int n = (count - done < FAD_MIC_DMA_BUF_LEN) ? count - done : FAD_MIC_DMA_BUF_LEN;
+		i2s_read(FAD_MIC_PORT, s_mic_words, n * FAD_ADC_CHANNELS * sizeof(int32_t), &bytes, pdMS_TO_TICKS(timeout_ms));
+		int got = bytes / (FAD_ADC_CHANNELS * sizeof(int32_t));
+		for (int i = 0; i < got * FAD_ADC_CHANNELS; i++)
+			samples[done * FAD_ADC_CHANNELS + i] = s_mic_words[i] >> 16; // top 16 of the 24 data bits
+		done += got;
+		if (got < n)
+			break;
+	}
+	return done;
+}
+
+uint32_t IRAM_ATTR fad_hal_cycles(void)
+{
+	return cpu_hal_get_cycle_count();
+}
+
+uint32_t fad_hal_cpu_hz(void)
+{
+	return esp_clk_cpu_freq();
+}
+
+int64_t IRAM_ATTR fad_hal_time_us(void)
+{
+	return esp_timer_get_time();
+}
@@ -0,0 +1,150 @@
+/**
+ * fad_i2s.c
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * I2S codec output task. dac_buffer_pos is the last sample the ISR has passed, so everything before
+ * it is finished algorithm output. The task stays a chunk or more behind it and blocks in the DMA
+ * write, which paces it to the codec clock. The codec takes 16-bit words, but they are widened from the
+ * 8-bit dac_buffer, so the resolution is still 8 bits.
+ */
+
+#include <string.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "fad_defs.h"
+#include "fad_dac.h"
+#include "fad_adc.h"
+#include "fad_i2s.h"
+#include "fad_timer.h"
+#include "fad_latency.h"
+#include "fad_hal.h"
+#include "fad_mem.h"
+#include "fad_format.h"
+
+#define I2S_TAG "I2S"
+#define I2S_TASK_STACK 2048
+#define I2S_TASK_PRIORITY (configMAX_PRIORITIES - 4) // below the app task; the DMA queue covers for the wait
+#define I2S_WRITE_TIMEOUT_MS 100
+#define I2S_QUEUE_SAMPLES (FAD_I2S_DMA_BUF_COUNT * FAD_I2S_DMA_BUF_LEN)
+
+static xTaskHandle s_i2s_task_handle = NULL;
+static SemaphoreHandle_t s_start_semaphore = NULL;
+static volatile bool s_running = false;
+static bool s_driver_installed = false;
+static int s_out_pos = 0;
+static int16_t s_chunk[FAD_I2S_CHUNK];
+static fad_i2s_stats_t s_stats;
+static fad_format_desc_t s_format;
+
+/**
+ * @brief FreeRTOS task that moves finished output to the codec
+ * @param params [in] required as part of the task function definition
+ */
+static void i2s_task(void *params)
+{
+	for (;;)
+	{
+		if (!s_running)
+		{
+			xSemaphoreTake(s_start_semaphore, portMAX_DELAY);
+			continue;
+		}
+
+		int ready = (dac_buffer_pos - s_out_pos + DAC_BUFFER_SIZE) % DAC_BUFFER_SIZE;
+		if (ready > DAC_BUFFER_SIZE / 2)
+		{
+			/* The algorithm writes the half ahead of the ISR, so anything further back is being overwritten */
+			s_out_pos = (dac_buffer_pos - FAD_I2S_CHUNK + DAC_BUFFER_SIZE) % DAC_BUFFER_SIZE;
+			ready = FAD_I2S_CHUNK;
+			s_stats.overruns++;
+		}
+		if (ready < FAD_I2S_CHUNK)
+		{
+			vTaskDelay(1);
+			continue;
+		}
+
+		/* Convert in at most two blocks, split where dac_buffer wraps */
+		int first = DAC_BUFFER_SIZE - s_out_pos;
+		if (first > FAD_I2S_CHUNK)
+			first = FAD_I2S_CHUNK;
+		fad_format_convert(&s_format, &dac_buffer[s_out_pos], first, s_chunk);
+		fad_format_convert(&s_format, dac_buffer, FAD_I2S_CHUNK - first, s_chunk + first);
+
+		int queued = 0;
+		while (queued < FAD_I2S_CHUNK && s_running)
+		{
+			int n = fad_hal_i2s_write(s_chunk + queued, FAD_I2S_CHUNK - queued, I2S_WRITE_TIMEOUT_MS);
+			if (n == 0)
+				vTaskDelay(1);
+			queued += n;
+		}
+
+		/* A sample queued now plays once the queue ahead of it has drained */
+		if (fad_latency_armed)
+		{
+			uint32_t played = adc_timer_get_sample_count() + I2S_QUEUE_SAMPLES * MULTISAMPLES;
+			for (int i = 0; i < queued; i++)
+				fad_latency_isr_output((s_out_pos + i) % DAC_BUFFER_SIZE, played);
+		}
+
+		s_out_pos = (s_out_pos + queued) % DAC_BUFFER_SIZE;
+		s_stats.samples += queued;
+	}
+
+	fad_mem_untrack_task(s_i2s_task_handle);
+	vTaskDelete(s_i2s_task_handle);
+}
+
+esp_err_t fad_i2s_init(void)
+{
+	fad_format_negotiate(FAD_OUTPUT_I2S, OUTPUT_FREQ, &s_format);
+	if (!s_driver_installed)
+	{
+		esp_err_t err = fad_hal_i2s_setup(OUTPUT_FREQ);
+		if (err)
+			return err;
+		s_driver_installed = true;
+	}
+
+	if (s_i2s_task_handle == NULL)
+	{
+		s_start_semaphore = xSemaphoreCreateBinary();
+		xTaskCreate(i2s_task, "I2S_Output_Task", I2S_TASK_STACK, 0, I2S_TASK_PRIORITY, &s_i2s_task_handle);
+		fad_mem_track_task(s_i2s_task_handle, "I2S_Output_Task", I2S_TASK_STACK);
+	}
+
+	ESP_LOGI(I2S_TAG, "Codec output on I2S%d at %d Hz, %d samples queued", FAD_I2S_OUT_PORT, OUTPUT_FREQ, I2S_QUEUE_SAMPLES);
+	return ESP_OK;
+}
+
+void fad_i2s_start(void)
+{
+	memset(&s_stats, 0, sizeof(s_stats));
+	s_out_pos = dac_buffer_pos;
+	s_running = true;
+	xSemaphoreGive(s_start_semaphore);
+}
+
+void fad_i2s_stop(void)
+{
+	s_running = false;
+}
+
+void fad_i2s_get_stats(fad_i2s_stats_t *stats)
+{
+	memcpy(stats, &s_stats, sizeof(fad_i2s_stats_t));
+}
+
+void fad_i2s_report(void)
+{
+	fad_i2s_stats_t stats;
+	fad_i2s_get_stats(&stats);
+	ESP_LOGI(I2S_TAG, "Codec output: %u samples queued, %u overruns", stats.samples, stats.overruns);
+}
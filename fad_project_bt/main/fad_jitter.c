@@ -0,0 +1,128 @@
+/**
+ * fad_jitter.c
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Sample clock accuracy measurement. Interval statistics are kept in CPU cycles in the ISR and only
+ * converted to time in the report. Cycle counts are per core, which is fine as the ISR stays on the
+ * core it was registered on, but they are wrong across a CPU frequency change. fad_power holds the
+ * CPU at one clock while FAD_JITTER_ENABLE is set, and adc_timer_start calibrates after it has.
+ */
+
+#include <string.h>
+#include "esp_log.h"
+
+#include "fad_defs.h"
+#include "fad_jitter.h"
+#include "fad_timer.h"
+#include "fad_hal.h"
+
+#define JITTER_TAG "JITTER"
+#define JITTER_CENTER_BIN (FAD_JITTER_BINS / 2)
+
+static uint32_t s_histogram[FAD_JITTER_BINS];
+static volatile uint32_t s_intervals = 0;
+static volatile uint32_t s_late = 0;
+static volatile int32_t s_min_dev = 0;	// in cycles
+static volatile int32_t s_max_dev = 0;	// in cycles
+static volatile uint32_t s_last_cycles = 0;
+static volatile bool s_have_last = false;
+
+static int32_t s_nominal_cycles = 1; // cycles per sample period at ALARM_FREQ
+static int32_t s_bin_cycles = 1;	 // cycles per histogram bin
+static uint32_t s_cpu_hz = 0;
+
+static int64_t s_start_us = 0;
+static uint32_t s_start_samples = 0;
+
+void fad_jitter_start(void)
+{
+	s_have_last = false;
+
+	s_cpu_hz = fad_hal_cpu_hz();
+	s_nominal_cycles = s_cpu_hz / ALARM_FREQ;
+	s_bin_cycles = (int32_t)((uint64_t)s_cpu_hz * FAD_JITTER_BIN_NS / 1000000000ULL);
+	if (s_bin_cycles < 1)
+		s_bin_cycles = 1;
+
+	memset(s_histogram, 0, sizeof(s_histogram));
+	s_intervals = 0;
+	s_late = 0;
+	s_min_dev = 0;
+	s_max_dev = 0;
+
+	s_start_us = fad_hal_time_us();
+	s_start_samples = adc_timer_get_sample_count();
+}
+
+void IRAM_ATTR fad_jitter_isr_tick(uint32_t cycles)
+{
+	if (!s_have_last)
+	{
+		s_last_cycles = cycles;
+		s_have_last = true;
+		return;
+	}
+
+	int32_t dev = (int32_t)(cycles - s_last_cycles) - s_nominal_cycles;
+	s_last_cycles = cycles;
+
+	/* Bin k holds deviations in [(k - center - 0.5), (k - center + 0.5)) bin widths */
+	int32_t shifted = dev + s_bin_cycles * JITTER_CENTER_BIN + s_bin_cycles / 2;
+	int bin = (shifted < 0) ? 0 : shifted / s_bin_cycles;
+	if (bin >= FAD_JITTER_BINS)
+		bin = FAD_JITTER_BINS - 1;
+	s_histogram[bin]++;
+
+	if (s_intervals == 0 || dev < s_min_dev)
+		s_min_dev = dev;
+	if (s_intervals == 0 || dev > s_max_dev)
+		s_max_dev = dev;
+	if (2 * dev > s_nominal_cycles)
+		s_late++;
+	s_intervals++;
+}
+
+static int32_t cycles_to_ns(int32_t cycles)
+{
+	return (int32_t)((int64_t)cycles * 1000000000LL / (s_cpu_hz ? s_cpu_hz : 1));
+}
+
+void fad_jitter_get_report(fad_jitter_report_t *report)
+{
+	memcpy(report->histogram, s_histogram, sizeof(s_histogram));
+	report->intervals = s_intervals;
+	report->late = s_late;
+	report->min_dev_ns = cycles_to_ns(s_min_dev);
+	report->max_dev_ns = cycles_to_ns(s_max_dev);
+
+	int64_t elapsed_us = fad_hal_time_us() - s_start_us;
+	uint32_t samples = adc_timer_get_sample_count() - s_start_samples;
+	report->measured_hz = (elapsed_us > 0) ? samples * 1000000.0 / elapsed_us : 0;
+	report->configured_hz = adc_timer_get_configured_rate();
+	report->drift_ppm = (report->measured_hz / ALARM_FREQ - 1.0) * 1000000.0;
+}
+
+void fad_jitter_report(void)
+{
+	fad_jitter_report_t report;
+	fad_jitter_get_report(&report);
+
+	ESP_LOGI(JITTER_TAG, "Sample clock: nominal %d Hz, configured %.3f Hz (%+.1f ppm), measured %.3f Hz (%+.1f ppm)",
+			 ALARM_FREQ, report.configured_hz, (report.configured_hz / ALARM_FREQ - 1.0) * 1000000.0,
+			 report.measured_hz, report.drift_ppm);
+	ESP_LOGI(JITTER_TAG, "ISR interval: %u measured, deviation %d..%d ns, %u late",
+			 report.intervals, report.min_dev_ns, report.max_dev_ns, report.late);
+
+	for (int i = 0; i < FAD_JITTER_BINS; i++)
+	{
+		if (report.histogram[i] == 0)
+			continue;
+
+		int32_t center_ns = (i - JITTER_CENTER_BIN) * FAD_JITTER_BIN_NS;
+		const char *edge = (i == 0) ? "<=" : (i == FAD_JITTER_BINS - 1) ? ">=" : "  ";
+		ESP_LOGI(JITTER_TAG, "  %s%+7d ns: %u", edge, center_ns, report.histogram[i]);
+	}
+}
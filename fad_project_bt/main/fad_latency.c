@@ -0,0 +1,397 @@
+/**
+ * fad_latency.c
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Latency measurement mode. One trial follows a single marker through the audio path and stamps it
+ * with the sample clock at every hand-off; FAD_LATENCY_TRIALS trials make up a report.
+ *
+ * INJECT:   ISR replaces one ADC sample with an impulse -> block ready -> algorithm start ->
+ *           marker found in the algorithm output -> DAC write / BT callback read of that value.
+ * LOOPBACK: a chirp replaces the start of an algorithm output block -> DAC write / BT callback read ->
+ *           chirp found by correlation in the mic input. Needs the headset speaker near the mic.
+ */
+
+#include <string.h>
+#include <math.h>
+#include "esp_log.h"
+
+#include "fad_defs.h"
+#include "fad_latency.h"
+#include "fad_timer.h"
+
+#define LATENCY_TAG "LATENCY"
+
+#define LATENCY_TIMEOUT_SAMPLES ((uint32_t)FAD_LATENCY_TIMEOUT_MS * ALARM_FREQ / 1000)
+#define LATENCY_SETTLE_SAMPLES ((uint32_t)FAD_LATENCY_SETTLE_MS * ALARM_FREQ / 1000)
+#define SAMPLES_TO_MS(s) ((float)(s) * 1000.0f / ALARM_FREQ)
+
+/* Where the current trial's marker is in the audio path */
+typedef enum {
+	LATENCY_STATE_IDLE,
+	LATENCY_STATE_ARMED,	// Waiting for the settle time to pass before placing the marker
+	LATENCY_STATE_INJECTED, // INJECT: marker is in the ADC buffer, waiting for the algorithm to read it
+	LATENCY_STATE_IN_ALGO,	// INJECT: algorithm has read the marker, waiting for it in the algorithm output
+	LATENCY_STATE_OUTPUT,	// Marker is in the output buffer, waiting for it to be output
+	LATENCY_STATE_LISTEN,	// LOOPBACK: marker has been output, waiting to hear it at the mic
+	LATENCY_STATE_DONE,		// Trial complete, waiting to be recorded by the app task
+} latency_state_t;
+
+/* Sample clock stamps of one trial */
+typedef struct {
+	uint32_t marked;	 // Marker placed (ADC sample time for INJECT, output buffer write time for LOOPBACK)
+	uint32_t block;		 // ISR signalled the block holding the marker
+	uint32_t algo_start; // App task began the algorithm on that block
+	uint32_t algo_out;	 // Marker was found in (or written to) the output buffer
+	uint32_t output;	 // Marker value was handed to the DAC or BT stream
+	uint32_t heard;		 // LOOPBACK: first sample of the chirp in the mic input
+	uint16_t in_pos;	 // Marker position in the ADC buffer
+	uint16_t out_pos;	 // Marker position in the DAC buffer
+} latency_trial_t;
+
+static const char *s_stage_names[FAD_LATENCY_STAGE_MAX] = {
+	"ADC buffer",
+	"Dispatch",
+	"Algorithm",
+	"Output buffer",
+	"Transport",
+	"Total",
+};
+
+volatile bool fad_latency_armed = false;
+
+static volatile latency_state_t s_state = LATENCY_STATE_IDLE;
+static volatile latency_trial_t s_trial;
+static volatile uint32_t s_next_trial = 0; // Sample clock value at which the next marker may be placed
+static fad_latency_mode_t s_mode = FAD_LATENCY_OFF;
+static fad_latency_report_t s_report;
+static bool s_report_done = false;
+
+/* Loopback chirp, as correlation template (zero mean) and as output values */
+static float s_chirp[FAD_LATENCY_CHIRP_LEN];
+static float s_chirp_energy = 0;
+static uint8_t s_chirp_out[FAD_LATENCY_CHIRP_LEN];
+
+/**
+ * @brief Build the linear chirp used by LOOPBACK mode. The mic sees it at ALARM_FREQ, so with
+ * MULTISAMPLES above 1 the template would have to be stretched to match.
+ */
+static void make_chirp(void)
+{
+	float duration = (float)FAD_LATENCY_CHIRP_LEN / OUTPUT_FREQ;
+	float sweep = (FAD_LATENCY_CHIRP_END_HZ - FAD_LATENCY_CHIRP_START_HZ) / duration;
+	float mean = 0;
+
+	for (int n = 0; n < FAD_LATENCY_CHIRP_LEN; n++)
+	{
+		float t = (float)n / OUTPUT_FREQ;
+		float val = sinf(2.0f * (float)M_PI * (FAD_LATENCY_CHIRP_START_HZ * t + 0.5f * sweep * t * t));
+		s_chirp[n] = val;
+		s_chirp_out[n] = (uint8_t)(128 + (int)(100.0f * val));
+		mean += val;
+	}
+
+	mean /= FAD_LATENCY_CHIRP_LEN;
+	s_chirp_energy = 0;
+	for (int n = 0; n < FAD_LATENCY_CHIRP_LEN; n++)
+	{
+		s_chirp[n] -= mean;
+		s_chirp_energy += s_chirp[n] * s_chirp[n];
+	}
+}
+
+static void stat_add(fad_latency_stage_t stage, uint32_t samples)
+{
+	fad_latency_stat_t *stat = &s_report.stage[stage];
+	if (stat->count == 0 || samples < stat->min)
+		stat->min = samples;
+	if (samples > stat->max)
+		stat->max = samples;
+	stat->sum += samples;
+	stat->count++;
+}
+
+static void log_report(void)
+{
+	ESP_LOGI(LATENCY_TAG, "Latency report (%s): %d trials, %d timeouts",
+			 s_report.mode == FAD_LATENCY_INJECT ? "inject" : "loopback", s_report.trials, s_report.timeouts);
+
+	for (int i = 0; i < FAD_LATENCY_STAGE_MAX; i++)
+	{
+		fad_latency_stat_t *stat = &s_report.stage[i];
+		if (stat->count == 0)
+			continue;
+		ESP_LOGI(LATENCY_TAG, "  %-14s avg %7.2f ms  min %7.2f ms  max %7.2f ms",
+				 s_stage_names[i], SAMPLES_TO_MS((float)stat->sum / stat->count),
+				 SAMPLES_TO_MS(stat->min), SAMPLES_TO_MS(stat->max));
+	}
+}
+
+/**
+ * @brief Close the current trial and either arm the next one or finish the run.
+ * @param now Current sample clock value
+ */
+static void next_trial(uint32_t now)
+{
+	s_report.trials++;
+
+	if (s_report.trials >= FAD_LATENCY_TRIALS)
+	{
+		fad_latency_armed = false;
+		s_state = LATENCY_STATE_IDLE;
+		s_report_done = true;
+		log_report();
+		return;
+	}
+
+	s_next_trial = now + LATENCY_SETTLE_SAMPLES;
+	s_state = LATENCY_STATE_ARMED;
+}
+
+static void record_trial(void)
+{
+	if (s_mode == FAD_LATENCY_INJECT)
+	{
+		stat_add(FAD_LATENCY_STAGE_ADC_BUFFER, s_trial.block - s_trial.marked);
+		stat_add(FAD_LATENCY_STAGE_DISPATCH, s_trial.algo_start - s_trial.block);
+		stat_add(FAD_LATENCY_STAGE_ALGORITHM, s_trial.algo_out - s_trial.algo_start);
+		stat_add(FAD_LATENCY_STAGE_OUTPUT_BUFFER, s_trial.output - s_trial.algo_out);
+		stat_add(FAD_LATENCY_STAGE_TOTAL, s_trial.output - s_trial.marked);
+	}
+	else
+	{
+		stat_add(FAD_LATENCY_STAGE_OUTPUT_BUFFER, s_trial.output - s_trial.algo_out);
+		stat_add(FAD_LATENCY_STAGE_TRANSPORT, s_trial.heard - s_trial.output);
+		stat_add(FAD_LATENCY_STAGE_TOTAL, s_trial.heard - s_trial.marked);
+	}
+}
+
+/**
+ * @brief Check whether the block the algorithm is about to read still holds the injected sample.
+ * The sample at block position k was written ((in_pos - k) mod ADC_BUFFER_SIZE) samples before the block,
+ * or (len - 1 - k) samples before the block for mic input.
+ */
+static bool block_holds_marker(uint16_t in_pos, int len, uint32_t block_count)
+{
+	int offset = (s_trial.in_pos - in_pos + ADC_BUFFER_SIZE) % ADC_BUFFER_SIZE;
+	uint32_t age = (in_pos - s_trial.in_pos + ADC_BUFFER_SIZE) % ADC_BUFFER_SIZE;
+
+	/* The timer hands over the span behind the newest sample, the mic the span ending in it */
+	return offset < len && (block_count - age == s_trial.marked || block_count - (len - 1 - offset) == s_trial.marked);
+}
+
+/**
+ * @brief Find the injected impulse in an algorithm output block: the value furthest from the block
+ * mean, if it is at least FAD_LATENCY_DETECT_LEVEL away.
+ * @return DAC buffer position of the marker, or -1 if not in this block
+ */
+static int find_marker(uint8_t *out_buff, uint16_t out_pos, int len)
+{
+	int sum = 0;
+	for (int i = 0; i < len; i++)
+	{
+		sum += out_buff[(out_pos + i) % DAC_BUFFER_SIZE];
+	}
+	int mean = sum / len;
+
+	int best = -1;
+	int best_dev = FAD_LATENCY_DETECT_LEVEL - 1;
+	for (int i = 0; i < len; i++)
+	{
+		int dev = abs(out_buff[(out_pos + i) % DAC_BUFFER_SIZE] - mean);
+		if (dev > best_dev)
+		{
+			best_dev = dev;
+			best = (out_pos + i) % DAC_BUFFER_SIZE;
+		}
+	}
+
+	return best;
+}
+
+/**
+ * @brief Correlate the newest input samples against the chirp. Each possible chirp start is tested
+ * exactly once, in the first block in which the whole chirp has arrived.
+ * @param heard [OUT] Sample clock value of the chirp's first sample, if found
+ * @return true if the chirp was found
+ */
+static bool find_chirp(uint16_t *in_buff, uint16_t in_pos, int len, uint32_t block_count, uint32_t *heard)
+{
+	int max_age = len + FAD_LATENCY_CHIRP_LEN - 2;
+	int32_t since_output = (int32_t)(block_count - s_trial.output);
+
+	if (max_age > ADC_BUFFER_SIZE - 1)
+		max_age = ADC_BUFFER_SIZE - 1;
+	if (max_age > since_output)
+		max_age = since_output; // nothing older than the output can hold the chirp
+
+	float best = FAD_LATENCY_CORR_THRESHOLD;
+	int best_age = -1;
+
+	for (int age = FAD_LATENCY_CHIRP_LEN - 1; age <= max_age; age++)
+	{
+		float sum = 0, sq = 0, dot = 0;
+		for (int n = 0; n < FAD_LATENCY_CHIRP_LEN; n++)
+		{
+			float x = in_buff[(in_pos - age + n + ADC_BUFFER_SIZE) % ADC_BUFFER_SIZE];
+			sum += x;
+			sq += x * x;
+			dot += x * s_chirp[n]; // template is zero mean, so this is the centered product
+		}
+
+		float var = sq - sum * sum / FAD_LATENCY_CHIRP_LEN;
+		if (var <= 0)
+			continue;
+
+		float corr = dot / sqrtf(var * s_chirp_energy);
+		if (corr > best)
+		{
+			best = corr;
+			best_age = age;
+		}
+	}
+
+	if (best_age < 0)
+		return false;
+
+	*heard = block_count - best_age;
+	return true;
+}
+
+esp_err_t fad_latency_start(fad_latency_mode_t mode)
+{
+	if (mode == FAD_LATENCY_OFF)
+		return ESP_ERR_INVALID_ARG;
+	if (fad_latency_armed)
+		return ESP_ERR_INVALID_STATE;
+
+	make_chirp();
+
+	memset(&s_report, 0, sizeof(s_report));
+	s_report.mode = mode;
+	s_report_done = false;
+	s_mode = mode;
+
+	s_next_trial = adc_timer_get_sample_count() + LATENCY_SETTLE_SAMPLES;
+	s_state = LATENCY_STATE_ARMED;
+	fad_latency_armed = true;
+
+	ESP_LOGI(LATENCY_TAG, "Starting %s latency measurement, %d trials",
+			 mode == FAD_LATENCY_INJECT ? "inject" : "loopback", FAD_LATENCY_TRIALS);
+	return ESP_OK;
+}
+
+void fad_latency_stop(void)
+{
+	fad_latency_armed = false;
+	s_state = LATENCY_STATE_IDLE;
+}
+
+bool fad_latency_get_report(fad_latency_report_t *report)
+{
+	memcpy(report, &s_report, sizeof(fad_latency_report_t));
+	return s_report_done;
+}
+
+void IRAM_ATTR fad_latency_isr_input(uint16_t adc_pos, uint32_t sample_count)
+{
+	if (s_state != LATENCY_STATE_ARMED || s_mode != FAD_LATENCY_INJECT)
+		return;
+	if ((int32_t)(sample_count - s_next_trial) < 0)
+		return;
+
+	adc_buffer[adc_pos] = FAD_LATENCY_IMPULSE;
+	s_trial.in_pos = adc_pos;
+	s_trial.marked = sample_count;
+	s_state = LATENCY_STATE_INJECTED;
+}
+
+void IRAM_ATTR fad_latency_isr_output(uint16_t dac_pos, uint32_t sample_count)
+{
+	if (s_state != LATENCY_STATE_OUTPUT || dac_pos != s_trial.out_pos)
+		return;
+
+	s_trial.output = sample_count;
+	s_state = (s_mode == FAD_LATENCY_LOOPBACK) ? LATENCY_STATE_LISTEN : LATENCY_STATE_DONE;
+}
+
+void fad_latency_algo_begin(uint16_t *in_buff, uint16_t in_pos, int len, uint32_t block_count)
+{
+	if (!fad_latency_armed)
+		return;
+
+	uint32_t now = adc_timer_get_sample_count();
+	uint32_t heard = 0;
+
+	switch (s_state)
+	{
+	case LATENCY_STATE_DONE:
+		record_trial();
+		next_trial(now);
+		return;
+
+	case LATENCY_STATE_INJECTED:
+		if (block_holds_marker(in_pos, len, block_count))
+		{
+			s_trial.block = block_count;
+			s_trial.algo_start = now;
+			s_state = LATENCY_STATE_IN_ALGO;
+		}
+		break;
+
+	case LATENCY_STATE_LISTEN:
+		if (find_chirp(in_buff, in_pos, len, block_count, &heard))
+		{
+			s_trial.heard = heard;
+			record_trial();
+			next_trial(now);
+			return;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	if (s_state != LATENCY_STATE_ARMED && now - s_trial.marked > LATENCY_TIMEOUT_SAMPLES)
+	{
+		ESP_LOGW(LATENCY_TAG, "Marker lost in state %d", s_state);
+		s_report.timeouts++;
+		next_trial(now);
+	}
+}
+
+void fad_latency_algo_end(uint8_t *out_buff, uint16_t out_pos, int len)
+{
+	if (!fad_latency_armed)
+		return;
+
+	uint32_t now = adc_timer_get_sample_count();
+
+	if (s_state == LATENCY_STATE_ARMED && s_mode == FAD_LATENCY_LOOPBACK && (int32_t)(now - s_next_trial) >= 0)
+	{
+		/* The ISR has already played out_pos; the chirp starts at the first sample it has not */
+		uint16_t chirp_pos = (out_pos + 1) % DAC_BUFFER_SIZE;
+		int chirp_len = (len < FAD_LATENCY_CHIRP_LEN) ? len : FAD_LATENCY_CHIRP_LEN;
+		for (int i = 0; i < chirp_len; i++)
+		{
+			out_buff[(chirp_pos + i) % DAC_BUFFER_SIZE] = s_chirp_out[i];
+		}
+		s_trial.out_pos = chirp_pos;
+		s_trial.marked = now;
+		s_trial.algo_out = now;
+		s_state = LATENCY_STATE_OUTPUT;
+	}
+	else if (s_state == LATENCY_STATE_IN_ALGO)
+	{
+		int marker_pos = find_marker(out_buff, out_pos, len);
+		if (marker_pos >= 0)
+		{
+			s_trial.out_pos = marker_pos;
+			s_trial.algo_out = now;
+			s_state = LATENCY_STATE_OUTPUT;
+		}
+	}
+}
@@ -0,0 +1,256 @@
+/**
+ * fad_load.c
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * CPU load meter. A software timer takes a snapshot of the task run-time counters each period and
+ * stores the difference to the last one as a window in a ring.
+ */
+
+#include <string.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+
+#include "fad_load.h"
+#include "fad_hal.h"
+
+#define LOAD_TAG "LOAD"
+
+/* Groups of tasks, by name prefix. Names are cut to CONFIG_FREERTOS_MAX_TASK_NAME_LEN - 1 characters */
+static const struct {
+	const char *prefix;
+	fad_load_group_t group;
+} s_task_groups[] = {
+	{"FAD_Task_Handler", FAD_LOAD_APP},
+	{"Interrupt_Alarm", FAD_LOAD_AUDIO},
+	{"Mic_Input_Task", FAD_LOAD_AUDIO},
+	{"I2S_Output_Task", FAD_LOAD_AUDIO},
+	{"Capture_Replay", FAD_LOAD_AUDIO},
+	{"BT_Output_Task", FAD_LOAD_AUDIO},
+	{"BT", FAD_LOAD_BT},		// BTC_TASK, BTU_TASK
+	{"Bt", FAD_LOAD_BT},		// Profile tasks
+	{"bt", FAD_LOAD_BT},		// btController
+	{"hci", FAD_LOAD_BT},
+	{"Tmr Svc", FAD_LOAD_TIMER},
+};
+
+static const char *s_group_names[FAD_LOAD_GROUP_MAX] = {
+	"isr",
+	"algo",
+	"app",
+	"audio",
+	"bt",
+	"timer",
+	"other",
+};
+
+typedef struct {
+	TaskHandle_t handle;
+	uint32_t run_time;
+} task_time_t;
+
+static TaskStatus_t s_status[FAD_LOAD_MAX_TASKS];
+static task_time_t s_last[FAD_LOAD_MAX_TASKS];
+static int s_last_count = 0;
+static uint32_t s_last_total = 0;
+static volatile uint32_t s_isr_cycles = 0;	// sample ISR cycles since boot, wrapping; only the ISR writes it
+static uint32_t s_last_isr_cycles = 0;
+static bool s_have_baseline = false;
+static uint32_t s_added_us[FAD_LOAD_GROUP_MAX];	// time charged with fad_load_add this window
+
+static fad_load_sample_t s_history[FAD_LOAD_HISTORY];
+static uint32_t s_samples = 0;		// windows completed since boot
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static TimerHandle_t s_timer = NULL;
+
+static fad_load_group_t task_group(const char *name)
+{
+	for (size_t i = 0; i < sizeof(s_task_groups) / sizeof(s_task_groups[0]); i++)
+		if (strncmp(name, s_task_groups[i].prefix, strlen(s_task_groups[i].prefix)) == 0)
+			return s_task_groups[i].group;
+	return FAD_LOAD_OTHER;
+}
+
+static uint32_t last_run_time(TaskHandle_t handle)
+{
+	for (int i = 0; i < s_last_count; i++)
+		if (s_last[i].handle == handle)
+			return s_last[i].run_time;
+	return 0; // created during the window
+}
+
+static uint16_t permille(uint64_t part_us, uint32_t window_us)
+{
+	uint64_t p = part_us * 1000 / window_us;
+	return p > UINT16_MAX ? UINT16_MAX : (uint16_t)p;
+}
+
+static uint32_t cycles_to_us(uint64_t cycles)
+{
+	uint32_t cycles_per_us = fad_hal_cpu_hz() / 1000000;
+	return (uint32_t)(cycles / (cycles_per_us ? cycles_per_us : 1));
+}
+
+void fad_load_add(fad_load_group_t group, uint32_t cycles)
+{
+	if (FAD_LOAD_ENABLE && group < FAD_LOAD_GROUP_MAX)
+		__atomic_fetch_add(&s_added_us[group], cycles_to_us(cycles), __ATOMIC_RELAXED);
+}
+
+void IRAM_ATTR fad_load_isr_cycles(uint32_t cycles)
+{
+	s_isr_cycles += cycles;
+}
+
+void fad_load_sample(void)
+{
+	if (!FAD_LOAD_ENABLE)
+		return;
+
+	uint32_t total;
+	int count = uxTaskGetSystemState(s_status, FAD_LOAD_MAX_TASKS, &total);
+
+	uint32_t isr_cycles = s_isr_cycles;
+
+	uint32_t added[FAD_LOAD_GROUP_MAX];
+	for (int g = 0; g < FAD_LOAD_GROUP_MAX; g++)
+		added[g] = __atomic_exchange_n(&s_added_us[g], 0, __ATOMIC_RELAXED);
+
+	uint32_t window = total - s_last_total;
+	if (s_have_baseline && window > 0)
+	{
+		fad_load_sample_t sample;
+		uint64_t busy[FAD_LOAD_GROUP_MAX] = {0};
+		uint64_t idle[portNUM_PROCESSORS] = {0};
+
+		for (int i = 0; i < count; i++)
+		{
+			uint32_t ran = s_status[i].ulRunTimeCounter - last_run_time(s_status[i].xHandle);
+			bool is_idle = false;
+			for (int core = 0; core < portNUM_PROCESSORS; core++)
+			{
+				if (s_status[i].xHandle == xTaskGetIdleTaskHandleForCPU(core))
+				{
+					idle[core] += ran;
+					is_idle = true;
+				}
+			}
+			if (!is_idle)
+				busy[task_group(s_status[i].pcTaskName)] += ran;
+		}
+		busy[FAD_LOAD_ISR] = cycles_to_us(isr_cycles - s_last_isr_cycles); // a window is far shorter than the wrap
+		for (int g = 0; g < FAD_LOAD_GROUP_MAX; g++)
+			busy[g] += added[g];
+
+		sample.time_ms = (uint32_t)(fad_hal_time_us() / 1000);
+		sample.window_us = window;
+		for (int core = 0; core < portNUM_PROCESSORS; core++)
+			sample.idle[core] = permille(idle[core], window);
+		for (int g = 0; g < FAD_LOAD_GROUP_MAX; g++)
+			sample.group[g] = permille(busy[g], window);
+
+		portENTER_CRITICAL(&s_mux);
+		s_history[s_samples % FAD_LOAD_HISTORY] = sample;
+		s_samples++;
+		portEXIT_CRITICAL(&s_mux);
+	}
+
+	s_last_count = (count < FAD_LOAD_MAX_TASKS) ? count : FAD_LOAD_MAX_TASKS;
+	for (int i = 0; i < s_last_count; i++)
+	{
+		s_last[i].handle = s_status[i].xHandle;
+		s_last[i].run_time = s_status[i].ulRunTimeCounter;
+	}
+	s_last_total = total;
+	s_last_isr_cycles = isr_cycles;
+	s_have_baseline = true;
+}
+
+static void load_timer_cb(TimerHandle_t timer)
+{
+	fad_load_sample();
+}
+
+esp_err_t fad_load_init(void)
+{
+	if (!FAD_LOAD_ENABLE || s_timer != NULL)
+		return ESP_OK;
+
+	if (uxTaskGetNumberOfTasks() > FAD_LOAD_MAX_TASKS)
+		ESP_LOGW(LOAD_TAG, "%u tasks, only the first %d are measured", (unsigned)uxTaskGetNumberOfTasks(), FAD_LOAD_MAX_TASKS);
+
+	s_timer = xTimerCreate("Load Meter", pdMS_TO_TICKS(FAD_LOAD_PERIOD_MS), pdTRUE, NULL, load_timer_cb);
+	if (s_timer == NULL || xTimerStart(s_timer, portMAX_DELAY) != pdPASS)
+	{
+		ESP_LOGW(LOAD_TAG, "Could not start the sampling timer");
+		return ESP_FAIL;
+	}
+	fad_load_sample(); // baseline
+	return ESP_OK;
+}
+
+bool fad_load_get(fad_load_sample_t *sample)
+{
+	bool have = false;
+	portENTER_CRITICAL(&s_mux);
+	if (s_samples > 0)
+	{
+		*sample = s_history[(s_samples - 1) % FAD_LOAD_HISTORY];
+		have = true;
+	}
+	portEXIT_CRITICAL(&s_mux);
+	return have;
+}
+
+int fad_load_history(fad_load_sample_t *samples, int max)
+{
+	portENTER_CRITICAL(&s_mux);
+	uint32_t kept = (s_samples < FAD_LOAD_HISTORY) ? s_samples : FAD_LOAD_HISTORY;
+	int n = ((uint32_t)max < kept) ? max : (int)kept;
+	for (int i = 0; i < n; i++)
+		samples[i] = s_history[(s_samples - n + i) % FAD_LOAD_HISTORY];
+	portEXIT_CRITICAL(&s_mux);
+	return n;
+}
+
+void fad_load_report(void)
+{
+	static fad_load_sample_t history[FAD_LOAD_HISTORY]; // report runs on one task at a time
+	int n = fad_load_history(history, FAD_LOAD_HISTORY);
+	if (n == 0)
+	{
+		ESP_LOGI(LOAD_TAG, "No load window completed yet");
+		return;
+	}
+	const fad_load_sample_t *last = &history[n - 1];
+
+	ESP_LOGI(LOAD_TAG, "CPU load over %.1f ms, average and extreme of the last %d windows:", last->window_us / 1000.0, n);
+	for (int core = 0; core < portNUM_PROCESSORS; core++)
+	{
+		uint32_t sum = 0, low = UINT16_MAX;
+		for (int i = 0; i < n; i++)
+		{
+			sum += history[i].idle[core];
+			if (history[i].idle[core] < low)
+				low = history[i].idle[core];
+		}
+		ESP_LOGI(LOAD_TAG, "  idle core %d %5.1f%%  avg %5.1f%%  min %5.1f%%", core,
+				 last->idle[core] / 10.0, sum / (10.0 * n), low / 10.0);
+	}
+	for (int g = 0; g < FAD_LOAD_GROUP_MAX; g++)
+	{
+		uint32_t sum = 0, high = 0;
+		for (int i = 0; i < n; i++)
+		{
+			sum += history[i].group[g];
+			if (history[i].group[g] > high)
+				high = history[i].group[g];
+		}
+		ESP_LOGI(LOAD_TAG, "  %-11s %5.1f%%  avg %5.1f%%  max %5.1f%%", s_group_names[g],
+				 last->group[g] / 10.0, sum / (10.0 * n), high / 10.0);
+	}
+}
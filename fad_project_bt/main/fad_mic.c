@@ -0,0 +1,222 @@
+/**
+ * fad_mic.c
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Digital mic input task. The task blocks in the DMA read, which paces it to the mic clock, and
+ * converts each block in place: the 16-bit samples land in adc_buffer and are rewritten as 12-bit
+ * offset values. adc_buffer_pos is only moved once a whole block is there.
+ *
+ * Samples are stamped with a mic sample clock: the timer's sample count at fad_mic_start plus the
+ * samples received since. Both clocks run at ALARM_FREQ, and the mic clock counts when a sample was
+ * taken rather than when the task got it, so the DMA wait shows up in the latency's dispatch stage and
+ * consecutive blocks are exactly a block apart in a capture.
+ */
+
+#include <string.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "main.h"
+#include "fad_defs.h"
+#include "fad_adc.h"
+#include "fad_dac.h"
+#include "fad_mic.h"
+#include "fad_app_core.h"
+#include "fad_timer.h"
+#include "fad_latency.h"
+#include "fad_perf.h"
+#include "fad_hal.h"
+#include "fad_trace.h"
+#include "fad_mem.h"
+
+#define MIC_TAG "MIC"
+#define MIC_TASK_STACK 2048
+#define MIC_TASK_PRIORITY (configMAX_PRIORITIES - 3) // same as the timer's alarm task it stands in for
+#define MIC_READ_TIMEOUT_MS 100
+
+static xTaskHandle s_mic_task_handle = NULL;
+static SemaphoreHandle_t s_start_semaphore = NULL;
+static volatile bool s_running = false;
+static bool s_driver_installed = false;
+static int s_read_size = 0;
+static int s_pos = 0;	   // block start in adc_buffer
+static int s_fill = 0;	   // samples of the block received so far
+static uint32_t s_base = 0; // mic sample clock at the block start
+static fad_mic_stats_t s_stats;
+static int16_t s_frames[2 * FAD_MIC_DMA_BUF_LEN]; // stereo frames before they are split, FAD_ADC_CHANNELS 2 only
+
+/**
+ * @brief Rewrite signed 16-bit samples as ADC-style 12-bit offset values, in place
+ */
+static void to_adc_range(uint16_t *buff, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		int32_t v = ((int32_t)(int16_t)buff[i] << FAD_MIC_GAIN_SHIFT) >> 4;
+		if (v > 2047)
+		{
+			v = 2047;
+			s_stats.clipped++;
+		}
+		else if (v < -2048)
+		{
+			v = -2048;
+			s_stats.clipped++;
+		}
+		buff[i] = (uint16_t)(v + 2048);
+	}
+}
+
+/**
+ * @brief Read up to a DMA buffer of stereo frames and split them into adc_buffer (first slot of each
+ * frame) and adc_buffer_ref (second slot). If the mics come out the wrong way round, swap their L/R selects.
+ * @return Number of frames read
+ */
+static int read_stereo(int pos, int count)
+{
+	if (count > FAD_MIC_DMA_BUF_LEN)
+		count = FAD_MIC_DMA_BUF_LEN;
+
+	int n = fad_hal_mic_read(s_frames, count, MIC_READ_TIMEOUT_MS);
+
+	uint32_t start = FAD_PERF_ENABLE ? fad_perf_cycles() : 0;
+	for (int i = 0; i < n; i++)
+	{
+		adc_buffer[pos + i] = s_frames[2 * i];
+		adc_buffer_ref[pos + i] = s_frames[2 * i + 1];
+	}
+	if (FAD_PERF_ENABLE && n > 0) fad_perf_record(FAD_PERF_MIC_SPLIT, fad_perf_cycles() - start);
+	return n;
+}
+
+/**
+ * @brief The algorithms write a block of output without wrapping, so it has to start on a block
+ * boundary of dac_buffer. Take the first one the ISR has not reached yet.
+ */
+static int next_output_block(void)
+{
+	int out_len = s_read_size / MULTISAMPLES;
+	int pos = dac_buffer_pos;
+	return ((pos + out_len - 1) / out_len * out_len) % DAC_BUFFER_SIZE;
+}
+
+/**
+ * @brief FreeRTOS task that collects mic blocks and hands them to the algorithm
+ * @param params [in] required as part of the task function definition
+ */
+static void mic_task(void *params)
+{
+	for (;;)
+	{
+		if (!s_running)
+		{
+			xSemaphoreTake(s_start_semaphore, portMAX_DELAY);
+			continue;
+		}
+
+		int at = s_pos + s_fill;
+		int n;
+		if (FAD_ADC_CHANNELS > 1)
+			n = read_stereo(at, s_read_size - s_fill);
+		else
+			n = fad_hal_mic_read((int16_t *)&adc_buffer[at], s_read_size - s_fill, MIC_READ_TIMEOUT_MS);
+		if (n == 0)
+		{
+			s_stats.timeouts++;
+			vTaskDelay(1);
+			continue;
+		}
+		if (!s_running)
+			continue;
+
+		to_adc_range(&adc_buffer[at], n);
+		if (FAD_ADC_CHANNELS > 1)
+			to_adc_range(&adc_buffer_ref[at], n);
+		if (fad_latency_armed)
+		{
+			for (int i = 0; i < n; i++)
+				fad_latency_isr_input(at + i, s_base + s_fill + i + 1);
+		}
+		s_fill += n;
+		s_stats.samples += n;
+		if (s_fill < s_read_size)
+			continue;
+
+		fad_main_cb_param_t params = {
+			.adc_buff_pos_info.adc_pos = s_pos,
+			.adc_buff_pos_info.dac_pos = next_output_block(),
+			.adc_buff_pos_info.sample_count = s_base + s_read_size, // like the timer: the newest sample's count
+		};
+		adc_buffer_pos = s_pos;
+		fad_trace_begin(FAD_TRACK_MIC, FAD_TRACE_DISPATCH, s_pos);
+		fad_app_work_dispatch_class(FAD_APP_CLASS_RT, fad_main_stack_evt_handler, FAD_ADC_BUFFER_READY, (void *)&params, sizeof(fad_main_cb_param_t), NULL);
+		fad_trace_end(FAD_TRACK_MIC, FAD_TRACE_DISPATCH);
+
+		s_stats.blocks++;
+		s_base += s_read_size;
+		s_pos = (s_pos + s_read_size) % ADC_BUFFER_SIZE;
+		s_fill = 0;
+	}
+
+	fad_mem_untrack_task(s_mic_task_handle);
+	vTaskDelete(s_mic_task_handle);
+}
+
+esp_err_t fad_mic_init(void)
+{
+	if (!s_driver_installed)
+	{
+		esp_err_t err = fad_hal_mic_setup(ALARM_FREQ);
+		if (err)
+			return err;
+		s_driver_installed = true;
+	}
+
+	if (s_mic_task_handle == NULL)
+	{
+		s_start_semaphore = xSemaphoreCreateBinary();
+		xTaskCreate(mic_task, "Mic_Input_Task", MIC_TASK_STACK, 0, MIC_TASK_PRIORITY, &s_mic_task_handle);
+		fad_mem_track_task(s_mic_task_handle, "Mic_Input_Task", MIC_TASK_STACK);
+	}
+
+	ESP_LOGI(MIC_TAG, "%s mic on I2S%d at %d Hz", FAD_MIC_PDM ? "PDM" : "I2S", FAD_MIC_PORT, ALARM_FREQ);
+	return ESP_OK;
+}
+
+esp_err_t fad_mic_start(int read_size)
+{
+	if (read_size <= 0 || ADC_BUFFER_SIZE % read_size != 0)
+		return ESP_ERR_INVALID_ARG;
+
+	memset(&s_stats, 0, sizeof(s_stats));
+	s_read_size = read_size;
+	s_pos = 0;
+	s_fill = 0;
+	s_base = adc_timer_get_sample_count();
+	s_running = true;
+	xSemaphoreGive(s_start_semaphore);
+	return ESP_OK;
+}
+
+void fad_mic_stop(void)
+{
+	s_running = false;
+}
+
+void fad_mic_get_stats(fad_mic_stats_t *stats)
+{
+	memcpy(stats, &s_stats, sizeof(fad_mic_stats_t));
+}
+
+void fad_mic_report(void)
+{
+	fad_mic_stats_t stats;
+	fad_mic_get_stats(&stats);
+	ESP_LOGI(MIC_TAG, "Mic input: %u samples, %u blocks, %u empty reads, %u clipped",
+			 stats.samples, stats.blocks, stats.timeouts, stats.clipped);
+}
@@ -0,0 +1,90 @@
+/**
+ * fad_perf.c
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Cycle-count instrumentation for the sample path. Counters are only written from one context each
+ * (ISR or the benchmark), so no locking is done; the report may read a half-updated entry.
+ */
+
+#include <string.h>
+#include "esp_log.h"
+
+#include "fad_defs.h"
+#include "fad_adc.h"
+#include "fad_perf.h"
+#include "fad_hal.h"
+
+#define PERF_TAG "PERF"
+
+static const char *s_counter_names[FAD_PERF_MAX] = {
+	"Sample ISR",
+	"ADC driver",
+	"ADC fast",
+	"DAC driver",
+	"DAC fast",
+	"PWM shaped",
+	"ADC ref ch",
+	"Mic split",
+};
+
+static fad_perf_stat_t s_stats[FAD_PERF_MAX];
+
+uint32_t IRAM_ATTR fad_perf_cycles(void)
+{
+	return fad_hal_cycles();
+}
+
+void IRAM_ATTR fad_perf_record(fad_perf_counter_t counter, uint32_t cycles)
+{
+	fad_perf_stat_t *stat = &s_stats[counter];
+	if (stat->count == 0 || cycles < stat->min)
+		stat->min = cycles;
+	if (cycles > stat->max)
+		stat->max = cycles;
+	stat->sum += cycles;
+	stat->count++;
+}
+
+void fad_perf_get(fad_perf_counter_t counter, fad_perf_stat_t *stat)
+{
+	memcpy(stat, &s_stats[counter], sizeof(fad_perf_stat_t));
+}
+
+void fad_perf_reset(void)
+{
+	memset(s_stats, 0, sizeof(s_stats));
+}
+
+void fad_perf_report(void)
+{
+	uint32_t cpu_hz = fad_hal_cpu_hz();
+	float cycles_per_us = cpu_hz / 1000000.0f;
+	uint32_t budget = cpu_hz / ALARM_FREQ; // cycles between two sample interrupts
+
+	ESP_LOGI(PERF_TAG, "Cycle report, CPU %u MHz, %u cycles per sample", cpu_hz / 1000000, budget);
+
+	for (int i = 0; i < FAD_PERF_MAX; i++)
+	{
+		fad_perf_stat_t stat;
+		fad_perf_get(i, &stat);
+		if (stat.count == 0)
+			continue;
+
+		uint32_t avg = stat.sum / stat.count;
+		ESP_LOGI(PERF_TAG, "  %-12s avg %5u (%6.2f us)  min %5u  max %5u  n=%u",
+				 s_counter_names[i], avg, avg / cycles_per_us, stat.min, stat.max, stat.count);
+	}
+
+	fad_perf_stat_t isr;
+	fad_perf_get(FAD_PERF_ISR, &isr);
+	if (isr.count > 0 && isr.max > 0)
+	{
+		ESP_LOGI(PERF_TAG, "  ISR load %.1f%% avg, %.1f%% worst; ISR alone allows %u Hz sampling",
+				 100.0f * (isr.sum / isr.count) / budget, 100.0f * isr.max / budget, cpu_hz / isr.max);
+	}
+
+	ESP_LOGI(PERF_TAG, "  ADC poll timeouts: %u", adc_get_poll_timeouts());
+}
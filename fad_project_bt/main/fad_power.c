@@ -0,0 +1,339 @@
+/**
+ * fad_power.c
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Power management: the PM locks around the sample clock and the algorithm, the clock governor, and the
+ * battery projections. The governor runs on a software timer and reads the windows of fad_load.c.
+ */
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+
+#include "fad_power.h"
+#include "fad_load.h"
+#include "fad_hal.h"
+
+#define POWER_TAG "POWER"
+#define POWER_ALGO_TYPES (FAD_ALGO_WHITE + 1)
+#define POWER_AUDIO_MHZ 80		// CPU clock between blocks: the lowest one the APB lock allows
+/* The perf and jitter timers count CPU cycles and convert them at one clock, so while either is on the CPU
+   stays at the top clock for as long as audio runs and the governor does not step */
+#define POWER_FIXED_CLOCK (FAD_PERF_ENABLE || FAD_JITTER_ENABLE)
+
+/* ESP32 datasheet, modem-sleep (CPU on, radio off). The low end of each range is an idle CPU,
+   the high end both cores busy */
+static const struct {
+	uint16_t mhz;
+	uint16_t idle_ma;
+	uint16_t busy_ma;
+} s_clocks[] = {
+	{80, 20, 31},
+	{160, 27, 44},
+	{240, 30, 68},
+};
+#define POWER_CLOCKS (sizeof(s_clocks) / sizeof(s_clocks[0]))
+
+/* Names of fad_algo_type_t */
+static const char *s_algo_names[POWER_ALGO_TYPES] = {
+	"delay",
+	"freq_shift",
+	"masking",
+	"template",
+	"white",
+};
+
+typedef struct {
+	double charge_mams;		// Estimated current times time, mA * ms
+	uint32_t measured_ms;
+	uint16_t algo_mhz;
+} power_account_t;
+
+static bool s_enabled = false;		// fad_power_init ran
+static bool s_pm = false;			// Dynamic frequency scaling is in the build
+static bool s_light_sleep = false;
+static esp_pm_lock_handle_t s_audio_apb_lock;
+static esp_pm_lock_handle_t s_audio_awake_lock;
+static esp_pm_lock_handle_t s_algo_lock;
+static esp_pm_lock_handle_t s_measure_lock;	// POWER_FIXED_CLOCK only
+static TimerHandle_t s_timer = NULL;
+
+/* Shared between the app task and the governor on the timer task */
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool s_audio_on = false;
+static bool s_radio = false;
+static int s_algo = -1;					// fad_algo_type_t being charged, -1 before the first
+static uint32_t s_epoch = 0;			// Counts algorithm and audio changes; a governor pass that straddles one is dropped
+static uint32_t s_last_ms = 0;			// End of the newest load window already used
+static uint16_t s_algo_mhz = 240;		// Clock the algorithm runs at
+static power_account_t s_accounts[POWER_ALGO_TYPES];
+
+static fad_load_sample_t s_windows[FAD_LOAD_HISTORY]; // governor only
+
+static int clock_index(uint32_t mhz)
+{
+	for (int i = 0; i < POWER_CLOCKS; i++)
+		if (s_clocks[i].mhz >= mhz)
+			return i;
+	return POWER_CLOCKS - 1;
+}
+
+static esp_err_t configure(uint16_t max_mhz)
+{
+	esp_pm_config_esp32_t config = {
+		.max_freq_mhz = max_mhz,
+		.min_freq_mhz = FAD_POWER_MIN_MHZ,
+		.light_sleep_enable = s_light_sleep,
+	};
+	return esp_pm_configure(&config);
+}
+
+/* Board current during one window, in mA. The algorithm's share of a core ran at algo_mhz, the rest
+   of the busy time and the idle time at the between-blocks clock */
+static float window_current(const fad_load_sample_t *w, uint16_t algo_mhz, bool radio)
+{
+	int hi = clock_index(algo_mhz);
+	int lo = (s_pm && !POWER_FIXED_CLOCK) ? clock_index(POWER_AUDIO_MHZ) : hi;
+	float busy = 0;
+	for (int core = 0; core < portNUM_PROCESSORS; core++)
+		busy += (1000 - (w->idle[core] > 1000 ? 1000 : w->idle[core])) / 1000.0f;
+	busy /= portNUM_PROCESSORS;
+	float algo = w->group[FAD_LOAD_ALGO] / (1000.0f * portNUM_PROCESSORS);
+	if (algo > busy)
+		algo = busy;
+
+	float ma = FAD_POWER_BOARD_MA + (radio ? FAD_POWER_RADIO_MA : 0);
+	ma += algo * s_clocks[hi].busy_ma;
+	ma += (busy - algo) * s_clocks[lo].busy_ma;
+	ma += (1 - busy) * s_clocks[lo].idle_ma;
+	return ma;
+}
+
+/* Lowest clock that keeps the busiest core under the limit in every window. Lowering the clock
+   needs FAD_POWER_HYSTERESIS more room than keeping it */
+static uint16_t pick_clock(const fad_load_sample_t *w, int n, uint16_t current_mhz)
+{
+	for (int c = 0; c < POWER_CLOCKS; c++)
+	{
+		uint32_t limit = FAD_POWER_LOAD_LIMIT - (s_clocks[c].mhz < current_mhz ? FAD_POWER_HYSTERESIS : 0);
+		bool fits = true;
+		for (int i = 0; i < n && fits; i++)
+		{
+			uint32_t algo = w[i].group[FAD_LOAD_ALGO];
+			for (int core = 0; core < portNUM_PROCESSORS; core++)
+			{
+				uint32_t busy = 1000 - (w[i].idle[core] > 1000 ? 1000 : w[i].idle[core]);
+				uint32_t other = busy > algo ? busy - algo : 0;
+				if (other + algo * current_mhz / s_clocks[c].mhz > limit)
+					fits = false;
+			}
+		}
+		if (fits)
+			return s_clocks[c].mhz;
+	}
+	return s_clocks[POWER_CLOCKS - 1].mhz;
+}
+
+static void governor_cb(TimerHandle_t timer)
+{
+	portENTER_CRITICAL(&s_mux);
+	uint32_t epoch = s_epoch;
+	uint32_t last_ms = s_last_ms;
+	uint16_t algo_mhz = s_algo_mhz;
+	bool radio = s_radio;
+	int algo_type = s_algo;
+	bool audio_on = s_audio_on;
+	portEXIT_CRITICAL(&s_mux);
+
+	int total = fad_load_history(s_windows, FAD_LOAD_HISTORY);
+	int first = total;
+	while (first > 0 && s_windows[first - 1].time_ms > last_ms)
+		first--;
+	int n = total - first;
+	if (n == 0 || !audio_on || algo_type < 0)
+		return;
+	const fad_load_sample_t *w = &s_windows[first];
+
+	double charge = 0;
+	uint32_t measured = 0;
+	for (int i = first; i < total; i++)
+	{
+		/* Window length in the time of fad_hal_time_us, which on the host is simulated like the audio */
+		uint32_t ms = (i > 0) ? s_windows[i].time_ms - s_windows[i - 1].time_ms : s_windows[i].window_us / 1000;
+		charge += (double)window_current(&s_windows[i], algo_mhz, radio) * ms;
+		measured += ms;
+	}
+	uint16_t next_mhz = (s_pm && !POWER_FIXED_CLOCK) ? pick_clock(w, n, algo_mhz) : algo_mhz;
+
+	bool changed = false;
+	portENTER_CRITICAL(&s_mux);
+	if (epoch == s_epoch)
+	{
+		power_account_t *account = &s_accounts[algo_type];
+		account->charge_mams += charge;
+		account->measured_ms += measured;
+		account->algo_mhz = algo_mhz;
+		s_last_ms = w[n - 1].time_ms;
+		if (next_mhz != s_algo_mhz)
+		{
+			s_algo_mhz = next_mhz;
+			s_epoch++; // windows so far ran at the old clock
+			changed = true;
+		}
+	}
+	portEXIT_CRITICAL(&s_mux);
+
+	if (changed)
+	{
+		ESP_LOGI(POWER_TAG, "Algorithm clock %u -> %u MHz", algo_mhz, next_mhz);
+		configure(next_mhz);
+	}
+}
+
+esp_err_t fad_power_init(void)
+{
+	if (!FAD_POWER_ENABLE || s_enabled)
+		return ESP_OK;
+
+	s_light_sleep = FAD_POWER_LIGHT_SLEEP;
+	esp_err_t err = configure(s_algo_mhz);
+	if (err == ESP_ERR_NOT_SUPPORTED && s_light_sleep)
+	{
+		ESP_LOGW(POWER_TAG, "No light sleep without CONFIG_FREERTOS_USE_TICKLESS_IDLE");
+		s_light_sleep = false;
+		err = configure(s_algo_mhz);
+	}
+	s_pm = (err == ESP_OK);
+	if (!s_pm)
+	{
+		ESP_LOGW(POWER_TAG, "No frequency scaling without CONFIG_PM_ENABLE; projecting at a fixed clock");
+		s_algo_mhz = s_clocks[clock_index(fad_hal_cpu_hz() / 1000000)].mhz;
+	}
+	else if (esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "fad_audio", &s_audio_apb_lock) != ESP_OK
+			 || esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "fad_audio", &s_audio_awake_lock) != ESP_OK
+			 || esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "fad_algo", &s_algo_lock) != ESP_OK
+			 || esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "fad_measure", &s_measure_lock) != ESP_OK)
+	{
+		ESP_LOGE(POWER_TAG, "Could not create the PM locks");
+		return ESP_FAIL;
+	}
+
+	s_timer = xTimerCreate("Power Governor", pdMS_TO_TICKS(FAD_POWER_PERIOD_MS), pdTRUE, NULL, governor_cb);
+	if (s_timer == NULL || xTimerStart(s_timer, portMAX_DELAY) != pdPASS)
+	{
+		ESP_LOGE(POWER_TAG, "Could not start the governor timer");
+		return ESP_FAIL;
+	}
+	s_enabled = true;
+	ESP_LOGI(POWER_TAG, "CPU %d-%u MHz, light sleep %s", FAD_POWER_MIN_MHZ, s_algo_mhz, s_light_sleep ? "on" : "off");
+	if (s_pm && POWER_FIXED_CLOCK)
+		ESP_LOGW(POWER_TAG, "Perf or jitter timing is on: the CPU stays at %u MHz while audio runs", s_algo_mhz);
+	return ESP_OK;
+}
+
+void fad_power_audio_start(bool radio)
+{
+	if (!s_enabled || s_audio_on)
+		return;
+	if (s_pm)
+	{
+		esp_pm_lock_acquire(s_audio_apb_lock);
+		esp_pm_lock_acquire(s_audio_awake_lock);
+		if (POWER_FIXED_CLOCK)
+			esp_pm_lock_acquire(s_measure_lock);
+	}
+	portENTER_CRITICAL(&s_mux);
+	s_audio_on = true;
+	s_radio = radio;
+	s_last_ms = (uint32_t)(fad_hal_time_us() / 1000); // only windows with audio from here on
+	s_epoch++;
+	portEXIT_CRITICAL(&s_mux);
+}
+
+void fad_power_audio_stop(void)
+{
+	if (!s_enabled || !s_audio_on)
+		return;
+	portENTER_CRITICAL(&s_mux);
+	s_audio_on = false;
+	s_epoch++;
+	portEXIT_CRITICAL(&s_mux);
+	if (s_pm)
+	{
+		if (POWER_FIXED_CLOCK)
+			esp_pm_lock_release(s_measure_lock);
+		esp_pm_lock_release(s_audio_awake_lock);
+		esp_pm_lock_release(s_audio_apb_lock);
+	}
+}
+
+void fad_power_algo_begin(void)
+{
+	if (s_enabled && s_pm)
+		esp_pm_lock_acquire(s_algo_lock);
+}
+
+void fad_power_algo_end(void)
+{
+	if (s_enabled && s_pm)
+		esp_pm_lock_release(s_algo_lock);
+}
+
+void fad_power_set_algo(fad_algo_type_t type)
+{
+	if (!s_enabled || type >= POWER_ALGO_TYPES)
+		return;
+	uint16_t top = s_pm ? s_clocks[POWER_CLOCKS - 1].mhz : s_algo_mhz;
+	portENTER_CRITICAL(&s_mux);
+	bool changed = (s_algo_mhz != top);
+	s_algo = type;
+	s_algo_mhz = top; // unknown load: start fast, the governor steps down
+	s_last_ms = (uint32_t)(fad_hal_time_us() / 1000);
+	s_epoch++;
+	portEXIT_CRITICAL(&s_mux);
+	if (changed)
+		configure(top);
+}
+
+bool fad_power_get_projection(fad_algo_type_t type, fad_power_projection_t *projection)
+{
+	memset(projection, 0, sizeof(*projection));
+	if (type >= POWER_ALGO_TYPES)
+		return false;
+	portENTER_CRITICAL(&s_mux);
+	power_account_t account = s_accounts[type];
+	portEXIT_CRITICAL(&s_mux);
+	if (account.measured_ms == 0)
+		return false;
+
+	projection->measured_ms = account.measured_ms;
+	projection->current_ma = account.charge_mams / account.measured_ms;
+	projection->hours = FAD_POWER_BATTERY_MAH / projection->current_ma;
+	projection->algo_mhz = account.algo_mhz;
+	return true;
+}
+
+void fad_power_report(void)
+{
+	if (!s_enabled)
+		return;
+	ESP_LOGI(POWER_TAG, "Algorithm clock %u MHz, %s between blocks, light sleep %s. Projections on %d mAh:",
+			 s_algo_mhz, (s_pm && !POWER_FIXED_CLOCK) ? "80 MHz" : "same", s_light_sleep ? "when stopped" : "off", FAD_POWER_BATTERY_MAH);
+	bool any = false;
+	for (int a = 0; a < POWER_ALGO_TYPES; a++)
+	{
+		fad_power_projection_t p;
+		if (!fad_power_get_projection(a, &p))
+			continue;
+		ESP_LOGI(POWER_TAG, "  %-11s %6.1f mA  %6.1f h  at %u MHz, from %u s", s_algo_names[a],
+				 p.current_ma, p.hours, p.algo_mhz, (unsigned)(p.measured_ms / 1000));
+		any = true;
+	}
+	if (!any)
+		ESP_LOGI(POWER_TAG, "  No algorithm has run for a full window yet");
+}
@@ -0,0 +1,90 @@
+/**
+ * fad_pwm.c
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * PWM / sigma-delta audio output. The shaper feeds back the requantization error of the last samples
+ * so that the noise transfer function is (1 - z^-1)^FAD_PWM_NOISE_SHAPING: the noise is pushed up
+ * towards OUTPUT_FREQ / 2, away from the voice band. The total noise power goes up, so it pays off
+ * when the duty resolution is below the sample resolution: the default 7-bit duty (625 kHz carrier)
+ * keeps close to 8-bit noise in the voice band. With an 8-bit duty or the sigma-delta modulator
+ * (which shapes its own noise) there is no requantization error and the shaper is compiled out.
+ */
+
+#include "esp_log.h"
+#include "driver/gpio.h"
+
+#include "fad_defs.h"
+#include "fad_pwm.h"
+#include "fad_perf.h"
+#include "fad_hal.h"
+
+#define PWM_TAG "PWM"
+#define SAMPLE_BITS 16
+#define SAMPLE_MIDSCALE 0x8000
+/* The shaper only has work below the 8-bit samples; the sigma-delta modulator shapes its own noise */
+#define PWM_SHAPING ((FAD_PWM_SIGMA_DELTA || FAD_PWM_BITS >= 8) ? 0 : FAD_PWM_NOISE_SHAPING)
+
+static int s_bits = 8;			 // duty resolution
+static int s_shift = 8;			 // SAMPLE_BITS - s_bits
+static int32_t s_max_duty = 255;
+static int32_t s_err1 = 0;		 // requantization error of the last sample, in sample units
+static int32_t s_err2 = 0;		 // and of the one before
+
+esp_err_t fad_pwm_init(void)
+{
+	s_bits = FAD_PWM_SIGMA_DELTA ? 8 : FAD_PWM_BITS;
+	s_shift = SAMPLE_BITS - s_bits;
+	s_max_duty = (1 << s_bits) - 1;
+	s_err1 = 0;
+	s_err2 = 0;
+
+	ESP_LOGI(PWM_TAG, "%s output on GPIO %d, %d bit, noise shaping order %d",
+			 FAD_PWM_SIGMA_DELTA ? "Sigma-delta" : "PWM", FAD_PWM_GPIO, s_bits, PWM_SHAPING);
+	return fad_hal_pwm_setup(FAD_PWM_GPIO, s_bits, FAD_PWM_SIGMA_DELTA);
+}
+
+void IRAM_ATTR fad_pwm_output_sample(uint16_t sample)
+{
+	int32_t u = sample;
+	if (PWM_SHAPING == 1)
+		u -= s_err1;
+	else if (PWM_SHAPING >= 2)
+		u -= 2 * s_err1 - s_err2;
+
+	int32_t duty = (u + (1 << (s_shift - 1))) >> s_shift; // round to the nearest duty step
+	if (duty < 0)
+		duty = 0;
+	else if (duty > s_max_duty)
+		duty = s_max_duty;
+
+	if (PWM_SHAPING == 0)
+	{
+		fad_hal_pwm_write_fast(duty);
+		return;
+	}
+
+	/* Clip the error too, so a run of full-scale samples cannot wind the shaper up */
+	int32_t err = (duty << s_shift) - u;
+	int32_t limit = 1 << s_shift;
+	s_err2 = s_err1;
+	s_err1 = (err > limit) ? limit : (err < -limit) ? -limit : err;
+
+	fad_hal_pwm_write_fast(duty);
+}
+
+void IRAM_ATTR fad_pwm_output_value(uint8_t value)
+{
+	fad_pwm_output_sample(value << 8);
+}
+
+void fad_pwm_benchmark(int iterations)
+{
+	for (int i = 0; i < iterations; i++) {
+		uint32_t start = fad_perf_cycles();
+		fad_pwm_output_sample(SAMPLE_MIDSCALE);
+		fad_perf_record(FAD_PERF_PWM, fad_perf_cycles() - start);
+	}
+}
@@ -5,30 +5,35 @@
  * Date: 10/03/2020
  *
  * Description:
- * This file initializes the timer and holds the timer alarm interrupt, which gets called at a set frequency
+ * This file initializes the timer and holds the timer alarm interrupt, which gets called at a set frequency.
+ * The timer hardware itself is driven through fad_hal.h.
  */
 
 #include "esp_system.h"
-#include "driver/timer.h"
-#include "esp_intr_alloc.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
-#include "driver/adc.h"
+#include "hal/adc_types.h"
 #include "esp_log.h"
-#include "driver/uart.h"
 
 #include "main.h"
 #include "fad_adc.h"
 #include "fad_dac.h"
+#include "fad_pwm.h"
 #include "fad_defs.h"
 #include "fad_app_core.h"
 #include "fad_gpio.h"
+#include "fad_latency.h"
+#include "fad_perf.h"
+#include "fad_jitter.h"
+#include "fad_hal.h"
+#include "fad_trace.h"
+#include "fad_log.h"
+#include "fad_mem.h"
+#include "fad_power.h"
+#include "fad_load.h"
+#include "fad_bt_buffer.h"
 
-#define TIMER_GROUP TIMER_GROUP_0
-#define TIMER_NUMBER TIMER_0
-#define CLOCK_DIVIDER (80000000 / TIMER_FREQ) //divider required to make timer frequency correct
-#define ALARM_STEP_SIZE (TIMER_FREQ / ALARM_FREQ)
 #define TASK_STACK_DEPTH 2048
 //#define OUTPUT_TAG "OUTPUT"
 
@@ -40,6 +45,9 @@ static const char *TIMER_TAG = "TIMER";
 static bool s_timer_running = 0; 	// keep track of whether timer is on
 static int s_adc_read_size = 0;
 static fad_output_mode_t s_output_mode = FAD_OUTPUT_DAC;
+static fad_input_mode_t s_input_mode = FAD_INPUT_ADC;
+static volatile uint32_t s_sample_count = 0;	// sample clock, counts every ISR call. Never reset.
+static volatile uint32_t s_block_sample_count = 0; // sample clock value when the last block was signalled
 
 /**
  * @brief Interrupt that is called every time the timer reaches the alarm value. Its purpose
@@ -52,39 +60,73 @@ static fad_output_mode_t s_output_mode = FAD_OUTPUT_DAC;
  */
 void IRAM_ATTR timer_intr_handler(void *arg)
 {
+	uint32_t isr_start = (FAD_PERF_ENABLE || FAD_JITTER_ENABLE || FAD_LOAD_ENABLE) ? fad_perf_cycles() : 0;
+	if (FAD_JITTER_ENABLE) fad_jitter_isr_tick(isr_start);
 
-	timer_spinlock_take(TIMER_GROUP); //At beginning and end, Timer API asks us to enclose ISR with spinlock _take and _give functions to function properly
+	fad_hal_timer_isr_enter();
 
-	//advance buffer, resetting to zero at max buffer position
-	adc_buffer_pos = adc_buffer_pos + 1; //adc_buffer_pos is global
-	if (adc_buffer_pos == ADC_BUFFER_SIZE) adc_buffer_pos = 0; //When the buffer reaches the buffer size then it will circle back to the first position
+	s_sample_count++;
+	bool adc_input = (s_input_mode == FAD_INPUT_ADC); // the mic task fills adc_buffer itself
 
-	// take reading
-	adc_buffer[adc_buffer_pos] = local_adc1_read(ADC_CHANNEL);
+	if (adc_input)
+	{
+		//advance buffer, resetting to zero at max buffer position
+		adc_buffer_pos = adc_buffer_pos + 1; //adc_buffer_pos is global
+		if (adc_buffer_pos == ADC_BUFFER_SIZE) adc_buffer_pos = 0; //When the buffer reaches the buffer size then it will circle back to the first position
+
+		// take reading
+		adc_buffer[adc_buffer_pos] = local_adc1_read(ADC_CHANNEL);
+		if (FAD_ADC_CHANNELS > 1)
+		{
+			uint32_t ref_start = FAD_PERF_ENABLE ? fad_perf_cycles() : 0;
+			adc_buffer_ref[adc_buffer_pos] = local_adc1_read(ADC_CHANNEL_REF);
+			if (FAD_PERF_ENABLE) fad_perf_record(FAD_PERF_ADC_REF, fad_perf_cycles() - ref_start);
+		}
+
+		if (fad_latency_armed) fad_latency_isr_input(adc_buffer_pos, s_sample_count);
+	}
 
 /*The Multisamples have been set to 1 now, this part is intended to throw away data when the ADC samples too fast*/
-	if (adc_buffer_pos % MULTISAMPLES == 0) 
+	if ((adc_input ? adc_buffer_pos : s_sample_count) % MULTISAMPLES == 0) 
 	{ //wait to increment dac buffer and output only when the multisample number of ADC samples have been taken.
 		dac_buffer_pos = (dac_buffer_pos + 1) % DAC_BUFFER_SIZE;
 		if (s_output_mode == FAD_OUTPUT_DAC)
 		{
 			//ESP_LOGI(TIMER_TAG, "DAC Buffer: %d", dac_buffer[dac_buffer_pos]);
 			dac_output_value(dac_buffer[dac_buffer_pos]);
+			if (fad_latency_armed) fad_latency_isr_output(dac_buffer_pos, s_sample_count);
+		}
+		else if (s_output_mode == FAD_OUTPUT_PWM)
+		{
+			fad_pwm_output_value(dac_buffer[dac_buffer_pos]);
+			if (fad_latency_armed) fad_latency_isr_output(dac_buffer_pos, s_sample_count);
+		}
+		else if (s_output_mode == FAD_OUTPUT_BT)
+		{
+			fad_bt_buffer_put(dac_buffer[dac_buffer_pos], dac_buffer_pos); // the A2DP callback takes it from there
 		}
 		
 	}
 
-	if (adc_buffer_pos % s_adc_read_size == 0)
+	if (adc_input && adc_buffer_pos % s_adc_read_size == 0)
 	{
 		adc_buffer_pos_copy = adc_buffer_pos; //these copies provide a stable reference for the algorithm to work on
 		dac_buffer_pos_copy = dac_buffer_pos;
+		s_block_sample_count = s_sample_count;
 
+		fad_trace_instant(FAD_TRACK_ISR, FAD_TRACE_BLOCK_READY, s_sample_count);
 		BaseType_t yield = false;	// required for next call
 		xSemaphoreGiveFromISR(s_algo_notify_semaphore_handle, &yield);
 	}
-	timer_group_clr_intr_status_in_isr(TIMER_GROUP, TIMER_NUMBER); // clear the interrupt
-	timer_group_enable_alarm_in_isr(TIMER_GROUP, TIMER_NUMBER); // enable alarm
-	timer_spinlock_give(TIMER_GROUP);
+
+	fad_hal_timer_isr_exit(); // acknowledge and re-arm the sample clock
+
+	if (FAD_PERF_ENABLE || FAD_LOAD_ENABLE)
+	{
+		uint32_t isr_cycles = fad_perf_cycles() - isr_start;
+		if (FAD_PERF_ENABLE) fad_perf_record(FAD_PERF_ISR, isr_cycles);
+		if (FAD_LOAD_ENABLE) fad_load_isr_cycles(isr_cycles);
+	}
 }
 
 /**
@@ -103,10 +145,13 @@ static void alarm_task(void *params)
 		fad_main_cb_param_t params = {
 			.adc_buff_pos_info.adc_pos = adc_buffer_pos_copy,
 			.adc_buff_pos_info.dac_pos = dac_buffer_pos_copy,
+			.adc_buff_pos_info.sample_count = s_block_sample_count,
 		};
 		
-		ESP_LOGI(TIMER_TAG, "ADC Buffer: %d", adc_buffer[adc_buffer_pos]);
-		fad_app_work_dispatch(fad_main_stack_evt_handler, FAD_ADC_BUFFER_READY, (void *)&params, sizeof(fad_main_cb_param_t), NULL);
+		FAD_LOGI_DEFER(TIMER_TAG, "ADC Buffer: %d", adc_buffer[adc_buffer_pos]);
+		fad_trace_begin(FAD_TRACK_ALARM, FAD_TRACE_DISPATCH, adc_buffer_pos_copy);
+		fad_app_work_dispatch_class(FAD_APP_CLASS_RT, fad_main_stack_evt_handler, FAD_ADC_BUFFER_READY, (void *)&params, sizeof(fad_main_cb_param_t), NULL);
+		fad_trace_end(FAD_TRACK_ALARM, FAD_TRACE_DISPATCH);
 	}
 
 	vTaskDelete(s_algo_notify_task_handle);
@@ -115,30 +160,14 @@ static void alarm_task(void *params)
 /*Initializes adc timer values and error checking*/
 esp_err_t adc_timer_init(void)
 {
-	//API struct from driver/timer.h
-	timer_config_t adc_timer =
-		{
-			.alarm_en = TIMER_ALARM_EN,
-			.counter_en = TIMER_PAUSE,
-			.counter_dir = TIMER_COUNT_UP,
-			.auto_reload = TIMER_AUTORELOAD_EN,
-			.divider = CLOCK_DIVIDER, //80 MHz / 2000 = 40 kHz
-		};
-
-	esp_err_t err;
-
-	//API functions from driver/timer.h
-	err = timer_init(TIMER_GROUP, TIMER_NUMBER, &adc_timer);
-	err = timer_set_counter_value(TIMER_GROUP, TIMER_NUMBER, 0x00000000ULL);
-	err = timer_enable_intr(TIMER_GROUP, TIMER_NUMBER);
-	err = timer_set_alarm_value(TIMER_GROUP, TIMER_NUMBER, ALARM_STEP_SIZE);
-	err = timer_isr_register(TIMER_GROUP, TIMER_NUMBER, timer_intr_handler, 0, ESP_INTR_FLAG_IRAM, NULL);
+	esp_err_t err = fad_hal_timer_init(timer_intr_handler);
 
 	s_algo_notify_semaphore_handle = xSemaphoreCreateBinary();
 
 	/*Creates the Alarm_task*/
 	xTaskCreate(alarm_task, "Interrupt_Alarm_Task_Handler", TASK_STACK_DEPTH,
 				0, configMAX_PRIORITIES - 3, &s_algo_notify_task_handle);
+	fad_mem_track_task(s_algo_notify_task_handle, "Interrupt_Alarm_Task_Handler", TASK_STACK_DEPTH);
 
 	if (err)
 		ESP_LOGI(TIMER_TAG, "Error");
@@ -152,7 +181,10 @@ esp_err_t adc_timer_init(void)
 esp_err_t adc_timer_start(void) 
 {
 	esp_err_t ret;
-	ret = timer_start(TIMER_GROUP, TIMER_NUMBER);
+	fad_power_audio_start(s_output_mode == FAD_OUTPUT_BT); // clocks steady before the first interrupt
+	if (FAD_JITTER_ENABLE) fad_jitter_start(); // calibrates at the clock the locks just settled
+	if (s_output_mode == FAD_OUTPUT_BT) fad_bt_buffer_reset();
+	ret = fad_hal_timer_start();
 	s_timer_running = true;
 
 	return ret;
@@ -161,13 +193,15 @@ esp_err_t adc_timer_start(void)
 void adc_timer_pause(void) 
 {
 	s_timer_running = false;
-	timer_pause(TIMER_GROUP, TIMER_NUMBER);
+	fad_hal_timer_pause();
+	fad_power_audio_stop();
 }
 
 void adc_timer_stop(void)
 {
 	s_timer_running = false;
-	timer_pause(TIMER_GROUP, TIMER_NUMBER);
+	fad_hal_timer_pause();
+	fad_power_audio_stop();
 	dac_buffer_pos = 0;
 	dac_buffer_pos_copy = 0;
 	adc_buffer_pos = 0;
@@ -188,4 +222,22 @@ esp_err_t adc_timer_set_mode(fad_output_mode_t mode)
 
 	s_output_mode = mode;
 	return ESP_OK;
-}
\ No newline at end of file
+}
+
+esp_err_t adc_timer_set_input_mode(fad_input_mode_t mode)
+{
+	if (s_timer_running == true) return ESP_FAIL;
+
+	s_input_mode = mode;
+	return ESP_OK;
+}
+
+uint32_t IRAM_ATTR adc_timer_get_sample_count(void)
+{
+	return s_sample_count;
+}
+
+double adc_timer_get_configured_rate(void)
+{
+	return fad_hal_timer_configured_rate();
+}
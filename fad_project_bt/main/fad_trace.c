@@ -0,0 +1,170 @@
+/**
+ * fad_trace.c
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Event trace ring. A writer claims a slot with an atomic increment of the record count and fills
+ * it in, so the ISR and tasks on both cores can trace without a lock. A snapshot pauses new records
+ * first; a writer already past the pause check may still finish its record while it is copied.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "esp_log.h"
+
+#include "fad_defs.h"
+#include "fad_hal.h"
+#include "fad_trace.h"
+#include "fad_mem.h"
+
+#define TRACE_TAG "TRACE"
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 16
+
+_Static_assert((FAD_TRACE_RECORDS & (FAD_TRACE_RECORDS - 1)) == 0, "FAD_TRACE_RECORDS must be a power of two");
+_Static_assert(sizeof(fad_trace_record_t) == 12, "trace records are 12 bytes");
+
+static const char *s_track_names[FAD_TRACK_MAX] = {
+	"Sample ISR",
+	"alarm_task",
+	"Mic task",
+	"App task",
+	"GPIO poll",
+	"A2DP data",
+};
+
+static const char *s_event_names[FAD_TRACE_MAX] = {
+	"Block ready",
+	"Dispatch",
+	"Dropped",
+	"Event",
+	"Algorithm",
+	"RT queue",
+	"GPIO poll",
+	"A2DP data",
+};
+
+static fad_trace_record_t *s_ring = NULL;
+static uint32_t s_head = 0;				// records written since init; the next one goes to s_head % FAD_TRACE_RECORDS
+static volatile bool s_paused = false;
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static size_t names_size(void)
+{
+	size_t size = 0;
+	for (int i = 0; i < FAD_TRACK_MAX; i++)
+		size += strlen(s_track_names[i]) + 1;
+	for (int i = 0; i < FAD_TRACE_MAX; i++)
+		size += strlen(s_event_names[i]) + 1;
+	return size;
+}
+
+esp_err_t fad_trace_init(void)
+{
+	if (!FAD_TRACE_ENABLE || s_ring != NULL)
+		return ESP_OK;
+
+	size_t size;
+	fad_trace_record_t *ring = fad_mem_region(FAD_MEM_TRACE, &size);
+	if (ring == NULL || size < FAD_TRACE_RECORDS * sizeof(fad_trace_record_t))
+	{
+		ESP_LOGE(TRACE_TAG, "No memory for %d trace records", FAD_TRACE_RECORDS);
+		return ESP_ERR_NO_MEM;
+	}
+	s_ring = ring;
+	return ESP_OK;
+}
+
+void IRAM_ATTR fad_trace_record(uint8_t type, fad_trace_track_t track, fad_trace_name_t name, int32_t value)
+{
+	if (s_ring == NULL || s_paused)
+		return;
+
+	uint32_t time_us = (uint32_t)fad_hal_time_us();
+	uint32_t n = __atomic_fetch_add(&s_head, 1, __ATOMIC_RELAXED);
+	fad_trace_record_t *rec = &s_ring[n & (FAD_TRACE_RECORDS - 1)];
+	rec->time_us = time_us;
+	rec->type = type;
+	rec->track = track;
+	rec->name = name;
+	rec->value = value;
+}
+
+esp_err_t fad_trace_snapshot(fad_capture_store_t *dest)
+{
+	if (s_ring == NULL)
+		return ESP_ERR_INVALID_STATE;
+
+	s_paused = true;
+	uint32_t head = __atomic_load_n(&s_head, __ATOMIC_RELAXED);
+	uint32_t count = head < FAD_TRACE_RECORDS ? head : FAD_TRACE_RECORDS;
+	size_t size = TRACE_HEADER_SIZE + names_size() + count * sizeof(fad_trace_record_t);
+
+	if (dest->data == NULL || dest->size < size)
+	{
+		dest->len = size;
+		s_paused = false;
+		return ESP_ERR_NO_MEM;
+	}
+
+	uint8_t *p = dest->data;
+	memcpy(p, "FTRC", 4);
+	p[4] = TRACE_VERSION;
+	p[5] = FAD_TRACK_MAX;
+	p[6] = FAD_TRACE_MAX;
+	p[7] = 0;
+	put_u32(p + 8, count);
+	put_u32(p + 12, head - count);
+	p += TRACE_HEADER_SIZE;
+
+	for (int i = 0; i < FAD_TRACK_MAX; i++)
+	{
+		strcpy((char *)p, s_track_names[i]);
+		p += strlen(s_track_names[i]) + 1;
+	}
+	for (int i = 0; i < FAD_TRACE_MAX; i++)
+	{
+		strcpy((char *)p, s_event_names[i]);
+		p += strlen(s_event_names[i]) + 1;
+	}
+
+	/* Records are stored little-endian already on both the ESP32 and the host */
+	for (uint32_t n = head - count; n != head; n++)
+	{
+		memcpy(p, &s_ring[n & (FAD_TRACE_RECORDS - 1)], sizeof(fad_trace_record_t));
+		p += sizeof(fad_trace_record_t);
+	}
+
+	dest->len = size;
+	s_paused = false;
+	return ESP_OK;
+}
+
+void fad_trace_dump(void)
+{
+	fad_capture_store_t store = {NULL, 0, 0};
+	store.size = TRACE_HEADER_SIZE + names_size() + FAD_TRACE_RECORDS * sizeof(fad_trace_record_t);
+	store.data = malloc(store.size);
+	if (store.data == NULL)
+	{
+		ESP_LOGE(TRACE_TAG, "No memory for the trace dump");
+		return;
+	}
+
+	esp_err_t err = fad_trace_snapshot(&store);
+	if (err == ESP_OK)
+		fad_capture_dump_bytes("FTRC", store.data, store.len);
+	else
+		ESP_LOGW(TRACE_TAG, "Tracing is not running");
+	free(store.data);
+}
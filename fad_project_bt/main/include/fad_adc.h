@@ -10,4 +10,16 @@
 esp_err_t adc_init(); //initializes ADC parameters
 int IRAM_ATTR local_adc1_read(int channel);
 
+/**
+ * @brief Number of ISR conversions that timed out (FAD_ADC_POLL_LIMIT) and repeated the last value
+ */
+uint32_t adc_get_poll_timeouts(void);
+
+/**
+ * @brief Time the driver read against the register-level read, recording FAD_PERF_ADC_DRIVER and
+ * FAD_PERF_ADC_FAST. Must be called after adc_init and while the sample timer is stopped.
+ * @param iterations Number of reads per path
+ */
+void adc_benchmark(int iterations);
+
 #endif
\ No newline at end of file
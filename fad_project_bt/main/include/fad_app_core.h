@@ -7,13 +7,56 @@
 #include "freertos/FreeRTOS.h"
 
 
+/* Where a message keeps its parameters */
+typedef enum {
+	FAD_APP_PARAMS_NONE,
+	FAD_APP_PARAMS_INLINE,	// in the message
+	FAD_APP_PARAMS_POOL,	// in a pool slot
+} fad_app_param_storage_t;
+
+/* Dispatch priority classes. Each has its own queue; the app task always serves the lowest numbered
+ * class that has work, so a burst of control events cannot hold up or push out audio blocks. */
+typedef enum {
+	FAD_APP_CLASS_RT,			// Audio blocks. Never waits for queue space: a late block is worth less than the next one
+	FAD_APP_CLASS_CONTROL,		// Buttons, BT connection, AVRCP. Waits up to 10 ticks for space
+	FAD_APP_CLASS_BACKGROUND,	// Diagnostics. Never waits for queue space
+	FAD_APP_CLASS_MAX,
+} fad_app_class_t;
+
 /* message for tasks */
 typedef struct {
 	uint16_t evt;
+	uint8_t storage;	// fad_app_param_storage_t
+	uint8_t slot;		// pool slot, FAD_APP_PARAMS_POOL only
+	uint32_t sent_us;	// fad_hal_time_us when queued, truncated; for the dispatch latency
 	fad_app_cb_t cb;
-	void *params;
+	union {
+		uint8_t bytes[FAD_APP_INLINE_PARAM_SIZE];
+		void *align_ptr;
+		uint32_t align_u32;
+	} params;
 } task_msg;
 
+/* Counters for one priority class */
+typedef struct {
+	uint32_t queued;			// Events accepted into the class queue
+	uint32_t dropped;			// Events dropped because the class queue stayed full
+	uint32_t depth_high_water;	// Most events waiting in the class queue at once
+	uint32_t handled;			// Events passed to their callback
+	uint64_t latency_sum_us;	// Total time from queueing to the callback being called
+	uint32_t latency_max_us;	// Longest time from queueing to the callback being called
+} fad_app_class_stats_t;
+
+/* Dispatch counters since boot */
+typedef struct {
+	uint32_t inline_msgs;		// Events whose parameters fit in the message
+	uint32_t pooled_msgs;		// Events whose parameters took a pool slot
+	uint32_t pool_exhausted;	// Events dropped because every pool slot was taken
+	uint32_t oversize;			// Events dropped because their parameters exceed FAD_APP_POOL_SLOT_SIZE
+	uint32_t pool_high_water;	// Most pool slots in use at once
+	fad_app_class_stats_t classes[FAD_APP_CLASS_MAX];
+} fad_app_stats_t;
+
 
 typedef void (* fad_app_copy_cb_t) (task_msg *msg, void *p_dest, void *p_src);
 
@@ -23,20 +66,40 @@ typedef void (* fad_app_copy_cb_t) (task_msg *msg, void *p_dest, void *p_src);
 void fad_app_task_startup();
 
 /**
- * @brief Add an event to the event queue to be sent out to the given callback function
+ * @brief Add a control class event to the event queue to be sent out to the given callback function.
+ * The parameters are copied into the message if they fit in FAD_APP_INLINE_PARAM_SIZE, otherwise into a
+ * pool slot. Nothing is allocated, so this can be called from the audio path.
  * 
  * @param p_cb The callback function for which the event will be sent to
  * @param event The enumerated event
  * @param p_params Extra parameters to be added that are associated with the event
- * @param param_len The length in bytes of p_params
+ * @param param_len The length in bytes of p_params, at most FAD_APP_POOL_SLOT_SIZE
  * @param p_copy_cb The deep copy callback. Not sure what this is for to be honest, can be NONE
  * @returns Boolean reprenting success of dispatch
  */
 bool fad_app_work_dispatch(fad_app_cb_t p_cb, uint16_t event, void *p_params, int param_len, fad_app_copy_cb_t p_copy_cb);
 
+/**
+ * @brief Same as fad_app_work_dispatch, for an event of the given priority class
+ * @param cls The priority class, which picks the queue and how long to wait for space in it
+ * @returns Boolean reprenting success of dispatch
+ */
+bool fad_app_work_dispatch_class(fad_app_class_t cls, fad_app_cb_t p_cb, uint16_t event, void *p_params, int param_len, fad_app_copy_cb_t p_copy_cb);
+
+/**
+ * @brief Copy out the dispatch counters
+ * @param stats [OUT] Destination for the counters
+ */
+void fad_app_get_stats(fad_app_stats_t *stats);
+
+/**
+ * @brief Log the dispatch counters
+ */
+void fad_app_report(void);
+
 /**
  * @brief Shut down the main dispatching task
  */
 void fad_app_task_shutdown();
 
-#endif
\ No newline at end of file
+#endif
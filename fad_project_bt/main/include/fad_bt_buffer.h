@@ -0,0 +1,135 @@
+/**
+ * fad_bt_buffer.h
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Jitter buffer between the algorithm output and the A2DP data callback. With FAD_OUTPUT_BT the sample
+ * ISR puts each output sample into a ring, the way it hands it to the DAC in wired mode, and the
+ * callback takes them out in whatever bursts Bluedroid asks for. The ring starts empty and the callback
+ * plays silence until it holds the target (FAD_BT_BUFFER_TARGET unless set), which is the latency the stream runs at.
+ * A read the ring cannot cover is an underrun: the missing samples fade out from the last one played
+ * and the ring fills back up to the target before playback fades back in.
+ *
+ * The sample clock and the headset clock drift apart, so the output task resamples: it reads the ring
+ * slightly faster or slower than one sample per output sample, steered by how far the fill is from the
+ * target (FAD_BT_ASRC_*). That holds the latency at the target over hours of streaming. Underruns and
+ * the drop back to the target above the high mark are left for stalls the loop cannot follow.
+ *
+ * The callback itself does no sample work. BT_Output_Task reads the ring in blocks and converts them
+ * to the sink's PCM format (fad_format.h) ahead of time, keeping FAD_BT_PCM_READY frames ready; the
+ * callback copies them out and wakes the task to top up. The latency is the ring target plus those frames.
+ */
+
+#ifndef _FAD_BT_BUFFER_H_
+#define _FAD_BT_BUFFER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_system.h"
+#include "fad_defs.h"
+
+/* Counters since the last fad_bt_buffer_reset. Fill is in samples of OUTPUT_FREQ */
+typedef struct {
+	uint32_t reads;			// Reads by the output task
+	uint32_t played;		// Samples played from the ring
+	uint32_t concealed;		// Samples made up: fade-outs and silence while refilling
+	uint32_t underruns;		// Reads the ring could not cover
+	uint32_t lows;			// Reads that left less than the low mark
+	uint32_t drops;			// Times the fill passed the high mark
+	uint32_t dropped;		// Samples dropped then
+	uint32_t overflows;		// Samples the ISR could not store because the ring was full
+	uint16_t fill;			// Fill after the last read
+	uint16_t fill_min;		// Least fill after a read while playing
+	uint16_t fill_max;		// Most fill before a read while playing
+	float fill_avg;			// Average fill after a read while playing
+	bool playing;			// false while filling up to the target
+	double ratio;			// Ring samples per output sample from the nominal clock rates
+	float correction_ppm;	// Correction to the ratio the fill loop applies now
+	uint32_t callbacks;		// A2DP data callbacks
+	uint32_t short_frames;	// PCM frames the callbacks padded with silence because none were ready
+	uint16_t pcm_fill;		// PCM frames ready now
+} fad_bt_buffer_stats_t;
+
+/**
+ * @brief Take the rings from the memory plan and start the output task
+ * @return
+ * 		-ESP_OK if successful
+ * 		-ESP_ERR_NO_MEM if the region, the task or its semaphore is missing
+ */
+esp_err_t fad_bt_buffer_init(void);
+
+/**
+ * @brief Empty the ring and fill it up to the target again. Call while the sample clock is stopped.
+ */
+void fad_bt_buffer_reset(void);
+
+/**
+ * @brief Set the fill the stream runs at. The low and high marks scale with it from the FAD_BT_BUFFER_*
+ * defaults. Restarts the buffer.
+ * @param target Samples of OUTPUT_FREQ
+ * @return
+ * 		-ESP_OK if successful
+ * 		-ESP_ERR_INVALID_ARG if the target is below two conversion blocks or its high mark does not fit the ring
+ */
+esp_err_t fad_bt_buffer_set_target(uint16_t target);
+
+/**
+ * @brief Get the fill the stream runs at
+ * @return Samples of OUTPUT_FREQ
+ */
+uint16_t fad_bt_buffer_get_target(void);
+
+/**
+ * @brief Negotiate the PCM format for the sink's sample rate. Restarts the buffer.
+ * @param hz The SBC sample rate, e.g. 44100
+ * @return
+ * 		-ESP_OK if successful
+ * 		-ESP_ERR_NOT_SUPPORTED if hz is not a multiple of OUTPUT_FREQ the PCM ring can hold; the old format stays
+ */
+esp_err_t fad_bt_buffer_set_sink_rate(uint32_t hz);
+
+/**
+ * @brief Store one output sample. Called by the sample ISR.
+ * @param value The sample, as written to dac_buffer
+ * @param dac_pos Its position in dac_buffer, for the latency hook
+ */
+void fad_bt_buffer_put(uint8_t value, uint16_t dac_pos);
+
+/**
+ * @brief Take samples out of the ring. Always fills all of out, concealing what the ring lacks.
+ * Called by the output task; only exposed for tests and tools that drive the ring directly.
+ * @param out [OUT] Samples, in dac_buffer format
+ * @param count Samples wanted
+ * @return Output samples that came from the ring; the rest are concealment
+ */
+int fad_bt_buffer_read(uint8_t *out, int count);
+
+/**
+ * @brief Copy ready PCM for the A2DP data callback and wake the output task. Pads a shortfall with silence.
+ * @param data [OUT] The stream buffer
+ * @param len Its length in bytes
+ * @return Bytes that came from the PCM ring; the rest of data is silence
+ */
+int fad_bt_buffer_pull(uint8_t *data, int len);
+
+/**
+ * @brief Get when the output task first played a ring sample since the last reset, rather than start-up
+ * silence. The A2DP callback takes it from the PCM ring within FAD_BT_PCM_READY frames.
+ * @return fad_hal_time_us() / 1000 at that moment, 0 if nothing has played yet
+ */
+uint32_t fad_bt_buffer_first_play_ms(void);
+
+/**
+ * @brief Copy out the counters
+ * @param stats [OUT] The counters
+ */
+void fad_bt_buffer_get_stats(fad_bt_buffer_stats_t *stats);
+
+/**
+ * @brief Log the counters, with the fill as latency
+ */
+void fad_bt_buffer_report(void);
+
+#endif
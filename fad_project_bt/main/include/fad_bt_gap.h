@@ -17,14 +17,68 @@
 #include "esp_system.h"
 #include "esp_bt_defs.h"
 #include "esp_gap_bt_api.h"
+#include "fad_defs.h"
+
+/* An audio sink that answered the inquiry */
+typedef struct {
+    esp_bd_addr_t bda;
+    int8_t rssi;                        // Strongest response, dBm; -128 if none carried one
+    uint8_t responses;                  // Responses this discovery
+    uint32_t cod;                       // Class of device
+    char name[FAD_GAP_NAME_LEN + 1];    // From its EIR or the name cache; empty if unknown
+} fad_gap_candidate_t;
+
+/* The current or last discovery */
+typedef struct {
+    bool running;
+    uint8_t rounds;             // Inquiries run, of FAD_GAP_INQUIRY_ROUNDS
+    uint32_t responses;         // Inquiry responses
+    uint32_t rejected_class;    // Responses that were not audio sinks
+    uint32_t rejected_rssi;     // Audio sinks weaker than FAD_GAP_MIN_RSSI
+    uint32_t elapsed_ms;        // Start to the choice or giving up; so far while running
+} fad_gap_stats_t;
 
 /**
- * @brief Initialize GAP and start discovery for a device. Returns address through
- * event to main stack event handler.
+ * @brief Initialize GAP and start discovery for a device. Inquiry responses that are not audio sinks or
+ * are weaker than FAD_GAP_MIN_RSSI are dropped; the strongest of the rest is returned through
+ * FAD_BT_ADDR_FOUND to the main stack event handler when the inquiry ends, or early once one reaches
+ * FAD_GAP_STRONG_RSSI. The device passed to fad_gap_connect_failed ranks below any other.
  */
 esp_err_t fad_gap_start_discovery();
 
-void fad_gap_cb(esp_bt_gap_cb_event_t evt, esp_bt_gap_cb_param_t *params);
+/**
+ * @brief Ask the controller for the RSSI delta of a link. The reading goes to fad_bt_telemetry_rssi.
+ * @param bda The peer of the link
+ * @return
+ * 		-ESP_OK if the read was started
+ * 		-an esp_bt_gap error otherwise, e.g. with no link to bda
+ */
+esp_err_t fad_gap_read_rssi(esp_bd_addr_t bda);
+
+/**
+ * @brief Copy out the candidates of the current or last discovery
+ * @param candidates [OUT] The candidates, in the order they first answered
+ * @param max Room in candidates
+ * @return Number copied
+ */
+int fad_gap_get_candidates(fad_gap_candidate_t *candidates, int max);
+
+/**
+ * @brief Copy out the counters of the current or last discovery
+ * @param stats [OUT] The counters
+ */
+void fad_gap_get_stats(fad_gap_stats_t *stats);
+
+/**
+ * @brief Note that connecting to a device failed, so the next discovery ranks it last
+ * @param bda The device
+ */
+void fad_gap_connect_failed(const esp_bd_addr_t bda);
+
+/**
+ * @brief Note that a connection came up, so no device is ranked last any more
+ */
+void fad_gap_connected(void);
 
 
 #endif
\ No newline at end of file
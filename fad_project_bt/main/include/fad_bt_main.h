@@ -16,10 +16,12 @@
 
 #include "esp_system.h"
 #include "esp_bt_defs.h"
+#include "fad_defs.h"
 
 enum  {
     FAD_BT_CONNECT,
     FAD_BT_ADVANCE_BUFF,
+    FAD_BT_RETRY,       // Retry the connection to the last peer, from the backoff timer
 } fad_bt_events;
 
 typedef union {
@@ -36,6 +38,44 @@ typedef union {
 
 } fad_bt_params;
 
+_Static_assert(sizeof(fad_bt_params) <= FAD_APP_INLINE_PARAM_SIZE, "fad_bt_params must fit FAD_APP_INLINE_PARAM_SIZE");
+
+/* SBC channel modes, numbered as in the A2DP codec information element */
+typedef enum {
+    FAD_BT_SBC_JOINT_STEREO = 0x01,
+    FAD_BT_SBC_STEREO = 0x02,
+    FAD_BT_SBC_DUAL = 0x04,
+    FAD_BT_SBC_MONO = 0x08,
+} fad_bt_sbc_mode_t;
+
+/* SBC encoder settings and the depth of the source queue in front of the encoder */
+typedef struct {
+    uint8_t blocks;             // Blocks per SBC frame: 4, 8, 12 or 16
+    uint8_t subbands;           // 4 or 8
+    uint8_t bitpool;            // 2 up to 16 * subbands (mono, dual) or 32 * subbands (stereo, joint), at most 250
+    fad_bt_sbc_mode_t mode;
+    uint16_t queue_samples;     // Jitter buffer target, in samples of OUTPUT_FREQ
+} fad_bt_sbc_config_t;
+
+/* Time to first audio, in ms from the start of the cycle: boot, or the moment the link was lost. 0 is not yet */
+typedef struct {
+    bool power_on;              // The cycle started at boot
+    uint32_t controller_ms;     // Controller and Bluedroid up; boot cycle only
+    uint32_t connected_ms;      // A2DP link up
+    uint32_t streaming_ms;      // Media start acknowledged by the headset
+    uint32_t first_audio_ms;    // First algorithm output, rather than start-up silence, converted for the headset
+    uint8_t attempts;           // Connection attempts it took
+} fad_bt_connect_times_t;
+
+/* Named SBC configurations. FAD_BT_SBC_PRESET picks the one fad_bt_init applies. ESP-IDF 4.x only lets the
+ * queue depth be tuned, so both use Bluedroid's codec settings */
+typedef enum {
+    FAD_BT_PRESET_MUSIC,        // Bluedroid's own: 16 blocks, 8 subbands, bitpool 53, joint stereo, 23 ms queue
+    FAD_BT_PRESET_SPEECH,       // Bluedroid's codec settings with a 12 ms queue, for lower latency
+    FAD_BT_PRESET_CUSTOM,       // Whatever fad_bt_set_sbc_config was given
+    FAD_BT_PRESET_MAX,
+} fad_bt_preset_t;
+
 /**
  * 
  * @brief Initializes controller modules and Bluedroid functions. Must be called before any
@@ -44,6 +84,20 @@ typedef union {
  */
 void fad_bt_init();
 
+/**
+ * @brief Bring Bluetooth up on its own task and return at once, so the audio path can initialise meanwhile.
+ * Once the controller is up it connects to peer_addr, retrying with a backoff that doubles from
+ * FAD_BT_RECONNECT_FIRST_MS, and falls back to discovery (FAD_DISC_START) after FAD_BT_RECONNECT_ATTEMPTS.
+ * Without a peer it starts discovery straight away. A lost link is retried the same way.
+ * 
+ * @param peer_addr The stored headset, or NULL
+ * @return
+ *      -ESP_OK if the task was started
+ *      -ESP_ERR_INVALID_STATE if Bluetooth is already being brought up
+ *      -ESP_ERR_NO_MEM if the task could not be created
+ */
+esp_err_t fad_bt_start(const uint8_t *peer_addr);
+
 /**
  * @brief Begin A2DP and AVRCP connection to peer device
  * 
@@ -56,4 +110,61 @@ void fad_bt_connect(esp_bd_addr_t peer_addr);
  */
 void fad_bt_stack_evt_handler(uint16_t event, void *param);
 
+/**
+ * @brief Set the source queue depth. ESP-IDF 4.x has Bluedroid advertise fixed SBC capabilities
+ * (bta_av_co.c) and offers no way to change them, so the queue depth is the only thing that can be tuned:
+ * the SBC settings must be Bluedroid's own, those of FAD_BT_PRESET_MUSIC. The queue applies at once,
+ * restarting the stream buffer.
+ * 
+ * @param config The settings
+ * @return
+ *      -ESP_OK if successful
+ *      -ESP_ERR_INVALID_ARG if a value is outside what SBC allows, or the queue does not fit the jitter buffer
+ *      -ESP_ERR_NOT_SUPPORTED if the SBC settings differ from Bluedroid's
+ */
+esp_err_t fad_bt_set_sbc_config(const fad_bt_sbc_config_t *config);
+
+/**
+ * @brief Apply a named configuration
+ * 
+ * @param preset FAD_BT_PRESET_MUSIC or FAD_BT_PRESET_SPEECH
+ * @return
+ *      -ESP_OK if successful
+ *      -ESP_ERR_INVALID_ARG for FAD_BT_PRESET_CUSTOM or an unknown preset
+ */
+esp_err_t fad_bt_set_preset(fad_bt_preset_t preset);
+
+/**
+ * @brief Get the configuration asked for and the one the headset agreed on
+ * 
+ * @param requested [OUT] The settings last set. May be NULL
+ * @param negotiated [OUT] The settings of the running stream, queue included. May be NULL
+ * @param sample_hz [OUT] The SBC sample rate of the running stream. May be NULL
+ * @return false if no stream has been configured yet; negotiated and sample_hz are then left alone
+ */
+bool fad_bt_get_sbc_config(fad_bt_sbc_config_t *requested, fad_bt_sbc_config_t *negotiated, uint32_t *sample_hz);
+
+/**
+ * @brief Get the timings of the current connection cycle
+ * 
+ * @param times [OUT] The timings so far
+ * @return true once audio has reached the headset
+ */
+bool fad_bt_get_connect_times(fad_bt_connect_times_t *times);
+
+/**
+ * @brief Bit rate of an SBC stream, frame headers included
+ * 
+ * @param config The settings
+ * @param sample_hz The SBC sample rate
+ * @return Bits per second
+ */
+uint32_t fad_bt_sbc_bitrate(const fad_bt_sbc_config_t *config, uint32_t sample_hz);
+
+/**
+ * @brief Log the time to first audio, the negotiated SBC stream, and for each preset used so far its air throughput and the
+ * latency last measured with it (fad_latency.h). Silent until a stream has been configured.
+ */
+void fad_bt_report(void);
+
 #endif
\ No newline at end of file
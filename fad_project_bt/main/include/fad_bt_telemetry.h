@@ -0,0 +1,112 @@
+/**
+ * fad_bt_telemetry.h
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * A2DP streaming telemetry for the field. The data callback stamps each call: the time since the last
+ * one and the bytes asked for go into histograms, next to the bytes moved. The jitter buffer's own
+ * counters (fad_bt_buffer.h) give fill, underruns and concealment. Link quality is the RSSI delta the
+ * controller reports, read every FAD_BT_TELEM_RSSI_MS while connected, plus the links lost.
+ *
+ * fad_bt_telemetry_dump prints it all as CSV between FBT-BEGIN and FBT-END lines, which the "bt"
+ * command of the diagnostics console (fad_diag.h) asks for and uart_tester/tools/bt_tools.py reads.
+ */
+
+#ifndef _FAD_BT_TELEMETRY_H_
+#define _FAD_BT_TELEMETRY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "esp_system.h"
+#include "esp_bt_defs.h"
+#include "fad_defs.h"
+
+/* Counters since the last fad_bt_telemetry_reset */
+typedef struct {
+	uint32_t elapsed_ms;								// Time the counters cover
+	uint32_t callbacks;									// A2DP data callbacks
+	uint64_t bytes;										// Bytes the callbacks asked for
+	uint32_t interval_hist[FAD_BT_TELEM_INTERVAL_BINS];	// Callbacks per FAD_BT_TELEM_INTERVAL_BIN_US of time since the last
+	uint32_t interval_min_us;							// Shortest time between callbacks
+	uint32_t interval_max_us;							// Longest time between callbacks
+	uint32_t len_hist[FAD_BT_TELEM_LEN_BINS];			// Callbacks per FAD_BT_TELEM_LEN_BIN bytes asked for
+	uint32_t len_min;									// Fewest bytes asked for
+	uint32_t len_max;									// Most bytes asked for
+	uint32_t stream_bps;								// SBC bitrate of the stream; 0 before the headset configures one
+	uint32_t stream_hz;									// Its sample rate
+	bool linked;										// An A2DP link is up
+	uint32_t links;										// Links made
+	uint32_t link_losses;								// Links lost without fad_bt asking
+	uint32_t rssi_reads;								// RSSI delta readings
+	int8_t rssi;										// Last RSSI delta, dB from the golden receive range
+	int8_t rssi_min;
+	int8_t rssi_max;
+} fad_bt_telemetry_t;
+
+/**
+ * @brief Create the RSSI timer and start counting
+ * @return
+ * 		-ESP_OK if successful
+ * 		-ESP_FAIL if the timer could not be created
+ */
+esp_err_t fad_bt_telemetry_init(void);
+
+/**
+ * @brief Zero the counters. The link state and the stream settings stay.
+ */
+void fad_bt_telemetry_reset(void);
+
+/**
+ * @brief Stamp a data callback. Called first thing in the A2DP data callback; takes no lock.
+ * @param len Bytes the callback is asked for
+ */
+void fad_bt_telemetry_callback(int32_t len);
+
+/**
+ * @brief The headset configured a stream
+ * @param bitrate SBC bits per second
+ * @param hz Sample rate
+ */
+void fad_bt_telemetry_stream(uint32_t bitrate, uint32_t hz);
+
+/**
+ * @brief An A2DP link came up; its RSSI is read from now on
+ * @param bda The headset
+ */
+void fad_bt_telemetry_link_up(const esp_bd_addr_t bda);
+
+/**
+ * @brief The A2DP link went down
+ * @param lost true if fad_bt did not ask for the disconnect
+ */
+void fad_bt_telemetry_link_down(bool lost);
+
+/**
+ * @brief An RSSI delta reading arrived. Called from the GAP callback.
+ * @param delta dB from the golden receive range; 0 inside it
+ */
+void fad_bt_telemetry_rssi(int8_t delta);
+
+/**
+ * @brief Copy out the counters. Retries while the data callback is updating them, so call it from a task
+ * below the Bluedroid tasks' priority.
+ * @param telemetry [OUT] The counters
+ */
+void fad_bt_telemetry_get(fad_bt_telemetry_t *telemetry);
+
+/**
+ * @brief Print the counters and the jitter buffer's as CSV (section,name,value) between FBT-BEGIN <rows>
+ * and FBT-END lines
+ * @param out Where to print, e.g. stdout
+ */
+void fad_bt_telemetry_dump(FILE *out);
+
+/**
+ * @brief Log a summary of the callback cadence, throughput and link
+ */
+void fad_bt_telemetry_report(void);
+
+#endif
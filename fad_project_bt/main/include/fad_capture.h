@@ -0,0 +1,157 @@
+/**
+ * fad_capture.h
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Capture and replay of the ADC blocks handed to the algorithm. A recording stores every block with
+ * its sample clock timestamp and buffer positions, and optionally the algorithm output for it.
+ * A replay feeds the stored blocks back through FAD_ADC_BUFFER_READY, on the device or in the host
+ * build, and checks the algorithm output against the recorded one sample by sample.
+ * With FAD_ADC_CHANNELS 2 the reference channel is recorded too, and replayed as the algorithm's ref_buff.
+ *
+ * Format (version 2; version 1 is the same without reference spans), all values little-endian:
+ *   Header (16 bytes): "FADC", u8 version, u8 flags (bit 0: outputs stored, bit 1: reference stored),
+ *                      u16 block length, u32 sample rate, u8 ADC bits, u8 multisamples, u8 algo type, u8 algo mode
+ *   Per block:         u16 sync 0xFAD0, u16 length, u32 sample clock, u16 ADC pos, u16 DAC pos,
+ *                      the samples packed as 12 bits (two samples in three bytes, an odd last one in two),
+ *                      then the reference samples packed the same way if the reference is stored,
+ *                      then length / multisamples output bytes if outputs are stored
+ */
+
+#ifndef _FAD_CAPTURE_H_
+#define _FAD_CAPTURE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_system.h"
+#include "fad_defs.h"
+
+/* A capture in memory. len bytes of data are valid, size are allocated. */
+typedef struct fad_capture_store {
+	uint8_t *data;
+	size_t size;
+	size_t len;
+} fad_capture_store_t;
+
+/* Decoded capture header */
+typedef struct {
+	uint32_t sample_rate;
+	uint16_t block_len;		 // ADC samples per block
+	uint8_t multisamples;
+	bool has_output;		 // Algorithm output is stored with each block
+	bool has_ref;			 // The reference channel is stored with each block
+	fad_algo_type_t algo_type;
+	fad_algo_mode_t algo_mode;
+} fad_capture_header_t;
+
+/* Progress and result of the current or last capture run */
+typedef struct {
+	fad_capture_mode_t mode;
+	bool done;					 // Run finished (buffer full, stopped, or replay at end)
+	uint32_t blocks;			 // Blocks recorded or replayed
+	uint32_t gaps;				 // Recorded blocks whose timestamp does not follow the previous block
+	bool overflow;				 // Recording stopped because the store was full
+	bool corrupt;				 // Replay stopped at a malformed block
+	bool verified;				 // Replay source had outputs to compare against
+	uint32_t mismatched_blocks;	 // Replayed blocks whose output differs from the recording
+	uint32_t mismatched_samples; // Output samples that differ
+	size_t bytes;				 // Size of the recording, or bytes of the source consumed
+} fad_capture_report_t;
+
+/* True while a recording or replay is running. Checked by the ADC block handler. */
+extern volatile bool fad_capture_active;
+
+/**
+ * @brief Start recording. The algorithm should be freshly initialized so a replay starts from the same state.
+ * @param dest Store to record into. Recording stops when it is full.
+ * @param algo_type Algorithm running, stored in the header
+ * @param algo_mode Algorithm mode, stored in the header
+ * @param block_len ADC samples per algorithm block
+ * @return
+ * 		-ESP_OK if successful
+ * 		-ESP_ERR_INVALID_STATE if a capture is already running
+ * 		-ESP_ERR_INVALID_ARG if block_len is larger than ADC_BUFFER_SIZE
+ * 		-ESP_ERR_NO_MEM if dest cannot hold the header
+ */
+esp_err_t fad_capture_record_start(fad_capture_store_t *dest, fad_algo_type_t algo_type, fad_algo_mode_t algo_mode, int block_len);
+
+/**
+ * @brief Start replaying. Blocks are dispatched as FAD_ADC_BUFFER_READY events with the replay flag set,
+ * one at a time. The caller must set up the algorithm from header before returning to the event loop.
+ * @param source Capture to replay. Must stay valid until the replay is done.
+ * @param dest Store for a new recording with the replayed outputs, or NULL
+ * @param header [OUT] The source header
+ * @return
+ * 		-ESP_OK if successful
+ * 		-ESP_ERR_INVALID_STATE if a capture is already running
+ * 		-ESP_ERR_INVALID_ARG if source is not a capture this firmware can replay
+ */
+esp_err_t fad_capture_replay_start(const fad_capture_store_t *source, fad_capture_store_t *dest, fad_capture_header_t *header);
+
+/**
+ * @brief Stop the running capture. No FAD_CAPTURE_DONE event is sent.
+ */
+void fad_capture_stop(void);
+
+/**
+ * @brief Called by the ADC block handler before the algorithm
+ * @param in_buff The ADC buffer
+ * @param ref_buff The reference channel buffer, or NULL with one channel
+ * @param in_pos Start of the block in in_buff
+ * @param len ADC samples in the block
+ * @param sample_count Sample clock at the block boundary
+ * @param dac_pos Start of the output block
+ * @param replay True if the block event came from the replay
+ * @param ref_block [OUT] The reference block for the algorithm to read from index 0, or NULL if there is none
+ * @return The block for the algorithm to read from index 0, or NULL if the algorithm should skip this event
+ */
+uint16_t *fad_capture_block_begin(const uint16_t *in_buff, const uint16_t *ref_buff, uint16_t in_pos, int len,
+								  uint32_t sample_count, uint16_t dac_pos, bool replay, const uint16_t **ref_block);
+
+/**
+ * @brief Called by the ADC block handler after the algorithm, when block_begin returned a block
+ * @param out The output block the algorithm wrote
+ * @param out_len Output samples in the block
+ */
+void fad_capture_block_end(const uint8_t *out, int out_len);
+
+/**
+ * @brief Copy out the progress of the current or last run
+ * @param report [OUT] Destination for the report
+ */
+void fad_capture_get_report(fad_capture_report_t *report);
+
+/**
+ * @brief Log the progress of the current or last run
+ */
+void fad_capture_report(void);
+
+/**
+ * @brief Decode the header of a capture
+ * @param store The capture
+ * @param header [OUT] The decoded header
+ * @return
+ * 		-ESP_OK if successful
+ * 		-ESP_ERR_INVALID_ARG if the store does not start with a valid header
+ */
+esp_err_t fad_capture_parse_header(const fad_capture_store_t *store, fad_capture_header_t *header);
+
+/**
+ * @brief Print a capture to stdout as base64 between "FADC-BEGIN <bytes>" and "FADC-END" lines.
+ * uart_tester/tools/capture_tools.py turns a console log with such a dump back into a capture file.
+ * @param store The capture
+ */
+void fad_capture_dump(const fad_capture_store_t *store);
+
+/**
+ * @brief Print any bytes to stdout as base64 between "<marker>-BEGIN <bytes>" and "<marker>-END" lines
+ * @param marker Name of the dump, e.g. "FADC"
+ * @param data The bytes
+ * @param len Number of bytes
+ */
+void fad_capture_dump_bytes(const char *marker, const uint8_t *data, size_t len);
+
+#endif
@@ -2,10 +2,34 @@
 #define _FAD_DAC_H_
 
 #include "esp_system.h"
+#include "hal/dac_types.h"
 
 
 esp_err_t dac_init(void);
 
 void IRAM_ATTR dac_output_value(uint8_t value);
 
-#endif
\ No newline at end of file
+/**
+ * @brief One-time setup of a DAC channel for dac_write_channel. dac_init does this for the output channel.
+ * @param channel DAC_CHANNEL_1 or DAC_CHANNEL_2
+ * @return
+ * 		-ESP_OK if successful
+ * 		-Error from dac_output_enable otherwise
+ */
+esp_err_t dac_channel_setup(dac_channel_t channel);
+
+/**
+ * @brief Register-level DAC write for the sample ISR. The channel must have been set up first.
+ * @param channel DAC_CHANNEL_1 or DAC_CHANNEL_2
+ * @param value Output value, 0 ~ 255
+ */
+void IRAM_ATTR dac_write_channel(dac_channel_t channel, uint8_t value);
+
+/**
+ * @brief Time dac_output_voltage against dac_write_channel, recording FAD_PERF_DAC_DRIVER and
+ * FAD_PERF_DAC_FAST. Writes midscale only. Must be called while the sample timer is stopped.
+ * @param iterations Number of writes per path
+ */
+void dac_benchmark(int iterations);
+
+#endif
@@ -0,0 +1,41 @@
+/**
+ * fad_diag.h
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Diagnostics console. A low-priority task reads command lines from the console UART, the one
+ * idf.py monitor types into, and answers on the console:
+ *   bt         A2DP telemetry as CSV between FBT-BEGIN and FBT-END (fad_bt_telemetry.h)
+ *   bt reset   Zero the A2DP telemetry counters
+ *   mem        Memory footprint as CSV between FMEM-BEGIN and FMEM-END (fad_mem.h)
+ *   help       List the commands
+ * uart_tester/tools/bt_tools.py sends "bt" and reads the answer, or pulls it out of a saved log.
+ */
+
+#ifndef _FAD_DIAG_H_
+#define _FAD_DIAG_H_
+
+#include "esp_system.h"
+#include "fad_defs.h"
+
+/**
+ * @brief Take the console UART's input and start the console task. Does nothing with FAD_DIAG_ENABLE 0.
+ * @return
+ * 		-ESP_OK if successful
+ * 		-the UART driver's error if the console input could not be taken, e.g. on the host
+ * 		-ESP_ERR_NO_MEM if the task could not be created
+ */
+esp_err_t fad_diag_init(void);
+
+/**
+ * @brief Run one command line
+ * @param line The command and its argument, without the line end
+ * @return
+ * 		-ESP_OK if the command ran
+ * 		-ESP_ERR_NOT_FOUND if there is no such command
+ */
+esp_err_t fad_diag_command(const char *line);
+
+#endif
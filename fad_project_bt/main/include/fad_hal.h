@@ -0,0 +1,173 @@
+/**
+ * fad_hal.h
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Hardware abstraction for the sample path. Every peripheral register and ESP-IDF driver call used
+ * by the timer, ADC, DAC and instrumentation code goes through these functions.
+ * fad_hal_esp.c implements them on the ESP32. fad_host/fad_hal_posix.c implements them on Linux
+ * with a simulated sample clock, file-backed ADC input and captured DAC output.
+ *
+ * RTOS, NVS and logging are not part of this layer; the host build provides those APIs itself.
+ */
+
+#ifndef _FAD_HAL_H_
+#define _FAD_HAL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_system.h"
+#include "hal/dac_types.h"
+
+/* Sample interrupt handler signature */
+typedef void (* fad_hal_isr_t) (void *arg);
+
+/**
+ * @brief Set up the sample clock to call isr at ALARM_FREQ. The clock is left paused.
+ * @param isr The sample interrupt handler
+ * @return
+ * 		-ESP_OK if successful
+ * 		-Non-zero if unsuccessful
+ */
+esp_err_t fad_hal_timer_init(fad_hal_isr_t isr);
+
+/**
+ * @brief Start (or resume) the sample clock
+ */
+esp_err_t fad_hal_timer_start(void);
+
+/**
+ * @brief Pause the sample clock
+ */
+void fad_hal_timer_pause(void);
+
+/**
+ * @brief Must be called first in the sample ISR
+ */
+void IRAM_ATTR fad_hal_timer_isr_enter(void);
+
+/**
+ * @brief Must be called last in the sample ISR. Acknowledges the interrupt and arms the next one.
+ */
+void IRAM_ATTR fad_hal_timer_isr_exit(void);
+
+/**
+ * @brief The sample rate the clock settings produce in theory, in Hz
+ */
+double fad_hal_timer_configured_rate(void);
+
+/**
+ * @brief Configure ADC1 width and attenuation for a channel and prepare fad_hal_adc_read_fast
+ * @param channel The ADC1 channel to be sampled
+ */
+esp_err_t fad_hal_adc_init(int channel);
+
+/**
+ * @brief Lock-free ADC1 read for the sample ISR. fad_hal_adc_init must have been called for the channel.
+ * @param channel The channel to be read from
+ * @return The value read from the ADC
+ */
+int IRAM_ATTR fad_hal_adc_read_fast(int channel);
+
+/**
+ * @brief ADC1 read through the driver. Not for use from the ISR. The driver may change the pad
+ * selection, so call fad_hal_adc_init again before going back to the fast path.
+ * @param channel The channel to be read from
+ * @return The value read from the ADC
+ */
+int fad_hal_adc_read_driver(int channel);
+
+/**
+ * @brief Number of fast reads that timed out and repeated the last value
+ */
+uint32_t fad_hal_adc_poll_timeouts(void);
+
+/**
+ * @brief Enable a DAC channel and prepare fad_hal_dac_write_fast for it
+ * @param channel DAC_CHANNEL_1 or DAC_CHANNEL_2
+ */
+esp_err_t fad_hal_dac_setup(dac_channel_t channel);
+
+/**
+ * @brief Lock-free DAC write for the sample ISR. The channel must have been set up.
+ * @param channel DAC_CHANNEL_1 or DAC_CHANNEL_2
+ * @param value Output value, 0 ~ 255
+ */
+void IRAM_ATTR fad_hal_dac_write_fast(dac_channel_t channel, uint8_t value);
+
+/**
+ * @brief DAC write through the driver. Not for use from the ISR.
+ * @param channel DAC_CHANNEL_1 or DAC_CHANNEL_2
+ * @param value Output value, 0 ~ 255
+ */
+void fad_hal_dac_write_driver(dac_channel_t channel, uint8_t value);
+
+/**
+ * @brief Set up a pulse output on a GPIO for audio through an external RC low-pass
+ * @param gpio The output pin
+ * @param bits Duty resolution. LEDC PWM runs its carrier at 80 MHz >> bits. Must be 8 for sigma-delta.
+ * @param sigma_delta True for the sigma-delta modulator, false for LEDC PWM
+ */
+esp_err_t fad_hal_pwm_setup(int gpio, int bits, bool sigma_delta);
+
+/**
+ * @brief Lock-free duty update for the sample ISR. fad_hal_pwm_setup must have been called.
+ * @param duty Output level, 0 ~ (1 << bits) - 1. Takes effect at the next carrier period.
+ */
+void IRAM_ATTR fad_hal_pwm_write_fast(uint32_t duty);
+
+/**
+ * @brief Set up FAD_I2S_OUT_PORT to play 16-bit stereo frames from DMA to an external codec
+ * @param rate Frame rate in Hz
+ * @return
+ * 		-ESP_OK if successful
+ * 		-Error from the I2S driver otherwise
+ */
+esp_err_t fad_hal_i2s_setup(uint32_t rate);
+
+/**
+ * @brief Queue mono samples for the codec; each goes out on both channels. Not for use from the ISR.
+ * @param samples Signed 16-bit samples
+ * @param count Number of samples
+ * @param timeout_ms Longest time to wait for DMA space
+ * @return Number of samples queued, fewer than count if the timeout ran out
+ */
+int fad_hal_i2s_write(const int16_t *samples, int count, uint32_t timeout_ms);
+
+/**
+ * @brief Set up FAD_MIC_PORT to receive a digital mic (PDM or I2S, see FAD_MIC_PDM) into DMA.
+ * With FAD_ADC_CHANNELS 2 it receives stereo: two mics sharing the clock and data lines.
+ * @param rate Sample rate in Hz
+ * @return
+ * 		-ESP_OK if successful
+ * 		-Error from the I2S driver otherwise
+ */
+esp_err_t fad_hal_mic_setup(uint32_t rate);
+
+/**
+ * @brief Take received mic frames out of DMA. Not for use from the ISR.
+ * @param samples [OUT] Destination for signed 16-bit samples, FAD_ADC_CHANNELS interleaved per frame
+ * @param count Number of frames wanted
+ * @param timeout_ms Longest time to wait for them
+ * @return Number of frames read, fewer than count if the timeout ran out
+ */
+int fad_hal_mic_read(int16_t *samples, int count, uint32_t timeout_ms);
+
+/**
+ * @brief CPU cycle counter of the calling core
+ */
+uint32_t IRAM_ATTR fad_hal_cycles(void);
+
+/**
+ * @brief Rate of fad_hal_cycles, in Hz
+ */
+uint32_t fad_hal_cpu_hz(void);
+
+/**
+ * @brief Monotonic time since boot in microseconds
+ */
+int64_t IRAM_ATTR fad_hal_time_us(void);
+
+#endif
@@ -0,0 +1,55 @@
+/**
+ * fad_i2s.h
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * 16-bit output to an external I2S codec (FAD_OUTPUT_I2S). Like the BT output, a task pulls finished
+ * samples out of dac_buffer behind the ISR's output position, here in FAD_I2S_CHUNK blocks, widens them
+ * to 16 bit and queues them for DMA. The codec runs on its own clock, so the task also counts overruns
+ * (fell so far behind that samples were skipped).
+ */
+
+#ifndef _FAD_I2S_H_
+#define _FAD_I2S_H_
+
+#include <stdint.h>
+#include "esp_system.h"
+
+/* Output counters since fad_i2s_start */
+typedef struct {
+	uint32_t samples;	// Samples queued for the codec
+	uint32_t overruns; // Times the task was more than half the DAC buffer behind and skipped ahead
+} fad_i2s_stats_t;
+
+/**
+ * @brief Install the I2S driver and create the output task. Safe to call again.
+ * @return
+ * 		-ESP_OK if successful
+ * 		-Error from the I2S driver otherwise
+ */
+esp_err_t fad_i2s_init(void);
+
+/**
+ * @brief Start moving samples to the codec, beginning at the ISR's current output position
+ */
+void fad_i2s_start(void);
+
+/**
+ * @brief Stop moving samples. The codec plays out what is queued, then silence.
+ */
+void fad_i2s_stop(void);
+
+/**
+ * @brief Copy out the output counters
+ * @param stats [OUT] Destination for the counters
+ */
+void fad_i2s_get_stats(fad_i2s_stats_t *stats);
+
+/**
+ * @brief Log the output counters
+ */
+void fad_i2s_report(void);
+
+#endif
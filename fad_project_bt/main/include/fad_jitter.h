@@ -0,0 +1,54 @@
+/**
+ * fad_jitter.h
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Sample clock accuracy measurement. The ISR timestamps its own entry with the CPU cycle counter;
+ * the spacing between entries goes into a histogram of deviation from the nominal sample period.
+ * The effective sample rate is measured against esp_timer and compared to ALARM_FREQ in ppm.
+ */
+
+#ifndef _FAD_JITTER_H_
+#define _FAD_JITTER_H_
+
+#include <stdint.h>
+#include "esp_system.h"
+#include "fad_defs.h"
+
+/* Jitter and rate figures since fad_jitter_start */
+typedef struct {
+	uint32_t histogram[FAD_JITTER_BINS]; // Entries per FAD_JITTER_BIN_NS bin, nominal period in the middle bin
+	uint32_t intervals;					 // Number of ISR-to-ISR intervals measured
+	int32_t min_dev_ns;					 // Shortest interval, as deviation from nominal
+	int32_t max_dev_ns;					 // Longest interval, as deviation from nominal
+	uint32_t late;						 // Intervals longer than 1.5 sample periods (an interrupt was held off)
+	double measured_hz;					 // Sample rate measured against esp_timer
+	double configured_hz;				 // Sample rate the timer settings produce in theory
+	double drift_ppm;					 // (measured_hz / ALARM_FREQ - 1) * 1e6
+} fad_jitter_report_t;
+
+/**
+ * @brief Reset the histogram and start the rate measurement. Called when the sample timer starts.
+ */
+void fad_jitter_start(void);
+
+/**
+ * @brief ISR hook, called first thing in the sample ISR
+ * @param cycles CPU cycle counter at ISR entry
+ */
+void IRAM_ATTR fad_jitter_isr_tick(uint32_t cycles);
+
+/**
+ * @brief Fill in a report of the measurement so far
+ * @param report [OUT] Destination for the report
+ */
+void fad_jitter_get_report(fad_jitter_report_t *report);
+
+/**
+ * @brief Log the jitter histogram and the sample clock accuracy
+ */
+void fad_jitter_report(void);
+
+#endif
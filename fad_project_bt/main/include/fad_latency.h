@@ -0,0 +1,108 @@
+/**
+ * fad_latency.h
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Built-in measurement of the mic-to-ear latency. In INJECT mode an impulse replaces one ADC
+ * sample and is followed through the ADC buffer, the event dispatch, the algorithm and the output
+ * buffer. In LOOPBACK mode a chirp is placed in the output stream and correlated against the
+ * returning mic signal, which adds the DAC/A2DP/headset/air path the inject mode cannot see.
+ *
+ * All times are taken from the sample clock kept by the timer ISR, so a run is deterministic for
+ * a given input stream.
+ */
+
+#ifndef _FAD_LATENCY_H_
+#define _FAD_LATENCY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_system.h"
+#include "fad_defs.h"
+
+/* Stages of the audio path that the latency report is broken into */
+typedef enum {
+	FAD_LATENCY_STAGE_ADC_BUFFER,	 // Marker sampled -> block holding it is ready in the ISR
+	FAD_LATENCY_STAGE_DISPATCH,		 // Block ready in the ISR -> algorithm starts in the app task
+	FAD_LATENCY_STAGE_ALGORITHM,	 // Algorithm starts -> marker shows up in its output (includes intended delay)
+	FAD_LATENCY_STAGE_OUTPUT_BUFFER, // Marker written to the output buffer -> DAC write / BT callback read
+	FAD_LATENCY_STAGE_TRANSPORT,	 // Output read -> marker heard again at the mic (LOOPBACK only)
+	FAD_LATENCY_STAGE_TOTAL,		 // End to end figure for the selected mode
+	FAD_LATENCY_STAGE_MAX,
+} fad_latency_stage_t;
+
+/* Running statistics for one stage, in samples of the sample clock */
+typedef struct {
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t count;
+} fad_latency_stat_t;
+
+/* Result of a latency measurement run */
+typedef struct {
+	fad_latency_mode_t mode;	// Mode the run was made in
+	int trials;					// Trials attempted
+	int timeouts;				// Trials where the marker was lost
+	fad_latency_stat_t stage[FAD_LATENCY_STAGE_MAX];
+} fad_latency_report_t;
+
+/* True while a measurement is running. Checked by the ISR hooks' callers to keep the idle cost to one load */
+extern volatile bool fad_latency_armed;
+
+/**
+ * @brief Begin a measurement run of FAD_LATENCY_TRIALS trials. Output must already be running.
+ * @param mode FAD_LATENCY_INJECT or FAD_LATENCY_LOOPBACK
+ * @return
+ * 		-ESP_OK if successful
+ * 		-ESP_ERR_INVALID_ARG if mode is FAD_LATENCY_OFF
+ * 		-ESP_ERR_INVALID_STATE if a run is already in progress
+ */
+esp_err_t fad_latency_start(fad_latency_mode_t mode);
+
+/**
+ * @brief Abort a running measurement. The partial report stays available.
+ */
+void fad_latency_stop(void);
+
+/**
+ * @brief Copy out the report of the last (or current) run
+ * @param report [OUT] Destination for the report
+ * @return true if the last run has finished
+ */
+bool fad_latency_get_report(fad_latency_report_t *report);
+
+/**
+ * @brief ISR hook, called after a sample is placed at adc_buffer[adc_pos]. May overwrite it with the marker.
+ * @param adc_pos Position of the sample just taken
+ * @param sample_count Sample clock value of that sample
+ */
+void IRAM_ATTR fad_latency_isr_input(uint16_t adc_pos, uint32_t sample_count);
+
+/**
+ * @brief Output hook, called when dac_buffer[dac_pos] is handed to the DAC or to the BT stream.
+ * @param dac_pos Position of the value being output
+ * @param sample_count Sample clock value at output
+ */
+void IRAM_ATTR fad_latency_isr_output(uint16_t dac_pos, uint32_t sample_count);
+
+/**
+ * @brief Called in the app task right before the algorithm runs on a block
+ * @param in_buff The ADC buffer
+ * @param in_pos Block position, as given to the algorithm
+ * @param len Number of input values the algorithm reads
+ * @param block_count Sample clock value when the ISR signalled the block
+ */
+void fad_latency_algo_begin(uint16_t *in_buff, uint16_t in_pos, int len, uint32_t block_count);
+
+/**
+ * @brief Called in the app task right after the algorithm has written its output block
+ * @param out_buff The DAC buffer
+ * @param out_pos Block position, as given to the algorithm
+ * @param len Number of output values the algorithm wrote
+ */
+void fad_latency_algo_end(uint8_t *out_buff, uint16_t out_pos, int len);
+
+#endif
@@ -0,0 +1,95 @@
+/**
+ * fad_load.h
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * CPU load meter. Every FAD_LOAD_PERIOD_MS it reads the FreeRTOS run-time counters of all tasks and
+ * turns the time each one ran in the window into a share of one core. The idle tasks give each core's
+ * headroom; the rest is summed into groups by task name (app task, audio tasks, Bluedroid, the timer
+ * service task that polls the GPIOs). The sample ISR and the algorithm are not tasks, so their time is
+ * counted in cycles by the ISR and by main.c; it is also part of the time of the task they ran in.
+ * The last FAD_LOAD_HISTORY windows are kept.
+ *
+ * Needs CONFIG_FREERTOS_USE_TRACE_FACILITY and CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS (on in sdkconfig).
+ * On the host the counters measure host time, so loads there say how hard the host works per
+ * simulated second, not how an ESP32 would fare.
+ */
+
+#ifndef _FAD_LOAD_H_
+#define _FAD_LOAD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "fad_defs.h"
+
+/* What the load is split into */
+typedef enum {
+	FAD_LOAD_ISR,		// Sample ISR, from the cycles it passes to fad_load_isr_cycles
+	FAD_LOAD_ALGO,		// The algorithm, timed around each block in main.c. Part of FAD_LOAD_APP
+	FAD_LOAD_APP,		// App task: every event callback
+	FAD_LOAD_AUDIO,		// alarm_task, the mic, I2S output and replay tasks
+	FAD_LOAD_BT,		// Bluedroid and the BT controller
+	FAD_LOAD_TIMER,		// FreeRTOS timer service: GPIO polling and other software timers
+	FAD_LOAD_OTHER,		// Every other task that is not idle
+	FAD_LOAD_GROUP_MAX,
+} fad_load_group_t;
+
+/* One window. Loads are in tenths of a percent of one core */
+typedef struct {
+	uint32_t time_ms;							// When the window ended, ms since boot
+	uint32_t window_us;							// Length of the window
+	uint16_t idle[portNUM_PROCESSORS];			// Idle time of each core
+	uint16_t group[FAD_LOAD_GROUP_MAX];			// Busy time of each group
+} fad_load_sample_t;
+
+/**
+ * @brief Start sampling every FAD_LOAD_PERIOD_MS. Does nothing with FAD_LOAD_ENABLE 0.
+ * @return
+ * 		-ESP_OK if successful
+ * 		-ESP_FAIL if the sampling timer could not be created
+ */
+esp_err_t fad_load_init(void);
+
+/**
+ * @brief Charge time measured in CPU cycles to a group. For groups that are not tasks: FAD_LOAD_ALGO.
+ * @param group The group
+ * @param cycles Cycles spent, from fad_perf_cycles
+ */
+void fad_load_add(fad_load_group_t group, uint32_t cycles);
+
+/**
+ * @brief Charge the cycles of one sample ISR run to FAD_LOAD_ISR. Only the sample ISR may call it.
+ * @param cycles Cycles spent, from fad_perf_cycles
+ */
+void IRAM_ATTR fad_load_isr_cycles(uint32_t cycles);
+
+/**
+ * @brief Close the current window now. Called by the sampling timer
+ */
+void fad_load_sample(void);
+
+/**
+ * @brief Get the latest window
+ * @param sample [OUT] The window
+ * @return false if no window has completed yet
+ */
+bool fad_load_get(fad_load_sample_t *sample);
+
+/**
+ * @brief Copy out the history
+ * @param samples [OUT] Windows, oldest first
+ * @param max Room in samples
+ * @return Number of windows copied
+ */
+int fad_load_history(fad_load_sample_t *samples, int max);
+
+/**
+ * @brief Log the latest window and the average and peak over the history
+ */
+void fad_load_report(void);
+
+#endif
@@ -0,0 +1,65 @@
+/**
+ * fad_mic.h
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Digital microphone input (FAD_INPUT_MIC) on I2S, for a PDM mic or an I2S MEMS mic (FAD_MIC_PDM).
+ * A task collects algorithm blocks from DMA straight into adc_buffer, scales them to the 12-bit
+ * unsigned range of the ADC so the algorithms see the same data either way, and signals each block
+ * with FAD_ADC_BUFFER_READY. The timer keeps pacing the output. With FAD_ADC_CHANNELS 2 the mic is
+ * read as stereo and the second channel fills adc_buffer_ref.
+ *
+ * Unlike the ADC path, where the algorithm reads the ring span behind the newest sample, a mic block
+ * is the span just filled, so the input stage of the latency is the DMA and block fill time only.
+ */
+
+#ifndef _FAD_MIC_H_
+#define _FAD_MIC_H_
+
+#include <stdint.h>
+#include "esp_system.h"
+
+/* Input counters since fad_mic_start */
+typedef struct {
+	uint32_t samples;	 // Frames taken from DMA
+	uint32_t blocks;	 // Blocks signalled to the algorithm
+	uint32_t timeouts; // Reads that returned nothing. The host build polls, so there it counts polls too.
+	uint32_t clipped;	 // Samples outside the 12-bit range after FAD_MIC_GAIN_SHIFT, both channels
+} fad_mic_stats_t;
+
+/**
+ * @brief Install the I2S driver for the mic and create the input task. Safe to call again.
+ * @return
+ * 		-ESP_OK if successful
+ * 		-Error from the I2S driver otherwise
+ */
+esp_err_t fad_mic_init(void);
+
+/**
+ * @brief Start collecting blocks. The timer must already be in FAD_INPUT_MIC mode.
+ * @param read_size Samples per block, the algorithm read size. Must divide ADC_BUFFER_SIZE.
+ * @return
+ * 		-ESP_OK if successful
+ * 		-ESP_ERR_INVALID_ARG if read_size does not fit the buffer
+ */
+esp_err_t fad_mic_start(int read_size);
+
+/**
+ * @brief Stop collecting blocks. A block in progress is dropped.
+ */
+void fad_mic_stop(void);
+
+/**
+ * @brief Copy out the input counters
+ * @param stats [OUT] Destination for the counters
+ */
+void fad_mic_get_stats(fad_mic_stats_t *stats);
+
+/**
+ * @brief Log the input counters
+ */
+void fad_mic_report(void);
+
+#endif
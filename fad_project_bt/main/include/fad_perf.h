@@ -0,0 +1,68 @@
+/**
+ * fad_perf.h
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Cycle-count instrumentation for the sample path. The ISR and the ADC/DAC primitives record
+ * their cost here, and fad_perf_report logs it together with the per-sample cycle budget.
+ */
+
+#ifndef _FAD_PERF_H_
+#define _FAD_PERF_H_
+
+#include <stdint.h>
+#include "esp_system.h"
+
+/* Measured code paths */
+typedef enum {
+	FAD_PERF_ISR,			// Whole sample ISR, entry to exit
+	FAD_PERF_ADC_DRIVER,	// adc1_get_raw
+	FAD_PERF_ADC_FAST,		// Register-level ADC1 read
+	FAD_PERF_DAC_DRIVER,	// dac_output_voltage
+	FAD_PERF_DAC_FAST,		// Register-level DAC write
+	FAD_PERF_PWM,			// Noise shaper and PWM duty write
+	FAD_PERF_ADC_REF,		// Reference channel read in the ISR, pad switch included
+	FAD_PERF_MIC_SPLIT,		// Splitting a chunk of stereo mic frames into the two channel rings
+	FAD_PERF_MAX,
+} fad_perf_counter_t;
+
+/* Running statistics for one code path, in CPU cycles */
+typedef struct {
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t count;
+} fad_perf_stat_t;
+
+/**
+ * @brief Read the CPU cycle counter of the calling core
+ */
+uint32_t IRAM_ATTR fad_perf_cycles(void);
+
+/**
+ * @brief Add one measurement to a counter. Safe from the ISR.
+ * @param counter The measured code path
+ * @param cycles Cycles spent in it
+ */
+void IRAM_ATTR fad_perf_record(fad_perf_counter_t counter, uint32_t cycles);
+
+/**
+ * @brief Copy out the statistics of one counter
+ * @param counter The measured code path
+ * @param stat [OUT] Destination for the statistics
+ */
+void fad_perf_get(fad_perf_counter_t counter, fad_perf_stat_t *stat);
+
+/**
+ * @brief Clear all counters
+ */
+void fad_perf_reset(void);
+
+/**
+ * @brief Log every counter that has measurements, with the ISR load against the sample period
+ */
+void fad_perf_report(void);
+
+#endif
@@ -0,0 +1,88 @@
+/**
+ * fad_power.h
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Power management. While the sample clock runs, an APB lock keeps the timer, ADC and DAC clocks steady
+ * and a no-sleep lock keeps the CPU awake for the ISR; the CPU itself drops to 80 MHz between blocks and
+ * only runs faster while the algorithm holds its CPU lock. Every FAD_POWER_PERIOD_MS a governor picks
+ * that faster clock (80, 160 or 240 MHz) from the load windows of fad_load.h: the lowest one that keeps
+ * the busiest core under FAD_POWER_LOAD_LIMIT. The no-sleep lock is held for as long as the sample clock
+ * runs, so with FAD_POWER_LIGHT_SLEEP set the chip only light-sleeps while audio is stopped. The console
+ * UART is then its wakeup source (fad_diag.c), and the characters that wake it are lost.
+ * While FAD_PERF_ENABLE or FAD_JITTER_ENABLE is set, whose cycle counts need one clock, the CPU instead
+ * stays at the top clock for as long as the sample clock runs.
+ *
+ * The same windows give an estimate of the current the device draws with each algorithm and so of the
+ * battery life. The estimate uses the datasheet currents of the ESP32 at each clock; measure a board
+ * before trusting it to better than about 20%.
+ *
+ * Needs CONFIG_PM_ENABLE and CONFIG_FREERTOS_USE_TICKLESS_IDLE (on in sdkconfig). Without them
+ * fad_power_init logs a warning and the module only projects battery life at the fixed clock.
+ */
+
+#ifndef _FAD_POWER_H_
+#define _FAD_POWER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_system.h"
+#include "fad_defs.h"
+
+/* What one algorithm is expected to draw, from the windows it has run in */
+typedef struct {
+	uint32_t measured_ms;		// Time the projection is based on; 0 if the algorithm has not run
+	float current_ma;			// Average current of the whole board
+	float hours;				// Runtime on FAD_POWER_BATTERY_MAH
+	uint16_t algo_mhz;			// CPU clock the governor gave the algorithm last
+} fad_power_projection_t;
+
+/**
+ * @brief Configure dynamic frequency scaling and create the locks and the governor timer.
+ * Does nothing with FAD_POWER_ENABLE 0.
+ * @return
+ * 		-ESP_OK if successful, also when power management is not in the build
+ * 		-ESP_FAIL if a lock or the governor timer could not be created
+ */
+esp_err_t fad_power_init(void);
+
+/**
+ * @brief The sample clock starts: hold the clocks and keep the chip awake until fad_power_audio_stop
+ * @param radio true if the output goes over Bluetooth, for the current estimate
+ */
+void fad_power_audio_start(bool radio);
+
+/**
+ * @brief The sample clock stopped: let the clocks drop and the chip sleep
+ */
+void fad_power_audio_stop(void);
+
+/**
+ * @brief Run the CPU at the governor's clock until fad_power_algo_end. Call around each algorithm block.
+ */
+void fad_power_algo_begin(void);
+void fad_power_algo_end(void);
+
+/**
+ * @brief A new algorithm starts. Its clock goes back to the top until the governor has measured it,
+ * and the load from now on counts towards its projection.
+ * @param type The new algorithm
+ */
+void fad_power_set_algo(fad_algo_type_t type);
+
+/**
+ * @brief Get the battery projection of one algorithm
+ * @param type The algorithm
+ * @param projection [OUT] The projection
+ * @return false if the algorithm has not run for a full load window yet
+ */
+bool fad_power_get_projection(fad_algo_type_t type, fad_power_projection_t *projection);
+
+/**
+ * @brief Log the clock settings and the projection of every algorithm that has run
+ */
+void fad_power_report(void);
+
+#endif
@@ -0,0 +1,46 @@
+/**
+ * fad_pwm.h
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Audio output through a PWM or sigma-delta pin (FAD_OUTPUT_PWM), for boards where the DAC is taken.
+ * Samples come in as 16 bit and are requantized to the duty resolution with error-feedback noise
+ * shaping, so the requantization noise moves from the speech band to the top of the audio band.
+ */
+
+#ifndef _FAD_PWM_H_
+#define _FAD_PWM_H_
+
+#include <stdint.h>
+#include "esp_system.h"
+
+/**
+ * @brief Set up the output pin from the FAD_PWM_ settings in fad_defs.h and clear the noise shaper
+ * @return
+ * 		-ESP_OK if successful
+ * 		-Error from the LEDC or sigma-delta driver otherwise
+ */
+esp_err_t fad_pwm_init(void);
+
+/**
+ * @brief Output one 16-bit unsigned sample (midscale 0x8000). Safe from the ISR.
+ * @param sample The sample
+ */
+void IRAM_ATTR fad_pwm_output_sample(uint16_t sample);
+
+/**
+ * @brief Output one 8-bit algorithm output value, like dac_output_value. Safe from the ISR.
+ * @param value Output value, 0 ~ 255
+ */
+void IRAM_ATTR fad_pwm_output_value(uint8_t value);
+
+/**
+ * @brief Time fad_pwm_output_sample, recording FAD_PERF_PWM. Writes midscale only.
+ * Must be called while the sample timer is stopped.
+ * @param iterations Number of writes
+ */
+void fad_pwm_benchmark(int iterations);
+
+#endif
@@ -49,4 +49,30 @@ esp_err_t adc_timer_set_read_size(int adc_read_size);
  */
 esp_err_t adc_timer_set_mode(fad_output_mode_t mode);
 
+/**
+ * @brief Sets where input samples come from. With FAD_INPUT_MIC the timer no longer reads the ADC or
+ * signals blocks; it only paces the output, and fad_mic.c fills adc_buffer. Should not be called if
+ * the timer is running.
+ * @param mode FAD_INPUT_ADC or FAD_INPUT_MIC
+ * @return
+ *      -ESP_OK if successful
+ *      -ESP_FAIL if unsuccessful, timer running
+ */
+esp_err_t adc_timer_set_input_mode(fad_input_mode_t mode);
+
+/**
+ * @brief Get the sample clock, the number of timer interrupts (ADC samples) taken since boot.
+ * Used to timestamp audio events in units of samples. Wraps after 2^32 samples.
+ * @return The current sample count
+ */
+uint32_t adc_timer_get_sample_count(void);
+
+/**
+ * @brief Get the sample rate the timer settings produce in theory. With integer division this is
+ * APB / CLOCK_DIVIDER / ALARM_STEP_SIZE, which is not exactly ALARM_FREQ; with FAD_TIMER_FRACTIONAL_N
+ * it is ALARM_FREQ on average.
+ * @return The configured sample rate in Hz
+ */
+double adc_timer_get_configured_rate(void);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,114 @@
+/**
+ * fad_trace.h
+ * Author: Tim Fair
+ * Organization: Messiah Collaboratory
+ * Date: 10/17/2026
+ *
+ * Description:
+ * Event trace of the audio pipeline. Begin/end, instant and counter events go into a fixed ring of
+ * 12-byte binary records, from the ISR or any task, and the oldest records are overwritten.
+ * fad_trace_dump prints the ring to the console; the host build writes it to a file with -T.
+ * uart_tester/tools/trace_tools.py turns either into Chrome trace JSON for chrome://tracing or Perfetto.
+ *
+ * Format, all values little-endian:
+ *   Header (16 bytes): "FTRC", u8 version, u8 track count, u8 name count, u8 reserved,
+ *                      u32 record count, u32 records overwritten before the oldest one
+ *   Track names, then event names, each NUL-terminated
+ *   Per record:        u32 time in us (wraps), u8 type ('B', 'E', 'I' or 'C'), u8 track, u16 name, i32 value
+ */
+
+#ifndef _FAD_TRACE_H_
+#define _FAD_TRACE_H_
+
+#include <stdint.h>
+#include "esp_system.h"
+#include "fad_defs.h"
+#include "fad_capture.h"
+
+/* Timeline rows, one per execution context */
+typedef enum {
+	FAD_TRACK_ISR,			// Sample ISR
+	FAD_TRACK_ALARM,		// alarm_task, which turns ADC blocks into events
+	FAD_TRACK_MIC,			// Digital mic task
+	FAD_TRACK_APP,			// App task running event callbacks
+	FAD_TRACK_GPIO,			// GPIO polling timer
+	FAD_TRACK_A2DP,			// A2DP source data callback
+	FAD_TRACK_MAX,
+} fad_trace_track_t;
+
+/* Traced events */
+typedef enum {
+	FAD_TRACE_BLOCK_READY,	// Instant: an ADC block is complete. Value: sample clock
+	FAD_TRACE_DISPATCH,		// Begin/end: queueing a block event. Value: ADC position
+	FAD_TRACE_DROP,			// Instant: an event was refused. Value: dispatch class
+	FAD_TRACE_EVENT,		// Begin/end: an event callback. Value: event number
+	FAD_TRACE_ALGO,			// Begin/end: the algorithm on one block. Value: ADC position
+	FAD_TRACE_RT_DEPTH,		// Counter: audio blocks waiting in the real-time queue
+	FAD_TRACE_GPIO_POLL,	// Begin/end: one button and headset poll
+	FAD_TRACE_A2DP_DATA,	// Begin/end: filling an A2DP buffer. Value: bytes asked for
+	FAD_TRACE_MAX,
+} fad_trace_name_t;
+
+/* One record as stored in the ring */
+typedef struct {
+	uint32_t time_us;
+	uint8_t type;
+	uint8_t track;
+	uint16_t name;
+	int32_t value;
+} fad_trace_record_t;
+
+/**
+ * @brief Start recording into the FAD_MEM_TRACE region. Does nothing with FAD_TRACE_ENABLE 0.
+ * @return
+ * 		-ESP_OK if successful
+ * 		-ESP_ERR_NO_MEM if the memory plan has not been reserved (fad_mem_init)
+ */
+esp_err_t fad_trace_init(void);
+
+/**
+ * @brief Add a record to the ring. Safe from the ISR and from any task. Use the wrappers below.
+ */
+void IRAM_ATTR fad_trace_record(uint8_t type, fad_trace_track_t track, fad_trace_name_t name, int32_t value);
+
+static inline void fad_trace_begin(fad_trace_track_t track, fad_trace_name_t name, int32_t value)
+{
+	if (FAD_TRACE_ENABLE)
+		fad_trace_record('B', track, name, value);
+}
+
+static inline void fad_trace_end(fad_trace_track_t track, fad_trace_name_t name)
+{
+	if (FAD_TRACE_ENABLE)
+		fad_trace_record('E', track, name, 0);
+}
+
+static inline void fad_trace_instant(fad_trace_track_t track, fad_trace_name_t name, int32_t value)
+{
+	if (FAD_TRACE_ENABLE)
+		fad_trace_record('I', track, name, value);
+}
+
+static inline void fad_trace_counter(fad_trace_track_t track, fad_trace_name_t name, int32_t value)
+{
+	if (FAD_TRACE_ENABLE)
+		fad_trace_record('C', track, name, value);
+}
+
+/**
+ * @brief Copy the ring, oldest record first, into a store in the format above. Recording pauses meanwhile.
+ * @param dest Store to write into
+ * @return
+ * 		-ESP_OK if successful
+ * 		-ESP_ERR_INVALID_STATE if tracing is not running
+ * 		-ESP_ERR_NO_MEM if dest is too small; dest->len is set to the size needed
+ */
+esp_err_t fad_trace_snapshot(fad_capture_store_t *dest);
+
+/**
+ * @brief Print the ring to stdout as base64 between "FTRC-BEGIN <bytes>" and "FTRC-END" lines.
+ * The ring is copied first, so recording carries on while the dump is printed.
+ */
+void fad_trace_dump(void);
+
+#endif
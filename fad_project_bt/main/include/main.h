@@ -1,6 +1,7 @@
 #include <stdint.h>
 #include "esp_bt_defs.h"
 #include "fad_defs.h"
+#include "fad_capture.h"
 
 /**
  * event enumerations for fad_hdl_stack_evt
@@ -17,6 +18,9 @@ enum {
 	FAD_DAC_BUFFER_READY,
 	FAD_ADC_BUFFER_READY,
 	FAD_ALGO_CHANGED,
+	FAD_LATENCY_START,
+	FAD_CAPTURE_START,
+	FAD_CAPTURE_DONE,
 } stack_evt;
 
 /** 
@@ -41,6 +45,8 @@ typedef union {
 	struct adc_buffer_rdy_param {
 		uint16_t adc_pos;
 		uint16_t dac_pos;
+		uint32_t sample_count;	/* Sample clock value when the block was signalled */
+		bool replay;			/* True if the block comes from a capture replay, not the ADC */
 	} adc_buff_pos_info;
 
 	/* FAD_ALGO_CHANGE */
@@ -58,8 +64,23 @@ typedef union {
 		int vol_change;	// The new volume
 	} vol_change_info;
 
+	/* FAD_LATENCY_START */
+	struct fad_latency_start_param_t {
+		fad_latency_mode_t mode;	// FAD_LATENCY_INJECT or FAD_LATENCY_LOOPBACK
+	} latency_start;
+
+	/* FAD_CAPTURE_START, FAD_CAPTURE_DONE */
+	struct fad_capture_param_t {
+		fad_capture_mode_t mode;		// FAD_CAPTURE_RECORD or FAD_CAPTURE_REPLAY
+		fad_capture_store_t *source;	// Capture to replay; unused for a recording
+		fad_capture_store_t *dest;		// Store to record into, or NULL to use the RAM buffer (replay: no re-recording)
+	} capture;
+
 } fad_main_cb_param_t;
 
+/* Main stack events are dispatched often, from the audio path too, so their parameters must travel in the message */
+_Static_assert(sizeof(fad_main_cb_param_t) <= FAD_APP_INLINE_PARAM_SIZE, "fad_main_cb_param_t must fit FAD_APP_INLINE_PARAM_SIZE");
+
 /**
  * @brief Event handler for general tasks. Includes initializing ADC and event queues/tasks
  * @param evt A stack_evt enum
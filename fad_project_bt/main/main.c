@@ -19,6 +19,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/timers.h"	
+#include "freertos/semphr.h"
 #include "nvs.h"
 #include "nvs_flash.h"
 #include "esp_system.h"
@@ -28,11 +29,26 @@
 #include "fad_app_core.h"
 #include "fad_adc.h"
 #include "fad_dac.h"
+#include "fad_pwm.h"
+#include "fad_i2s.h"
+#include "fad_mic.h"
 #include "fad_gpio.h"
 #include "fad_timer.h"
 #include "fad_bt_main.h"
 #include "fad_bt_gap.h"
 #include "fad_gpio.h"
+#include "fad_latency.h"
+#include "fad_perf.h"
+#include "fad_jitter.h"
+#include "fad_capture.h"
+#include "fad_trace.h"
+#include "fad_log.h"
+#include "fad_mem.h"
+#include "fad_load.h"
+#include "fad_power.h"
+#include "fad_bt_buffer.h"
+#include "fad_bt_telemetry.h"
+#include "fad_diag.h"
 
 #include "algo_template.h"
 #include "algo_delay.h"
@@ -47,6 +63,34 @@
 /* Determines whether program starts with test event. 0 for no test event, 1 for test event */
 #define TEST_MODE 0
 
+/* Wired headset output. FAD_OUTPUT_DAC for the internal DAC, FAD_OUTPUT_PWM for the PWM / sigma-delta pin,
+ * FAD_OUTPUT_I2S for an external codec */
+#define WIRED_OUTPUT_MODE FAD_OUTPUT_DAC
+
+/* Audio input. FAD_INPUT_ADC for the analog mic on the ADC, FAD_INPUT_MIC for a PDM / I2S digital mic */
+#define INPUT_MODE FAD_INPUT_ADC
+
+/* Runs a latency measurement once output starts. FAD_LATENCY_OFF, FAD_LATENCY_INJECT or FAD_LATENCY_LOOPBACK */
+#define LATENCY_MODE FAD_LATENCY_OFF
+
+/* Records the algorithm input once output starts, until the RAM buffer is full, then dumps it to the console.
+ * FAD_CAPTURE_OFF, FAD_CAPTURE_RECORD, or FAD_CAPTURE_REPLAY to also replay the recording and check the output matches */
+#define CAPTURE_MODE FAD_CAPTURE_OFF
+
+/* Dumps the event trace to the console with the first instrumentation report. 0 or 1; needs FAD_TRACE_ENABLE */
+#define TRACE_MODE 0
+
+/* Prints the memory footprint as CSV with each instrumentation report, for uart_tester/tools/mem_tools.py. 0 or 1 */
+#define MEMORY_MODE 0
+
+/* Logs the instrumentation reports (perf, jitter, load, power, dispatch, BT) every FAD_PERF_REPORT_BLOCKS algorithm
+ * blocks. 0 or 1. A burst is ~2 KB, ~200 ms of console at 115200 baud, so the reports print from their own task at
+ * the lowest priority rather than the app task that handles the audio blocks */
+#define REPORT_MODE 0
+
+#define REPORT_TASK_STACK 4096
+#define REPORT_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+
 /*Initiliasing variables for bluetooth address*/
 static char s_nvs_addr_key[15] = "NVS_PEER_ADDR";
 static char s_nvs_algo_key[15] = "NVS_ALGO_INFO";
@@ -56,15 +100,46 @@ static esp_bd_addr_t s_peer_bda = {0, 0, 0, 0, 0, 0};
 static algo_func_t s_algo_func = algo_masking; //was algo_template Change this to test <<<<<<<<<<<<<<
 static int s_algo_read_size = 512;
 static algo_deinit_func_t s_algo_deinit_func = algo_delay_deinit;
+static fad_algo_type_t s_algo_type = FAD_ALGO_MASKING;
+static fad_algo_mode_t s_algo_mode = FAD_ALGO_MODE_1;
+
+/* Capture buffer for CAPTURE_MODE, the FAD_MEM_CAPTURE region */
+static fad_capture_store_t s_capture_store = {NULL, 0, 0};
+
+/* Output the boot flow chose; the BT reports only apply to FAD_OUTPUT_BT */
+static fad_output_mode_t s_output_mode = WIRED_OUTPUT_MODE;
 
 /* Testing vars */
 static int s_adc_calls = 0;
+static bool s_trace_dumped = false;
+static SemaphoreHandle_t s_report_sem = NULL;
+
+static void report_task(void *params);
 
 /* Called on ESP32 startup */ //First file to run
 void app_main(void)
 {
+	/* Reserve every audio buffer up front; the audio path never allocates after this */
+	fad_mem_init(CAPTURE_MODE != FAD_CAPTURE_OFF ? FAD_MEM_BIT(FAD_MEM_CAPTURE) : 0);
+	fad_mem_report();
+	fad_trace_init(); // before the rest, so the trace covers start-up
+	fad_log_init();
+
 	/* create application task. Used to send events to event handlers */
 	fad_app_task_startup();
+	fad_load_init(); // after the app task, so its first window has every long-lived task
+	fad_power_init();
+	fad_diag_init();
+
+	if (REPORT_MODE || TRACE_MODE || MEMORY_MODE)
+	{
+		TaskHandle_t report_task_handle = NULL;
+		s_report_sem = xSemaphoreCreateBinary();
+		if (s_report_sem == NULL || xTaskCreate(report_task, "Report_Task", REPORT_TASK_STACK, NULL, REPORT_TASK_PRIORITY, &report_task_handle) != pdPASS)
+			ESP_LOGW(FAD_TAG, "Couldn't start the report task");
+		else
+			fad_mem_track_task(report_task_handle, "Report_Task", REPORT_TASK_STACK);
+	}
 
 	if (TEST_MODE)
 	{
@@ -89,6 +164,42 @@ void parse_error(esp_err_t err)
 	}
 }
 
+/**
+ * @brief FreeRTOS task that logs the instrumentation reports each time the audio path asks for them. A request
+ * made while a report is still printing is merged into it.
+ * @param params [in] required as part of the task function definition
+ */
+static void report_task(void *params)
+{
+	for (;;)
+	{
+		xSemaphoreTake(s_report_sem, portMAX_DELAY);
+		if (REPORT_MODE)
+		{
+			if (FAD_PERF_ENABLE) fad_perf_report();
+			if (FAD_JITTER_ENABLE) fad_jitter_report();
+			if (WIRED_OUTPUT_MODE == FAD_OUTPUT_I2S) fad_i2s_report();
+			if (s_output_mode == FAD_OUTPUT_BT)
+			{
+				fad_bt_buffer_report();
+				fad_bt_report();
+				fad_bt_telemetry_report();
+			}
+			if (INPUT_MODE == FAD_INPUT_MIC) fad_mic_report();
+			fad_app_report();
+			fad_log_report();
+			if (FAD_LOAD_ENABLE) fad_load_report();
+			if (FAD_POWER_ENABLE) fad_power_report();
+		}
+		if (MEMORY_MODE) fad_mem_dump(stdout);
+		if (TRACE_MODE && !s_trace_dumped)
+		{
+			fad_trace_dump();
+			s_trace_dumped = true;
+		}
+	}
+}
+
 /*Prints the bluetooth address*/
 void print_global_peer_addr()
 {
@@ -165,6 +276,10 @@ void get_addr_in_nvs()
 void handle_algo_change(fad_algo_type_t type, fad_algo_mode_t mode)
 {
 	s_algo_deinit_func();
+	fad_mem_algo_reset(type); // the new algorithm gets the whole scratch region
+	fad_power_set_algo(type);
+	s_algo_type = type;
+	s_algo_mode = mode;
 
 	switch (type)
 	{
@@ -221,12 +336,48 @@ void handle_algo_change(fad_algo_type_t type, fad_algo_mode_t mode)
 		s_algo_deinit_func = algo_delay_deinit;
 		s_algo_read_size = 512;
 		algo_delay_init();
+		break;
 	default:
 		ESP_LOGI(FAD_TAG, "Unhandled algo function %d", type);
 		break;
 	}
 }
 
+/* Initialize the audio path without starting it. Runs once: at boot while Bluetooth comes up, or when the
+ * first output is ready. A reconnect only restarts the sample clock */
+static esp_err_t audio_prepare(void)
+{
+	static bool s_prepared = false;
+	esp_err_t err;
+	if (s_prepared)
+		return ESP_OK;
+	s_prepared = true;
+
+	/* Initialize physical audio measurements */
+	err = adc_timer_init();
+	err = adc_init();
+	if (WIRED_OUTPUT_MODE == FAD_OUTPUT_DAC)
+		err = dac_init();
+	if (WIRED_OUTPUT_MODE == FAD_OUTPUT_PWM)
+		err = fad_pwm_init();
+	if (WIRED_OUTPUT_MODE == FAD_OUTPUT_I2S)
+		err = fad_i2s_init();
+	if (INPUT_MODE == FAD_INPUT_MIC)
+		err = fad_mic_init();
+	err = adc_timer_set_read_size(s_algo_read_size);
+	adc_timer_set_input_mode(INPUT_MODE);
+	if (FAD_PERF_ENABLE)
+	{
+		adc_benchmark(FAD_PERF_BENCH_ITERATIONS);
+		if (WIRED_OUTPUT_MODE == FAD_OUTPUT_DAC)
+			dac_benchmark(FAD_PERF_BENCH_ITERATIONS);
+		if (WIRED_OUTPUT_MODE == FAD_OUTPUT_PWM)
+			fad_pwm_benchmark(FAD_PERF_BENCH_ITERATIONS);
+		fad_perf_report();
+	}
+	return err;
+}
+
 /*Main function to determine the tasks*/
 void fad_main_stack_evt_handler(uint16_t evt, void *params)
 {
@@ -242,6 +393,12 @@ void fad_main_stack_evt_handler(uint16_t evt, void *params)
 		err = adc_init();
 		err = dac_init();
 		err = adc_timer_set_read_size(s_algo_read_size);
+		if (FAD_PERF_ENABLE)
+		{
+			adc_benchmark(FAD_PERF_BENCH_ITERATIONS);
+			dac_benchmark(FAD_PERF_BENCH_ITERATIONS);
+			fad_perf_report();
+		}
 		
 		parse_error(err);
 		adc_timer_start();
@@ -271,33 +428,22 @@ void fad_main_stack_evt_handler(uint16_t evt, void *params)
 
 		if (wired_output_exists) //Checks if there is aux connected first
 		{
-			adc_timer_set_mode(FAD_OUTPUT_DAC);
+			adc_timer_set_mode(WIRED_OUTPUT_MODE);
+			s_output_mode = WIRED_OUTPUT_MODE;
 			fad_app_work_dispatch(fad_main_stack_evt_handler, FAD_OUTPUT_READY, NULL, 0, NULL);
 			break;
 		}
 
-		// If no headphones connected, set up BT
-
+		// If no headphones connected, set up BT. The controller comes up on its own task while the audio path
+		// is initialized here, and connects to the stored device, if any, as soon as it is up
 		adc_timer_set_mode(FAD_OUTPUT_BT);
-		fad_bt_init();
-
-		// Check if there was a valid stored BDA address, skip gap if so
+		s_output_mode = FAD_OUTPUT_BT;
 		if (s_peer_bda[0] != 0)
-		{
 			ESP_LOGI(FAD_TAG, "Stored device found, connecting...");
-
-			fad_main_cb_param_t p;
-			p.addr_found.from_nvs = true;
-
-			fad_app_work_dispatch(fad_main_stack_evt_handler, FAD_BT_ADDR_FOUND, (void *)&p, sizeof(fad_main_cb_param_t), NULL);
-			break;
-		}
 		else
-		{
-			ESP_LOGI(FAD_TAG, "No device found. Waiting for user to start discovery.");
-			 fad_app_work_dispatch(fad_main_stack_evt_handler, FAD_DISC_START, NULL, 0, NULL);
-		}
-
+			ESP_LOGI(FAD_TAG, "No device found. Discovery starts once the controller is up.");
+		parse_error(fad_bt_start(s_peer_bda[0] != 0 ? s_peer_bda : NULL));
+		parse_error(audio_prepare());
 		break;
 
 	case FAD_DISC_START: // No stored address, so initialize and begin gap search
@@ -327,16 +473,84 @@ void fad_main_stack_evt_handler(uint16_t evt, void *params)
 
 	case FAD_OUTPUT_READY: // Connection was successful. Prepare for transmission of data
 		ESP_LOGI(FAD_TAG, "Connected to a target device. Initializing output...");
-		/* Initialize physical audio measurements */
-		err = adc_timer_init();
-		err = adc_init();
-		err = dac_init();
-		err = adc_timer_set_read_size(s_algo_read_size);
-		parse_error(err);
+		parse_error(audio_prepare());
 		adc_timer_start();
+		if (WIRED_OUTPUT_MODE == FAD_OUTPUT_I2S)
+			fad_i2s_start();
+		if (INPUT_MODE == FAD_INPUT_MIC)
+			parse_error(fad_mic_start(s_algo_read_size));
+
+		if (LATENCY_MODE != FAD_LATENCY_OFF)
+		{
+			fad_main_cb_param_t lat_p;
+			lat_p.latency_start.mode = LATENCY_MODE;
+			fad_app_work_dispatch_class(FAD_APP_CLASS_BACKGROUND, fad_main_stack_evt_handler, FAD_LATENCY_START, (void *)&lat_p, sizeof(fad_main_cb_param_t), NULL);
+		}
+
+		if (CAPTURE_MODE != FAD_CAPTURE_OFF)
+		{
+			fad_main_cb_param_t cap_p = {
+				.capture.mode = FAD_CAPTURE_RECORD,
+				.capture.dest = NULL,
+			};
+			fad_app_work_dispatch_class(FAD_APP_CLASS_BACKGROUND, fad_main_stack_evt_handler, FAD_CAPTURE_START, (void *)&cap_p, sizeof(fad_main_cb_param_t), NULL);
+		}
+		break;
+
+	case FAD_LATENCY_START: // Measure mic-to-ear latency. Report is logged when all trials finish.
+		err = fad_latency_start(p->latency_start.mode);
+		parse_error(err);
+		break;
+
+	case FAD_CAPTURE_START: // Record the algorithm input, or replay a recording through the algorithm
+		if (p->capture.mode == FAD_CAPTURE_RECORD)
+		{
+			fad_capture_store_t *dest = p->capture.dest;
+			if (dest == NULL)
+			{
+				if (s_capture_store.data == NULL)
+					s_capture_store.data = fad_mem_region(FAD_MEM_CAPTURE, &s_capture_store.size);
+				dest = &s_capture_store;
+			}
+			handle_algo_change(s_algo_type, s_algo_mode); // Fresh algorithm state, so a replay starts from the same point
+			err = fad_capture_record_start(dest, s_algo_type, s_algo_mode, s_algo_read_size);
+		}
+		else
+		{
+			fad_capture_header_t header;
+			err = fad_capture_replay_start(p->capture.source, p->capture.dest, &header);
+			if (err == ESP_OK)
+			{
+				handle_algo_change(header.algo_type, header.algo_mode);
+				if (header.block_len != s_algo_read_size)
+					ESP_LOGW(FAD_TAG, "Capture blocks are %d samples, algorithm reads %d", header.block_len, s_algo_read_size);
+			}
+		}
+		parse_error(err);
+		break;
+
+	case FAD_CAPTURE_DONE: // A recording filled its store or a replay reached the end
+		fad_capture_report();
+		if (p->capture.mode == FAD_CAPTURE_RECORD && p->capture.dest == &s_capture_store)
+		{
+			fad_capture_dump(&s_capture_store);
+			if (CAPTURE_MODE == FAD_CAPTURE_REPLAY)
+			{
+				fad_main_cb_param_t cap_p = {
+					.capture.mode = FAD_CAPTURE_REPLAY,
+					.capture.source = &s_capture_store,
+					.capture.dest = NULL,
+				};
+				fad_app_work_dispatch_class(FAD_APP_CLASS_BACKGROUND, fad_main_stack_evt_handler, FAD_CAPTURE_START, (void *)&cap_p, sizeof(fad_main_cb_param_t), NULL);
+			}
+		}
 		break;
 
 	case FAD_OUTPUT_DISCONNECT: // Disconnected from output device, halt adc and timer, etc.
+		fad_latency_stop();
+		fad_capture_stop();
+		fad_i2s_stop();
+		fad_mic_stop();
 		adc_timer_stop();
 		break;
 
@@ -352,7 +566,42 @@ void fad_main_stack_evt_handler(uint16_t evt, void *params)
 
 	case FAD_ADC_BUFFER_READY:;
 		struct adc_buffer_rdy_param buff = p->adc_buff_pos_info;
-		s_algo_func(adc_buffer, dac_buffer, buff.adc_pos, buff.dac_pos, MULTISAMPLES);  //Send input values to algorithms
+		if (fad_capture_active)
+		{
+			/* The algorithm reads a copy of the block, taken after any latency impulse is injected */
+			if (!buff.replay)
+				fad_latency_algo_begin(adc_buffer, buff.adc_pos, s_algo_read_size, buff.sample_count);
+			const uint16_t *ref_block;
+			uint16_t *block = fad_capture_block_begin(adc_buffer, adc_buffer_ref, buff.adc_pos, s_algo_read_size,
+													  buff.sample_count, buff.dac_pos, buff.replay, &ref_block);
+			if (block == NULL)
+				break;
+			fad_trace_begin(FAD_TRACK_APP, FAD_TRACE_ALGO, buff.adc_pos);
+			fad_power_algo_begin();
+			uint32_t algo_start = fad_perf_cycles();
+			s_algo_func(block, ref_block, dac_buffer, 0, buff.dac_pos, MULTISAMPLES);
+			fad_load_add(FAD_LOAD_ALGO, fad_perf_cycles() - algo_start);
+			fad_power_algo_end();
+			fad_trace_end(FAD_TRACK_APP, FAD_TRACE_ALGO);
+			if (!buff.replay)
+				fad_latency_algo_end(dac_buffer, buff.dac_pos, s_algo_read_size / MULTISAMPLES);
+			fad_capture_block_end(dac_buffer + buff.dac_pos, s_algo_read_size / MULTISAMPLES);
+			break;
+		}
+		if (buff.replay)
+			break; // Left in the queue after the replay was stopped
+
+		fad_latency_algo_begin(adc_buffer, buff.adc_pos, s_algo_read_size, buff.sample_count);
+		fad_trace_begin(FAD_TRACK_APP, FAD_TRACE_ALGO, buff.adc_pos);
+		fad_power_algo_begin();
+		uint32_t algo_start = fad_perf_cycles();
+		s_algo_func(adc_buffer, adc_buffer_ref, dac_buffer, buff.adc_pos, buff.dac_pos, MULTISAMPLES);  //Send input values to algorithms
+		fad_load_add(FAD_LOAD_ALGO, fad_perf_cycles() - algo_start);
+		fad_power_algo_end();
+		fad_trace_end(FAD_TRACK_APP, FAD_TRACE_ALGO);
+		fad_latency_algo_end(dac_buffer, buff.dac_pos, s_algo_read_size / MULTISAMPLES);
+		if (s_report_sem != NULL && ++s_adc_calls % FAD_PERF_REPORT_BLOCKS == 0)
+			xSemaphoreGive(s_report_sem); // report_task prints; never wait on the console here
 		//ESP_LOGI(FAD_TAG, "Dac buffer: %d", dac_buffer[100]);
 		//if(++s_adc_calls % 128 == 0);
 		 	//ESP_LOGI(FAD_TAG, "ADC Calls: %d", s_adc_calls);
@@ -0,0 +1,142 @@
+# bt_tools.py
+# Author: Tim Fair
+#
+# Reads the A2DP telemetry dumps of fad_bt_telemetry.c: CSV (section,name,value) between FBT-BEGIN <rows> and
+# FBT-END lines, printed by the "bt" command of the diagnostics console (fad_diag.h). Asks a running device for one
+# over its console port, pulls one out of a saved log, and prints it as a summary with the histograms drawn.
+# The query needs pyserial; the rest only uses the standard library.
+#
+# python -m tools.bt_tools query COM5 [out.csv]
+# python -m tools.bt_tools extract monitor.log out.csv
+# python -m tools.bt_tools info out.csv
+#
+import csv
+import sys
+import time
+
+
+class BtError(Exception):
+    pass
+
+
+def extract_dump(log_text):
+    '''Returns the CSV text of the last FBT-BEGIN ... FBT-END dump in a console log'''
+    lines = log_text.splitlines()
+    begin = None
+    for i, line in enumerate(lines):
+        if line.strip().startswith('FBT-BEGIN'):
+            begin = i
+    if begin is None:
+        raise BtError('no FBT-BEGIN line in the log')
+
+    body = []
+    for line in lines[begin + 1:]:
+        line = line.strip()
+        if line == 'FBT-END':
+            break
+        body.append(line)
+    else:
+        raise BtError('dump has no FBT-END line')
+
+    expected = int(lines[begin].split()[1])
+    if len(body) != expected + 1:
+        raise BtError('dump holds %d rows, header says %d' % (len(body) - 1, expected))
+    return '\n'.join(body)
+
+
+def parse(text):
+    '''Returns {section: {name: value}} from the CSV of a dump; histogram sections are keyed by bin start'''
+    if 'FBT-BEGIN' in text:
+        text = extract_dump(text)
+    sections = {}
+    for row in csv.DictReader(text.splitlines()):
+        try:
+            value = float(row['value'])
+            if value.is_integer():
+                value = int(value)
+            name = int(row['name']) if row['section'] in ('interval_us', 'len') else row['name']
+        except (KeyError, TypeError, ValueError):
+            raise BtError('not a telemetry dump')
+        sections.setdefault(row['section'], {})[name] = value
+    return sections
+
+
+def query(port, timeout_s=5.0):
+    '''Sends "bt" to a device on a serial port and returns the text of its answer'''
+    import serial
+    with serial.Serial(port, 115200, timeout=0.2) as ser:
+        ser.reset_input_buffer()
+        ser.write(b'bt\r\n')
+        text = ''
+        deadline = time.time() + timeout_s
+        while time.time() < deadline:
+            text += ser.read(4096).decode('ascii', errors='replace')
+            if 'FBT-END' in text:
+                return extract_dump(text)
+    raise BtError('no answer from %s within %.0f s' % (port, timeout_s))
+
+
+def draw(title, hist, unit):
+    if not hist:
+        return
+    print(title)
+    peak = max(hist.values())
+    for start in sorted(hist):
+        print('  %6d %-3s %8d  %s' % (start, unit, hist[start], '#' * max(1, 40 * hist[start] // peak)))
+
+
+def print_info(s):
+    cb = s.get('callback', {})
+    buf = s.get('buffer', {})
+    link = s.get('link', {})
+    stream = s.get('stream', {})
+    count = cb.get('count', 0)
+    elapsed = cb.get('elapsed_ms', 0)
+
+    print('%d callbacks in %.1f s, %.1f ms apart on average (%.1f-%.1f ms), %d-%d bytes, %.1f kB/s'
+          % (count, elapsed / 1000.0, elapsed / float(count) if count else 0, cb.get('interval_min_us', 0) / 1000.0,
+             cb.get('interval_max_us', 0) / 1000.0, cb.get('len_min', 0), cb.get('len_max', 0),
+             cb.get('bytes_per_s', 0) / 1000.0))
+    if stream.get('hz'):
+        print('SBC stream %d Hz, %.0f kbps' % (stream['hz'], stream.get('bitrate', 0) / 1000.0))
+    draw('Time between callbacks:', s.get('interval_us', {}), 'us')
+    draw('Bytes asked for:', s.get('len', {}), 'B')
+    print('Jitter buffer: fill %s (avg %s, %s-%s) of target %s, PCM %s frames ready'
+          % (buf.get('fill'), buf.get('fill_avg'), buf.get('fill_min'), buf.get('fill_max'), buf.get('target'),
+             buf.get('pcm_fill')))
+    print('  %s played, %s concealed, %s underruns, %s low, %s dropped, %s overflows, %s frames short, %+.1f ppm'
+          % (buf.get('played'), buf.get('concealed'), buf.get('underruns'), buf.get('lows'), buf.get('dropped'),
+             buf.get('overflows'), buf.get('short_frames'), buf.get('correction_ppm', 0)))
+    print('Link %s: %s made, %s lost, RSSI delta %s dB (%s..%s over %s reads)'
+          % ('up' if link.get('up') else 'down', link.get('links'), link.get('losses'), link.get('rssi'),
+             link.get('rssi_min'), link.get('rssi_max'), link.get('rssi_reads')))
+
+
+def main(argv):
+    cmd = argv[1] if len(argv) > 2 else None
+    try:
+        if cmd == 'query' and len(argv) in (3, 4):
+            text = query(argv[2])
+            if len(argv) == 4:
+                with open(argv[3], 'w') as f:
+                    f.write(text + '\n')
+            print_info(parse(text))
+        elif cmd == 'extract' and len(argv) == 4:
+            with open(argv[2], 'r', errors='replace') as f:
+                text = extract_dump(f.read())
+            with open(argv[3], 'w') as f:
+                f.write(text + '\n')
+        elif cmd == 'info' and len(argv) == 3:
+            with open(argv[2], 'r', errors='replace') as f:
+                print_info(parse(f.read()))
+        else:
+            print('usage: bt_tools.py query PORT [OUT.csv] | extract LOG OUT.csv | info FILE')
+            return 2
+    except (BtError, IOError) as e:
+        print('error: %s' % e)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,227 @@
+# capture_tools.py
+# Author: Tim Fair
+#
+# Reads the capture files written by fad_capture.c (see fad_capture.h for the format).
+# Pulls a capture out of a console log dump, prints a summary, exports the input and output
+# to WAV files, and compares the outputs of two captures block by block.
+# Only uses the standard library, so it runs without the virtual environment.
+#
+# python -m tools.capture_tools extract monitor.log out.fadc
+# python -m tools.capture_tools info out.fadc
+# python -m tools.capture_tools wav out.fadc input.wav [output.wav]
+# python -m tools.capture_tools compare a.fadc b.fadc
+#
+import base64
+import struct
+import sys
+import wave
+
+HEADER = struct.Struct('<4sBBHIBBBB')
+RECORD = struct.Struct('<HHIHH')
+RECORD_SYNC = 0xFAD0
+FLAG_OUTPUT = 0x01
+FLAG_REF = 0x02
+
+ALGO_NAMES = ['delay', 'freq_shift', 'masking', 'template', 'white']
+
+
+class CaptureError(Exception):
+    pass
+
+
+class Block(object):
+    def __init__(self, sample_clock, adc_pos, dac_pos, samples, ref, output):
+        self.sample_clock = sample_clock
+        self.adc_pos = adc_pos
+        self.dac_pos = dac_pos
+        self.samples = samples
+        self.ref = ref
+        self.output = output
+
+
+class Capture(object):
+    def __init__(self, data):
+        if len(data) < HEADER.size:
+            raise CaptureError('too short for a header')
+        (magic, version, flags, self.block_len, self.sample_rate, self.adc_bits,
+         self.multisamples, self.algo_type, self.algo_mode) = HEADER.unpack_from(data)
+        if magic != b'FADC' or version not in (1, 2):
+            raise CaptureError('not a version 1 or 2 capture')
+        self.has_output = bool(flags & FLAG_OUTPUT)
+        self.has_ref = version >= 2 and bool(flags & FLAG_REF)
+        self.blocks = []
+        self.truncated = False
+
+        pos = HEADER.size
+        while pos + RECORD.size <= len(data):
+            sync, length, clock, adc_pos, dac_pos = RECORD.unpack_from(data, pos)
+            out_len = length // self.multisamples if self.has_output else 0
+            packed = packed_size(length)
+            end = pos + RECORD.size + packed * (2 if self.has_ref else 1) + out_len
+            if sync != RECORD_SYNC or end > len(data):
+                self.truncated = True
+                break
+            samples_at = pos + RECORD.size
+            samples = unpack12(data[samples_at:samples_at + packed], length)
+            ref = unpack12(data[samples_at + packed:samples_at + 2 * packed], length) if self.has_ref else None
+            output = bytes(data[end - out_len:end])
+            self.blocks.append(Block(clock, adc_pos, dac_pos, samples, ref, output))
+            pos = end
+        if pos != len(data):
+            self.truncated = True
+
+    @classmethod
+    def load(cls, path):
+        with open(path, 'rb') as f:
+            return cls(f.read())
+
+    def algo_name(self):
+        if self.algo_type < len(ALGO_NAMES):
+            return ALGO_NAMES[self.algo_type]
+        return str(self.algo_type)
+
+    def input_samples(self):
+        return [s for b in self.blocks for s in b.samples]
+
+    def ref_samples(self):
+        return [s for b in self.blocks for s in b.ref] if self.has_ref else None
+
+    def output_samples(self):
+        return b''.join(b.output for b in self.blocks)
+
+    def gaps(self):
+        '''Blocks whose sample clock does not follow on from the previous block'''
+        gaps = 0
+        for prev, cur in zip(self.blocks, self.blocks[1:]):
+            if (cur.sample_clock - prev.sample_clock) & 0xffffffff != len(prev.samples):
+                gaps += 1
+        return gaps
+
+
+def packed_size(length):
+    return (length // 2) * 3 + (length % 2) * 2
+
+
+def unpack12(data, length):
+    '''Two 12-bit samples in three bytes; an odd last sample takes two'''
+    out = []
+    i = 0
+    while len(out) + 1 < length:
+        out.append(data[i] | ((data[i + 1] & 0x0f) << 8))
+        out.append((data[i + 1] >> 4) | (data[i + 2] << 4))
+        i += 3
+    if len(out) < length:
+        out.append((data[i] | (data[i + 1] << 8)) & 0x0fff)
+    return out
+
+
+def extract_dump(log_text, marker='FADC'):
+    '''Returns the bytes of the last <marker>-BEGIN ... <marker>-END dump in a console log'''
+    lines = log_text.splitlines()
+    begin = None
+    for i, line in enumerate(lines):
+        if line.strip().startswith(marker + '-BEGIN'):
+            begin = i
+    if begin is None:
+        raise CaptureError('no %s-BEGIN line in the log' % marker)
+
+    expected = int(lines[begin].split()[1])
+    encoded = []
+    for line in lines[begin + 1:]:
+        line = line.strip()
+        if line == marker + '-END':
+            break
+        encoded.append(line)
+    else:
+        raise CaptureError('dump has no %s-END line' % marker)
+
+    data = base64.b64decode(''.join(encoded))
+    if len(data) != expected:
+        raise CaptureError('dump holds %d bytes, header says %d' % (len(data), expected))
+    return data
+
+
+def write_wav(path, rate, width, frames, channels=1):
+    with wave.open(path, 'wb') as w:
+        w.setnchannels(channels)
+        w.setsampwidth(width)
+        w.setframerate(rate)
+        w.writeframes(frames)
+
+
+def export_wav(capture, input_path, output_path=None):
+    '''Input as 16-bit PCM centered on ADC mid-scale (stereo with the reference on the right), output as 8-bit PCM like the DAC'''
+    pcm = [(s - 2048) << 4 for s in capture.input_samples()]
+    channels = 1
+    if capture.has_ref:
+        ref = [(s - 2048) << 4 for s in capture.ref_samples()]
+        pcm = [s for frame in zip(pcm, ref) for s in frame]
+        channels = 2
+    write_wav(input_path, capture.sample_rate, 2, struct.pack('<%dh' % len(pcm), *pcm), channels)
+    if output_path is not None:
+        if not capture.has_output:
+            raise CaptureError('capture has no outputs')
+        write_wav(output_path, capture.sample_rate // capture.multisamples, 1, capture.output_samples())
+
+
+def compare(a, b):
+    '''Returns (blocks compared, mismatched blocks, mismatched samples, first mismatched block or None)'''
+    if not (a.has_output and b.has_output):
+        raise CaptureError('both captures need outputs to compare')
+    mismatched_blocks = 0
+    mismatched_samples = 0
+    first = None
+    count = min(len(a.blocks), len(b.blocks))
+    for i in range(count):
+        diffs = sum(1 for x, y in zip(a.blocks[i].output, b.blocks[i].output) if x != y)
+        diffs += abs(len(a.blocks[i].output) - len(b.blocks[i].output))
+        if diffs:
+            mismatched_blocks += 1
+            mismatched_samples += diffs
+            if first is None:
+                first = i
+    return count, mismatched_blocks, mismatched_samples, first
+
+
+def print_info(path, capture):
+    seconds = len(capture.input_samples()) / float(capture.sample_rate)
+    print('%s: %s mode %d, %d Hz, %d-sample blocks, %d blocks (%.2f s), %d gaps%s%s%s' % (
+        path, capture.algo_name(), capture.algo_mode + 1, capture.sample_rate, capture.block_len,
+        len(capture.blocks), seconds, capture.gaps(),
+        ', reference stored' if capture.has_ref else '',
+        ', outputs stored' if capture.has_output else '',
+        ', TRUNCATED' if capture.truncated else ''))
+
+
+def main(argv):
+    cmd = argv[1] if len(argv) > 2 else None
+    try:
+        if cmd == 'extract' and len(argv) == 4:
+            with open(argv[2], 'r', errors='replace') as f:
+                data = extract_dump(f.read())
+            with open(argv[3], 'wb') as f:
+                f.write(data)
+            print_info(argv[3], Capture(data))
+        elif cmd == 'info':
+            for path in argv[2:]:
+                print_info(path, Capture.load(path))
+        elif cmd == 'wav' and len(argv) in (4, 5):
+            export_wav(Capture.load(argv[2]), argv[3], argv[4] if len(argv) == 5 else None)
+        elif cmd == 'compare' and len(argv) == 4:
+            count, blocks, samples, first = compare(Capture.load(argv[2]), Capture.load(argv[3]))
+            if blocks == 0:
+                print('%d blocks compared, outputs identical' % count)
+            else:
+                print('%d blocks compared, %d differ (%d samples), first at block %d' % (count, blocks, samples, first))
+                return 1
+        else:
+            print('usage: capture_tools.py extract LOG OUT | info FILE... | wav FILE IN.wav [OUT.wav] | compare A B')
+            return 2
+    except (CaptureError, IOError) as e:
+        print('error: %s' % e)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,192 @@
+# mem_tools.py
+# Author: Tim Fair
+#
+# Memory footprint reports in one CSV format (kind,name,size,peak), so any two can be diffed.
+# The runtime footprint comes from fad_mem_dump (fad_algorithms/fad_mem.h): MEMORY_MODE 1 in main.c prints it
+# to the console, and the host build writes it with -M. The build footprint comes from the linker map
+# (build/fad_project_bt.map): static IRAM, DRAM and flash per subsystem, where a subsystem is the source
+# file for the project's own code (fad_timer, algo_delay, ...) and the component for everything else (bt, ...).
+# Only uses the standard library, so it runs without the virtual environment.
+#
+# python -m tools.mem_tools extract monitor.log run.csv
+# python -m tools.mem_tools map ../fad_project_bt/build/fad_project_bt.map build.csv
+# python -m tools.mem_tools diff old.csv new.csv
+#
+import csv
+import os
+import re
+import sys
+
+FIELDS = ['kind', 'name', 'size', 'peak']
+
+# Components whose objects are reported one source file at a time
+OWN_COMPONENTS = ('main', 'fad_algorithms')
+
+OUTPUT_SECTION = re.compile(r'^(\.\S+|COMMON)(?:\s+0x[0-9a-fA-F]+\s+0x[0-9a-fA-F]+.*)?$')
+INPUT_SECTION = re.compile(r'^ (\S+)\s+0x[0-9a-fA-F]+\s+0x([0-9a-fA-F]+)\s+(\S.*)$')
+INPUT_NAME_ONLY = re.compile(r'^ (\S+)$')
+INPUT_CONTINUED = re.compile(r'^\s+0x[0-9a-fA-F]+\s+0x([0-9a-fA-F]+)\s+(\S.*)$')
+ARCHIVE_MEMBER = re.compile(r'lib([^/\\]+)\.a\(([^)]+)\)')
+
+
+class MemError(Exception):
+    pass
+
+
+def read_csv(path):
+    '''Returns {(kind, name): (size, peak)} from a footprint CSV, or from a log holding an FMEM dump'''
+    with open(path, 'r', errors='replace') as f:
+        text = f.read()
+    if 'FMEM-BEGIN' in text:
+        text = extract_dump(text)
+    rows = {}
+    for row in csv.DictReader(text.splitlines()):
+        try:
+            rows[(row['kind'], row['name'])] = (int(row['size']), int(row['peak']))
+        except (KeyError, TypeError, ValueError):
+            raise MemError('%s: not a footprint CSV' % path)
+    return rows
+
+
+def write_csv(path, rows):
+    with open(path, 'w', newline='') as f:
+        w = csv.writer(f)
+        w.writerow(FIELDS)
+        for (kind, name), (size, peak) in rows.items():
+            w.writerow([kind, name, size, peak])
+
+
+def extract_dump(log_text):
+    '''Returns the CSV text of the last FMEM-BEGIN ... FMEM-END dump in a console log'''
+    lines = log_text.splitlines()
+    begin = None
+    for i, line in enumerate(lines):
+        if line.strip().startswith('FMEM-BEGIN'):
+            begin = i
+    if begin is None:
+        raise MemError('no FMEM-BEGIN line in the log')
+
+    body = []
+    for line in lines[begin + 1:]:
+        line = line.strip()
+        if line == 'FMEM-END':
+            break
+        body.append(line)
+    else:
+        raise MemError('dump has no FMEM-END line')
+
+    expected = int(lines[begin].split()[1])
+    if len(body) != expected + 1:
+        raise MemError('dump holds %d rows, header says %d' % (len(body) - 1, expected))
+    return '\n'.join(body)
+
+
+def memory_kind(section):
+    '''Which memory an output section of the ESP32 linker script occupies, or None to leave it out'''
+    if section.startswith('.iram0'):
+        return 'iram'
+    if section.startswith(('.dram0.data', '.data')):
+        return 'dram_data'
+    if section.startswith(('.dram0.bss', '.bss', '.noinit', 'COMMON')):
+        return 'dram_bss'
+    if section.startswith(('.flash.text', '.text')):
+        return 'flash_text'
+    if section.startswith(('.flash.rodata', '.flash.appdesc', '.rodata')):
+        return 'flash_rodata'
+    return None
+
+
+def subsystem(path):
+    member = ARCHIVE_MEMBER.search(path)
+    if member is None:
+        return os.path.basename(path).split('.')[0]
+    component, obj = member.groups()
+    if component in OWN_COMPONENTS:
+        return obj.split('.')[0]
+    return component
+
+
+def parse_map(text):
+    '''Returns {(kind, subsystem): bytes} for the static memory in a GNU ld map file'''
+    start = text.find('Linker script and memory map')
+    if start < 0:
+        raise MemError('no memory map in the file')
+
+    sizes = {}
+    kind = None
+    pending = None
+    for line in text[start:].splitlines():
+        out = OUTPUT_SECTION.match(line)
+        if out and not line.startswith(' '):
+            kind = memory_kind(out.group(1))
+            pending = None
+            continue
+
+        size = path = None
+        m = INPUT_SECTION.match(line)
+        if m:
+            size, path = int(m.group(2), 16), m.group(3)
+        elif pending is not None:
+            m = INPUT_CONTINUED.match(line)
+            if m:
+                size, path = int(m.group(1), 16), m.group(2)
+        pending = line.strip() if INPUT_NAME_ONLY.match(line) else None
+
+        if kind is None or size is None or size == 0 or path.startswith('*fill*'):
+            continue
+        key = (kind, subsystem(path))
+        sizes[key] = sizes.get(key, 0) + size
+    return sizes
+
+
+def map_rows(sizes):
+    '''Footprint rows from parse_map, plus a total per kind. Static memory is always in use, so peak is size'''
+    rows = {}
+    totals = {}
+    for (kind, name), size in sorted(sizes.items()):
+        rows[(kind, name)] = (size, size)
+        totals[kind] = totals.get(kind, 0) + size
+    for kind, size in sorted(totals.items()):
+        rows[(kind, 'total')] = (size, size)
+    return rows
+
+
+def diff(old, new):
+    '''Prints the entries that differ between two footprints, with the change in size and peak'''
+    changed = 0
+    print('%-12s %-30s %10s %10s %8s %8s' % ('kind', 'name', 'size', 'peak', 'd size', 'd peak'))
+    for key in sorted(set(old) | set(new)):
+        a = old.get(key, (0, 0))
+        b = new.get(key, (0, 0))
+        if a == b:
+            continue
+        changed += 1
+        note = ' (new)' if key not in old else ' (gone)' if key not in new else ''
+        print('%-12s %-30s %10d %10d %+8d %+8d%s' % (key[0], key[1], b[0], b[1], b[0] - a[0], b[1] - a[1], note))
+    print('%d of %d entries changed' % (changed, len(set(old) | set(new))))
+
+
+def main(argv):
+    cmd = argv[1] if len(argv) > 2 else None
+    try:
+        if cmd == 'extract' and len(argv) == 4:
+            with open(argv[2], 'r', errors='replace') as f:
+                text = extract_dump(f.read())
+            with open(argv[3], 'w') as f:
+                f.write(text + '\n')
+        elif cmd == 'map' and len(argv) == 4:
+            with open(argv[2], 'r', errors='replace') as f:
+                write_csv(argv[3], map_rows(parse_map(f.read())))
+        elif cmd == 'diff' and len(argv) == 4:
+            diff(read_csv(argv[2]), read_csv(argv[3]))
+        else:
+            print('usage: mem_tools.py extract LOG OUT.csv | map FILE.map OUT.csv | diff OLD.csv NEW.csv')
+            return 2
+    except (MemError, IOError) as e:
+        print('error: %s' % e)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
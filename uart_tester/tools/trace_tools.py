@@ -0,0 +1,145 @@
+# trace_tools.py
+# Author: Tim Fair
+#
+# Reads the event traces written by fad_trace.c (see fad_trace.h for the format).
+# Pulls a trace out of a console log dump, prints a summary, and converts it to Chrome trace JSON,
+# which chrome://tracing and ui.perfetto.dev open as a timeline with one row per track.
+# Only uses the standard library, so it runs without the virtual environment.
+#
+# python -m tools.trace_tools extract monitor.log out.ftrc
+# python -m tools.trace_tools info out.ftrc
+# python -m tools.trace_tools json out.ftrc out.json
+#
+import json
+import struct
+import sys
+
+from tools.capture_tools import CaptureError, extract_dump
+
+HEADER = struct.Struct('<4sBBBBII')
+RECORD = struct.Struct('<IBBHi')
+
+
+class Record(object):
+    def __init__(self, time_us, kind, track, name, value):
+        self.time_us = time_us
+        self.kind = kind
+        self.track = track
+        self.name = name
+        self.value = value
+
+
+class Trace(object):
+    def __init__(self, data):
+        if len(data) < HEADER.size:
+            raise CaptureError('too short for a header')
+        magic, version, track_count, name_count, _, count, self.overwritten = HEADER.unpack_from(data)
+        if magic != b'FTRC' or version != 1:
+            raise CaptureError('not a version 1 trace')
+
+        strings = data[HEADER.size:].split(b'\0', track_count + name_count)
+        if len(strings) <= track_count + name_count:
+            raise CaptureError('names are cut off')
+        self.tracks = [s.decode('ascii', 'replace') for s in strings[:track_count]]
+        self.names = [s.decode('ascii', 'replace') for s in strings[track_count:track_count + name_count]]
+
+        pos = len(data) - len(strings[-1])
+        if pos + count * RECORD.size != len(data):
+            raise CaptureError('header says %d records, file holds %d bytes of them' % (count, len(data) - pos))
+
+        self.records = []
+        last = None
+        base = 0
+        for i in range(count):
+            time_us, kind, track, name, value = RECORD.unpack_from(data, pos + i * RECORD.size)
+            # Timestamps are 32-bit microseconds; a large step back is a wrap, a small one is a
+            # record written from another context between taking its time and claiming its slot
+            if last is not None and time_us + base < last - (1 << 31):
+                base += 1 << 32
+            last = time_us + base
+            self.records.append(Record(last, chr(kind), track, name, value))
+
+    @classmethod
+    def load(cls, path):
+        with open(path, 'rb') as f:
+            return cls(f.read())
+
+    def track_name(self, track):
+        return self.tracks[track] if track < len(self.tracks) else 'track %d' % track
+
+    def event_name(self, name):
+        return self.names[name] if name < len(self.names) else 'event %d' % name
+
+    def span_us(self):
+        if not self.records:
+            return 0
+        return self.records[-1].time_us - self.records[0].time_us
+
+
+def to_chrome(trace):
+    '''Chrome trace event format: https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU'''
+    start = trace.records[0].time_us if trace.records else 0
+    events = []
+    for track, name in enumerate(trace.tracks):
+        events.append({'name': 'thread_name', 'ph': 'M', 'pid': 1, 'tid': track, 'args': {'name': name}})
+        events.append({'name': 'thread_sort_index', 'ph': 'M', 'pid': 1, 'tid': track, 'args': {'sort_index': track}})
+
+    # The oldest records may be the ends of slices whose beginnings were overwritten
+    depth = {}
+    for r in trace.records:
+        event = {'name': trace.event_name(r.name), 'pid': 1, 'tid': r.track, 'ts': r.time_us - start}
+        if r.kind == 'B':
+            depth[r.track] = depth.get(r.track, 0) + 1
+            event.update(ph='B', args={'value': r.value})
+        elif r.kind == 'E':
+            if depth.get(r.track, 0) == 0:
+                continue
+            depth[r.track] -= 1
+            event.update(ph='E')
+        elif r.kind == 'I':
+            event.update(ph='i', s='t', args={'value': r.value})
+        elif r.kind == 'C':
+            event.update(ph='C', args={'value': r.value})
+        else:
+            continue
+        events.append(event)
+    return {'traceEvents': events, 'displayTimeUnit': 'ms'}
+
+
+def print_info(path, trace):
+    print('%s: %d records over %.3f s, %d overwritten before the first' % (
+        path, len(trace.records), trace.span_us() / 1e6, trace.overwritten))
+    counts = {}
+    for r in trace.records:
+        key = (r.track, r.name)
+        counts[key] = counts.get(key, 0) + (0 if r.kind == 'E' else 1)
+    for (track, name), n in sorted(counts.items()):
+        print('  %-12s %-12s %6d' % (trace.track_name(track), trace.event_name(name), n))
+
+
+def main(argv):
+    cmd = argv[1] if len(argv) > 2 else None
+    try:
+        if cmd == 'extract' and len(argv) == 4:
+            with open(argv[2], 'r', errors='replace') as f:
+                data = extract_dump(f.read(), 'FTRC')
+            with open(argv[3], 'wb') as f:
+                f.write(data)
+            print_info(argv[3], Trace(data))
+        elif cmd == 'info':
+            for path in argv[2:]:
+                print_info(path, Trace.load(path))
+        elif cmd == 'json' and len(argv) == 4:
+            with open(argv[3], 'w') as f:
+                json.dump(to_chrome(Trace.load(argv[2])), f)
+        else:
+            print('usage: trace_tools.py extract LOG OUT | info FILE... | json FILE OUT.json')
+            return 2
+    except (CaptureError, IOError) as e:
+        print('error: %s' % e)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
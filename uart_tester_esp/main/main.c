@@ -277,8 +277,8 @@ void handle_u2_packets(packet_t *p1, packet_t *p2)
         return;
 
     uint8_t *output_data = malloc(PACKET_DATA_SIZE);
-    fad_algo((uint16_t *)p1->data, output_data, 0, 0, 1);
-    fad_algo((uint16_t *)p2->data, output_data + PACKET_DATA_SIZE / 2, 0, 0, 1);
+    fad_algo((uint16_t *)p1->data, NULL, output_data, 0, 0, 1);
+    fad_algo((uint16_t *)p2->data, NULL, output_data + PACKET_DATA_SIZE / 2, 0, 0, 1);
 
     int num_to_follow = p2->packets_incoming / 2;
     // ESP_LOGI(SERIAL_TAG, "num to follow: %d", num_to_follow);